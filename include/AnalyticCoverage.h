@@ -0,0 +1,60 @@
+#ifndef ANALYTICCOVERAGE_H
+#define ANALYTICCOVERAGE_H
+
+#include <vector>
+#include <utility>
+
+class DetectorModule;
+
+/**
+ * @class AnalyticCoverage
+ * @brief The (eta, phi) coverage of a set of modules, computed from their projected outlines instead of random tracks.
+ *
+ * The base polygon of every module is projected into the (eta, phi) plane as seen from a set of track origins on the z axis,
+ * spread uniformly over the luminous region (+/- zError, as the random tracks of the geometry analysis).
+ * The straight edges become curves in (eta, phi), which are approximated by polylines of edgeSteps points per edge.
+ * At a given eta, every projected outline crossing that eta yields the phi intervals a track can hit the module in:
+ * the mean number of hit modules is then the sum of the interval lengths over 2pi, and the fraction of tracks hitting
+ * a group of modules (e.g. a layer) the length of the union of their intervals over 2pi. All the figures are averaged over
+ * the zSteps origins. The results carry no statistical noise, as thin cracks are not missed for lack of tracks, but they
+ * have a discretisation error, from the polylines and from the finite number of origins.
+ */
+class AnalyticCoverage {
+public:
+  struct Scan {
+    double hits = 0.;                   // mean number of hit modules
+    std::vector<double> typeHits;       // mean number of hit modules, per module type
+    std::vector<double> groupCoverage;  // fraction of the tracks hitting at least one module, per group
+    std::vector<double> phiHits;        // mean number of hit modules, per phi bin in [-pi, pi)
+  };
+
+  void build(const std::vector<const DetectorModule*>& modules, const std::vector<int>& types, int numTypes,
+             const std::vector<int>& groups, int numGroups, double zError, int zSteps = 8);
+
+  Scan scan(double eta, int phiBins) const;
+
+  // The fraction of the tracks with eta in [minEta, maxEta] hitting each module
+  std::vector<double> acceptance(double minEta, double maxEta) const;
+
+private:
+  typedef std::pair<double, double> PhiInterval;
+
+  static const int edgeSteps = 16;
+
+  struct Projection {
+    double minEta, maxEta;
+    double centerPhi;             // the outline phis are relative to it, so that they never wrap around
+    std::vector<double> eta, phi;
+  };
+
+  std::vector<int> types_, groups_;
+  int numTypes_ = 0, numGroups_ = 0;
+  std::vector<std::vector<Projection> > projections_; // by origin, then by module
+
+  static Projection project(const DetectorModule& m, double z0);
+  static void crossings(const Projection& p, double eta, std::vector<PhiInterval>& intervals);
+  static double unionLength(std::vector<PhiInterval>& intervals);
+  static double area(const Projection& p, double minEta, double maxEta);
+};
+
+#endif
@@ -34,6 +34,9 @@
 #include <global_funcs.h>
 
 #include "TRandom3.h"
+#include "CounterRandom.h"
+#include "PileUpSimulator.h"
+#include "AnalyticCoverage.h"
 #include "Module.h"
 #include "SimParms.h"
 #include "AnalyzerVisitor.h"
@@ -159,10 +162,12 @@ namespace insur {
     virtual void analyzeTriggerEfficiency(Tracker& tracker,
                                           const std::vector<double>& triggerMomenta,
                                           const std::vector<double>& thresholdProbabilities,
-                                          int etaSteps = 50);
+                                          int etaSteps = 50,
+                                          int nThreads = 1);
     void createTriggerDistanceTuningPlots(Tracker& tracker, const std::vector<double>& triggerMomenta);
-    void analyzeGeometry(Tracker& tracker, int nTracks = 1000);
+    void analyzeGeometry(Tracker& tracker, int nTracks = 1000, int nThreads = 1, bool usePhiSymmetry = false, bool analyticCoverage = false);
     void computeBandwidth(Tracker& tracker);
+    void simulatePileUp(Tracker& tracker, const PileUpSpectra& spectra, long crossings, int nThreads = 1);
     void computeTriggerFrequency(Tracker& tracker);
     void computeIrradiatedPowerConsumption(Tracker& tracker);
     void analyzePower(Tracker& tracker);
@@ -188,6 +193,11 @@ namespace insur {
     TH1D& getChanHitDistribution() { return chanHitDistribution; };
     TH1D& getBandwidthDistribution() { return bandwidthDistribution; };
     TH1D& getBandwidthDistributionSparsified() { return bandwidthDistributionSparsified; }
+    TH1D& getPileUpChanHitDistribution() { return pileUpChanHitDistribution; }
+    TH1D& getPileUpClusterWidthDistribution() { return pileUpClusterWidthDistribution; }
+    TH1D& getPileUpBandwidthDistributionSparsified() { return pileUpBandwidthDistributionSparsified; }
+    TH1D& getPileUpOccupancyRatioDistribution() { return pileUpOccupancyRatioDistribution; }
+    long getPileUpCrossings() const { return pileUpCrossings_; }
     TH1I& getModuleConnectionsDistribution() { return moduleConnectionsDistribution; }
     const ModuleConnectionMap& getModuleConnectionMap() const { return moduleConnections_; }
     int getGeometryTracksUsed() {return geometryTracksUsed; }
@@ -239,6 +249,8 @@ namespace insur {
 
     std::map<std::string, SummaryTable>& getStripOccupancySummaries() { return stripOccupancySummaries_; }
     std::map<std::string, SummaryTable>& getHitOccupancySummaries() { return hitOccupancySummaries_; }
+    std::map<std::string, SummaryTable>& getPileUpHitOccupancySummaries() { return pileUpHitOccupancySummaries_; }
+    std::map<std::string, SummaryTable>& getPileUpClusterWidthSummaries() { return pileUpClusterWidthSummaries_; }
 
     SummaryTable& getProcessorConnectionSummary() { return processorConnectionSummary_; }
     SummaryTable& getProcessorCommonConnectionSummary() { return processorCommonConnectionSummary_; }
@@ -269,6 +281,18 @@ namespace insur {
      * @param etamax The maximal eta value of the cell
      */
     struct Cell { double rlength; double ilength; double rmin; double rmax; double etamin; double etamax; };
+    /**
+     * @struct TriggerTrackSummary
+     * @brief The figures of a trigger track filled in the trigger efficiency plots, so that the track itself need not be kept.
+     */
+    struct TriggerTrackSummary {
+      bool triggering; // false if the track has no active trigger hit, and is not plotted
+      double eta;
+      int nHits;
+      std::vector<std::string> stubLayers; // of the modules with a stub
+      std::vector<double> expectedPoints, trueRates, fakeRates; // by trigger momentum
+      TriggerTrackSummary() : triggering(false), eta(0), nHits(0) {}
+    };
     std::vector<std::vector<Cell> > cells;
     TH1D ractivebarrel, ractiveendcap, rserfbarrel, rserfendcap, rlazybarrel, rlazyendcap, rlazybtube, rlazytube, rlazyuserdef;
     TH1D iactivebarrel, iactiveendcap, iserfbarrel, iserfendcap, ilazybarrel, ilazyendcap, ilazybtube, ilazytube, ilazyuserdef;
@@ -293,6 +317,11 @@ namespace insur {
     TH1D chanHitDistribution;
     TH1D bandwidthDistribution;
     TH1D bandwidthDistributionSparsified;
+    TH1D pileUpChanHitDistribution;
+    TH1D pileUpClusterWidthDistribution;
+    TH1D pileUpBandwidthDistributionSparsified;
+    TH1D pileUpOccupancyRatioDistribution;
+    long pileUpCrossings_;
     TH1D optimalSpacingDistribution;
     TH1D optimalSpacingDistributionAW;
 
@@ -323,6 +352,7 @@ namespace insur {
 
     std::map<std::string, SummaryTable> stripOccupancySummaries_;
     std::map<std::string, SummaryTable> hitOccupancySummaries_;
+    std::map<std::string, SummaryTable> pileUpHitOccupancySummaries_, pileUpClusterWidthSummaries_;
 
 
     SummaryTable processorConnectionSummary_;
@@ -375,19 +405,22 @@ namespace insur {
 
     void computeDetailedWeights(std::vector<std::vector<ModuleCap> >& tracker, std::map<std::string, SummaryTable>& weightTables, bool byMaterial);
     virtual Material analyzeModules(std::vector<std::vector<ModuleCap> >& tr, double eta, double theta, double phi, Track& t, 
-                                    std::map<std::string, Material>& sumComponentsRI, bool isPixel = false);
+                                    std::map<std::string, Material>& sumComponentsRI, bool isPixel = false, const ModuleHitIndex* index = NULL);
 
     int findHitsModules(Tracker& tracker, double z0, double eta, double theta, double phi, Track& t);
 
     virtual Material findHitsModules(std::vector<std::vector<ModuleCap> >& tr,
-                                     double eta, double theta, double phi, Track& t, bool isPixel = false);
+                                     double eta, double theta, double phi, Track& t, bool isPixel = false, const ModuleHitIndex* index = NULL);
     virtual Material findHitsModuleLayer(std::vector<ModuleCap>& layer, double eta, double theta, double phi, Track& t, bool isPixel = false);
+    Material findHitModuleCap(ModuleCap& cap, const std::pair<XYZVector, HitType>& h, double theta, Track& t, bool isPixel);
 
     virtual Material findModuleLayerRI(std::vector<ModuleCap>& layer, double eta, double theta, double phi, Track& t, 
                                        std::map<std::string, Material>& sumComponentsRI, bool isPixel = false);
-    virtual Material analyzeInactiveSurfaces(std::vector<InactiveElement>& elements, double eta, double theta, 
+    Material findModuleCapRI(ModuleCap& cap, const std::pair<XYZVector, HitType>& h, double eta, double theta, Track& t,
+                             std::map<std::string, Material>& sumComponentsRI, bool isPixel);
+    virtual Material analyzeInactiveSurfaces(InactiveSurfaces& surfaces, int collections, double eta, double theta, 
                                              Track& t, MaterialProperties::Category cat = MaterialProperties::no_cat, bool isPixel = false);
-    virtual Material findHitsInactiveSurfaces(std::vector<InactiveElement>& elements, double eta, double theta,
+    virtual Material findHitsInactiveSurfaces(InactiveSurfaces& surfaces, int collections, double eta, double theta,
                                               Track& t, bool isPixel = false);
 
     void clearGraphsPt(int graphAttributes, const std::string& aTag);
@@ -401,9 +434,10 @@ namespace insur {
                                int graphAttributes,
                                const string& graphTag);
     void calculateParametrizedResolutionPlots(std::map<std::string, TrackCollectionMap>& taggedTrackPtCollectionMap);    
-    void fillTriggerEfficiencyGraphs(const Tracker& tracker,
-                                     const std::vector<double>& triggerMomenta,
-                                     const std::vector<Track>& trackVector);
+    void summarizeTriggerTrack(const Track& track, const std::vector<double>& triggerMomenta, TriggerTrackSummary& summary) const;
+    void fillTriggerEfficiencyGraphs(const std::vector<double>& triggerMomenta,
+                                     const std::vector<TriggerTrackSummary>& summaries,
+                                     int nTracks);
     void fillTriggerPerformanceMaps(Tracker& tracker);
     //void fillPowerMap(Tracker& tracker);
     void clearMaterialBudgetHistograms();
@@ -421,13 +455,13 @@ namespace insur {
     double findXThreshold(const TProfile& aProfile, const double& yThreshold, const bool& goForward );
     std::pair<double, double> computeMinMaxTracksEta(const Tracker& t) const;
   private:
-    // A random number generator
-    TRandom3 myDice; 
     int findCellIndexR(double r);
     int findCellIndexEta(double eta);
     int createResetCounters(Tracker& tracker, std::map <std::string, int> &modTypes);
-    std::pair <XYZVector, double > shootDirection(double minEta, double maxEta);
-    std::vector<std::pair<Module*, HitType>> trackHit(const XYZVector& origin, const XYZVector& direction, Tracker::Modules& properModules);
+    std::pair <XYZVector, double > shootDirection(CounterRandom::Stream& dice, double minEta, double maxEta, double spanPhi = 2*M_PI) const;
+    std::vector<std::pair<Module*, HitType>> trackHit(const XYZVector& origin, const XYZVector& direction, Tracker& tracker) const;
+    void fillAnalyticCoverage(const AnalyticCoverage& coverage, double minEta, double maxEta, const std::vector<std::string>& typeNames,
+                              const std::vector<std::string>& layerNames, std::map<std::string, TProfile>& etaProfileByType, int nThreads);
     void resetTypeCounter(std::map<std::string, int> &modTypes);
     double diffclock(clock_t clock1, clock_t clock2);
     Color_t colorPicker(std::string);
@@ -29,7 +29,7 @@ class MaterialBillAnalyzer {
   typedef std::vector<ServiceElement> ServicesMaterialVector;
   ServicesMaterialVector servicesMaterialVector_;
   LayerMaterialMap layerMaterialMap_;
-  void inspectInactiveElements(const std::vector<InactiveElement>& inactiveElements);
+  void inspectInactiveElements(const InactiveSurfaces::ElementList& inactiveElements);
   void inspectModules(std::vector<std::vector<insur::ModuleCap> >& tracker);
 
 
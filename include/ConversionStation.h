@@ -9,6 +9,7 @@
 #define CONVERSIONSTATION_H_
 
 #include "Property.h"
+#include <set>
 #include "MaterialObject.h"
 
 namespace insur {
@@ -39,6 +40,7 @@ namespace material {
     //void routeConvertedServicesTo(MaterialObject& outputObject) const;
     //void routeConvertedLocalsTo(MaterialObject& outputObject) const;
     Type stationType() const;
+    void getInputMaterials(std::set<std::string>& materials) const;
 
     ReadonlyProperty<std::string, NoDefault> stationName_;
     ReadonlyProperty<std::string, NoDefault> type_;
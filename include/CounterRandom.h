@@ -0,0 +1,83 @@
+#ifndef COUNTERRANDOM_H
+#define COUNTERRANDOM_H
+
+#include <stdint.h>
+#include <math.h>
+
+/**
+ * @class CounterRandom
+ * @brief A counter-based random number generator (Philox4x32-10), giving an independent stream per track.
+ *
+ * The numbers are a pure function of (seed, analysis id, track index, draw number): the stream of a track
+ * does not depend on how many numbers were drawn for the other tracks, nor on the order in which the tracks
+ * are processed. Any range of tracks can then be computed on its own, on any thread, with the same results.
+ */
+class CounterRandom {
+public:
+  // The analysis ids: each analysis gets its own streams, which do not depend on which analyses ran before
+  enum Analysis { GEOMETRY = 1, MATERIAL_BUDGET = 2, TAGGED_TRACKING = 3, TRIGGER_EFFICIENCY = 4, TRACK_SIMULATION = 5, PILE_UP = 6, HOUGH_TRANSFORM = 7 };
+
+  class Stream {
+    uint32_t key_[2];
+    uint32_t counter_[4];
+    uint32_t block_[4];
+    int used_;
+    double spareGaus_;
+    bool hasSpareGaus_;
+
+    void nextBlock() {
+      uint32_t k0 = key_[0], k1 = key_[1];
+      uint32_t c0 = counter_[0], c1 = counter_[1], c2 = counter_[2], c3 = counter_[3];
+      for (int round = 0; round < 10; round++) {
+        uint64_t p0 = uint64_t(0xD2511F53) * c0;
+        uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+        uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0; c1 = uint32_t(p1); c2 = n2; c3 = uint32_t(p0);
+        k0 += 0x9E3779B9; k1 += 0xBB67AE85;
+      }
+      block_[0] = c0; block_[1] = c1; block_[2] = c2; block_[3] = c3;
+      counter_[2]++; // the draw number; the track index sits in counter_[0] and counter_[1]
+      used_ = 0;
+    }
+    uint32_t next32() {
+      if (used_ == 4) nextBlock();
+      return block_[used_++];
+    }
+  public:
+    Stream(uint32_t seed, uint32_t analysis, uint64_t track) : used_(4), spareGaus_(0.), hasSpareGaus_(false) {
+      key_[0] = seed;
+      key_[1] = analysis;
+      counter_[0] = uint32_t(track);
+      counter_[1] = uint32_t(track >> 32);
+      counter_[2] = 0;
+      counter_[3] = 0;
+    }
+    // Uniform in (0, 1), with 53 random bits
+    double Rndm() {
+      uint64_t bits = (uint64_t(next32()) << 32 | next32()) >> 11;
+      return (bits + 0.5) * (1./9007199254740992.);
+    }
+    // Gaussian, Box-Muller: the draws come in pairs
+    double Gaus(double mean = 0., double sigma = 1.) {
+      if (hasSpareGaus_) {
+        hasSpareGaus_ = false;
+        return mean + sigma * spareGaus_;
+      }
+      double r = sqrt(-2. * log(Rndm()));
+      double phi = 2. * M_PI * Rndm();
+      spareGaus_ = r * sin(phi);
+      hasSpareGaus_ = true;
+      return mean + sigma * r * cos(phi);
+    }
+  };
+
+  CounterRandom(uint32_t seed, Analysis analysis) : seed_(seed), analysis_(analysis) {}
+  Stream stream(uint64_t track) const { return Stream(seed_, analysis_, track); }
+
+private:
+  uint32_t seed_;
+  uint32_t analysis_;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define DETECTOR_MODULE_H
 
 #include <limits.h>
+#include <map>
 
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/accumulators/accumulators.hpp>
@@ -42,6 +43,19 @@ struct PosRef { int cnt, z, rho, phi; };
 struct TableRef { string table; int row, col; };
 struct UniRef { string cnt; int layer, ring, phi, side; };
 
+class DetectorModule;
+
+// Number of tracks hitting each module. The hit checks do not count anything themselves: each caller
+// (or each thread) keeps its own counts, merged afterwards if needed
+class ModuleHitCounts {
+  std::map<const DetectorModule*, int> counts_;
+public:
+  void add(const DetectorModule* m) { counts_[m]++; }
+  void merge(const ModuleHitCounts& other) { for (const auto& c : other.counts_) counts_[c.first] += c.second; }
+  int count(const DetectorModule* m) const { auto it = counts_.find(m); return it != counts_.end() ? it->second : 0; }
+  void clear() { counts_.clear(); }
+};
+
 namespace insur {
   class ModuleCap;
 }
@@ -59,13 +73,9 @@ protected:
   Sensors sensors_;
   std::string cntName_;
   int16_t cntId_;
-  mutable double cachedZError_ = -1.;
-  mutable std::pair<double,double> cachedMinMaxEtaWithError_;
   XYZVector rAxis_;
   double tiltAngle_ = 0., skewAngle_ = 0.;
 
-  int numHits_ = 0;
-  
   void clearSensorPolys() { for (auto& s : sensors_) s.clearPolys(); }
   ModuleCap* myModuleCap_ = NULL;
 public:
@@ -292,9 +302,9 @@ int numSegmentsEstimate() const { return sensors().front().numSegmentsEstimate()
 
   bool couldHit(const XYZVector& direction, double zError) const;
   double trackCross(const XYZVector& PL, const XYZVector& PU) { return decorated().trackCross(PL, PU); }
-  std::pair<XYZVector, HitType> checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir);
-  int numHits() const { return numHits_; }
-  void resetHits() { numHits_ = 0; }
+  std::pair<XYZVector, HitType> checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) const;
+  std::pair<XYZVector, HitType> assignTrackHits(const std::pair<XYZVector, int>& inSegm, const std::pair<XYZVector, int>& outSegm) const; // combines the sensor hits as checkTrackHits does, outSegm is ignored for single sensor modules
+  void freeze() const; // computes the polygons and cached quantities read by the hit checks, which can then be run concurrently
 };
 
 
@@ -34,7 +34,6 @@ enum ModuleShape { RECTANGULAR, WEDGE };
 
 class GeometricModule : public ModuleDecorable {
 protected:
-  int numHits_ = 0;
   bool flipped_ = false;
   int tiltAngle_ = 0., skewAngle_ = 0.;
   Polygon3d<4> basePoly_;
@@ -75,9 +74,7 @@ public:
   virtual void accept(ConstGeometryVisitor& v) const = 0;
   virtual void build() = 0;
 
-  double trackCross(const XYZVector& PL, const XYZVector& PU);
-  int numHits() const { return numHits_; }
-  void resetHits() { numHits_ = 0; }
+  double trackCross(const XYZVector& PL, const XYZVector& PU) const;
 
   virtual ModuleShape shape() const = 0;
 };
@@ -0,0 +1,86 @@
+#ifndef HELIX_NAVIGATOR_H
+#define HELIX_NAVIGATOR_H
+
+#include <map>
+#include <vector>
+
+#include <global_funcs.h>
+#include <global_constants.h>
+#include <Tracker.h>
+#include <DetectorModule.h>
+
+
+
+/**
+ * @struct Helix
+ * @brief A helix from a point of the beam line, as a function of the path length s of its projection in the transverse plane.
+ *
+ * A positive pt is a positive charge, which bends clockwise seen from z > 0 in the solenoid field.
+ */
+struct Helix {
+  double pt, eta, phi0, z0;
+  double R, curvature, cotTheta; // curvature is signed
+
+  Helix(double pt_, double eta_, double phi0_, double z0_) : pt(pt_), eta(eta_), phi0(phi0_), z0(z0_) {
+    R = fabs(pt)/(0.3*insur::magnetic_field) * 1e3;
+    curvature = -signum(pt)/R;
+    cotTheta = sinh(eta);
+  }
+  XYZVector at(double s) const {
+    double phi = phi0 + curvature*s;
+    return XYZVector((sin(phi) - sin(phi0))/curvature, (cos(phi0) - cos(phi))/curvature, z0 + s*cotTheta);
+  }
+  XYZVector direction(double s) const { // d at(s) / ds
+    double phi = phi0 + curvature*s;
+    return XYZVector(cos(phi), sin(phi), cotTheta);
+  }
+  double pathToRadius(double r) const { return r <= 2*R ? 2*R*asin(r/(2*R)) : -1.; } // on the way out, -1 if the helix never gets there
+  double pathToZ(double z) const { return (z - z0)/cotTheta; } // negative if the helix goes the other way
+};
+
+
+
+/**
+ * @class HelixNavigator
+ * @brief Finds the modules of a tracker crossed by a helix.
+ *
+ * The modules are binned in surfaces of equal radius (barrel) or z (endcap), and each surface in phi sectors: a track
+ * is propagated to each surface analytically, and only the modules of the sector it reaches there are intersected
+ * with it, their plane crossing being found with a few Newton steps from there. A track is followed on its way out
+ * only, up to the outer radius of the tracker or half a turn for the ones curling inside it.
+ *
+ * Once setTracker() has returned, the navigator only reads the modules, and can be used by several threads at once.
+ */
+class HelixNavigator {
+public:
+  struct Crossing {
+    double s; // path length, to order the crossings along the track
+    int module; // index in modules()
+    XYZVector global; // on the module mid-plane
+  };
+
+  HelixNavigator() : trackerMaxRho_(0.) {}
+  void setTracker(const Tracker& tracker);
+  const std::vector<const DetectorModule*>& modules() const { return modules_; }
+  void crossings(const Helix& helix, std::vector<Crossing>& result) const;
+
+private:
+  static const int phiSectors = 64;
+
+  struct Surface {
+    double position; // radius of the barrel surfaces, z of the endcap ones
+    double min, max; // extent in z of the barrel surfaces, in radius of the endcap ones
+    std::vector<std::vector<int> > sectors; // the modules overlapping each phi sector
+  };
+
+  std::vector<const DetectorModule*> modules_;
+  std::vector<Surface> barrelSurfaces_, endcapSurfaces_;
+  double trackerMaxRho_;
+
+  void addToSurface(std::map<long, Surface>& surfaces, double position, double min, double max, int moduleIndex);
+  void crossSurfaces(const Helix& helix, const std::vector<Surface>& surfaces, bool barrel, double maxPath, std::vector<Crossing>& result) const;
+  bool crossModule(const Helix& helix, int moduleIndex, double s, double maxPath, Crossing& crossing) const;
+  static int phiSector(double phi);
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include <map>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <stdint.h>
 
 #include <TH1.h>
 #include <TH2.h>
@@ -350,6 +352,134 @@ public:
 
 
 
+/**
+ * A histogram of up to 4 dimensions of up to 65534 bins each, stored in an open-addressing hash table with linear probing:
+ * a fill costs one probe of a flat array instead of the tree lookups and node allocations of Histo. Only the bins within
+ * the range are stored, the coordinates out of it are dropped. The bins of histograms with the same binning, filled
+ * separately (e.g. one per thread), are summed up with merge().
+ */
+template<int N, class T>
+class HashedHisto {
+  static_assert(N <= 4, "HashedHisto packs the bin indices of up to 4 dimensions in 64 bits");
+public:
+  enum { Dimensions = N };
+  typedef T BinType;
+  typedef BinKey<N, double> ExportableBinKey;
+  typedef std::pair<ExportableBinKey, T> exportable_iterator_element;
+
+  class const_iterator : public std::iterator<std::input_iterator_tag, exportable_iterator_element> {
+    const HashedHisto<N, T>* histo_;
+    size_t slot_;
+    exportable_iterator_element current_;
+    void skipEmpty() { while (slot_ < histo_->keys_.size() && histo_->keys_[slot_] == emptyKey) slot_++; }
+  public:
+    const_iterator(const HashedHisto<N, T>& histo, size_t slot) : histo_(&histo), slot_(slot) { skipEmpty(); }
+    const_iterator& operator++() { slot_++; skipEmpty(); return *this; }
+    bool operator==(const const_iterator& other) const { return slot_ == other.slot_; }
+    bool operator!=(const const_iterator& other) const { return slot_ != other.slot_; }
+    const exportable_iterator_element& operator*() {
+      return (current_ = exportable_iterator_element(histo_->makeExportableBinKey(histo_->keys_[slot_]), histo_->values_[slot_]));
+    }
+    const exportable_iterator_element* operator->() { return &operator*(); }
+  };
+
+  HashedHisto(const int nbins[N], const double lo[N], const double hi[N]) : size_(0) {
+    for (int i=0; i<N; i++) {
+      nbins_[i] = nbins[i];
+      lo_[i] = lo[i];
+      hi_[i] = hi[i];
+    }
+  }
+
+  void fill(const double coords[N], const T& weight = T(1)) {
+    uint64_t key;
+    if (makeKey(coords, key)) bin(key) += weight;
+  }
+
+  // mergeBins(T& bin, const T& otherBin) adds a bin of the other histogram to the one of this histogram
+  template<class MergeFunction> void merge(const HashedHisto<N, T>& other, MergeFunction mergeBins) {
+    for (size_t i = 0; i < other.keys_.size(); i++) {
+      if (other.keys_[i] != emptyKey) mergeBins(bin(other.keys_[i]), other.values_[i]);
+    }
+  }
+  void merge(const HashedHisto<N, T>& other) { merge(other, [](T& bin, const T& otherBin) { bin += otherBin; }); }
+
+  int getNbins(int k) const { return nbins_[k]; }
+  double getLo(int k) const { return lo_[k]; }
+  double getHi(int k) const { return hi_[k]; }
+  double getWbins(int k) const { return (hi_[k]-lo_[k])/nbins_[k]; }
+
+  size_t size() const { return size_; }
+  size_t memoryUsage() const { return keys_.capacity()*sizeof(uint64_t) + values_.capacity()*sizeof(T); } // in bytes
+
+  const_iterator begin() const { return const_iterator(*this, 0); }
+  const_iterator end() const { return const_iterator(*this, keys_.size()); }
+
+  void clear() { // and release the memory
+    std::vector<uint64_t>().swap(keys_);
+    std::vector<T>().swap(values_);
+    size_ = 0;
+  }
+
+private:
+  static const uint64_t emptyKey = ~0ULL; // never a bin within the range, as the bin indices are at most 65534
+
+  int nbins_[N];
+  double lo_[N], hi_[N];
+  std::vector<uint64_t> keys_;
+  std::vector<T> values_;
+  size_t size_;
+
+  // the bin indices start at 1, as in Histo, and are packed 16 bits each
+  bool makeKey(const double coords[N], uint64_t& key) const {
+    key = 0;
+    for (int i=0; i<N; i++) {
+      double index = floor((coords[i] - lo_[i])/getWbins(i)) + 1;
+      if (!(index >= 1 && index <= nbins_[i])) return false;
+      key = key << 16 | uint64_t(index);
+    }
+    return true;
+  }
+
+  ExportableBinKey makeExportableBinKey(uint64_t key) const {
+    ExportableBinKey ebk;
+    for (int i=N-1; i>=0; i--) {
+      ebk.set(i, (double(key & 0xffff) - 1)*getWbins(i) + lo_[i] + getWbins(i)/2.); // the center of the bin, as in Histo
+      key >>= 16;
+    }
+    return ebk;
+  }
+
+  T& bin(uint64_t key) {
+    if (2*(size_ + 1) > keys_.size()) grow();
+    size_t mask = keys_.size() - 1;
+    size_t i = (key * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+    while (keys_[i] != emptyKey && keys_[i] != key) i = (i + 1) & mask;
+    if (keys_[i] == emptyKey) {
+      keys_[i] = key;
+      size_++;
+    }
+    return values_[i];
+  }
+
+  void grow() {
+    std::vector<uint64_t> keys;
+    std::vector<T> values;
+    keys.swap(keys_);
+    values.swap(values_);
+    keys_.assign(std::max<size_t>(1024, 2*keys.size()), emptyKey);
+    values_.assign(keys_.size(), T());
+    size_ = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] != emptyKey) bin(keys[i]) = values[i];
+    }
+  }
+};
+
+template<int N, class T> const uint64_t HashedHisto<N, T>::emptyKey;
+
+
+
 template<class H> void toTH1(H& histo, TH1& thisto, int k = 0) {
   thisto.SetBins(histo.getNbins(k), histo.getLo(k), histo.getHi(k));
   for (typename H::const_iterator it = histo.begin(); it != histo.end(); ++it) {
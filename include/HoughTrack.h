@@ -5,6 +5,7 @@
 #include <iterator>
 #include <map>
 #include <fstream>
+#include <vector>
 #include <stdint.h>
 
 
@@ -14,7 +15,6 @@
 
 #include <Histo.h>
 #include <TrackShooter.h>
-#include <ptError.h>
 #include <global_funcs.h>
 
 
@@ -61,14 +61,14 @@ struct HitsP { // holder struct for TTree export
 
 
 struct SmartBin {
-  uint8_t count;
-  uint8_t eventid;
+  uint32_t eventid; // the full tree entry: a truncated one would merge the events 256 entries apart, depending on the threads
   uint16_t hitmask;
+  uint8_t count;
   int8_t stacked; // how many events have been stacked on top of each other
 //public:
-  SmartBin(int count_ = 0, uint8_t eventid_ = 0, uint16_t hitmask_ = 0, uint8_t stacked_ = -1) : count(count_), eventid(eventid_), hitmask(hitmask_), stacked(stacked_) {}
+  SmartBin(int count_ = 0, uint32_t eventid_ = 0, uint16_t hitmask_ = 0, uint8_t stacked_ = -1) : eventid(eventid_), hitmask(hitmask_), count(count_), stacked(stacked_) {}
   SmartBin& operator+=(const SmartBin& other) {
-    if (eventid != other.eventid) {
+    if (stacked < 0 || eventid != other.eventid) { // the first event of a bin counts as well, whatever its id
       eventid = other.eventid;
       hitmask = 0;
       stacked++;
@@ -79,6 +79,15 @@ struct SmartBin {
     }
     return *this;
   }
+  // adds a bin filled with later events, e.g. on another thread
+  SmartBin& merge(const SmartBin& other) {
+    if (other.stacked < 0) return *this;
+    count += other.count;
+    stacked += other.stacked + 1;
+    eventid = other.eventid;
+    hitmask = other.hitmask;
+    return *this;
+  }
 /*  SmartBin& operator=(const SmartBin& other) {
     count_ = other.count_;
     eventid_ = other.eventid_;
@@ -96,28 +105,41 @@ struct SmartBin {
 
 
 
+/**
+ * @class HoughTrack
+ * @brief Fills the Hough transform of the hits of simulated tracks, in (1/pT, phi0, z0, theta), and reports the load of its cells.
+ *
+ * Every hit is smeared over its errors in 1/pT, z0 and z, and each sample fills a cell. The cells are kept in a hash table.
+ * The entries are read from the tree serially in batches, then shared among the threads, entry i going to the thread
+ * i modulo the number of threads, which fills its own table; the tables are merged in thread order at the end. The
+ * smearing of a hit draws from its own random stream, so the transform does not depend on the number of threads.
+ */
 class HoughTrack {
+  struct HitSample {
+    long entry;
+    int track, hitid;
+    double x, y, z, pt, ptError, yres;
+  };
 
   SparseMatrix<ModuleData, 4> mods_;
-  typedef Histo<4, SmartBin, BinKey<4, uint16_t> > HistoType;
+  typedef HashedHisto<4, SmartBin> HistoType;
   HistoType histo_;
 
-  TRandom3 die_;
+  static const long entriesPerThreadBatch = 1000;
 
-  double rectangularSmear(double mean, double sigma, int nsteps, int step);  
+  static double rectangularSmear(double mean, double sigma, int nsteps, int step);
 
-  double calcPhi0(double x, double y, double pt);
-  double calcTheta(double x, double y, double z, double z0, double pt);
-  void processHit(int evid, int hitid, double x, double y, double z, double pt, double ptError, double yres);
+  static double calcPhi0(double x, double y, double pt);
+  static double calcTheta(double x, double y, double z, double z0, double pt);
+  void processHit(const HitSample& hit, CounterRandom::Stream& dice, HistoType& histo) const;
   void loadGeometryData(TFile* infile);
 
   enum { H_K = 0, H_PHI0 = 1, H_Z0 = 2, H_THETA = 3 };
 public:                     //     invPt,phi0,  z0, theta
   HoughTrack() : histo_(seq<4>(1000)(1000)(100)(1000),
                         seq<4>(-0.5)(-3.14)(-70.5)(0.),
-                        seq<4>(0.5)(3.14)(69.5)(3.14)),
-                 die_(0xcafebabe) {}
-  void processTree(std::string filename, long int startev, long int howmany);
+                        seq<4>(0.5)(3.14)(69.5)(3.14)) {}
+  void processTree(std::string filename, long int startev, long int howmany, int numThreads = 1);
   ~HoughTrack();
 };
 
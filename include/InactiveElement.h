@@ -32,6 +32,10 @@ namespace insur {
      */
     enum InType { no_in, tracker, barrel, endcap };
     InactiveElement();
+    InactiveElement(const InactiveElement&) = default;
+    InactiveElement(InactiveElement&&) = default;
+    InactiveElement& operator=(const InactiveElement&) = default;
+    InactiveElement& operator=(InactiveElement&&) = default;
     virtual ~InactiveElement() {}
     virtual double getSurface() const;
     bool isVertical() const;
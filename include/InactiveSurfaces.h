@@ -17,6 +17,9 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <deque>
+#include <iterator>
+#include <cstddef>
 #include <InactiveElement.h>
 namespace insur {
   /**
@@ -24,40 +27,154 @@ namespace insur {
    * @brief This is the top-level container class  for the inactive surfaces.
    *
    * It contains lists of all subgroups of inactive volumes: the services list and the supporting parts list.
-   * It provides access functions to them or their individual elements that typically copy a new element to
-   * its place at the end of the vector or return a reference to a requested element. It also stores the type of
+   * It provides access functions to them or their individual elements that typically move a new element to
+   * the end of its list or return a reference to a requested element. It also stores the type of
    * configuration (UP or DOWN) in a boolean flag. Some of the access functions to individual elements
    * may throw an exception if the requested index is out of range.
+   *
+   * The elements themselves live in a single arena and never move once added: each list only holds the arena slots of
+   * its elements, in list order, so removing an element shifts a few integers instead of the elements after it, and the
+   * references and pointers to the other elements stay valid. The slots freed by a removal are reused by the next additions.
+   * The feeder and neighbour indices of the elements are positions in these lists, as before.
+   *
+   * The elements crossed by a track from the origin can be queried by eta. The query goes through an interval tree over
+   * the eta ranges of the elements, which is built on the first query and again on the first query after the lists changed.
    */
   class InactiveSurfaces {
   public:
-    InactiveSurfaces() {}
+    /**
+     * @enum Collection The lists of elements, as flags that can be combined in the eta queries
+     */
+    enum Collection { BarrelServices = 1, EndcapServices = 2, Supports = 4, AllCollections = 7 };
+
+    /**
+     * @class ElementList
+     * @brief One list of elements, as the arena slots of its elements: it is indexed and iterated like a vector of elements.
+     */
+    class ElementList {
+    public:
+      template<class Element> class Iterator {
+      public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef InactiveElement value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Element* pointer;
+        typedef Element& reference;
+        Iterator() : arena_(nullptr) {}
+        Iterator(std::deque<InactiveElement>* arena, std::vector<int>::const_iterator slot) : arena_(arena), slot_(slot) {}
+        Iterator(const Iterator<InactiveElement>& other) : arena_(other.arena_), slot_(other.slot_) {} // also iterator to const_iterator
+        reference operator*() const { return (*arena_)[*slot_]; }
+        pointer operator->() const { return &(*arena_)[*slot_]; }
+        reference operator[](difference_type n) const { return (*arena_)[slot_[n]]; }
+        Iterator& operator++() { ++slot_; return *this; }
+        Iterator operator++(int) { Iterator i(*this); ++slot_; return i; }
+        Iterator& operator--() { --slot_; return *this; }
+        Iterator operator--(int) { Iterator i(*this); --slot_; return i; }
+        Iterator& operator+=(difference_type n) { slot_ += n; return *this; }
+        Iterator& operator-=(difference_type n) { slot_ -= n; return *this; }
+        Iterator operator+(difference_type n) const { return Iterator(arena_, slot_ + n); }
+        Iterator operator-(difference_type n) const { return Iterator(arena_, slot_ - n); }
+        difference_type operator-(const Iterator& other) const { return slot_ - other.slot_; }
+        bool operator==(const Iterator& other) const { return slot_ == other.slot_; }
+        bool operator!=(const Iterator& other) const { return slot_ != other.slot_; }
+        bool operator<(const Iterator& other) const { return slot_ < other.slot_; }
+        bool operator>(const Iterator& other) const { return slot_ > other.slot_; }
+        bool operator<=(const Iterator& other) const { return slot_ <= other.slot_; }
+        bool operator>=(const Iterator& other) const { return slot_ >= other.slot_; }
+      private:
+        template<class Other> friend class Iterator;
+        std::deque<InactiveElement>* arena_;
+        std::vector<int>::const_iterator slot_;
+      };
+      typedef Iterator<InactiveElement> iterator;
+      typedef Iterator<const InactiveElement> const_iterator;
+
+      ElementList() : arena_(nullptr) {}
+      size_t size() const { return slots_.size(); }
+      bool empty() const { return slots_.empty(); }
+      InactiveElement& operator[](size_t index) { return (*arena_)[slots_[index]]; }
+      const InactiveElement& operator[](size_t index) const { return (*arena_)[slots_[index]]; }
+      InactiveElement& at(size_t index) { return (*arena_)[slots_.at(index)]; } // throws exception
+      const InactiveElement& at(size_t index) const { return (*arena_)[slots_.at(index)]; } // throws exception
+      iterator begin() { return iterator(arena_, slots_.begin()); }
+      iterator end() { return iterator(arena_, slots_.end()); }
+      const_iterator begin() const { return const_iterator(arena_, slots_.begin()); }
+      const_iterator end() const { return const_iterator(arena_, slots_.end()); }
+    private:
+      friend class InactiveSurfaces;
+      std::deque<InactiveElement>* arena_;
+      std::vector<int> slots_;
+    };
+
+    InactiveSurfaces();
+    InactiveSurfaces(const InactiveSurfaces& other);
+    InactiveSurfaces(InactiveSurfaces&& other);
+    InactiveSurfaces& operator=(InactiveSurfaces other);
     virtual ~InactiveSurfaces() {}
     // services
-    void addBarrelServicePart(InactiveElement service);
+    void addBarrelServicePart(InactiveElement&& service);
     InactiveElement& getBarrelServicePart(int index); // throws exception
-    std::vector<InactiveElement>::iterator removeBarrelServicePart(int index);
-    std::vector<InactiveElement>& getBarrelServices(); // may return empty vector
-    void addEndcapServicePart(InactiveElement service);
+    ElementList::iterator removeBarrelServicePart(int index);
+    ElementList& getBarrelServices(); // may return empty list
+    void addEndcapServicePart(InactiveElement&& service);
     InactiveElement& getEndcapServicePart(int index); // throws exception
-    std::vector<InactiveElement>::iterator removeEndcapServicePart(int index);
-    std::vector<InactiveElement>& getEndcapServices(); // may return empty vector
+    ElementList::iterator removeEndcapServicePart(int index);
+    ElementList& getEndcapServices(); // may return empty list
     // supports
-    void addSupportPart(InactiveElement support);
+    void addSupportPart(InactiveElement&& support);
     InactiveElement& getSupportPart(int index); // throws exception
-    std::vector<InactiveElement>::iterator removeSupportPart(int index);
-    std::vector<InactiveElement>& getSupports(); // may return empty vector
+    ElementList::iterator removeSupportPart(int index);
+    ElementList& getSupports(); // may return empty list
     // layout flag
     bool isUp();
     void setUp(bool up);
     void print(bool full_summary);
+    // eta queries
+    std::vector<InactiveElement*> elementsCrossedAt(double eta, MaterialProperties::Category cat = MaterialProperties::no_cat,
+                                                    int collections = AllCollections);
+    void invalidateEtaIndex() { etaIndexValid_ = false; } // to be called when elements are moved through the list references
   protected:
     //layout flag
     bool is_up;
-    // element collections
-    std::vector<InactiveElement> barrelservices, endcapservices, supports;
+    // element storage and lists
+    std::deque<InactiveElement> arena;
+    std::vector<int> freeSlots;
+    ElementList barrelservices, endcapservices, supports;
   private:
+    /**
+     * @class EtaIndex
+     * @brief A centered interval tree over the open eta ranges of the elements reaching z > 0.
+     */
+    class EtaIndex {
+    public:
+      struct Entry {
+        double etaMin, etaMax;
+        int collection, element;
+        MaterialProperties::Category category;
+      };
+      void build(const std::vector<Entry>& entries);
+      void query(double eta, std::vector<int>& found) const; // indices of the entries with etaMin < eta < etaMax
+      const Entry& entry(int i) const { return entries_[i]; }
+    private:
+      struct Node {
+        double center;
+        int left, right;
+        std::vector<int> byMin, byMax; // the entries containing the center, by increasing etaMin and by decreasing etaMax
+      };
+      std::vector<Entry> entries_;
+      std::vector<Node> nodes_;
+      int root_ = -1;
+      int buildNode(std::vector<int>& ids);
+    };
 
+    EtaIndex etaIndex_;
+    bool etaIndexValid_;
+    size_t indexedSizes_[3];
+    ElementList& collection(int i);
+    void add(ElementList& list, InactiveElement&& element);
+    ElementList::iterator remove(ElementList& list, int index);
+    void bindLists();
+    void buildEtaIndex();
   };
 }
 #endif	/* _INACTIVESURFACES_H */
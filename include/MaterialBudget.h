@@ -18,6 +18,7 @@
 #include <InactiveSurfaces.h>
 #include <ModuleCap.h>
 #include <MatCalc.h>
+#include <ModuleHitIndex.h>
 namespace insur {
   /**
    * Errors that may occur during operations
@@ -46,11 +47,15 @@ namespace insur {
     InactiveSurfaces& getInactiveSurfaces();
     std::vector<std::vector<ModuleCap> >& getBarrelModuleCaps();
     std::vector<std::vector<ModuleCap> >& getEndcapModuleCaps();
+    const ModuleHitIndex& getBarrelModuleCapIndex() const { return capsbarrelindex; }
+    const ModuleHitIndex& getEndcapModuleCapIndex() const { return capsendindex; }
     void print();
   protected:
     Tracker* tracker;
     InactiveSurfaces* inactive;
     std::vector<std::vector<ModuleCap> > capsbarrelmods, capsendmods;
+    ModuleHitIndex capsbarrelindex, capsendindex; // candidates are the positions of the caps, counted layer after layer
+    void buildCapIndex(std::vector<std::vector<ModuleCap> >& caps, ModuleHitIndex& index);
     int onBoundary(std::vector<std::vector<ModuleCap> >& source, int layer); //throws exception
   private:
     MaterialBudget();
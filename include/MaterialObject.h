@@ -30,6 +30,7 @@ namespace material {
   public:
     class Element; //forward declaration for getElementIfService(Element& inputElement)
     class Component;
+    class Materials;
 
     typedef std::vector<Component*> ComponentsVector;
     typedef std::vector<const Element*> ElementsVector;
@@ -48,11 +49,14 @@ namespace material {
     
     void deployMaterialTo(MaterialObject& outputObject, const std::vector<std::string>& unitsToDeploy, bool onlyServices = false, double gramsMultiplier = 1.) const;
     void addElement(const MaterialObject::Element* element);
+    const ElementsVector& serviceElements() const;
+    void clearServiceElements();
     void populateMaterialProperties(MaterialProperties& materialProperties) const;
 
     ElementsVector& getLocalElements() const;
 
     bool isPopulated() const;
+    const Materials* materials() const; //shared between the objects with the same MaterialObjectKey
 
     //TODO: do methods for interrogate/get materials
 
@@ -17,6 +17,11 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <utility>
 #include <MaterialTable.h>
 
 class RILength {
@@ -37,6 +42,58 @@ namespace insur {
      */
     static const std::string err_local_mass = "Local mass not found";
     static const std::string msg_mattab_except_local = "Exception other than runtime_error occurred accessing material table for local masses: ";
+
+    /**
+     * @class MaterialSymbols
+     * @brief The global table of the material and component names, which are stored by id in the material properties.
+     *
+     * Ids are given in order of first appearance and never change. For every name the ids of its sub and super names
+     * (the parts before and after the first '_', see <i>MaterialProperties::getSubName()</i>) are also kept, so that
+     * the components need not be parsed again. The table is safe to use from several threads.
+     */
+    class MaterialSymbols {
+    public:
+        static int id(const std::string& name);     // adds the name if it is new
+        static int find(const std::string& name);   // -1 if the name is unknown
+        static const std::string& name(int id);
+        static int subId(int id);
+        static int superId(int id);
+        static std::vector<int> superIds();          // of all the ids so far, taken at once
+    private:
+        struct Symbol {
+            std::string name;
+            int sub, super;
+        };
+        static std::deque<Symbol>& symbols();       // a deque, so that the names never move
+        static std::map<std::string, int>& ids();
+        static std::mutex& mutex();
+        static int intern(const std::string& name); // to be called with the mutex locked
+    };
+
+    class MaterialProperties;
+
+    /**
+     * @class MaterialLengthTable
+     * @brief The radiation and interaction lengths of the materials of the material tab, resolved by id.
+     *
+     * The table is filled once with the materials of a set of elements, so that their lengths can then be calculated
+     * concurrently, with neither the string lookups of the material tab nor the lock of the symbol table.
+     */
+    class MaterialLengthTable {
+    public:
+        MaterialLengthTable();
+        void add(const MaterialProperties& element);  // resolves the materials of the element not in the table yet
+        double radiationLength(int id) const { return lengths_[id].radiation; }
+        double interactionLength(int id) const { return lengths_[id].interaction; }
+        int superId(int id) const { return superIds_[id]; }
+    private:
+        std::vector<RILength> lengths_;
+        std::vector<int> superIds_;
+        std::vector<bool> resolved_;
+    };
+
+    typedef std::vector<std::pair<int, double> > MassVector;        // (id, grams), sorted by id
+    typedef std::vector<std::pair<int, RILength> > ComponentsRIVector; // (component id, lengths), sorted by id
     /**
      * @class MaterialProperties
      * @brief This is the base class for collections of properties related to the material budget.
@@ -49,6 +106,7 @@ namespace insur {
      * throw exceptions if the requested material does not appear on the list.
      */
     class MaterialProperties {
+        friend class MaterialSymbols;
     public:
         /**
          * @enum Category A list of logical categories within the detector geometry; a single element belongs to exactly one of them
@@ -64,23 +122,28 @@ namespace insur {
         virtual double getSurface() const;
         virtual double getLength() const;
         // material mass handling
-        const std::map<std::string, double>& getLocalMasses() const;
-        const std::map<std::string, double>& getLocalMassesComp() const;
+        const MassVector& getLocalMasses() const;
+        const MassVector& getLocalMassesComp() const;
+        std::map<std::string, double> getLocalMassesByName() const; // for printouts, in alphabetical order
         double getLocalMass(std::string tag); // throws exception
         double getLocalMassComp(std::string tag); // throws exception
+        double getLocalMass(int materialId) const; // 0 if not present
+        double getLocalMassComp(int componentId) const; // 0 if not present
         void addLocalMass(std::string tag, std::string comp, double ms, int minZ = -777);
         void addLocalMass(std::string tag, double ms);
+        void addLocalMass(int materialId, int componentId, double ms);
         unsigned int localMassCount();
         unsigned int localMassCompCount();
         void clearMassVectors();
         void copyMassVectors(MaterialProperties& mp);
+        void shareMassVectors(const MaterialProperties& mp);
         // calculated output values
         double getTotalMass() const;
         double getLocalMass();
         double getRadiationLength();
         double getInteractionLength();
         RILength getMaterialLengths();
-        const std::map<std::string, RILength>& getComponentsRI() const;
+        const ComponentsRIVector& getComponentsRI() const;
         // output calculations
         void calculateTotalMass(double offset = 0);
         void calculateLocalMass(double offset = 0);
@@ -88,6 +151,8 @@ namespace insur {
         void calculateInteractionLength(MaterialTable& materials,  double offset = 0.0);
         void calculateRadiationLength(double offset = 0.0);
         void calculateInteractionLength(double offset = 0.0);
+        void calculateRadiationLength(const MaterialLengthTable& lengths, double offset = 0.0);
+        void calculateInteractionLength(const MaterialLengthTable& lengths, double offset = 0.0);
         // tracking information
         bool track();
         void track(bool tracking_on);
@@ -99,17 +164,28 @@ namespace insur {
         bool msl_set, trck;
         // geometry-dependent parameters
         Category cat;
-        std::map<std::string, double> localmasses;
-        std::map<std::string, double> localmassesComp;
-
-        std::map<std::string, std::map<std::string, double> > localCompMats; // format here is <component name string, <material name, mass> >
+        struct ComponentMaterial {
+            int component, material;
+            double mass;
+        };
+        struct MassTable {
+            MassVector localmasses;
+            MassVector localmassesComp;  // by sub name of the component
+            std::vector<ComponentMaterial> localCompMats; // sorted by component, then by material
+        };
+        std::shared_ptr<MassTable> masses;  // shared by the elements with the same masses, copied on the first change
 
-        std::map<std::string, RILength> componentsRI;  // component-by-component radiation and interaction lengths
+        ComponentsRIVector componentsRI;  // component-by-component radiation and interaction lengths, by super name of the component
         // complex parameters (OUTPUT)
         double total_mass, local_mass, r_length, i_length;
         // internal help
-        std::string getSuperName(std::string name) const;
-        std::string getSubName(std::string name) const;
+        static std::string getSuperName(std::string name);
+        static std::string getSubName(std::string name);
+        MassTable& editMasses();
+        static void addMass(MassVector& massVector, int id, double ms);
+        static double findMass(const MassVector& massVector, int id);
+        template<class LengthFunction, class SuperIdFunction>
+        void calculateLengths(LengthFunction length, SuperIdFunction superId, double RILength::* result, double& total, double offset);
     };
 }
 #endif	/* _MATERIALPROPERTIES_H */
@@ -9,6 +9,8 @@
 #define MATERIALTAB_H_
 
 #include <map>
+#include <set>
+#include <string>
 #include <tuple>
 
 namespace material {
@@ -17,12 +19,16 @@ namespace material {
     class MaterialTab : public MaterialTabType {
     private:
       MaterialTab();
+      void read();
+      static MaterialTab& editableInstance();
       static const std::string msg_no_mat_file;
       static const std::string msg_no_mat_file_entry1;
       static const std::string msg_no_mat_file_entry2;
 
     public:
       static const MaterialTab& instance();
+      static void reload(std::set<std::string>& changedDensities, std::set<std::string>& changedLengths);
+      std::string fileName() const;
 
       double density(std::string material) const;
       double radiationLength(std::string material) const;
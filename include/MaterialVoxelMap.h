@@ -0,0 +1,66 @@
+/**
+ * @file MaterialVoxelMap.h
+ * @brief This is the header file for the (r, z) voxel map of the material densities
+ */
+
+#ifndef _MATERIALVOXELMAP_H
+#define _MATERIALVOXELMAP_H
+
+#include <vector>
+#include <string>
+#include "MaterialProperties.h"
+#include "InactiveSurfaces.h"
+
+namespace insur {
+  class MaterialBudget;
+  class ModuleCap;
+
+  /**
+   * @class MaterialVoxelMap
+   * @brief The material of a <i>MaterialBudget</i>, averaged over phi and binned in (r, z) as densities of radiation and interaction length per mm.
+   *
+   * Every inactive element is a ring or a tube of uniform density: its radiation and interaction lengths, which are
+   * given for a crossing along its thickness, are spread over its (r, z) box. The modules are spread over the box
+   * of their sensors in the same way, after being averaged over phi: the lengths times the module surface are divided
+   * by the volume of the full ring the box sweeps. Only the elements flagged to be tracked are mapped, for the
+   * active modules, the services and the supports separately.
+   *
+   * A straight track from the origin is integrated with a 2D DDA traversal of the voxels it crosses, so that the material
+   * of an eta scan costs a few hundred voxel steps per track (about 780 for the full tracker at 5 mm bins) instead of a loop over
+   * all the elements. The map only covers z >= 0, as the tracks of the material budget analysis do. It can be saved to and
+   * loaded from a text file. It only backs the material map export (<i>Squid::exportMaterialMap()</i>): the material budget
+   * analysis still shoots its tracks through the elements.
+   */
+  class MaterialVoxelMap {
+  public:
+    enum Component { Active, Services, Supports, NumComponents };
+
+    MaterialVoxelMap() : binR_(0.), binZ_(0.), binsR_(0), binsZ_(0) {}
+
+    void build(MaterialBudget& mb, double binSize);
+    void integrate(double theta, Material* byComponent) const;
+    Material integrate(double theta) const;
+
+    bool save(const std::string& fileName) const;
+    bool load(const std::string& fileName);
+    bool saveEtaScan(const std::string& fileName, double maxEta, int etaSteps) const;
+
+    int binsR() const { return binsR_; }
+    int binsZ() const { return binsZ_; }
+    double binR() const { return binR_; }
+    double binZ() const { return binZ_; }
+    const Material& density(Component component, int iR, int iZ) const { return densities_[index(component, iR, iZ)]; }
+
+  private:
+    double binR_, binZ_;
+    int binsR_, binsZ_;
+    std::vector<Material> densities_; // by component, then by r bin, then by z bin
+
+    int index(int component, int iR, int iZ) const { return (component*binsR_ + iR)*binsZ_ + iZ; }
+    void deposit(Component component, double minR, double maxR, double minZ, double maxZ, const Material& quantity);
+    void addElements(InactiveSurfaces::ElementList& elements, Component component);
+    void addModules(std::vector<std::vector<ModuleCap> >& caps);
+  };
+}
+
+#endif /* _MATERIALVOXELMAP_H */
@@ -13,6 +13,7 @@
 #include <utility>
 #include <set>
 #include <string>
+#include <functional>
 #include "MaterialObject.h"
 //#include "global_constants.h"
 
@@ -162,6 +163,41 @@ namespace material {
     typedef std::vector<Station*> StationVector;
     typedef std::map<const DetectorModule*, Section*> ModuleSectionMap;
 
+    /**
+     * @class ServiceFlow
+     * @brief Routes the services of many sources down the sections in a single pass
+     *
+     * The services entering each section are summed per element (the elements are shared between
+     * the modules of the same type), then the sums are propagated down the sections in topological order,
+     * so that every section receives each element once, weighted by the number of sources upstream.
+     * As for Section::getServicesAndPass, the flow ends at the first station.
+     */
+    class ServiceFlow {
+    public:
+      ServiceFlow();
+      void add(Section* entry, const MaterialObject& source, const std::vector<std::string>& unitsToPass);
+      void route();
+    private:
+      /**
+       * The weights of the elements entering a section, in the order they first entered it, so that the elements
+       * are delivered in the same order from run to run (the pointer order is not)
+       */
+      class ElementWeights {
+      public:
+        typedef std::vector<std::pair<const MaterialObject::Element*, double> > Weights;
+        void add(const MaterialObject::Element* element, double weight);
+        const Weights& weights() const { return weights_; }
+      private:
+        Weights weights_;
+        std::map<const MaterialObject::Element*, int> index_; /**< position in weights_, for the lookups only */
+      };
+      std::map<Section*, ElementWeights> inflows_;  /**< for the lookups only, never iterated */
+      std::vector<Section*> entries_;               /**< the sections of inflows_ the services enter, in the order they were added */
+      MaterialObject filtered_;   /**< scratch object, receives the services of a source that match the units */
+
+      static void deliver(const ElementWeights& weights, MaterialObject& destination);
+    }; //class ServiceFlow
+
     /**
      * @class Boundary
      * @brief Represents a boundary where the services are routed around
@@ -202,6 +238,44 @@ namespace material {
 
     typedef std::set<Boundary*, BoundaryComparator> BoundariesSet;
 
+    /**
+     * @class ObstacleIndex
+     * @brief Finds the first boundary or section met going along +z or +rho from a point
+     *
+     * There is a segment tree over the integer coordinates for each direction: every obstacle is stored in the nodes
+     * covering the span it blocks across the direction (rho if horizontal, z if vertical), keyed by its start along
+     * the direction. A query descends to the leaf of the starting point and keeps the nearest key beyond it,
+     * in O(log^2) time. On equal distance the obstacle added last wins, as with the former linear scans.
+     */
+    template<class Obstacle>
+    class ObstacleIndex {
+    public:
+      ObstacleIndex(int margin);
+      void add(Obstacle* obstacle);
+      void update(Obstacle* obstacle);      /**< to be called when the obstacle has been resized */
+      void clear();
+      int size() const;
+      Obstacle* firstHit(int z, int r, Direction direction, int& hitCoord) const;
+    private:
+      typedef std::pair<int, int> Key;      /**< the start of the obstacle and its order, negated */
+      struct Extent {
+        int minZ, minR, maxZ, maxR;
+      };
+      struct Node {
+        int children[2] = {-1, -1};
+        std::set<Key> keys;
+      };
+
+      int margin_;                          /**< how much the obstacles are widened across the direction */
+      std::vector<Obstacle*> obstacles_;
+      std::vector<Extent> extents_;         /**< the extents the obstacles are stored with */
+      std::map<const Obstacle*, int> orders_;
+      std::vector<Node> nodes_[2];          /**< horizontal and vertical trees, roots first */
+
+      void place(int order, bool remove);
+      void modify(int tree, int node, long long low, long long high, int from, int to, const Key& key, bool remove);
+    }; //class ObstacleIndex
+
     /**
      * @class OuterUsher
      * @brief Is the core of the functionality that builds sections across boundaries
@@ -216,6 +290,8 @@ namespace material {
     private:
       SectionVector& sectionsList_;
       BoundariesSet& boundariesList_;
+      ObstacleIndex<Boundary> boundaryIndex_;  /**< follows boundariesList_ */
+      ObstacleIndex<Section> sectionIndex_;    /**< follows sectionsList_, which only grows while the sections are built */
 
       bool findBoundaryCollision(int& collision, int& border, int startZ, int startR, const Tracker& tracker, Direction direction);
       bool findSectionCollision(std::pair<int,Section*>& sectionCollision, int startZ, int startR, int end, Direction direction);
@@ -270,7 +346,8 @@ namespace material {
     Materialway();
     virtual ~Materialway();
 
-    bool build(Tracker& tracker, InactiveSurfaces& inactiveSurface, WeightDistributionGrid& weightDistribution);
+    bool build(Tracker& tracker, InactiveSurfaces& inactiveSurface, WeightDistributionGrid* weightDistribution, int threads = 1);
+    bool update(WeightDistributionGrid* weightDistribution, const std::set<std::string>& changedDensities, const std::set<std::string>& changedLengths);
 
     static const double gridFactor;                                     /**< the conversion factor for using integers in the algorithm (helps finding collisions),
                                                                             actually transforms millimiters in microns */
@@ -305,6 +382,29 @@ namespace material {
     OuterUsher outerUsher;
     InnerUsher innerUsher;
 
+    /**
+     * @struct MaterialConsumer
+     * @brief A module cap, service or support of the built geometry, with the way its masses are filled
+     */
+    struct MaterialConsumer {
+      MaterialProperties* properties;
+      std::function<void(MaterialProperties&)> populate;
+      int sharedFrom;                   /**< the consumer whose masses are shared instead of populated, or -1 */
+    };
+    /**
+     * @struct WeightBox
+     * @brief The (z, r) box of a section or module, whose grams go to the weight distribution
+     */
+    struct WeightBox {
+      double minZ, minR, maxZ, maxR, length, surface;
+      const MaterialObject* materialObject;
+    };
+    std::vector<MaterialConsumer> materialConsumers_;           /**< The consumers, in the order they were populated */
+    std::map<int, std::vector<int> > materialConsumersIndex_;   /**< The consumers with a mass of each material id */
+    std::set<std::string> convertedMaterials_;                  /**< The materials converted by the stations, whose density changes the routed services */
+    std::vector<WeightBox> weightBoxes_;
+    int threads_;                                               /**< The number of threads of the build, used by the updates too */
+
     bool buildBoundaries(const Tracker& tracker);             /**< build the boundaries around barrels and endcaps */
     void buildExternalSections(const Tracker& tracker);       /**< build the sections outside the boundaries */
     void buildInternalSections(Tracker& tracker);                             /**< build the sections inside the boundaries */
@@ -316,10 +416,13 @@ namespace material {
     void secondStepConversions();
     void createModuleCaps(Tracker& tracker);
     void duplicateSections();
-    void populateAllMaterialProperties(Tracker& tracker, WeightDistributionGrid& weightDistribution);
+    void populateAllMaterialProperties(Tracker& tracker, WeightDistributionGrid* weightDistribution);
     //void calculateMaterialValues(Tracker& tracker);
     void buildInactiveSurface(Tracker& tracker, InactiveSurfaces& inactiveSurface);
     void calculateMaterialValues(InactiveSurfaces& inactiveSurface, Tracker& tracker);
+    void calculateMaterialValues(const std::vector<MaterialProperties*>& elements) const;
+    void indexMaterialConsumers();
+    void fillWeightDistribution(WeightDistributionGrid& weightDistribution) const;
     //InactiveElement* buildOppositeInactiveElement(InactiveElement* inactiveElement);
 
 
@@ -0,0 +1,63 @@
+#ifndef MODULEHITINDEX_H
+#define MODULEHITINDEX_H
+
+#include <vector>
+#include <cmath>
+
+#include <Math/Vector3D.h>
+
+#include "PackedSensorPolygons.h"
+
+class DetectorModule;
+
+using ROOT::Math::XYZVector;
+
+/**
+ * @class ModuleHitIndex
+ * @brief A binned (eta, phi) look-up of the modules a straight track can reach.
+ *
+ * Every module is registered in all the (eta, phi) bins its sensors' hit polygons can be seen from,
+ * for any track origin on the z axis within +/- zMargin. A track then only needs to be checked against
+ * the candidates of the bin it points to. Candidates are identified by their position in the module list
+ * the index was built from and are kept in ascending order, so that looping over them visits the modules
+ * in the same order as a full scan would.
+ * Tracks which cannot be served (origin off the z axis or beyond the margin) get no candidate list
+ * and the caller is expected to fall back to the full scan.
+ * The index also keeps a packed copy of the sensor polygons, so that the candidates can be checked in one batch.
+ */
+class ModuleHitIndex {
+public:
+  typedef std::vector<int> Candidates;
+
+  ModuleHitIndex(int etaBins = 180, int phiBins = 360, double etaMax = 4.5);
+
+  void build(const std::vector<const DetectorModule*>& modules, double zMargin);
+  void clear();
+
+  bool built() const { return built_; }
+  double zMargin() const { return zMargin_; }
+  int numModules() const { return numModules_; }
+
+  const Candidates* candidates(const XYZVector& origin, const XYZVector& direction) const;
+  const PackedSensorPolygons& sensorPolygons() const { return sensorPolygons_; }
+
+private:
+  static constexpr double etaSafetyMargin = 1e-3;  // eta units
+  static constexpr double phiSafetyMargin = 1e-3;  // rad
+  static constexpr double lengthSafetyMargin = 1.; // mm
+
+  int etaBins_, phiBins_;
+  double etaMax_, etaWidth_, phiWidth_;
+  double zMargin_ = 0.;
+  int numModules_ = 0;
+  bool built_ = false;
+  std::vector<Candidates> bins_;
+  PackedSensorPolygons sensorPolygons_;
+
+  int etaBin(double eta) const;
+  int phiBin(double phi) const;
+  Candidates& bin(int iEta, int iPhi) { return bins_[iEta*phiBins_ + iPhi]; }
+  const Candidates& bin(int iEta, int iPhi) const { return bins_[iEta*phiBins_ + iPhi]; }
+};
+
+#endif
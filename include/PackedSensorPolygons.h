@@ -0,0 +1,54 @@
+#ifndef PACKEDSENSORPOLYGONS_H
+#define PACKEDSENSORPOLYGONS_H
+
+#include <vector>
+#include <utility>
+
+#include <Math/Vector3D.h>
+
+class DetectorModule;
+class Sensor;
+
+using ROOT::Math::XYZVector;
+
+/**
+ * @class PackedSensorPolygons
+ * @brief A structure-of-arrays copy of the sensor hit polygons of a list of modules, for batched track intersection.
+ *
+ * For every sensor it keeps the plane (unit normal and offset), the vertices, the in-plane edge normals and the strip axis,
+ * each coordinate in its own contiguous array. A track is then tested against a whole batch of sensors in one plain loop
+ * without any virtual call, temporary polygon or ROOT vector arithmetic, which the compiler can vectorize.
+ * The inside test is the exact rewriting of Polygon3d::isPointInside (sum of the triangle areas within 1e-4 of the polygon area):
+ * with edge normals as long as the edges, the excess area is twice the sum of the negative signed areas.
+ * Modules are addressed by their position in the list the structure was built from.
+ */
+class PackedSensorPolygons {
+public:
+  typedef std::pair<XYZVector, int> SegmentHit; // same convention as Sensor::checkHitSegment: segment is -1 if not hit
+
+  void build(const std::vector<const DetectorModule*>& modules);
+  void clear();
+
+  int numModules() const { return innerSensor_.size(); }
+  int numSensors() const { return d_.size(); }
+
+  void checkHitSegments(const XYZVector& trackOrig, const XYZVector& trackDir, const std::vector<int>& modules,
+                        std::vector<SegmentHit>& innerHits, std::vector<SegmentHit>& outerHits) const;
+
+private:
+  static const int NumVertices = 4;
+  static constexpr double minNormDir = 1e-3;         // as in Polygon3d::isLineIntersecting
+  static constexpr double maxHalfExcessArea = 0.5e-4; // as in Polygon3d::isPointInside
+
+  std::vector<double> nx_, ny_, nz_, d_;
+  std::vector<double> vx_[NumVertices], vy_[NumVertices], vz_[NumVertices];
+  std::vector<double> ex_[NumVertices], ey_[NumVertices], ez_[NumVertices];
+  std::vector<double> sx_, sy_, sz_, stripLength_;
+  std::vector<int> innerSensor_, outerSensor_;
+
+  int addSensor(const Sensor& s);
+  void intersect(double ox, double oy, double oz, double dx, double dy, double dz, const std::vector<int>& sensors,
+                 std::vector<double>& px, std::vector<double>& py, std::vector<double>& pz, std::vector<int>& segments) const;
+};
+
+#endif
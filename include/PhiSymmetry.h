@@ -0,0 +1,42 @@
+#ifndef PHISYMMETRY_H
+#define PHISYMMETRY_H
+
+#include <vector>
+#include <map>
+
+class Tracker;
+class DetectorModule;
+
+/**
+ * @class PhiSymmetry
+ * @brief The rotational symmetry of a tracker around the z axis.
+ *
+ * Each layer is expected to repeat with the number of its rods and each ring with the number of its modules.
+ * Since rods or modules can alternate (e.g. zig-zag placement), the largest divisor of that number for which
+ * the rotated modules actually fall on other modules of the same type is kept. The tracker is symmetric under the
+ * rotations by 2*pi/order, order being the greatest common divisor of those of all the layers and rings.
+ * The modules which map onto each other under those rotations form an orbit: a straight track rotated by 2*pi/order
+ * hits the images of the modules hit by the original track.
+ */
+class PhiSymmetry {
+public:
+  void build(const Tracker& tracker);
+
+  int order() const { return order_; }
+  int orbit(const DetectorModule* m) const; // the id of the orbit of the module, -1 if the module is unknown
+  int numOrbits() const { return numOrbits_; }
+
+private:
+  typedef std::vector<const DetectorModule*> Group;
+
+  static constexpr double tolerance = 1e-3; // mm
+
+  int order_ = 1;
+  int numOrbits_ = 0;
+  std::map<const DetectorModule*, int> orbits_;
+
+  static const DetectorModule* findImage(const DetectorModule& m, double angle, const Group& group);
+  static bool isSymmetric(const Group& group, int order);
+};
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file PileUpSimulator.h
+ * @brief This is the header file for the Monte Carlo simulation of the pile-up occupancy
+ */
+
+#ifndef _PILEUPSIMULATOR_H
+#define _PILEUPSIMULATOR_H
+
+#include <string>
+#include <vector>
+
+#include "CounterRandom.h"
+#include "HelixNavigator.h"
+
+namespace insur {
+  /**
+   * @class PileUpSpectra
+   * @brief The spectra of the charged particles of a minimum bias interaction, read from a text file.
+   *
+   * The file lists the dN/deta of the charged particles per interaction and their relative dN/dpt, as piecewise
+   * constant spectra, one bin per line:
+   * <pre>
+   * eta &lt;low edge&gt; &lt;high edge&gt; &lt;dN/deta&gt;
+   * pt &lt;low edge&gt; &lt;high edge&gt; &lt;dN/dpt&gt;   (GeV/c)
+   * z0sigma &lt;mm&gt;                           (optional, the length of the luminous region)
+   * </pre>
+   * with # starting a comment. The mean number of charged particles per interaction is the integral of dN/deta.
+   */
+  class PileUpSpectra {
+  public:
+    PileUpSpectra() : z0Sigma_(70.) {}
+    bool load(const std::string& fileName);
+
+    double multiplicity() const { return eta_.total(); }
+    double z0Sigma() const { return z0Sigma_; }
+    double drawEta(CounterRandom::Stream& dice) const { return eta_.draw(dice); }
+    double drawPt(CounterRandom::Stream& dice) const { return pt_.draw(dice); }
+
+  private:
+    class Spectrum {
+      std::vector<double> low_, high_, cumulative_;
+    public:
+      bool add(double low, double high, double density);
+      bool empty() const { return cumulative_.empty(); }
+      double total() const { return cumulative_.empty() ? 0. : cumulative_.back(); }
+      double draw(CounterRandom::Stream& dice) const;
+    };
+    Spectrum eta_, pt_;
+    double z0Sigma_;
+  };
+
+  /**
+   * @class PileUpSimulator
+   * @brief Counts the channels hit in each sensor by the pile-up of minimum bias interactions, over many bunch crossings.
+   *
+   * Each bunch crossing overlays a fixed number of interactions, each with a Poisson number of charged particles drawn
+   * from a <i>PileUpSpectra</i> and a vertex spread along the beam line. The particles are propagated as helices with a
+   * <i>HelixNavigator</i>; in every sensor they cross they leave a cluster of the channels their path through the sensor
+   * thickness covers. The channels hit in a crossing are then counted once per sensor and per readout chip, which
+   * gives the measured occupancy, cluster width and bandwidth of every sensor.
+   *
+   * The crossings are shared among the threads, each with its own counters, summed up at the end. The counts are integers
+   * and every interaction draws from its own random stream, so the results do not depend on the number of threads.
+   */
+  class PileUpSimulator {
+  public:
+    static const int maxClusterWidth = 16; // in channels, the wider clusters of the tracks grazing a sensor are cut there
+    static const int maxHitChannelsCounted = 4096; // the distribution of the hit channels per crossing stops there
+
+    /**
+     * The counts of a sensor, summed over the crossings
+     */
+    struct SensorCounts {
+      long hitChannels, hitChannelsSquared, clusters, clusterWidths;
+      int maxHitChannels, maxChipHitChannels; // in a single crossing
+      SensorCounts() : hitChannels(0), hitChannelsSquared(0), clusters(0), clusterWidths(0), maxHitChannels(0), maxChipHitChannels(0) {}
+      void merge(const SensorCounts& other);
+    };
+
+    struct SensorOccupancy {
+      const DetectorModule* module;
+      int sensor; // index in the sensors of the module
+      int channels, chips;
+      SensorCounts counts;
+    };
+
+    PileUpSimulator() : crossings_(0) {}
+    void simulate(const Tracker& tracker, const PileUpSpectra& spectra, int interactionsPerCrossing, long crossings, int seed, int numThreads = 1);
+
+    long crossings() const { return crossings_; }
+    const std::vector<SensorOccupancy>& sensors() const { return sensors_; }
+    // The number of (sensor, crossing) pairs by number of hit channels, the last bin counting the ones with more
+    const std::vector<long>& hitChannelDistribution() const { return hitChannelDistribution_; }
+    // The number of clusters by width
+    const std::vector<long>& clusterWidthDistribution() const { return clusterWidthDistribution_; }
+
+  private:
+    /**
+     * The frame of a sensor, resolved before the threads start: its mid-plane centre and axes, and the layout of its
+     * channels and chips
+     */
+    struct SensorFrame {
+      int module;
+      double normalOffset, thickness;
+      XYZVector center, along, across, normal; // along the strips from the wide end, across them
+      double length, maxWidth, minWidth;
+      int strips, segments;
+      int chipsAcross, chipsAlong, stripsPerChip, segmentsPerChip;
+    };
+    struct Shard {
+      std::vector<SensorCounts> sensors;
+      std::vector<long> hitChannels, clusterWidths;
+      long touched; // (sensor, crossing) pairs with at least a hit
+      std::vector<uint64_t> keys; // the channels hit in the current crossing
+    };
+
+    HelixNavigator navigator_;
+    std::vector<SensorFrame> frames_;
+    std::vector<std::vector<int> > moduleFrames_; // the frames of the sensors of each module
+    std::vector<SensorOccupancy> sensors_;
+    std::vector<long> hitChannelDistribution_, clusterWidthDistribution_;
+    long crossings_;
+
+    void setupFrames();
+    void simulateCrossing(const PileUpSpectra& spectra, const CounterRandom& dice, int interactionsPerCrossing, long crossing,
+                          std::vector<HelixNavigator::Crossing>& crossings, Shard& shard) const;
+    void addCluster(const SensorFrame& frame, int frameIndex, const XYZVector& position, const XYZVector& direction, Shard& shard) const;
+    void countCrossing(Shard& shard) const;
+  };
+}
+
+#endif /* _PILEUPSIMULATOR_H */
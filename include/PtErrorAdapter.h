@@ -1,6 +1,9 @@
 #ifndef PT_ERROR_ADAPTER_H
 #define PT_ERROR_ADAPTER_H
 
+#include <map>
+#include <mutex>
+
 #include "global_constants.h"
 #include "ptError.h"
 #include "Module.h"
@@ -16,6 +19,37 @@ class PtErrorAdapter {
   static const double ptFitParamsMid[]; // 1 GeV to 4 GeV     Chi^2 / dof = 84.2299/71 = 1.18634
   static const double ptFitParamsHigh[]; // 4 GeV to 10 GeV    Chi^2 / dof = 102.736/135 = 0.76101
 
+  static const double curvatureStep; // of the tabulated trigger probabilities, in c/GeV
+
+  /**
+   * @class TriggerProbabilityTable
+   * @brief The trigger probabilities of the modules, tabulated against the track curvature.
+   *
+   * The probability depends on the module only through the parameters of its <i>ptError</i> and its pt cut, so the
+   * modules sharing them (the ones of a ring, or of a layer at the same z) share a curve. The points of a curve are
+   * computed on first use, and the probabilities in between are interpolated linearly.
+   * The points are kept in a table shared by the threads, and each thread copies the ones it used to a table of its own,
+   * which it reads without locking: the shared table is only locked the first time a thread needs a point.
+   */
+  class TriggerProbabilityTable {
+  public:
+    double probability(ptError& pterr, double ptCut, double trackPt);
+  private:
+    struct Key {
+      double r, z, pitch, stripLength, height, distance, effectiveDistance, tilt, ptCut;
+      int moduleType, zCorrelation;
+      bool operator<(const Key& other) const;
+    };
+    typedef std::map<long, double> Curve; // by multiple of curvatureStep
+    typedef std::map<Key, Curve> Curves;
+    Curves curves_;
+    std::mutex mutex_; // the adapters of different threads share the table
+    static Curves& localCurves();
+    double point(const Key& key, Curve& localCurve, long step, ptError& pterr, double ptCut);
+  };
+  static TriggerProbabilityTable& triggerProbabilityTable();
+  static double computeTriggerProbability(ptError& pterr, double ptCut, double trackPt);
+
   ptError myPtError;
   const DetectorModule& mod_;
 
@@ -23,6 +57,7 @@ class PtErrorAdapter {
 public:
    PtErrorAdapter(const DetectorModule& m) : mod_(m) { setPterrorParameters(); }
    double getTriggerProbability(const double& trackPt, const double& stereoDistance = 0, const int& triggerWindow = 0);
+   double computeError(double trackPt);
    double getTriggerFrequencyTruePerEventAbove(const double& myCut);
    double getParticleFrequencyPerEventAbove(const double& myCut);
    double getTriggerFrequencyTruePerEventBelow(const double& myCut);
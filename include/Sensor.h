@@ -80,6 +80,7 @@ public:
 //  double minZVertex() const { double min = std::numeric_limits<double>::max(); for (auto v : *poly_) { min = MIN(min, v.Z()); } return min; }
   
   void clearPolys();
+  void buildPolys() const;
   const Polygon3d<4>& hitPoly() const;
   const Polygon3d<4>& envelopePoly() const;
 };
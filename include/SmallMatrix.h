@@ -0,0 +1,156 @@
+#ifndef SMALLMATRIX_H
+#define SMALLMATRIX_H
+
+#include <vector>
+#include <cmath>
+
+/**
+ * @class SmallMatrix
+ * @brief A dense matrix with its elements on the stack, for the small linear algebra of the track error propagation.
+ *
+ * The dimensions are set at run time, up to MaxRows x MaxCols: within those bounds nothing is allocated.
+ * Larger matrices are still supported, their elements then go to the heap.
+ */
+template<int MaxRows, int MaxCols>
+class SmallMatrix {
+  int rows_, cols_;
+  double fixed_[MaxRows*MaxCols];
+  std::vector<double> heap_;
+  double* data_;
+public:
+  SmallMatrix(int rows = MaxRows, int cols = MaxCols) : rows_(rows), cols_(cols), data_(fixed_) {
+    if (rows > MaxRows || cols > MaxCols) { heap_.resize(rows*cols); data_ = &heap_[0]; }
+    for (int i = 0; i < rows*cols; i++) data_[i] = 0.;
+  }
+  SmallMatrix(const SmallMatrix& other) : rows_(other.rows_), cols_(other.cols_), heap_(other.heap_), data_(heap_.empty() ? fixed_ : &heap_[0]) {
+    if (heap_.empty()) for (int i = 0; i < rows_*cols_; i++) fixed_[i] = other.fixed_[i];
+  }
+  SmallMatrix& operator=(const SmallMatrix& other) {
+    if (this == &other) return *this;
+    rows_ = other.rows_;
+    cols_ = other.cols_;
+    heap_ = other.heap_;
+    data_ = heap_.empty() ? fixed_ : &heap_[0];
+    if (heap_.empty()) for (int i = 0; i < rows_*cols_; i++) fixed_[i] = other.fixed_[i];
+    return *this;
+  }
+
+  int rows() const { return rows_; }
+  int cols() const { return cols_; }
+  double& operator()(int r, int c) { return data_[r*cols_ + c]; }
+  double operator()(int r, int c) const { return data_[r*cols_ + c]; }
+};
+
+namespace SmallMatrixOps {
+
+/**
+ * Cholesky decomposition of a symmetric positive definite matrix, in place: the lower triangle is replaced by L, with A = L * L^T.
+ * Only the lower triangle of the input is read.
+ * @return False if the matrix is not positive definite
+ */
+template<int N>
+bool cholesky(SmallMatrix<N, N>& a) {
+  int n = a.rows();
+  for (int j = 0; j < n; j++) {
+    double d = a(j, j);
+    for (int k = 0; k < j; k++) d -= a(j, k)*a(j, k);
+    if (!(d > 0.)) return false;
+    d = sqrt(d);
+    a(j, j) = d;
+    for (int i = j + 1; i < n; i++) {
+      double s = a(i, j);
+      for (int k = 0; k < j; k++) s -= a(i, k)*a(j, k);
+      a(i, j) = s/d;
+    }
+  }
+  return true;
+}
+
+/**
+ * Solves L * Y = B in place (B is replaced by Y), L being the lower triangle of a Cholesky decomposition.
+ */
+template<int N, int K>
+void forwardSubstitute(const SmallMatrix<N, N>& l, SmallMatrix<N, K>& b) {
+  int n = l.rows();
+  for (int c = 0; c < b.cols(); c++) {
+    for (int i = 0; i < n; i++) {
+      double s = b(i, c);
+      for (int k = 0; k < i; k++) s -= l(i, k)*b(k, c);
+      b(i, c) = s/l(i, i);
+    }
+  }
+}
+
+/**
+ * Computes D^T * A^-1 * D for a symmetric positive definite A, without inverting A: with A = L * L^T and L * Y = D, it is Y^T * Y.
+ * @param a The matrix A, overwritten by its Cholesky decomposition
+ * @param d The matrix D, overwritten by Y
+ * @param result The K x K result
+ * @return False if A is not positive definite
+ */
+template<int N, int K>
+bool weightedProduct(SmallMatrix<N, N>& a, SmallMatrix<N, K>& d, SmallMatrix<K, K>& result) {
+  if (!cholesky(a)) return false;
+  forwardSubstitute(a, d);
+  for (int i = 0; i < d.cols(); i++) {
+    for (int j = 0; j <= i; j++) {
+      double s = 0.;
+      for (int k = 0; k < d.rows(); k++) s += d(k, i)*d(k, j);
+      result(i, j) = s;
+      result(j, i) = s;
+    }
+  }
+  return true;
+}
+
+/**
+ * Computes the diagonal of the inverse of a symmetric positive definite matrix: with A = L * L^T, (A^-1)_ii is the
+ * squared norm of the i-th column of L^-1.
+ * @param a The matrix, which is left untouched
+ * @param diagonal Filled with the a.rows() diagonal elements of the inverse
+ * @return False if the matrix is not positive definite
+ */
+template<int N>
+bool inverseDiagonal(const SmallMatrix<N, N>& a, double* diagonal) {
+  int n = a.rows();
+  SmallMatrix<N, N> l(a);
+  if (!cholesky(l)) return false;
+  SmallMatrix<N, N> inverseL(n, n);
+  for (int i = 0; i < n; i++) inverseL(i, i) = 1.;
+  forwardSubstitute(l, inverseL);
+  for (int i = 0; i < n; i++) {
+    double s = 0.;
+    for (int k = i; k < n; k++) s += inverseL(k, i)*inverseL(k, i);
+    diagonal[i] = s;
+  }
+  return true;
+}
+
+/**
+ * Computes the inverse of a symmetric positive definite matrix: with A = L * L^T, A^-1 = L^-T * L^-1.
+ * @param a The matrix, which is left untouched
+ * @param result Filled with the inverse
+ * @return False if the matrix is not positive definite
+ */
+template<int N>
+bool inverse(const SmallMatrix<N, N>& a, SmallMatrix<N, N>& result) {
+  int n = a.rows();
+  SmallMatrix<N, N> l(a);
+  if (!cholesky(l)) return false;
+  SmallMatrix<N, N> inverseL(n, n);
+  for (int i = 0; i < n; i++) inverseL(i, i) = 1.;
+  forwardSubstitute(l, inverseL);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      double s = 0.;
+      for (int k = i; k < n; k++) s += inverseL(k, i)*inverseL(k, j);
+      result(i, j) = s;
+      result(j, i) = s;
+    }
+  }
+  return true;
+}
+
+}
+
+#endif
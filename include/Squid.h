@@ -35,6 +35,7 @@
 #include <Support.h>
 #include "Materialway.h"
 #include "WeightDistributionGrid.h"
+#include "MaterialVoxelMap.h"
 #include <PixelExtractor.h>
 
 
@@ -84,19 +85,24 @@ namespace insur {
     //bool buildTrackerSystem();
     //bool irradiateTracker();
     bool buildInactiveSurfaces(bool verbose = false);
-    bool buildMaterials(bool verbose = false);
+    bool buildMaterials(bool verbose = false, int threads = 1, double weightBinSize = 0.);
     bool createMaterialBudget(bool verbose = false);
+    bool updateMaterials(bool verbose = false);
+    bool watchMaterials(const std::string& mapFileName, int etaSteps);
     //bool buildFullSystem(bool usher_verbose = false, bool mat_verbose = false);
     bool analyzeNeighbours(std::string graphout = "");
     bool translateFullSystemToXML(std::string xmlout = "");
     bool webOutput = false;
 
     // Functions using rootweb
-    bool analyzeTriggerEfficiency(int tracks, bool detailed);
-    bool pureAnalyzeGeometry(int tracks);
+    bool analyzeTriggerEfficiency(int tracks, bool detailed, int threads = 1);
+    bool pureAnalyzeGeometry(int tracks, int threads = 1, bool phiSymmetry = false, bool analyticCoverage = false);
     bool pureAnalyzeMaterialBudget(int tracks, bool trackingResolution, bool debugResolution);
+    bool exportMaterialMap(const std::string& fileName, int etaSteps, double binSize = 5.);
+    bool exportWeightMap(const std::string& fileName);
     bool reportGeometrySite(bool debugResolution);
     bool reportBandwidthSite();
+    bool reportPileUpSite(const std::string& spectraFile, long crossings, int threads = 1);
     bool reportTriggerProcessorsSite();
     bool reportPowerSite();
     bool reportMaterialBudgetSite(bool debugServices);
@@ -109,7 +115,7 @@ namespace insur {
     void setGeometryFile(std::string geomFile);
     void setHtmlDir(std::string htmlDir);
 
-    void simulateTracks(const po::variables_map& varmap, int seed);
+    void simulateTracks(const po::variables_map& varmap, int seed, int threads = 1);
     void setCommandLine(int argc, char* argv[]);
     void pixelExtraction(std::string xmlout);
     void createAdditionalXmlSite(std::string xmlout);
@@ -157,6 +163,7 @@ namespace insur {
 
     WeightDistributionGrid weightDistributionTracker;
     WeightDistributionGrid weightDistributionPixel;
+    bool weightsFilled;
 
     bool prepareWebsite();
     bool sitePrepared;
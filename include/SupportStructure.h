@@ -57,6 +57,7 @@ namespace material {
     void buildInEndcap(Endcap& endcap);
 
     void updateInactiveSurfaces(InactiveSurfaces& inactiveSurfaces);
+    void populateMaterialProperties(MaterialProperties& materialPropertie) const;
     
   private:
     const double inactiveElementWidth = insur::geom_inactive_volume_width;
@@ -71,7 +72,6 @@ namespace material {
     Direction direction_;
 
     void buildBase();
-    void populateMaterialProperties(MaterialProperties& materialPropertie) const;
     void buildInactiveElementPair(Direction direction, double zStart, double rStart, double length);
 
 
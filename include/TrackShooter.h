@@ -10,38 +10,23 @@
 #include <memory>
 
 
-#include <TRandom3.h>
-#include <TCanvas.h>
-#include <TImage.h>
-#include <TPolyLine.h>
-#include <TPolyLine3D.h>
-#include <TView.h>
-#include <TSystem.h> // CUIDADO: WTF is this?
 #include <TROOT.h>
 #include <TChain.h>
 #include <TFile.h>
-#include <Math/GenVector/DisplacementVector2D.h>
-#include <Math/GenVector/RotationZ.h>
-#include <Math/GenVector/Rotation3D.h>
-#include <Math/GenVector/Transform3D.h>
+#include <TTree.h>
+#include <TRandom.h>
 #include <boost/program_options/variables_map.hpp>
 
 #include <global_funcs.h>
 #include <global_constants.h>
-#include <module.hh>
-#include <PlotDrawer.h>
-#include <Palette.h>
+#include <Tracker.h>
+#include <DetectorModule.h>
+#include <PtErrorAdapter.h>
+#include <CounterRandom.h>
+#include <HelixNavigator.h>
 
 namespace po = boost::program_options;
 
-template<typename T> int getPointOctant(const T& x, const T& y, const T& z) {
-  return (int(x < T(0)) << 2) || (int(x < T(0)) << 1) || int(x < T(0));
-}
-
-typedef ROOT::Math::DisplacementVector2D<ROOT::Math::Cartesian2D<double>,ROOT::Math::DefaultCoordinateSystemTag> XYVector; // CUIDADO The version of ROOT tkLayout is linked with misses this typedef
-
-std::set<int> getModuleOctants(const Module* mod);
-
 
 class ParticleGenerator {
 public:
@@ -211,34 +196,14 @@ struct Hits { // holder struct for TTree export
 
 
 
-struct Helix {
-  double h, k;
-  double R, Rs; // Rs = Radius with sign depending on particle direction
-  double pt;
-  double eta, theta, L;
-  double phi0;
-  double z0;
-  double d0;
-  int dir;
-
-  Helix(double pt_, double eta_, double phi0_, double z0_, double d0_)
-    : pt(pt_), eta(eta_), phi0(phi0_), z0(z0_), d0(d0_) {
-      theta = 2*atan(exp(-eta));
-      R = fabs(pt)/(0.3*insur::magnetic_field) * 1e3;
-      Rs = R*dir + d0;
-      dir = signum(pt);
-      h = -Rs*sin(phi0);
-      k =  Rs*cos(phi0);
-      L = tan(M_PI/2 - theta);
-  }
-};
-
-
-
+/**
+ * The generators of the track parameters: the values are drawn from the random stream of the track.
+ */
 template<class T>
 class Value {
 public:
-  virtual T get() = 0;
+  virtual ~Value() {}
+  virtual T get(CounterRandom::Stream& dice) const = 0;
   virtual std::string toString() const = 0;
 };
 
@@ -247,100 +212,87 @@ class ConstValue : public Value<T> {
   T value_;
 public:
   ConstValue(T value) : value_(value) {}
-  T get() { return value_; }
+  T get(CounterRandom::Stream&) const { return value_; }
   std::string toString() const { return any2str(value_); } 
 };
 
 template<class T>
 class UniformValue : public Value<T> {
-  TRandom& die_;
   T min_, max_;
 public:
-  UniformValue(TRandom& die, T min, T max) : die_(die), min_(min), max_(max) {}
-  T get() { return die_.Uniform(min_, max_); }
+  UniformValue(T min, T max) : min_(min), max_(max) {}
+  T get(CounterRandom::Stream& dice) const { return min_ + (max_ - min_)*dice.Rndm(); }
   std::string toString() const { return any2str(min_) + ":" + any2str(max_); }
 };
 
 template<class T>
 class BinaryValue : public Value<T> {
-  TRandom& die_;
   T value0_, value1_;
 public:
-  BinaryValue(TRandom& die, T value0, T value1) : die_(die), value0_(value0), value1_(value1) {}
-  T get() { return die_.Integer(2) ? value1_ : value0_; }
+  BinaryValue(T value0, T value1) : value0_(value0), value1_(value1) {}
+  T get(CounterRandom::Stream& dice) const { return dice.Rndm() < 0.5 ? value0_ : value1_; }
   std::string toString() const { return any2str(value0_) + "," + any2str(value1_); }
 };
 
-/*
-template<>
-class BinaryValue<bool> : public Value<bool> {
-  TRandom& die_;
-  BinaryValue(TRandom& die) : die_(die) {}
-  bool get() { return die_.Integer(2); }
-  std::string toString() const { return "true|false"; }
-};
-*/
-
+// "a:b" is uniform in [a, b], "a,b" is either a or b, anything else a constant
 template<class T>
-std::auto_ptr<Value<T> > valueFromString(TRandom& die, const std::string& str) {
+std::unique_ptr<Value<T> > valueFromString(const std::string& str) {
   std::vector<std::string> values = split(str, ":,");
-  if (str.find(":") != std::string::npos && values.size() == 2) return std::auto_ptr<Value<T> >(new UniformValue<T>(die, str2any<T>(values[0]), str2any<T>(values[1])));
-  else if (str.find(",") != std::string::npos && values.size() == 2) return std::auto_ptr<Value<T> >(new BinaryValue<T>(die, str2any<T>(values[0]), str2any<T>(values[1])));
-  else return std::auto_ptr<Value<T> >(new ConstValue<T>(str2any<T>(values[0])));
+  if (str.find(":") != std::string::npos && values.size() == 2) return std::unique_ptr<Value<T> >(new UniformValue<T>(str2any<T>(values[0]), str2any<T>(values[1])));
+  else if (str.find(",") != std::string::npos && values.size() == 2) return std::unique_ptr<Value<T> >(new BinaryValue<T>(str2any<T>(values[0]), str2any<T>(values[1])));
+  else return std::unique_ptr<Value<T> >(new ConstValue<T>(str2any<T>(values[0])));
 }
 
 
 
+/**
+ * @class TrackShooter
+ * @brief Simulates the hits of helix tracks in the modules of a tracker, and writes them to a ROOT file for the trigger studies.
+ *
+ * The modules crossed by a track are found by a <i>HelixNavigator</i>.
+ *
+ * The events are simulated in batches on several threads. Every track draws its parameters from its own random stream,
+ * so the output does not depend on the number of threads; the records of a batch are written in event order before the
+ * next batch starts, which bounds the memory used whatever the number of events.
+ */
 class TrackShooter {
-  static const float HIGH_PT_THRESHOLD = 2.;
-
-  double trackerMaxRho_;
-  double barrelMinZ_, barrelMaxZ_;
-
-  std::ostream* output_;
-  const char *FS, *LS;
-
-  std::vector<Module*> allMods_;
-  typedef std::list<BarrelModule*> BarrelModules;   // accessed sequentially. last step in hit localization
-  typedef std::list<EndcapModule*> EndcapModules;
-  typedef std::vector<BarrelModules> BarrelOctants; // these vectors are accessed randomly when the octant of the hit is known (function of the radius/z discovered in the previous step)
-  typedef std::vector<EndcapModules> EndcapOctants;
-  typedef std::map<double, BarrelOctants> BarrelRadii; // first step in hit localization. we fix radius/z and we calculate the rest of the coordinates of a hit
-  typedef std::map<double, EndcapOctants> EndcapZs;
-  BarrelRadii barrelModsByRadius_;
-  EndcapZs endcapModsByZ_;
-
-  TRandom3 die_;
-  std::auto_ptr<Value<double> > eta_, phi0_, z0_, pt_, invPt_;  // auto_ptr because I don't want to be bothered with deletion
-  std::auto_ptr<Value<int> > charge_;
+  static const long tracksPerBatch = 100000;
+
+  struct HitRecord {
+    XYZVector global;
+    double locx, locy;
+    float pterr, hitprob, deltas;
+    PosRef posref;
+  };
+  struct TrackRecord {
+    long eventn, trackn;
+    double eta, phi0, z0, pt;
+    std::vector<HitRecord> hits;
+  };
+  typedef std::vector<PtErrorAdapter> PtErrorAdapters; // one per module and per thread, as they are not const
+
+  HelixNavigator navigator_;
+
+  std::unique_ptr<Value<double> > eta_, phi0_, z0_, pt_, invPt_;
+  std::unique_ptr<Value<int> > charge_;
   bool useInvPt_;
 
   long int numEvents_, numTracksEv_, eventOffset_;
+  int seed_;
   std::string instanceId_;
   std::string tracksDir_;
 
-  int detectCollisionSlanted(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
-  int detectCollisionBarrel(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
-  int detectCollisionEndcap(const Helix& helix, const Polygon3d<4>& poly, std::vector<XYZVector>& collisions);
-
-  XYVector convertToLocalCoords(const XYZVector& globalHit, const BarrelModule* mod) const;
-  XYVector convertToLocalCoords(const XYZVector& globalHit, const EndcapModule* mod) const;
-
-  void shootTracks();
+  void simulateTrack(const Helix& helix, std::vector<HitRecord>& hits, PtErrorAdapters& ptErrors) const;
 
+  void shootTracks(int numThreads);
   void setDefaultParameters();
-
-  void printParameters();
-public:
-  TrackShooter() : trackerMaxRho_(std::numeric_limits<double>::max()), barrelMinZ_(0.), barrelMaxZ_(0.) { setDefaultParameters(); }
-  void setOutput(std::ostream& output, const char* fieldSeparator = "\t", const char* lineSeparator = "\n", bool synced = false);
-  void setTrackerBoundaries(double trackerMaxRho, double barrelMinZ, double barrelMaxZ);  // if not set the tracker is considered infinite in the rho direction and no particle can escape without ever curving back
-  void addModule(Module* module);
-  void shootTracks(long int numEvents, long int numTracksPerEvent, int seed);
-  void shootTracks(const po::variables_map& varmap, int seed);
+  void printParameters(int numThreads);
   void exportGeometryData();
-  //void manualPolygonTestBench();
-  //void moduleTestBench();
+public:
+  TrackShooter() : seed_(0) { setDefaultParameters(); }
+  void setTracker(const Tracker& tracker) { navigator_.setTracker(tracker); }
+  void shootTracks(long int numEvents, long int numTracksPerEvent, int seed, int numThreads = 1);
+  void shootTracks(const po::variables_map& varmap, int seed, int numThreads = 1);
 };
 
 #endif
@@ -16,6 +16,7 @@
 #include "Barrel.h"
 #include "Endcap.h"
 #include "SupportStructure.h"
+#include "ModuleHitIndex.h"
 #include "Visitor.h"
 #include "Visitable.h"
 
@@ -58,6 +59,9 @@ private:
 
   ModuleSetVisitor moduleSetVisitor_;
 
+  ModuleHitIndex hitIndex_;
+  std::vector<Module*> indexedModules_;
+
   PropertyNode<string> barrelNode;
   PropertyNode<string> endcapNode;
   PropertyNodeUnique<string> supportNode;
@@ -107,6 +111,10 @@ public:
   const Modules& modules() const { return moduleSetVisitor_.modules(); }
   Modules& modules() { return moduleSetVisitor_.modules(); }
 
+  void buildHitIndex(double zMargin);
+  const ModuleHitIndex& hitIndex() const { return hitIndex_; }
+  const std::vector<Module*>& indexedModules() const { return indexedModules_; } // same order as modules(), addressed by the hit index candidates
+
   void accept(GeometryVisitor& v) { 
     v.visit(*this); 
     for (auto& b : barrels_) { b.accept(v); }
@@ -1,23 +1,80 @@
 #ifndef WEIGHTDISTRIBUTIONGRID_H
 #define WEIGHTDISTRIBUTIONGRID_H
 
-#include <map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
 
 namespace material {
 
   class MaterialObject;
-  
-  typedef std::map<std::pair<int, int>,double> WeightDistributionGridMapType;
 
-  class WeightDistributionGrid : public WeightDistributionGridMapType {
+  /**
+   * @class WeightDistributionGrid
+   * @brief The grams of material binned in (z, r), with square bins of binDimension mm.
+   *
+   * The bins inside the envelope set with setEnvelope() are stored in a dense array, as long as it has no more than
+   * maxDenseBins bins; the others go to an open-addressing hash table, so a sparse layout or a fine binning only costs
+   * the bins actually filled. fill() bins a whole set of boxes on several threads.
+   */
+  class WeightDistributionGrid {
   public:
+    static const long maxDenseBins = 1L << 24;
+
+    /**
+     * @struct Box
+     * @brief A (z, r) box and the grams spread over it
+     */
+    struct Box {
+      double minZ, minR, maxZ, maxR, grams;
+    };
+
     WeightDistributionGrid(double binDimension);
     virtual ~WeightDistributionGrid() {};
+    void setEnvelope(double minZ, double minR, double maxZ, double maxR);
     void addTotalGrams(double minZ, double minR, double maxZ, double maxR, double length, double surface, const MaterialObject& materialObject);
+    void addGrams(double minZ, double minR, double maxZ, double maxR, double grams);
+    void fill(const std::vector<Box>& boxes, int threads);
+    void merge(const WeightDistributionGrid& other);
+    void clear();
+    bool save(const std::string& fileName) const;
+
     double binDimension() const;
+    double grams(int binIndexZ, int binIndexR) const;
+    bool empty() const;
+    // calls fn(binIndexZ, binIndexR, grams) for every filled bin
+    template<class Function> void forEachBin(Function fn) const;
+
   private:
     double binDimension_;
+    // dense window, in bin indices
+    int firstBinZ_, firstBinR_, binsZ_, binsR_;
+    std::vector<double> dense_;
+    // open-addressing hash table for the bins outside the window, with linear probing
+    std::vector<uint64_t> keys_;
+    std::vector<double> values_;
+    long sparseSize_;
+
+    static const uint64_t emptyKey = uint64_t(1) << 63; // the key of the bin (INT32_MIN, 0), never reached
+    static uint64_t key(int binIndexZ, int binIndexR) { return (uint64_t(uint32_t(binIndexZ)) << 32) | uint32_t(binIndexR); }
+    void addGrams(double minZ, double minR, double maxZ, double maxR, double grams, int fromBinZ, int toBinZ);
+    void add(int binIndexZ, int binIndexR, double grams);
+    void addSparse(uint64_t k, double grams);
+    void growSparse();
   };
+
+  template<class Function> void WeightDistributionGrid::forEachBin(Function fn) const {
+    for (int iZ = 0; iZ < binsZ_; iZ++) {
+      for (int iR = 0; iR < binsR_; iR++) {
+        double grams = dense_[long(iZ) * binsR_ + iR];
+        if (grams != 0) fn(firstBinZ_ + iZ, firstBinR_ + iR, grams);
+      }
+    }
+    for (size_t i = 0; i < keys_.size(); i++) {
+      if (keys_[i] != emptyKey) fn(int32_t(uint32_t(keys_[i] >> 32)), int32_t(uint32_t(keys_[i])), values_[i]);
+    }
+  }
 }
 
 #endif // WEIGHTDISTRIBUTIONGRID_H
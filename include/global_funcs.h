@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <iterator>
 #include <type_traits>
+#include <thread>
 
 template<typename T>
 struct EnumTraits {
@@ -172,4 +173,18 @@ template<class I, class MemFn> inline auto minget2(I begin, I end, MemFn fn) ->
   return min;
 }
 
+// example: parallelFor(0, nTracks, nThreads, [&](int i) { results[i] = shoot(i); }); // fn must be safe to call concurrently
+// iterations i, i+numThreads, i+2*numThreads... run on the same thread, fn is called in order on the calling thread if numThreads <= 1
+template<class Function> void parallelFor(int begin, int end, int numThreads, Function fn) {
+  if (numThreads <= 1 || end - begin <= 1) {
+    for (int i = begin; i < end; i++) fn(i);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads && begin + t < end; t++) {
+    workers.push_back(std::thread([=]() { for (int i = begin + t; i < end; i += numThreads) fn(i); }));
+  }
+  for (auto& w : workers) w.join();
+}
+
 #endif
@@ -12,9 +12,10 @@
 #include <MaterialProperties.h>
 #include <cmath>
 #include <vector>
-#include <TMatrixT.h>
-#include <TMatrixTSym.h>
+#include <mutex>
+#include <SmallMatrix.h>
 #include <messageLogger.h>
+#include <CounterRandom.h>
 
 
 #include <TFile.h>
@@ -128,16 +129,29 @@ bool sortSmallerR(Hit* h1, Hit* h2);
  * radiation and interaction length from the hits as a basis for the calculations.
  */
 class Track {
+public:
+  // The resolution estimators: the global fit with the full hit correlation matrix, the hit by hit information filter, or both
+  enum ErrorBackend { GlobalFit, KalmanFilter, Validation };
+
+  // The state of the Kalman filter after the measurement of an active hit, given this hit and the ones outside it
+  struct FilterState {
+    int hit;                          // position of the hit in the track
+    double radius;
+    bool validRphi, validRZ;          // false as long as the hits seen do not constrain the whole state
+    SmallMatrix<3, 3> covarianceRphi; // (rho, drphi/dr, rphi) at the hit radius
+    SmallMatrix<2, 2> covarianceRZ;   // (dz/dr, z) at the hit radius
+  };
 protected:
   double theta_;
   double phi_;
   double cotgTheta_, eta_; // calculated from theta and then cached
   std::vector<Hit*> hitV_;
   // Track resolution as a function of momentum
-  TMatrixTSym<double> correlations_;
-  TMatrixT<double> covariances_;
-  TMatrixTSym<double> correlationsRZ_;
-  TMatrixT<double> covariancesRZ_;
+  static const int MaxHits = 32; // the error propagation allocates nothing up to this number of active hits
+  typedef SmallMatrix<MaxHits, MaxHits> HitMatrix;
+  typedef SmallMatrix<2*MaxHits, 1> HitVector;
+  SmallMatrix<3, 3> covariances_;   // of the track parameters, filled by the global fit only (zero with the Kalman filter)
+  SmallMatrix<2, 2> covariancesRZ_; // ditto
   double deltarho_;
   double deltaphi_;
   double deltad_;
@@ -145,10 +159,31 @@ protected:
   double deltaZ0_;
   double deltaP_;
   void computeLocalResolution();
-  void computeCorrelationMatrixRZ();
-  void computeCovarianceMatrixRZ();
-  void computeCorrelationMatrix();
-  void computeCovarianceMatrix();
+  void computeCorrelationMatrixRZ(HitMatrix& correlations);
+  bool computeCovarianceMatrixRZ(HitMatrix& correlations);
+  void computeCorrelationMatrix(HitMatrix& correlations);
+  bool computeCovarianceMatrix(HitMatrix& correlations);
+  void computeErrorsRZ(HitMatrix& correlations);
+  void computeErrorsRphi(HitMatrix& correlations);
+  void setErrorsRZ(const double* inverseDiagonal);
+  void setErrorsRphi(const double* inverseDiagonal);
+  void computeErrorsGlobalFit();
+  void computeErrorsKalman();
+  void validateErrors();
+  friend class MomentumSweep;
+
+  std::vector<FilterState> filterStates_;
+  static ErrorBackend errorBackend_;
+  static double validationTolerance_;
+  // The disagreements between the resolution backends found by validateErrors, until reportValidation
+  struct ValidationSummary {
+    long tracks;
+    long disagreements[6];
+    double worstDifference[6]; // relative to the global fit
+    double worstEta[6], worstPt[6];
+  };
+  static ValidationSummary validation_;
+  static std::mutex validationMutex_;
   
   std::set<std::string> tags_;
   double transverseMomentum_;
@@ -166,8 +201,7 @@ public:
   double getCotgTheta() const { return cotgTheta_; } // ditto here
   double setPhi(double& newPhi);
   double getPhi() const {return phi_;}
-  TMatrixTSym<double>& getCorrelations() { return correlations_; }
-  TMatrixT<double>& getCovariances() { return covariances_; }
+  const SmallMatrix<3, 3>& getCovariances() const { return covariances_; }
   const double& getDeltaRho() const { return deltarho_; }
   const double& getDeltaPhi() const { return deltaphi_; }
   const double& getDeltaD() const { return deltad_; }
@@ -179,6 +213,10 @@ public:
   const std::set<std::string>& tags() const { return tags_; }
   void sort();
   void computeErrors();
+  const std::vector<FilterState>& filterStates() const { return filterStates_; } // only filled by the Kalman filter, outermost hit first
+  static void setErrorBackend(ErrorBackend backend, double validationTolerance = 1e-6) { errorBackend_ = backend; validationTolerance_ = validationTolerance; }
+  static ErrorBackend errorBackend() { return errorBackend_; }
+  static void reportValidation();
   void printErrors();
   void print();
   void removeMaterial();
@@ -186,6 +224,7 @@ public:
   std::vector<double> hadronActiveHitsProbability(bool usePixels = false);
   double hadronActiveHitsProbability(int nHits, bool usePixels = false);
   void addEfficiency(double efficiency, bool alsoPixel = false);
+  void addEfficiency(double efficiency, bool alsoPixel, CounterRandom::Stream& dice);
   void keepTriggerOnly();
   void keepTaggedOnly(const string& tag);
   void setTriggerResolution(bool isTrigger);
@@ -205,4 +244,22 @@ public:
 
   void pruneHits();
 };
+
+/**
+ * @class MomentumSweep
+ * @brief The errors of copies of a track at several momenta, from one set-up of its correlation matrices.
+ *
+ * Only the multiple scattering terms of the correlation matrices are costly (cubic in the number of hits), and they scale as 1/pT^2:
+ * they are computed once for the whole track. The errors at each momentum then only need the hit resolutions on the diagonal
+ * and two small Cholesky solves.
+ */
+class MomentumSweep {
+  int numHits_;
+  bool prefixPruning_;              // false if the hits are not sorted by radius: computeErrors then falls back to Track::computeErrors
+  std::vector<int> active_;         // the positions of the active hits
+  std::vector<double> scatteringRphi_, scatteringRZ_; // the scattering terms at pT = 1 GeV/c, between active hits
+public:
+  MomentumSweep(const Track& track);
+  void computeErrors(Track& prunedTrack, bool withMaterial) const;
+};
 #endif
@@ -72,6 +72,8 @@ class ptError {
    double getR() const { return Module_r ; }
    double getDistance() const { return Module_d ; }
    double getHeight() const { return Module_h ; }
+   double getEffectiveDistance() const { return Module_ed ; }
+   double getTilt() const { return Module_tilt ; }
    ZCorrelation getZCorrelation() const { return zCorrelation; }
    int getModuleType() const { return moduleType ; }
    int getEndcapType() { return endcapType ; }
@@ -0,0 +1,181 @@
+#include "AnalyticCoverage.h"
+#include "DetectorModule.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+/**
+ * Projects the base polygon of a module into the (eta, phi) plane.
+ * @param m The module
+ * @param z0 The z of the track origin
+ * @return The outline, with the phis relative to the one of the module center
+ */
+AnalyticCoverage::Projection AnalyticCoverage::project(const DetectorModule& m, double z0) {
+  const Polygon3d<4>& poly = m.basePoly();
+  XYZVector origin(0, 0, z0);
+  Projection p;
+  p.centerPhi = (poly.getCenter() - origin).Phi();
+  p.minEta = std::numeric_limits<double>::max();
+  p.maxEta = -std::numeric_limits<double>::max();
+  for (int i = 0; i < 4; i++) {
+    const XYZVector& v0 = poly.getVertex(i);
+    const XYZVector& v1 = poly.getVertex((i+1) % 4);
+    for (int s = 0; s < edgeSteps; s++) {
+      XYZVector d = v0 + (v1 - v0)*(s/double(edgeSteps)) - origin;
+      double eta = d.Eta();
+      p.eta.push_back(eta);
+      p.phi.push_back(remainder(d.Phi() - p.centerPhi, 2*M_PI));
+      p.minEta = MIN(p.minEta, eta);
+      p.maxEta = MAX(p.maxEta, eta);
+    }
+  }
+  return p;
+}
+
+/**
+ * Builds the outlines of the modules.
+ * @param modules The modules
+ * @param types The type index of each module, in [0, numTypes)
+ * @param groups The group index of each module, in [0, numGroups)
+ * @param zError The half length of the luminous region
+ * @param zSteps The number of track origins the luminous region is sampled with
+ */
+void AnalyticCoverage::build(const std::vector<const DetectorModule*>& modules, const std::vector<int>& types, int numTypes,
+                             const std::vector<int>& groups, int numGroups, double zError, int zSteps) {
+  types_ = types;
+  groups_ = groups;
+  numTypes_ = numTypes;
+  numGroups_ = numGroups;
+  if (zError <= 0.) zSteps = 1;
+  projections_.assign(zSteps, std::vector<Projection>());
+  for (int iz = 0; iz < zSteps; iz++) {
+    double z0 = zError * (-1. + (2.*iz + 1.)/zSteps); // midpoints of [-zError, zError]
+    projections_[iz].reserve(modules.size());
+    for (const DetectorModule* m : modules) projections_[iz].push_back(project(*m, z0));
+  }
+}
+
+/**
+ * Finds the phi intervals an outline covers at a given eta, in [-pi, pi).
+ */
+void AnalyticCoverage::crossings(const Projection& p, double eta, std::vector<PhiInterval>& intervals) {
+  std::vector<double> phis;
+  int n = p.eta.size();
+  for (int i = 0; i < n; i++) {
+    int j = (i+1) % n;
+    if ((p.eta[i] <= eta) == (p.eta[j] <= eta)) continue;
+    double t = (eta - p.eta[i])/(p.eta[j] - p.eta[i]);
+    phis.push_back(p.phi[i] + t*(p.phi[j] - p.phi[i]));
+  }
+  std::sort(phis.begin(), phis.end());
+  for (unsigned int k = 0; k + 1 < phis.size(); k += 2) {
+    double low = remainder(p.centerPhi + phis[k], 2*M_PI);
+    double high = low + phis[k+1] - phis[k];
+    if (low == M_PI) { low -= 2*M_PI; high -= 2*M_PI; }
+    if (high > M_PI) {
+      intervals.push_back(std::make_pair(low, M_PI));
+      intervals.push_back(std::make_pair(-M_PI, high - 2*M_PI));
+    } else {
+      intervals.push_back(std::make_pair(low, high));
+    }
+  }
+}
+
+double AnalyticCoverage::unionLength(std::vector<PhiInterval>& intervals) {
+  std::sort(intervals.begin(), intervals.end());
+  double length = 0.;
+  double high = -M_PI;
+  for (const auto& i : intervals) {
+    if (i.second <= high) continue;
+    length += i.second - MAX(i.first, high);
+    high = i.second;
+  }
+  return length;
+}
+
+/**
+ * Computes the coverage figures at a given eta.
+ * @param eta The track eta
+ * @param phiBins The number of bins of the phi distribution of the hits
+ * @return The mean number of hit modules (total, per type and per phi bin) and the group coverages
+ */
+AnalyticCoverage::Scan AnalyticCoverage::scan(double eta, int phiBins) const {
+  Scan result;
+  result.typeHits.assign(numTypes_, 0.);
+  result.groupCoverage.assign(numGroups_, 0.);
+  result.phiHits.assign(phiBins, 0.);
+  double phiWidth = 2*M_PI/phiBins;
+  double norm = 1./(2*M_PI*projections_.size());
+
+  std::vector<PhiInterval> intervals;
+  std::vector<std::vector<PhiInterval> > groupIntervals(numGroups_);
+  for (const auto& projections : projections_) {
+    for (auto& g : groupIntervals) g.clear();
+    for (unsigned int m = 0; m < projections.size(); m++) {
+      const Projection& p = projections[m];
+      if (eta < p.minEta || eta > p.maxEta) continue;
+      intervals.clear();
+      crossings(p, eta, intervals);
+      for (const auto& i : intervals) {
+        double length = i.second - i.first;
+        result.hits += length * norm;
+        result.typeHits[types_[m]] += length * norm;
+        groupIntervals[groups_[m]].push_back(i);
+        int firstBin = MAX(0, int((i.first + M_PI)/phiWidth));
+        int lastBin = MIN(phiBins - 1, int((i.second + M_PI)/phiWidth));
+        for (int b = firstBin; b <= lastBin; b++) {
+          double overlap = MIN(i.second, -M_PI + (b+1)*phiWidth) - MAX(i.first, -M_PI + b*phiWidth);
+          if (overlap > 0.) result.phiHits[b] += overlap/phiWidth/projections_.size();
+        }
+      }
+    }
+    for (int g = 0; g < numGroups_; g++) result.groupCoverage[g] += unionLength(groupIntervals[g]) * norm;
+  }
+  return result;
+}
+
+/**
+ * The area of an outline within an eta band: the outline is clipped to the band, then the shoelace formula is applied.
+ */
+double AnalyticCoverage::area(const Projection& p, double minEta, double maxEta) {
+  std::vector<std::pair<double, double> > poly; // (phi, eta)
+  for (unsigned int i = 0; i < p.eta.size(); i++) poly.push_back(std::make_pair(p.phi[i], p.eta[i]));
+  for (int side = 0; side < 2; side++) {
+    double limit = side == 0 ? minEta : maxEta;
+    auto inside = [&](const std::pair<double, double>& v) { return side == 0 ? v.second >= limit : v.second <= limit; };
+    std::vector<std::pair<double, double> > clipped;
+    for (unsigned int i = 0; i < poly.size(); i++) {
+      const auto& a = poly[i];
+      const auto& b = poly[(i+1) % poly.size()];
+      if (inside(a)) clipped.push_back(a);
+      if (inside(a) != inside(b)) {
+        double t = (limit - a.second)/(b.second - a.second);
+        clipped.push_back(std::make_pair(a.first + t*(b.first - a.first), limit));
+      }
+    }
+    poly.swap(clipped);
+  }
+  double twiceArea = 0.;
+  for (unsigned int i = 0; i < poly.size(); i++) {
+    const auto& a = poly[i];
+    const auto& b = poly[(i+1) % poly.size()];
+    twiceArea += a.first*b.second - b.first*a.second;
+  }
+  return fabs(twiceArea)/2.;
+}
+
+/**
+ * Computes the fraction of the tracks hitting each module, for tracks flat in phi and in eta within [minEta, maxEta].
+ * @param minEta The lowest track eta
+ * @param maxEta The highest track eta
+ * @return The fractions, in the module order
+ */
+std::vector<double> AnalyticCoverage::acceptance(double minEta, double maxEta) const {
+  std::vector<double> result(projections_.empty() ? 0 : projections_.front().size(), 0.);
+  double norm = 1./(2*M_PI*(maxEta - minEta)*projections_.size());
+  for (const auto& projections : projections_) {
+    for (unsigned int m = 0; m < projections.size(); m++) result[m] += area(projections[m], minEta, maxEta) * norm;
+  }
+  return result;
+}
@@ -11,6 +11,8 @@
 
 #include "AnalyzerVisitors/MaterialBillAnalyzer.h"
 #include <Units.h>
+#include <PhiSymmetry.h>
+#include <AnalyticCoverage.h>
 
 #undef MATERIAL_SHADOW
 
@@ -68,6 +70,7 @@ namespace insur {
     geomLiteEC         = nullptr; geomLiteECCreated=false;
     geometryTracksUsed = 0;
     materialTracksUsed = 0;
+    pileUpCrossings_ = 0;
   }
 
   // private
@@ -83,22 +86,22 @@ namespace insur {
                                  double& eta, double& theta, double& phi, Track& track) {
     Material totalMaterial;
     //      active volumes, barrel
-    totalMaterial  = findHitsModules(mb.getBarrelModuleCaps(), eta, theta, phi, track);
+    totalMaterial  = findHitsModules(mb.getBarrelModuleCaps(), eta, theta, phi, track, false, &mb.getBarrelModuleCapIndex());
     //      active volumes, endcap
-    totalMaterial += findHitsModules(mb.getEndcapModuleCaps(), eta, theta, phi, track);
+    totalMaterial += findHitsModules(mb.getEndcapModuleCaps(), eta, theta, phi, track, false, &mb.getEndcapModuleCapIndex());
     //      services, barrel
-    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces().getBarrelServices(), eta, theta, track);
+    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::BarrelServices, eta, theta, track);
     //      services, endcap
-    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces().getEndcapServices(), eta, theta, track);
+    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::EndcapServices, eta, theta, track);
     //      supports
-    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track);
+    totalMaterial += findHitsInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track);
     //      pixels, if they exist
     if (pm != NULL) {
-      totalMaterial += findHitsModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, true);
-      totalMaterial += findHitsModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, true);
-      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces().getBarrelServices(), eta, theta, track, true);
-      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces().getEndcapServices(), eta, theta, track, true);
-      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces().getSupports(), eta, theta, track, true);
+      totalMaterial += findHitsModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, true, &pm->getBarrelModuleCapIndex());
+      totalMaterial += findHitsModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, true, &pm->getEndcapModuleCapIndex());
+      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::BarrelServices, eta, theta, track, true);
+      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::EndcapServices, eta, theta, track, true);
+      totalMaterial += findHitsInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, true);
     }
     return totalMaterial;
   }
@@ -157,9 +160,10 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
   std::map<std::string, TrackCollectionMap> taggedTrackPtCollectionMapIdeal;
   std::map<std::string, TrackCollectionMap> taggedTrackPCollectionMapIdeal;
 
+  CounterRandom dice(MY_RANDOM_SEED, CounterRandom::TAGGED_TRACKING);
 
   for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-    phi = myDice.Rndm() * M_PI * 2.0;
+    phi = dice.stream(i_eta).Rndm() * M_PI * 2.0;
     Material tmp;
     Track track;
     eta = i_eta * etaStep;
@@ -196,6 +200,8 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
         track.setTriggerResolution(true); // TODO: remove this (?)
 
         if (efficiency!=1) track.addEfficiency(efficiency, false);
+        // The scattering terms are set up once for all the momenta
+        MomentumSweep sweep(track);
         // For each momentum/transverse momentum compute the tracks error
         for (const auto& pIter : momenta ) {
           int    parameter = pIter * 1000; // Store p or pT in MeV as int (key to the map)
@@ -209,7 +215,7 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
           trackPt.setTransverseMomentum(pT);        
           trackPt.pruneHits();                // Remove hits from a track that is not able to reach a given radius due to its limited momentum
           if (trackPt.nActiveHits(true)>=3) { // Only keep tracks which have minimum 3 active hits
-            trackPt.computeErrors();
+            sweep.computeErrors(trackPt, true);
             TrackCollectionMap &myMap     = taggedTrackPtCollectionMap[tag];
             TrackCollection &myCollection = myMap[parameter];
             myCollection.push_back(trackPt);
@@ -219,7 +225,7 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
           Track idealTrackPt(trackPt);
           idealTrackPt.removeMaterial(); 
           if (idealTrackPt.nActiveHits(true)>=3) { // Only keep tracks which have minimum 3 active hits
-            idealTrackPt.computeErrors();
+            sweep.computeErrors(idealTrackPt, false);
             TrackCollectionMap &myMapIdeal     = taggedTrackPtCollectionMapIdeal[tag];
             TrackCollection &myCollectionIdeal = myMapIdeal[parameter];
             myCollectionIdeal.push_back(idealTrackPt);
@@ -233,7 +239,7 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
           trackP.setTransverseMomentum(pT);
           trackP.pruneHits();                // Remove hits from a track that is not able to reach a given radius due to its limited momentum
           if (trackP.nActiveHits(true)>=3) { // Only keep tracks which have minimum 3 active hits
-            trackP.computeErrors();
+            sweep.computeErrors(trackP, true);
             TrackCollectionMap &myMapII     = taggedTrackPCollectionMap[tag];
             TrackCollection &myCollectionII = myMapII[parameter];
             myCollectionII.push_back(trackP);
@@ -243,7 +249,7 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
           Track idealTrackP(trackP);
           idealTrackP.removeMaterial();
           if (idealTrackP.nActiveHits(true)>=3) { // Only keep tracks which have minimum 3 active hits
-            idealTrackP.computeErrors();
+            sweep.computeErrors(idealTrackP, false);
             TrackCollectionMap &myMapIdealII     = taggedTrackPCollectionMapIdeal[tag];
             TrackCollection &myCollectionIdealII = myMapIdealII[parameter];
             myCollectionIdealII.push_back(idealTrackP);
@@ -253,6 +259,8 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
     }
   }
 
+  if (Track::errorBackend() == Track::Validation) Track::reportValidation();
+
   if (!isPixel) {
     // Momentum = Pt
     for (/*const*/ auto& ttcmIt : taggedTrackPtCollectionMap) {
@@ -308,18 +316,20 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
    * @param tracker 
    * @param thresholdProbabilities
    * @param etaSteps The number of wedges in the fan of tracks covered by the eta scan
+   * @param nThreads The number of threads the tracks are traced on (the results do not depend on it)
    */
   void Analyzer::analyzeTriggerEfficiency(Tracker& tracker,
                                           const std::vector<double>& triggerMomenta,
                                           const std::vector<double>& thresholdProbabilities,
-                                          int etaSteps) {
+                                          int etaSteps,
+                                          int nThreads) {
 
     double efficiency = simParms().efficiency();
 
     materialTracksUsed = etaSteps;
 
     int nTracks;
-    double etaStep, z0, eta, theta, phi;
+    double etaStep;
     double zError = simParms().zErrorCollider();
 
     // prepare etaStep, phiStep, nTracks, nScans
@@ -329,40 +339,46 @@ void Analyzer::createTaggedTrackCollection(std::vector<MaterialBudget*> material
 
     prepareTriggerPerformanceHistograms(nTracks, getEtaMaxTrigger(), triggerMomenta, thresholdProbabilities);
 
-    // reset the list of tracks
-    std::vector<Track> tv;
-
-    // Loop over nTracks (eta range [0, getEtaMaxTrigger()])
-    for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-      phi = myDice.Rndm() * M_PI * 2.0;
-      z0 = myDice.Gaus(0, zError);
-      int nHits;
-      Track track;
-      eta = i_eta * etaStep;
-      theta = 2 * atan(exp(-eta));
-      track.setTheta(theta);      
-      track.setPhi(phi);
-
-      nHits = findHitsModules(tracker, z0, eta, theta, phi, track);
-
-      if (nHits) {
-        // Keep only triggering hits
-        // std::cerr << "Material before = " << track.getCorrectedMaterial().radiation;
-        track.keepTriggerOnly();
-        track.sort();
-        track.setTriggerResolution(true);
-
-        // std::cerr << " material after = " << track.getCorrectedMaterial().radiation << std::endl;
+    CounterRandom dice(MY_RANDOM_SEED, CounterRandom::TRIGGER_EFFICIENCY);
+
+    // Shoot the tracks by blocks: the tracks of a block are traced and their triggering points computed on nThreads threads,
+    // then their summaries are filled in the plots in the track order, so that the results do not depend on nThreads
+    static const int tracksPerBlock = 1024;
+    std::vector<TriggerTrackSummary> blockSummaries;
+    for (int blockBegin = 0; blockBegin < nTracks; blockBegin += tracksPerBlock) {
+      int blockSize = MIN(tracksPerBlock, nTracks - blockBegin);
+      blockSummaries.assign(blockSize, TriggerTrackSummary());
+      parallelFor(0, blockSize, nThreads, [&](int k) {
+        // Loop over nTracks (eta range [0, getEtaMaxTrigger()])
+        int i_eta = blockBegin + k;
+        CounterRandom::Stream trackDice = dice.stream(i_eta);
+        double phi = trackDice.Rndm() * M_PI * 2.0;
+        double z0 = trackDice.Gaus(0, zError);
+        double eta = i_eta * etaStep;
+        double theta = 2 * atan(exp(-eta));
+        Track track;
+        track.setTheta(theta);      
+        track.setPhi(phi);
+
+        if (findHitsModules(tracker, z0, eta, theta, phi, track)) {
+          // Keep only triggering hits
+          track.keepTriggerOnly();
+          track.sort();
+          track.setTriggerResolution(true);
+
+          if (efficiency!=1) track.addEfficiency(efficiency, false, trackDice);
+          if (track.nActiveHits(true)>0) { // At least 3 points are needed to measure the arrow
+            summarizeTriggerTrack(track, triggerMomenta, blockSummaries[k]);
+          }    
+        }
+      });
 
-        if (efficiency!=1) track.addEfficiency(efficiency, false);
-        if (track.nActiveHits(true)>0) { // At least 3 points are needed to measure the arrow
-          tv.push_back(track);
-        }    
-      }
+      // Compute the number of triggering points along the selected tracks
+      fillTriggerEfficiencyGraphs(triggerMomenta, blockSummaries, nTracks);
     }
 
-    // Compute the number of triggering points along the selected tracks
-    fillTriggerEfficiencyGraphs(tracker, triggerMomenta, tv);
+    TProfile& totalProfile = myProfileBag.getProfiles(profileBag::TriggerProfile|profileBag::TriggeredProfile)[profileBag::Triggerable];
+    if (totalProfile.GetMaximum() < maximum_n_planes) totalProfile.SetMaximum(maximum_n_planes);
 
     // Fill the trigger performance maps
     fillTriggerPerformanceMaps(tracker);
@@ -413,9 +429,54 @@ void Analyzer::createTriggerDistanceTuningPlots(Tracker& tracker, const std::vec
 
 
 
-void Analyzer::fillTriggerEfficiencyGraphs(const Tracker& tracker,
-                                           const std::vector<double>& triggerMomenta,
-                                           const std::vector<Track>& trackVector) {
+/**
+ * Computes the figures of a trigger track filled in the trigger efficiency plots: its expected number of triggering
+ * points, and the true and fake trigger rates along it, for each trigger momentum. The tracker is only read, so that
+ * several tracks can be summarized at once.
+ */
+void Analyzer::summarizeTriggerTrack(const Track& track, const std::vector<double>& triggerMomenta, TriggerTrackSummary& summary) const {
+  summary.triggering = true;
+  summary.eta = track.getEta();
+  summary.nHits = track.nActiveHits(false, false);
+  std::vector<std::pair<Module*,HitType>> hitModules = track.getHitModules();
+
+  for (const auto& modAndType : hitModules) {
+    Module* hitModule = modAndType.first;
+    if (modAndType.second == HitType::STUB) summary.stubLayers.push_back(hitModule->uniRef().cnt + "_" + any2str(hitModule->uniRef().layer));
+  }
+
+  for (double momentum : triggerMomenta) {
+    double nExpectedTriggerPoints = track.expectedTriggerPoints(momentum);
+    double curAvgTrue=0;
+    double curAvgFake=0;
+    if ((nExpectedTriggerPoints>=0) && (summary.nHits>0)) { // sanity check (! nan)
+      double bgReductionFactor; // Reduction of the combinatorial background for ptPS modules by turning off the appropriate pixels
+      for (const auto& modAndType : hitModules) {
+        Module* hitModule = modAndType.first;
+        PtErrorAdapter pterr(*hitModule);
+        // Hits that we would like to have from tracks above this threshold are only seen as these
+        curAvgTrue += pterr.getTriggerFrequencyTruePerEventAbove(momentum);
+
+        // The background is given by the contamination from low pT tracks...
+        curAvgFake += pterr.getTriggerFrequencyTruePerEventBelow(momentum);
+        // ... plus the combinatorial background from occupancy (can be reduced using ptPS modules)
+        if (hitModule->reduceCombinatorialBackground()) bgReductionFactor = hitModule->geometricEfficiency(); else bgReductionFactor=1;
+        curAvgFake += pterr.getTriggerFrequencyFakePerEvent()*simParms().numMinBiasEvents() * bgReductionFactor;
+      }
+    }
+    summary.expectedPoints.push_back(nExpectedTriggerPoints);
+    summary.trueRates.push_back(curAvgTrue);
+    summary.fakeRates.push_back(curAvgFake);
+  }
+}
+
+/**
+ * Fills the trigger efficiency plots with the summaries of a block of tracks.
+ * @param nTracks The number of tracks of the whole analysis, which is the number of bins of the stub coverage plots
+ */
+void Analyzer::fillTriggerEfficiencyGraphs(const std::vector<double>& triggerMomenta,
+                                           const std::vector<TriggerTrackSummary>& summaries,
+                                           int nTracks) {
 
   // Prepare the graphs to record the number of triggered points
   //std::map<double, TGraph>& trigGraphs = myGraphBag.getGraphs(GraphBag::TriggerGraph|GraphBag::TriggeredGraph);
@@ -429,66 +490,33 @@ void Analyzer::fillTriggerEfficiencyGraphs(const Tracker& tracker,
 
   double maxEta = 4.0; //getEtaMaxTrigger();
 
-  for (std::vector<Track>::const_iterator itTrack = trackVector.begin();
-       itTrack != trackVector.end(); ++itTrack) {
-    const Track& myTrack=(*itTrack);
-
-    double eta = myTrack.getEta();
-    int nHits = myTrack.nActiveHits(false, false);
+  for (const TriggerTrackSummary& summary : summaries) {
+    if (!summary.triggering) continue;
+    double eta = summary.eta;
+    int nHits = summary.nHits;
     totalProfile.Fill(eta, nHits);
-    std::vector<std::pair<Module*,HitType>> hitModules = myTrack.getHitModules();
-
-    for(std::vector<double>::const_iterator itMomentum = triggerMomenta.begin();
-        itMomentum!=triggerMomenta.end(); ++itMomentum) {
-      TProfile& myProfile = trigProfiles[(*itMomentum)];
-      TProfile& myFractionProfile = trigFractionProfiles[(*itMomentum)];
-      TProfile& myPurityProfile = trigPurityProfiles[(*itMomentum)];
-      double nExpectedTriggerPoints = myTrack.expectedTriggerPoints(*itMomentum);
+
+    for (unsigned int iMomentum = 0; iMomentum < triggerMomenta.size(); iMomentum++) {
+      double momentum = triggerMomenta[iMomentum];
+      double nExpectedTriggerPoints = summary.expectedPoints[iMomentum];
       if (nExpectedTriggerPoints>=0) { // sanity check (! nan)
-        myProfile.Fill(eta, nExpectedTriggerPoints);
+        trigProfiles[momentum].Fill(eta, nExpectedTriggerPoints);
         if (nHits>0) {
-          myFractionProfile.Fill(eta, nExpectedTriggerPoints*100/double(nHits));
-           double curAvgTrue=0;
-           double curAvgInteresting=0;
-           double curAvgFake=0;
-           double bgReductionFactor; // Reduction of the combinatorial background for ptPS modules by turning off the appropriate pixels
-           for (const auto& modAndType : hitModules) {
-             Module* hitModule = modAndType.first;
-             PtErrorAdapter pterr(*hitModule);
-             // Hits that we would like to have from tracks above this threshold
-             curAvgInteresting += pterr.getParticleFrequencyPerEventAbove(*itMomentum);
-             // ... out of which we only see these
-             curAvgTrue += pterr.getTriggerFrequencyTruePerEventAbove(*itMomentum);
-               
-             // The background is given by the contamination from low pT tracks...
-             curAvgFake += pterr.getTriggerFrequencyTruePerEventBelow(*itMomentum);
-             // ... plus the combinatorial background from occupancy (can be reduced using ptPS modules)
-             if (hitModule->reduceCombinatorialBackground()) bgReductionFactor = hitModule->geometricEfficiency(); else bgReductionFactor=1;
-             curAvgFake += pterr.getTriggerFrequencyFakePerEvent()*simParms().numMinBiasEvents() * bgReductionFactor;
-
-             std::string layerName = hitModule->uniRef().cnt + "_" + any2str(hitModule->uniRef().layer);
-             if (modAndType.second == HitType::STUB) {
-               std::string momentumString = any2str(*itMomentum, 2);
-               if (stubEfficiencyCoverageProfiles[layerName].count(momentumString) == 0) {
-                 stubEfficiencyCoverageProfiles[layerName][momentumString] = new TH1I(Form("stubEfficiencyCoverageProfile%s%s", layerName.c_str(), momentumString.c_str()), (layerName + ";#eta;Stubs").c_str(), trackVector.size(), 0.0, maxEta); 
-               }
-               stubEfficiencyCoverageProfiles[layerName][momentumString]->Fill(myTrack.getEta(), 1);
-             } 
-           }
-           myPurityProfile.Fill(eta, 100*curAvgTrue/(curAvgTrue+curAvgFake));
+          trigFractionProfiles[momentum].Fill(eta, nExpectedTriggerPoints*100/double(nHits));
+          std::string momentumString = any2str(momentum, 2);
+          for (const std::string& layerName : summary.stubLayers) {
+            if (stubEfficiencyCoverageProfiles[layerName].count(momentumString) == 0) {
+              stubEfficiencyCoverageProfiles[layerName][momentumString] = new TH1I(Form("stubEfficiencyCoverageProfile%s%s", layerName.c_str(), momentumString.c_str()), (layerName + ";#eta;Stubs").c_str(), nTracks, 0.0, maxEta); 
+            }
+            stubEfficiencyCoverageProfiles[layerName][momentumString]->Fill(eta, 1);
+          }
+          double curAvgTrue = summary.trueRates[iMomentum];
+          double curAvgFake = summary.fakeRates[iMomentum];
+          trigPurityProfiles[momentum].Fill(eta, 100*curAvgTrue/(curAvgTrue+curAvgFake));
         }
       }
     }
   }
-//  for (auto i : stubEfficiencyCoverageProfiles) {
-//    std::cout << "--------------------- " << i.first << " ------------------ " << std::endl;
-//    for (auto j : i.second) {
-//      std::cout << j.first << std::endl;
-//      j.second->Print("all");
-//    }
-//  }
-  if (totalProfile.GetMaximum() < maximum_n_planes) totalProfile.SetMaximum(maximum_n_planes);
-
 }
 
 /**
@@ -523,8 +551,10 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
   // std::vector<Track> tv;
   // std::vector<Track> tvIdeal;
 
+  CounterRandom dice(MY_RANDOM_SEED, CounterRandom::MATERIAL_BUDGET);
+
   for (int i_eta = 0; i_eta < nTracks; i_eta++) {
-    phi = myDice.Rndm() * M_PI * 2.0;
+    phi = dice.stream(i_eta).Rndm() * M_PI * 2.0;
     Material tmp;
     Track track;
     eta = i_eta * etaStep;
@@ -533,7 +563,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     track.setPhi(phi);
     //      active volumes, barrel
     std::map<std::string, Material> sumComponentsRI;
-    tmp = analyzeModules(mb.getBarrelModuleCaps(), eta, theta, phi, track, sumComponentsRI);
+    tmp = analyzeModules(mb.getBarrelModuleCaps(), eta, theta, phi, track, sumComponentsRI, false, &mb.getBarrelModuleCapIndex());
     ractivebarrel.Fill(eta, tmp.radiation);
     iactivebarrel.Fill(eta, tmp.interaction);
     rbarrelall.Fill(eta, tmp.radiation);
@@ -544,7 +574,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     iglobal.Fill(eta, tmp.interaction);
 
     //      active volumes, endcap
-    tmp = analyzeModules(mb.getEndcapModuleCaps(), eta, theta, phi, track, sumComponentsRI);
+    tmp = analyzeModules(mb.getEndcapModuleCaps(), eta, theta, phi, track, sumComponentsRI, false, &mb.getEndcapModuleCapIndex());
     ractiveendcap.Fill(eta, tmp.radiation);
     iactiveendcap.Fill(eta, tmp.interaction);
     rendcapall.Fill(eta, tmp.radiation);
@@ -585,7 +615,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
       iComponents["Supports"]->SetBins(nTracks, 0.0, getEtaMaxMaterial()); 
     }
     //      services, barrel
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::BarrelServices, eta, theta, track, MaterialProperties::no_cat);
     rserfbarrel.Fill(eta, tmp.radiation);
     iserfbarrel.Fill(eta, tmp.interaction);
     rbarrelall.Fill(eta, tmp.radiation);
@@ -604,7 +634,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Services"]->Fill(eta, tmp.radiation);
     iComponents["Services"]->Fill(eta, tmp.interaction);
     //      services, endcap
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::EndcapServices, eta, theta, track, MaterialProperties::no_cat);
     rserfendcap.Fill(eta, tmp.radiation);
     iserfendcap.Fill(eta, tmp.interaction);
     rendcapall.Fill(eta, tmp.radiation);
@@ -616,7 +646,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Services"]->Fill(eta, tmp.radiation);
     iComponents["Services"]->Fill(eta, tmp.interaction);
     //      supports, barrel
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::b_sup);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::b_sup);
     rlazybarrel.Fill(eta, tmp.radiation);
     ilazybarrel.Fill(eta, tmp.interaction);
     rbarrelall.Fill(eta, tmp.radiation);
@@ -628,7 +658,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Supports"]->Fill(eta, tmp.radiation);
     iComponents["Supports"]->Fill(eta, tmp.interaction);
     //      supports, endcap
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::e_sup);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::e_sup);
     rlazyendcap.Fill(eta, tmp.radiation);
     ilazyendcap.Fill(eta, tmp.interaction);
     rendcapall.Fill(eta, tmp.radiation);
@@ -640,7 +670,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Supports"]->Fill(eta, tmp.radiation);
     iComponents["Supports"]->Fill(eta, tmp.interaction);
     //      supports, tubes
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::o_sup);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::o_sup);
     rlazytube.Fill(eta, tmp.radiation);
     ilazytube.Fill(eta, tmp.interaction);
     rlazyall.Fill(eta, tmp.radiation);
@@ -650,7 +680,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Supports"]->Fill(eta, tmp.radiation);
     iComponents["Supports"]->Fill(eta, tmp.interaction);
     //      supports, barrel tubes
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::t_sup);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::t_sup);
     rlazybtube.Fill(eta, tmp.radiation);
     ilazybtube.Fill(eta, tmp.interaction);
     rlazyall.Fill(eta, tmp.radiation);
@@ -660,7 +690,7 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     rComponents["Supports"]->Fill(eta, tmp.radiation);
     iComponents["Supports"]->Fill(eta, tmp.interaction);
     //      supports, user defined
-    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::u_sup);
+    tmp = analyzeInactiveSurfaces(mb.getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::u_sup);
     rlazyuserdef.Fill(eta, tmp.radiation);
     ilazyuserdef.Fill(eta, tmp.interaction);
     rlazyall.Fill(eta, tmp.radiation);
@@ -672,11 +702,11 @@ void Analyzer::analyzeMaterialBudget(MaterialBudget& mb, const std::vector<doubl
     //      pixels, if they exist
     if (pm != NULL) {
       std::map<std::string, Material> ignoredPixelSumComponentsRI;
-      analyzeModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
-      analyzeModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getBarrelServices(), eta, theta, track, MaterialProperties::no_cat, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getEndcapServices(), eta, theta, track, MaterialProperties::no_cat, true);
-      analyzeInactiveSurfaces(pm->getInactiveSurfaces().getSupports(), eta, theta, track, MaterialProperties::no_cat, true);
+      analyzeModules(pm->getBarrelModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true, &pm->getBarrelModuleCapIndex());
+      analyzeModules(pm->getEndcapModuleCaps(), eta, theta, phi, track, ignoredPixelSumComponentsRI, true, &pm->getEndcapModuleCapIndex());
+      analyzeInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::BarrelServices, eta, theta, track, MaterialProperties::no_cat, true);
+      analyzeInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::EndcapServices, eta, theta, track, MaterialProperties::no_cat, true);
+      analyzeInactiveSurfaces(pm->getInactiveSurfaces(), InactiveSurfaces::Supports, eta, theta, track, MaterialProperties::no_cat, true);
     }
 
     // Add the hit on the beam pipe
@@ -852,15 +882,15 @@ void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& trac
   Module* myModule;
   //  unsigned int nLocalMasses;
 
-  std::map<std::string, double>::const_iterator localmassesBegin;
-  std::map<std::string, double>::const_iterator localmassesEnd;
+  MassVector::const_iterator localmassesBegin;
+  MassVector::const_iterator localmassesEnd;
 
-  // First create a list of material used anywhere
-  std::vector<std::string> materialTagV;
-  std::vector<std::string>::iterator materialTagIt;
+  // First create a list of material used anywhere (by material or component id)
+  std::vector<int> materialTagV;
+  std::vector<int>::iterator materialTagIt;
 
   double localMaterial;
-  string materialTag;
+  int materialTag;
 
   // loop over layers
   for (layerIt = tracker.begin(); layerIt != tracker.end(); ++layerIt) {
@@ -901,7 +931,7 @@ void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& trac
           localmassesBegin = myModuleCap->getLocalMassesComp().begin();
           localmassesEnd = myModuleCap->getLocalMassesComp().end();
         }
-        for (std::map<std::string, double>::const_iterator it = localmassesBegin; it != localmassesEnd; ++it) {
+        for (MassVector::const_iterator it = localmassesBegin; it != localmassesEnd; ++it) {
           // if (byMaterial) materialTag = myModuleCap->getLocalTag(iLocalMasses); // sort by Material tag
           //  else materialTag = myModuleCap->getLocalTagComp(iLocalMasses);           // sort by Component tag
           materialTag = it->first;
@@ -915,13 +945,13 @@ void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& trac
   }
 
   // Alphabetically sort materials
-  std::sort(materialTagV.begin(), materialTagV.end());
+  std::sort(materialTagV.begin(), materialTagV.end(), [](int a, int b) { return MaterialSymbols::name(a) < MaterialSymbols::name(b); });
 
   // Prepare the columns of the tables
   for (map<string, SummaryTable>::iterator it=result.begin();
        it!=result.end(); ++it) {
     for (unsigned int materialTag_i=0; materialTag_i<materialTagV.size(); ++materialTag_i) {
-      it->second.setCell(materialTag_i+1, 0, materialTagV[materialTag_i]);
+      it->second.setCell(materialTag_i+1, 0, MaterialSymbols::name(materialTagV[materialTag_i]));
     }
     it->second.setCell(materialTagV.size()+1, 0, "Total");
   }
@@ -972,11 +1002,9 @@ void Analyzer::computeDetailedWeights(std::vector<std::vector<ModuleCap> >& trac
             for (unsigned int materialTag_i=0; materialTag_i<materialTagV.size(); ++materialTag_i) {
               materialTag = materialTagV[materialTag_i];
               if (byMaterial) { // table by materials
-                try { localMaterial = myModuleCap->getLocalMass(materialTag); }
-                catch (exception e) { localMaterial = 0; }
+                localMaterial = myModuleCap->getLocalMass(materialTag);
               } else { // table by components
-                try { localMaterial = myModuleCap->getLocalMassComp(materialTag); }
-                catch (exception e) { localMaterial = 0; }
+                localMaterial = myModuleCap->getLocalMassComp(materialTag);
               }
               //cout << materialTag << "\t"
               //<< localMaterial << "\t"
@@ -1023,6 +1051,42 @@ void Analyzer::computeWeightSummary(MaterialBudget& mb) {
   billOfMaterials_ = v.outputTable;
 }
 
+/**
+ * Checks the caps listed by a hit index for collisions with a track, in one batch against the index's packed sensor polygons.
+ * Only the caps on the z+ side are kept, as in the full scan.
+ * @param tr The <i>ModuleCap</i> vector of vectors the index was built on (flattened layer by layer)
+ * @param index The hit index
+ * @param candidates The candidates the index gave for the track
+ * @param origin The origin of the track
+ * @param direction The direction of the track
+ * @param caps Filled with the checked caps, in the order of the full scan
+ * @param hits Filled with the collision check result of each of <i>caps</i>, as given by <i>checkTrackHits()</i>
+ * @param layerEnds Filled with the end position in <i>caps</i> of each layer
+ */
+static void checkCandidateCaps(std::vector<std::vector<ModuleCap> >& tr, const ModuleHitIndex& index, const ModuleHitIndex::Candidates& candidates,
+                               const XYZVector& origin, const XYZVector& direction,
+                               std::vector<ModuleCap*>& caps, std::vector<std::pair<XYZVector, HitType> >& hits, std::vector<int>& layerEnds) {
+  ModuleHitIndex::Candidates reachable;
+  ModuleHitIndex::Candidates::const_iterator cand = candidates.begin();
+  int layerOffset = 0;
+  for (auto& layer : tr) {
+    int layerEnd = layerOffset + layer.size();
+    for (; cand != candidates.end() && *cand < layerEnd; ++cand) {
+      ModuleCap& cap = layer.at(*cand - layerOffset);
+      // collision detection: rays are in z+ only, so consider only modules that lie on that side
+      if (cap.getModule().maxZ() > 0) {
+        reachable.push_back(*cand);
+        caps.push_back(&cap);
+      }
+    }
+    layerEnds.push_back(caps.size());
+    layerOffset = layerEnd;
+  }
+  std::vector<PackedSensorPolygons::SegmentHit> innerHits, outerHits;
+  index.sensorPolygons().checkHitSegments(origin, direction, reachable, innerHits, outerHits);
+  for (unsigned int k = 0; k < caps.size(); k++) hits.push_back(caps[k]->getModule().assignTrackHits(innerHits[k], outerHits[k]));
+}
+
 // protected
 /**
  * The layer-level analysis function for modules forms the frame for sending a single track through the active modules.
@@ -1038,17 +1102,38 @@ void Analyzer::computeWeightSummary(MaterialBudget& mb) {
 Material Analyzer::analyzeModules(std::vector<std::vector<ModuleCap> >& tr,
                                   double eta, double theta, double phi, Track& t, 
                                   std::map<std::string, Material>& sumComponentsRI,
-                                  bool isPixel) {
+                                  bool isPixel, const ModuleHitIndex* index) {
   std::vector<std::vector<ModuleCap> >::iterator iter = tr.begin();
   std::vector<std::vector<ModuleCap> >::iterator guard = tr.end();
   Material res, tmp;
   res.radiation= 0.0;
   res.interaction = 0.0;
-  while (iter != guard) {
-    tmp = findModuleLayerRI(*iter, eta, theta, phi, t, sumComponentsRI, isPixel);
-    res.radiation= res.radiation+ tmp.radiation;
-    res.interaction= res.interaction + tmp.interaction;
-    iter++;
+  XYZVector origin, direction;
+  Polar3DVector dir;
+  dir.SetCoordinates(1, theta, phi);
+  direction = dir;
+  const ModuleHitIndex::Candidates* candidates = index ? index->candidates(origin, direction) : NULL;
+  if (candidates == NULL) {
+    while (iter != guard) {
+      tmp = findModuleLayerRI(*iter, eta, theta, phi, t, sumComponentsRI, isPixel);
+      res.radiation= res.radiation+ tmp.radiation;
+      res.interaction= res.interaction + tmp.interaction;
+      iter++;
+    }
+  } else {
+    // Only the caps listed by the index can be hit: they are checked in one batch, then visited layer by layer in the same order as the full scan
+    std::vector<ModuleCap*> caps;
+    std::vector<std::pair<XYZVector, HitType> > hits;
+    std::vector<int> layerEnds;
+    checkCandidateCaps(tr, *index, *candidates, origin, direction, caps, hits, layerEnds);
+    int k = 0;
+    for (int layerEnd : layerEnds) {
+      tmp.radiation = 0.0;
+      tmp.interaction = 0.0;
+      for (; k < layerEnd; k++) tmp += findModuleCapRI(*caps[k], hits[k], eta, theta, t, sumComponentsRI, isPixel);
+      res.radiation= res.radiation+ tmp.radiation;
+      res.interaction= res.interaction + tmp.interaction;
+    }
   }
   return res;
 }
@@ -1076,11 +1161,9 @@ Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
                                      bool isPixel) {
   std::vector<ModuleCap>::iterator iter = layer.begin();
   std::vector<ModuleCap>::iterator guard = layer.end();
-  Material res, tmp;
+  Material res;
   XYZVector origin, direction;
   Polar3DVector dir;
-  double distance, r;
-  int hits = 0;
   res.radiation = 0.0;
   res.interaction = 0.0;
   // set the track direction vector
@@ -1090,62 +1173,81 @@ Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
     // collision detection: rays are in z+ only, so consider only modules that lie on that side
     // only consider modules that have type BarrelModule or EndcapModule
     if (iter->getModule().maxZ() > 0) {
-        // same method as in Tracker, same function used
-        // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
-        //distance = iter->getModule().trackCross(origin, direction);
-        auto h = iter->getModule().checkTrackHits(origin, direction);
-        if (h.second != HitType::NONE) {
-          distance = h.first.R();
-          HitType type = h.second;
-          // module was hit
-          hits++;
-          r = distance * sin(theta);
-          tmp.radiation = iter->getRadiationLength();
-          tmp.interaction = iter->getInteractionLength();
-
-          Module& m = iter->getModule();
-          double tiltAngle = m.tiltAngle();
-          // 2D material maps
-          fillMapRT(r, theta, tmp);
-          // radiation and interaction length scaling for barrels
-          if (iter->getModule().subdet() == BARREL) {
-            tmp.radiation = tmp.radiation / sin(theta + tiltAngle);
-            tmp.interaction = tmp.interaction / sin(theta + tiltAngle);
-          }
-          // radiation and interaction length scaling for endcaps
-          else {
-            tmp.radiation = tmp.radiation / cos(theta + tiltAngle - M_PI/2);
-            tmp.interaction = tmp.interaction / cos(theta + tiltAngle - M_PI/2);
-          }
-
-          double tmpr = 0., tmpi = 0.;
-
-          std::map<std::string, Material> moduleComponentsRI = iter->getComponentsRI();
-          for (std::map<std::string, Material>::iterator cit = moduleComponentsRI.begin(); cit != moduleComponentsRI.end(); ++cit) {
-            sumComponentsRI[cit->first].radiation += cit->second.radiation / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
-            //if (cit->first == "SupportMechanics") std::cout << eta << " " << distance << " " << cit->second.radiation / sin(theta + tiltAngle) << " " << cit->second.radiation << std::endl;
-            tmpr += sumComponentsRI[cit->first].radiation;
-            sumComponentsRI[cit->first].interaction += cit->second.interaction / (iter->getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
-            tmpi += sumComponentsRI[cit->first].interaction;
-          }
-          // 2D plot and eta plot results
-          if (!isPixel) fillCell(r, eta, theta, tmp);
-          res += tmp;
-          // create Hit object with appropriate parameters, add to Track t
-          Hit* hit = new Hit(distance, &(iter->getModule()), type);
-          //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
-          //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
-          //hit->setObjectKind(Hit::Active); // should not be necessary
-          hit->setCorrectedMaterial(tmp);
-          hit->setPixel(isPixel);
-          t.addHit(hit);
-        }
+      // same method as in Tracker, same function used
+      // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
+      //distance = cap.getModule().trackCross(origin, direction);
+      res += findModuleCapRI(*iter, iter->getModule().checkTrackHits(origin, direction), eta, theta, t, sumComponentsRI, isPixel);
     }
     iter++;
   }
   return res;
 }
 
+/**
+ * Accounts for the collision of the given track with a single module. If it is hit, the radiation and interaction lengths are scaled
+ * with respect to theta and the tilt angle, the component breakdown and the 2D maps are filled and a hit is added to the track.
+ * @param cap A reference to the <i>ModuleCap</i> of the module to be checked
+ * @param h The result of the collision check of the track with the module, as given by <i>checkTrackHits()</i>
+ * @param eta The pseudorapidity of the current track
+ * @param theta The track angle in the yz-plane
+ * @param t A reference to the current track object
+ * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
+ * @return The scaled radiation and interaction lengths of the module, or zero if it was not hit
+ */
+Material Analyzer::findModuleCapRI(ModuleCap& cap, const std::pair<XYZVector, HitType>& h,
+                                   double eta, double theta, Track& t,
+                                   std::map<std::string, Material>& sumComponentsRI,
+                                   bool isPixel) {
+  Material tmp;
+  double distance, r;
+  if (h.second != HitType::NONE) {
+    distance = h.first.R();
+    HitType type = h.second;
+    // module was hit
+    r = distance * sin(theta);
+    tmp.radiation = cap.getRadiationLength();
+    tmp.interaction = cap.getInteractionLength();
+
+    Module& m = cap.getModule();
+    double tiltAngle = m.tiltAngle();
+    // 2D material maps
+    fillMapRT(r, theta, tmp);
+    // radiation and interaction length scaling for barrels
+    if (cap.getModule().subdet() == BARREL) {
+      tmp.radiation = tmp.radiation / sin(theta + tiltAngle);
+      tmp.interaction = tmp.interaction / sin(theta + tiltAngle);
+    }
+    // radiation and interaction length scaling for endcaps
+    else {
+      tmp.radiation = tmp.radiation / cos(theta + tiltAngle - M_PI/2);
+      tmp.interaction = tmp.interaction / cos(theta + tiltAngle - M_PI/2);
+    }
+
+    double tmpr = 0., tmpi = 0.;
+
+    const ComponentsRIVector& moduleComponentsRI = cap.getComponentsRI();
+    for (ComponentsRIVector::const_iterator cit = moduleComponentsRI.begin(); cit != moduleComponentsRI.end(); ++cit) {
+      Material& componentSum = sumComponentsRI[MaterialSymbols::name(cit->first)];
+      componentSum.radiation += cit->second.radiation / (cap.getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
+      //if (cit->first == "SupportMechanics") std::cout << eta << " " << distance << " " << cit->second.radiation / sin(theta + tiltAngle) << " " << cit->second.radiation << std::endl;
+      tmpr += componentSum.radiation;
+      componentSum.interaction += cit->second.interaction / (cap.getModule().subdet() == BARREL ? sin(theta + tiltAngle) : cos(theta + tiltAngle - M_PI/2));
+      tmpi += componentSum.interaction;
+    }
+    // 2D plot and eta plot results
+    if (!isPixel) fillCell(r, eta, theta, tmp);
+    // create Hit object with appropriate parameters, add to Track t
+    Hit* hit = new Hit(distance, &(cap.getModule()), type);
+    //if (cap.getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
+    //else if(cap.getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
+    //hit->setObjectKind(Hit::Active); // should not be necessary
+    hit->setCorrectedMaterial(tmp);
+    hit->setPixel(isPixel);
+    t.addHit(hit);
+  }
+  return tmp;
+}
+
 
 // protected
 /**
@@ -1157,21 +1259,44 @@ Material Analyzer::findModuleLayerRI(std::vector<ModuleCap>& layer,
  * @param phi The track angle in the xy-plane
  * @param t A reference to the current track object
  * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
+ * @param index The hit index built on <i>tr</i>, if any: only the caps it lists are checked
  * @return The summed up radiation and interaction lengths for the given track, bundled into a <i>std::pair</i>
  */
 Material Analyzer::findHitsModules(std::vector<std::vector<ModuleCap> >& tr,
                                    // TODO: add z0 here and in the hit finder for inactive surfaces
-                                   double eta, double theta, double phi, Track& t, bool isPixel) {
+                                   double eta, double theta, double phi, Track& t, bool isPixel,
+                                   const ModuleHitIndex* index) {
   std::vector<std::vector<ModuleCap> >::iterator iter = tr.begin();
   std::vector<std::vector<ModuleCap> >::iterator guard = tr.end();
   Material res, tmp;
   res.radiation= 0.0;
   res.interaction = 0.0;
-  while (iter != guard) {
-    tmp = findHitsModuleLayer(*iter, eta, theta, phi, t, isPixel);
-    res.radiation = res.radiation + tmp.radiation;
-    res.interaction = res.interaction + tmp.interaction;
-    iter++;
+  XYZVector origin, direction;
+  Polar3DVector dir;
+  dir.SetCoordinates(1, theta, phi);
+  direction = dir;
+  const ModuleHitIndex::Candidates* candidates = index ? index->candidates(origin, direction) : NULL;
+  if (candidates == NULL) {
+    while (iter != guard) {
+      tmp = findHitsModuleLayer(*iter, eta, theta, phi, t, isPixel);
+      res.radiation = res.radiation + tmp.radiation;
+      res.interaction = res.interaction + tmp.interaction;
+      iter++;
+    }
+  } else {
+    // Only the caps listed by the index can be hit: they are checked in one batch, then visited layer by layer in the same order as the full scan
+    std::vector<ModuleCap*> caps;
+    std::vector<std::pair<XYZVector, HitType> > hits;
+    std::vector<int> layerEnds;
+    checkCandidateCaps(tr, *index, *candidates, origin, direction, caps, hits, layerEnds);
+    int k = 0;
+    for (int layerEnd : layerEnds) {
+      tmp.radiation = 0.0;
+      tmp.interaction = 0.0;
+      for (; k < layerEnd; k++) tmp += findHitModuleCap(*caps[k], hits[k], theta, t, isPixel);
+      res.radiation = res.radiation + tmp.radiation;
+      res.interaction = res.interaction + tmp.interaction;
+    }
   }
   return res;
 }
@@ -1182,7 +1307,6 @@ int Analyzer::findHitsModules(Tracker& tracker, double z0, double eta, double th
   XYZVector origin(0,0,z0);
   XYZVector direction;
   Polar3DVector dir;
-  double distance;
 
   int hits = 0;
   emptyMaterial.radiation = 0.0;
@@ -1192,14 +1316,7 @@ int Analyzer::findHitsModules(Tracker& tracker, double z0, double eta, double th
   dir.SetCoordinates(1, theta, phi);
   direction = dir;
 
-  for (auto aModule : tracker.modules()) {
-
-    // collision detection: rays are in z+ only, so consider only modules that lie on that side
-    if (aModule->maxZ() > 0) {
-
-      // same method as in Tracker, same function used
-      //distance = aModule->trackCross(origin, direction);
-      auto ht = aModule->checkTrackHits(origin, direction);
+  auto addHit = [&](Module* aModule, const std::pair<XYZVector, HitType>& ht) {
       //if (distance > 0) {
       if (ht.second != HitType::NONE) {
         double distance = ht.first.R();
@@ -1211,6 +1328,26 @@ int Analyzer::findHitsModules(Tracker& tracker, double z0, double eta, double th
         hit->setCorrectedMaterial(emptyMaterial);
         t.addHit(hit);
       }
+  };
+
+  const ModuleHitIndex::Candidates* candidates = tracker.hitIndex().candidates(origin, direction);
+  if (candidates) {
+    // collision detection: rays are in z+ only, so consider only modules that lie on that side
+    ModuleHitIndex::Candidates reachable;
+    for (int i : *candidates) if (tracker.indexedModules()[i]->maxZ() > 0) reachable.push_back(i);
+    // the reachable candidates are checked in one batch against the packed sensor polygons
+    std::vector<PackedSensorPolygons::SegmentHit> innerHits, outerHits;
+    tracker.hitIndex().sensorPolygons().checkHitSegments(origin, direction, reachable, innerHits, outerHits);
+    for (unsigned int k = 0; k < reachable.size(); k++) {
+      Module* aModule = tracker.indexedModules()[reachable[k]];
+      addHit(aModule, aModule->assignTrackHits(innerHits[k], outerHits[k]));
+    }
+  } else {
+    for (auto aModule : tracker.modules()) {
+      // collision detection: rays are in z+ only, so consider only modules that lie on that side
+      // same method as in Tracker, same function used
+      //distance = aModule->trackCross(origin, direction);
+      if (aModule->maxZ() > 0) addHit(aModule, aModule->checkTrackHits(origin, direction));
     }
   }
   return hits;
@@ -1234,12 +1371,9 @@ Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
                                        double eta, double theta, double phi, Track& t, bool isPixel) {
   std::vector<ModuleCap>::iterator iter = layer.begin();
   std::vector<ModuleCap>::iterator guard = layer.end();
-  Material res, tmp;
+  Material res;
   XYZVector origin, direction;
   Polar3DVector dir;
-  double distance;
-  //double r;
-  int hits = 0;
   res.radiation = 0.0;
   res.interaction = 0.0;
   // set the track direction vector
@@ -1248,38 +1382,10 @@ Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
   while (iter != guard) {
     // collision detection: rays are in z+ only, so consider only modules that lie on that side
     if (iter->getModule().maxZ() > 0) {
-        // same method as in Tracker, same function used
-        // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
-        //distance = iter->getModule().trackCross(origin, direction);
-        auto h = iter->getModule().checkTrackHits(origin, direction); 
-        if (h.second != HitType::NONE) {
-        //if (distance > 0) {
-          double distance = h.first.R();
-          // module was hit
-          hits++;
-          // r = distance * sin(theta);
-          tmp.radiation = iter->getRadiationLength();
-          tmp.interaction = iter->getInteractionLength();
-          // radiation and interaction length scaling for barrels
-          if (iter->getModule().subdet() == BARREL) {
-            tmp.radiation = tmp.radiation / sin(theta);
-            tmp.interaction = tmp.interaction / sin(theta);
-          }
-          // radiation and interaction length scaling for endcaps
-          else {
-            tmp.radiation = tmp.radiation / cos(theta);
-            tmp.interaction = tmp.interaction / cos(theta);
-          }
-          res += tmp;
-          // create Hit object with appropriate parameters, add to Track t
-          Hit* hit = new Hit(distance, &(iter->getModule()), h.second);
-          //if (iter->getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
-          //else if(iter->getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
-          //hit->setObjectKind(Hit::Active); // should not be necessary
-          hit->setCorrectedMaterial(tmp);
-          hit->setPixel(isPixel);
-          t.addHit(hit);
-        }
+      // same method as in Tracker, same function used
+      // TODO: in case origin==0,0,0 and phi==0 just check if sectionYZ and minEta, maxEta
+      //distance = cap.getModule().trackCross(origin, direction);
+      res += findHitModuleCap(*iter, iter->getModule().checkTrackHits(origin, direction), theta, t, isPixel);
     }
     iter++;
   }
@@ -1287,11 +1393,54 @@ Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
 }
 
 /**
- * The analysis function for inactive volumes loops through the given vector of elements, checking for collisions with
- * the given track. If one is found, the radiation and interaction lengths are scaled with respect to theta, then summed
+ * Accounts for the collision of the given track with a single module. If it is hit, the radiation and interaction lengths are scaled
+ * with respect to theta and a hit is added to the track.
+ * @param cap A reference to the <i>ModuleCap</i> of the module to be checked
+ * @param h The result of the collision check of the track with the module, as given by <i>checkTrackHits()</i>
+ * @param theta The track angle in the yz-plane
+ * @param t A reference to the current track object
+ * @param A boolean flag to indicate which set of active surfaces is analysed: true if the belong to a pixel detector, false if they belong to the tracker
+ * @return The scaled radiation and interaction lengths of the module, or zero if it was not hit
+ */
+Material Analyzer::findHitModuleCap(ModuleCap& cap, const std::pair<XYZVector, HitType>& h,
+                                    double theta, Track& t, bool isPixel) {
+  Material tmp;
+  if (h.second != HitType::NONE) {
+  //if (distance > 0) {
+    double distance = h.first.R();
+    // module was hit
+    // r = distance * sin(theta);
+    tmp.radiation = cap.getRadiationLength();
+    tmp.interaction = cap.getInteractionLength();
+    // radiation and interaction length scaling for barrels
+    if (cap.getModule().subdet() == BARREL) {
+      tmp.radiation = tmp.radiation / sin(theta);
+      tmp.interaction = tmp.interaction / sin(theta);
+    }
+    // radiation and interaction length scaling for endcaps
+    else {
+      tmp.radiation = tmp.radiation / cos(theta);
+      tmp.interaction = tmp.interaction / cos(theta);
+    }
+    // create Hit object with appropriate parameters, add to Track t
+    Hit* hit = new Hit(distance, &(cap.getModule()), h.second);
+    //if (cap.getModule().getSubdetectorType() == Module::Barrel) hit->setOrientation(Hit::Horizontal); // should not be necessary
+    //else if(cap.getModule().getSubdetectorType() == Module::Endcap) hit->setOrientation(Hit::Vertical); // should not be necessary
+    //hit->setObjectKind(Hit::Active); // should not be necessary
+    hit->setCorrectedMaterial(tmp);
+    hit->setPixel(isPixel);
+    t.addHit(hit);
+  }
+  return tmp;
+}
+
+/**
+ * The analysis function for inactive volumes loops through the elements of the given lists crossed by the track, as found
+ * by the eta index of the inactive surfaces. The radiation and interaction lengths are scaled with respect to theta, then summed
  * up into a grand total, which is returned. As all inactive volumes are symmetric with respect to rotation around the
  * z-axis, the track angle phi is not necessary.
- * @param elements A reference to the collection of inactive surfaces that is to be checked for collisions with the track
+ * @param surfaces A reference to the inactive surfaces that are to be checked for collisions with the track
+ * @param collections The lists of elements to check, as a combination of <i>InactiveSurfaces::Collection</i> flags
  * @param eta The pseudorapidity of the current track
  * @param theta The track angle in the yz-plane
  * @param t A reference to the current track object
@@ -1300,7 +1449,7 @@ Material Analyzer::findHitsModuleLayer(std::vector<ModuleCap>& layer,
  * @return The scaled and summed up radiation and interaction lengths for the given collection of elements and track, bundled into a <i>std::pair</i>
  */
 
-Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& elements, double eta,
+Material Analyzer::analyzeInactiveSurfaces(InactiveSurfaces& surfaces, int collections, double eta,
                                            double theta, Track& t, MaterialProperties::Category cat, bool isPixel) {
 
   /*
@@ -1311,250 +1460,226 @@ Material Analyzer::analyzeInactiveSurfaces(std::vector<InactiveElement>& element
   }
   */
   
-  std::vector<InactiveElement>::iterator iter = elements.begin();
-  std::vector<InactiveElement>::iterator guard = elements.end();
+  std::vector<InactiveElement*> crossed = surfaces.elementsCrossedAt(eta, cat, collections);
   Material res, corr;
-  std::pair<double, double> tmp;
   double s = 0.0;
-  while ((iter != guard)) {
-    //if  ((iter->getInteractionLength() > 0) && (iter->getRadiationLength() > 0)) {
-    // collision detection: rays are in z+ only, so only volumes in z+ need to be considered
-    // only volumes of the requested category, or those without one (which should not exist) are examined
-    if (((iter->getZOffset() + iter->getZLength()) > 0)
-        && ((cat == MaterialProperties::no_cat) || (cat == iter->getCategory()))) {
-      // collision detection: check eta range
-      tmp = iter->getEtaMinMax();
-      // volume was hit
-      if ((tmp.first < eta) && (tmp.second > eta)) {
-        double r, z;
-        /*
-        if (eta<0.01) {
-          std::cout << "Hitting an inactive surface at z=("
-                    << iter->getZOffset() << " to " << iter->getZOffset()+iter->getZLength()
-                    << ") r=(" << iter->getInnerRadius() << " to " << iter->getInnerRadius()+iter->getRWidth() << ")" << std::endl;
-          const std::map<std::string, double>& localMasses = iter->getLocalMasses();
-          for (auto massIt : localMasses) std::cerr   << "       localMass" <<  massIt.first << " = " << any2str(massIt.second) << " g" << std::endl;
+  // the eta index only returns the volumes in z+ (rays are in z+ only) of the requested category whose eta range contains the track
+  for (InactiveElement* element : crossed) {
+    double r, z;
+    /*
+    if (eta<0.01) {
+      std::cout << "Hitting an inactive surface at z=("
+                << element->getZOffset() << " to " << element->getZOffset()+element->getZLength()
+                << ") r=(" << element->getInnerRadius() << " to " << element->getInnerRadius()+element->getRWidth() << ")" << std::endl;
+      const std::map<std::string, double>& localMasses = element->getLocalMassesByName();
+      for (auto massIt : localMasses) std::cerr   << "       localMass" <<  massIt.first << " = " << any2str(massIt.second) << " g" << std::endl;
+    }
+    */
+    // radiation and interaction lenth scaling for vertical volumes
+    if (element->isVertical()) {
+      z = element->getZOffset() + element->getZLength() / 2.0;
+      r = z * tan(theta);
+      // 2D maps for vertical surfaces
+      fillMapRZ(r,z,element->getMaterialLengths());
+      // special treatment for user-defined supports as they can be very close to z=0
+      if (cat == MaterialProperties::u_sup) {
+        s = element->getZLength() / cos(theta);
+        if (s > (element->getRWidth() / sin(theta))) s = element->getRWidth() / sin(theta);
+        // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
+        if (element->track()) {
+          corr.radiation = element->getRadiationLength() * s / element->getZLength();
+          corr.interaction = element->getInteractionLength() * s / element->getZLength();
+          res += corr;
+          if (!isPixel) {
+            Material thisLength;
+            thisLength.radiation = element->getRadiationLength() * s / element->getZLength();
+            thisLength.interaction = element->getInteractionLength() * s / element->getZLength(); 
+            fillCell(r, eta, theta, thisLength); 
+          }
         }
-        */
-        // radiation and interaction lenth scaling for vertical volumes
-        if (iter->isVertical()) {
-          z = iter->getZOffset() + iter->getZLength() / 2.0;
-          r = z * tan(theta);
-          // 2D maps for vertical surfaces
-          fillMapRZ(r,z,iter->getMaterialLengths());
-          // special treatment for user-defined supports as they can be very close to z=0
-          if (cat == MaterialProperties::u_sup) {
-            s = iter->getZLength() / cos(theta);
-            if (s > (iter->getRWidth() / sin(theta))) s = iter->getRWidth() / sin(theta);
-            // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
-            if (iter->track()) {
-              corr.radiation = iter->getRadiationLength() * s / iter->getZLength();
-              corr.interaction = iter->getInteractionLength() * s / iter->getZLength();
-              res += corr;
-              if (!isPixel) {
-                Material thisLength;
-                thisLength.radiation = iter->getRadiationLength() * s / iter->getZLength();
-                thisLength.interaction = iter->getInteractionLength() * s / iter->getZLength(); 
-                fillCell(r, eta, theta, thisLength); 
-              }
-            }
-            else {
-              if (!isPixel) {
-                rextrasupports.Fill(eta, iter->getRadiationLength() * s / iter->getZLength());
-                iextrasupports.Fill(eta, iter->getInteractionLength() * s / iter->getZLength());
-              }
-            }
+        else {
+          if (!isPixel) {
+            rextrasupports.Fill(eta, element->getRadiationLength() * s / element->getZLength());
+            iextrasupports.Fill(eta, element->getInteractionLength() * s / element->getZLength());
           }
-          else {
-            // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
-            if (iter->track()) {
-              corr.radiation = iter->getRadiationLength() / cos(theta);
-              corr.interaction = iter->getInteractionLength() / cos(theta);
-              res += corr;
-              if (!isPixel) {
-                Material thisLength;
-                thisLength.radiation = iter->getRadiationLength() / cos(theta); 
-                thisLength.interaction = iter->getInteractionLength() / cos(theta);
-                fillCell(r, eta, theta, thisLength);
-              }
-            }
-            else {
-              if (!isPixel) {
-                if ((iter->getCategory() == MaterialProperties::b_ser)
-                    || (iter->getCategory() == MaterialProperties::e_ser)) {
-                  rextraservices.Fill(eta, iter->getRadiationLength() / cos(theta));
-                  iextraservices.Fill(eta, iter->getInteractionLength() / cos(theta));
-                }
-                else if ((iter->getCategory() == MaterialProperties::b_sup)
-                         || (iter->getCategory() == MaterialProperties::e_sup)
-                         || (iter->getCategory() == MaterialProperties::o_sup)
-                         || (iter->getCategory() == MaterialProperties::t_sup)) {
-                  rextrasupports.Fill(eta, iter->getRadiationLength() / cos(theta));
-                  iextrasupports.Fill(eta, iter->getInteractionLength() / cos(theta));
-                }
-              }
-            }
+        }
+      }
+      else {
+        // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
+        if (element->track()) {
+          corr.radiation = element->getRadiationLength() / cos(theta);
+          corr.interaction = element->getInteractionLength() / cos(theta);
+          res += corr;
+          if (!isPixel) {
+            Material thisLength;
+            thisLength.radiation = element->getRadiationLength() / cos(theta); 
+            thisLength.interaction = element->getInteractionLength() / cos(theta);
+            fillCell(r, eta, theta, thisLength);
           }
         }
-        // radiation and interaction length scaling for horizontal volumes
         else {
-          r = iter->getInnerRadius() + iter->getRWidth() / 2.0;
-          // 2D maps for horizontal surfaces
-          fillMapRT(r,theta,iter->getMaterialLengths());
-          // special treatment for user-defined supports; should not be necessary for now
-          // as all user-defined supports are vertical, but just in case...
-          if (cat == MaterialProperties::u_sup) {
-            s = iter->getZLength() / sin(theta);
-            if (s > (iter->getRWidth() / cos(theta))) s = iter->getRWidth() / cos(theta);
-            // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
-            if (iter->track()) {
-              corr.radiation = iter->getRadiationLength() * s / iter->getZLength();
-              corr.interaction = iter->getInteractionLength() * s / iter->getZLength();
-              res += corr;
-              if (!isPixel) {
-                Material thisLength;
-                thisLength.radiation = iter->getRadiationLength() * s / iter->getZLength(); 
-                thisLength.interaction = iter->getInteractionLength() * s / iter->getZLength();
-                fillCell(r, eta, theta, thisLength);
-              }
+          if (!isPixel) {
+            if ((element->getCategory() == MaterialProperties::b_ser)
+                || (element->getCategory() == MaterialProperties::e_ser)) {
+              rextraservices.Fill(eta, element->getRadiationLength() / cos(theta));
+              iextraservices.Fill(eta, element->getInteractionLength() / cos(theta));
             }
-            else {
-              if (!isPixel) {
-                rextrasupports.Fill(eta, iter->getRadiationLength() * s / iter->getZLength());
-                iextrasupports.Fill(eta, iter->getInteractionLength() * s / iter->getZLength());
-              }
+            else if ((element->getCategory() == MaterialProperties::b_sup)
+                     || (element->getCategory() == MaterialProperties::e_sup)
+                     || (element->getCategory() == MaterialProperties::o_sup)
+                     || (element->getCategory() == MaterialProperties::t_sup)) {
+              rextrasupports.Fill(eta, element->getRadiationLength() / cos(theta));
+              iextrasupports.Fill(eta, element->getInteractionLength() / cos(theta));
             }
           }
-          else {
-            // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
-            if (iter->track()) {
-              corr.radiation = iter->getRadiationLength() / sin(theta);
-              corr.interaction = iter->getInteractionLength() / sin(theta);
-              res += corr;
-              if (!isPixel) {
-                Material thisLength;
-                thisLength.radiation = iter->getRadiationLength() / sin(theta);
-                thisLength.interaction =  iter->getInteractionLength() / sin(theta);
-                fillCell(r, eta, theta, thisLength); 
-              }
+        }
+      }
+    }
+    // radiation and interaction length scaling for horizontal volumes
+    else {
+      r = element->getInnerRadius() + element->getRWidth() / 2.0;
+      // 2D maps for horizontal surfaces
+      fillMapRT(r,theta,element->getMaterialLengths());
+      // special treatment for user-defined supports; should not be necessary for now
+      // as all user-defined supports are vertical, but just in case...
+      if (cat == MaterialProperties::u_sup) {
+        s = element->getZLength() / sin(theta);
+        if (s > (element->getRWidth() / cos(theta))) s = element->getRWidth() / cos(theta);
+        // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
+        if (element->track()) {
+          corr.radiation = element->getRadiationLength() * s / element->getZLength();
+          corr.interaction = element->getInteractionLength() * s / element->getZLength();
+          res += corr;
+          if (!isPixel) {
+            Material thisLength;
+            thisLength.radiation = element->getRadiationLength() * s / element->getZLength(); 
+            thisLength.interaction = element->getInteractionLength() * s / element->getZLength();
+            fillCell(r, eta, theta, thisLength);
+          }
+        }
+        else {
+          if (!isPixel) {
+            rextrasupports.Fill(eta, element->getRadiationLength() * s / element->getZLength());
+            iextrasupports.Fill(eta, element->getInteractionLength() * s / element->getZLength());
+          }
+        }
+      }
+      else {
+        // add the hit if it's declared as inside the tracking volume, add it to 'others' if not
+        if (element->track()) {
+          corr.radiation = element->getRadiationLength() / sin(theta);
+          corr.interaction = element->getInteractionLength() / sin(theta);
+          res += corr;
+          if (!isPixel) {
+            Material thisLength;
+            thisLength.radiation = element->getRadiationLength() / sin(theta);
+            thisLength.interaction =  element->getInteractionLength() / sin(theta);
+            fillCell(r, eta, theta, thisLength); 
+          }
+        }
+        else {
+          if (!isPixel) {
+            if ((element->getCategory() == MaterialProperties::b_ser)
+                || (element->getCategory() == MaterialProperties::e_ser)) {
+              rextraservices.Fill(eta, element->getRadiationLength() / sin(theta));
+              iextraservices.Fill(eta, element->getInteractionLength() / sin(theta));
             }
-            else {
-              if (!isPixel) {
-                if ((iter->getCategory() == MaterialProperties::b_ser)
-                    || (iter->getCategory() == MaterialProperties::e_ser)) {
-                  rextraservices.Fill(eta, iter->getRadiationLength() / sin(theta));
-                  iextraservices.Fill(eta, iter->getInteractionLength() / sin(theta));
-                }
-                else if ((iter->getCategory() == MaterialProperties::b_sup)
-                         || (iter->getCategory() == MaterialProperties::e_sup)
-                         || (iter->getCategory() == MaterialProperties::o_sup)
-                         || (iter->getCategory() == MaterialProperties::t_sup)) {
-                  rextrasupports.Fill(eta, iter->getRadiationLength() / sin(theta));
-                  iextrasupports.Fill(eta, iter->getInteractionLength() / sin(theta));
-                }
-              }
+            else if ((element->getCategory() == MaterialProperties::b_sup)
+                     || (element->getCategory() == MaterialProperties::e_sup)
+                     || (element->getCategory() == MaterialProperties::o_sup)
+                     || (element->getCategory() == MaterialProperties::t_sup)) {
+              rextrasupports.Fill(eta, element->getRadiationLength() / sin(theta));
+              iextrasupports.Fill(eta, element->getInteractionLength() / sin(theta));
             }
           }
         }
-        // create Hit object with appropriate parameters, add to Track t
-        Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
-        if (iter->isVertical()) hit->setOrientation(Hit::Vertical);
-        else hit->setOrientation(Hit::Horizontal);
-        hit->setObjectKind(Hit::Inactive);
-        hit->setCorrectedMaterial(corr);
-        hit->setPixel(isPixel);
-        t.addHit(hit);
       }
     }
-    iter++;
-    //}
+    // create Hit object with appropriate parameters, add to Track t
+    Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
+    if (element->isVertical()) hit->setOrientation(Hit::Vertical);
+    else hit->setOrientation(Hit::Horizontal);
+    hit->setObjectKind(Hit::Inactive);
+    hit->setCorrectedMaterial(corr);
+    hit->setPixel(isPixel);
+    t.addHit(hit);
   }
   return res;
 }
 
 /**
- * The analysis function for inactive volumes loops through the given vector of elements, checking for collisions with
- * the given track. If one is found, the radiation and interaction lengths are scaled with respect to theta.
+ * The analysis function for inactive volumes loops through the elements of the given lists crossed by the track, as found
+ * by the eta index of the inactive surfaces. The radiation and interaction lengths are scaled with respect to theta.
  * All hits are added to the given track
  * The total crossed material is returned.
  * As all inactive volumes are symmetric with respect to rotation around the z-axis, the track angle phi is not necessary.
- * @param elements A reference to the collection of inactive surfaces that is to be checked for collisions with the track
+ * @param surfaces A reference to the inactive surfaces that are to be checked for collisions with the track
+ * @param collections The lists of elements to check, as a combination of <i>InactiveSurfaces::Collection</i> flags
  * @param eta The pseudorapidity of the current track
  * @param theta The track angle in the yz-plane
  * @param t A reference to the current track object
  * @return The scaled and summed up crossed material amount
  */
-Material Analyzer::findHitsInactiveSurfaces(std::vector<InactiveElement>& elements, double eta,
+Material Analyzer::findHitsInactiveSurfaces(InactiveSurfaces& surfaces, int collections, double eta,
                                             double theta, Track& t, bool isPixel) {
-  std::vector<InactiveElement>::iterator iter = elements.begin();
-  std::vector<InactiveElement>::iterator guard = elements.end();
+  std::vector<InactiveElement*> crossed = surfaces.elementsCrossedAt(eta, MaterialProperties::no_cat, collections);
   Material res, corr;
-  std::pair<double, double> tmp;
   double s_normal = 0;
   double s_alternate = 0;
-  while (iter != guard) {
-    // Collision detection: rays are in z+ only, so only volumes in z+ need to be considered
-    // only volumes of the requested category, or those without one (which should not exist) are examined
-    if ((iter->getZOffset() + iter->getZLength()) > 0) {
-      // collision detection: check eta range
-      tmp = iter->getEtaMinMax();
-      // Volume was hit if:
-      if ((tmp.first < eta) && (tmp.second > eta)) {
-        double r, z;
-        // radiation and interaction lenth scaling for vertical volumes
-        if (iter->isVertical()) { // Element is vertical
-          z = iter->getZOffset() + iter->getZLength() / 2.0;
-          r = z * tan(theta);
-
-          // In case we are crossing the material with a very shallow angle
-          // we have to take into account its finite radial size
-          s_normal = iter->getZLength() / cos(theta);
-          s_alternate = iter->getRWidth() / sin(theta);
-          if (s_normal > s_alternate) { 
-            // Special case: it's easier to cross the material by going left-to-right than
-            // by going bottom-to-top, so I have to rescale the material amount computation
-            corr.radiation = iter->getRadiationLength() / iter->getZLength() * s_alternate;
-            corr.interaction = iter->getInteractionLength() / iter->getZLength() * s_alternate;
-            res += corr;
-          } else {
-            // Standard computing of the crossed material amount
-            corr.radiation = iter->getRadiationLength() / cos(theta);
-            corr.interaction = iter->getInteractionLength() / cos(theta);
-            res += corr;
-          }
-        }
-        // radiation and interaction length scaling for horizontal volumes
-        else { // Element is horizontal
-          r = iter->getInnerRadius() + iter->getRWidth() / 2.0;
-
-          // In case we are crossing the material with a very shallow angle
-          // we have to take into account its finite z length
-          s_normal = iter->getRWidth() / sin(theta);
-          s_alternate = iter->getZLength() / cos(theta);
-          if (s_normal > s_alternate) { 
-            // Special case: it's easier to cross the material by going left-to-right than
-            // by going bottom-to-top, so I have to rescale the material amount computation
-            corr.radiation = iter->getRadiationLength() / iter->getRWidth() * s_alternate;
-            corr.interaction = iter->getInteractionLength() / iter->getRWidth() * s_alternate;
-            res += corr;
-          } else {
-            // Standard computing of the crossed material amount
-            corr.radiation = iter->getRadiationLength() / sin(theta);
-            corr.interaction = iter->getInteractionLength() / sin(theta);
-            res += corr;
-          }
-        }
-        // create Hit object with appropriate parameters, add to Track t
-        Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
-        if (iter->isVertical()) hit->setOrientation(Hit::Vertical);
-        else hit->setOrientation(Hit::Horizontal);
-        hit->setObjectKind(Hit::Inactive);
-        hit->setCorrectedMaterial(corr);
-        hit->setPixel(isPixel);
-        t.addHit(hit);
+  // the eta index only returns the volumes in z+ (rays are in z+ only) whose eta range contains the track
+  for (InactiveElement* element : crossed) {
+    double r, z;
+    // radiation and interaction lenth scaling for vertical volumes
+    if (element->isVertical()) { // Element is vertical
+      z = element->getZOffset() + element->getZLength() / 2.0;
+      r = z * tan(theta);
+
+      // In case we are crossing the material with a very shallow angle
+      // we have to take into account its finite radial size
+      s_normal = element->getZLength() / cos(theta);
+      s_alternate = element->getRWidth() / sin(theta);
+      if (s_normal > s_alternate) { 
+        // Special case: it's easier to cross the material by going left-to-right than
+        // by going bottom-to-top, so I have to rescale the material amount computation
+        corr.radiation = element->getRadiationLength() / element->getZLength() * s_alternate;
+        corr.interaction = element->getInteractionLength() / element->getZLength() * s_alternate;
+        res += corr;
+      } else {
+        // Standard computing of the crossed material amount
+        corr.radiation = element->getRadiationLength() / cos(theta);
+        corr.interaction = element->getInteractionLength() / cos(theta);
+        res += corr;
       }
     }
-    iter++;
+    // radiation and interaction length scaling for horizontal volumes
+    else { // Element is horizontal
+      r = element->getInnerRadius() + element->getRWidth() / 2.0;
+
+      // In case we are crossing the material with a very shallow angle
+      // we have to take into account its finite z length
+      s_normal = element->getRWidth() / sin(theta);
+      s_alternate = element->getZLength() / cos(theta);
+      if (s_normal > s_alternate) { 
+        // Special case: it's easier to cross the material by going left-to-right than
+        // by going bottom-to-top, so I have to rescale the material amount computation
+        corr.radiation = element->getRadiationLength() / element->getRWidth() * s_alternate;
+        corr.interaction = element->getInteractionLength() / element->getRWidth() * s_alternate;
+        res += corr;
+      } else {
+        // Standard computing of the crossed material amount
+        corr.radiation = element->getRadiationLength() / sin(theta);
+        corr.interaction = element->getInteractionLength() / sin(theta);
+        res += corr;
+      }
+    }
+    // create Hit object with appropriate parameters, add to Track t
+    Hit* hit = new Hit((theta == 0) ? r : (r / sin(theta)));
+    if (element->isVertical()) hit->setOrientation(Hit::Vertical);
+    else hit->setOrientation(Hit::Horizontal);
+    hit->setObjectKind(Hit::Inactive);
+    hit->setCorrectedMaterial(corr);
+    hit->setPixel(isPixel);
+    t.addHit(hit);
   }
   return res;
 }
@@ -2673,8 +2798,11 @@ std::pair<double, double> Analyzer::computeMinMaxTracksEta(const Tracker& t) con
  * Creates the histograms to analyze the tracker coverage
  * @param tracker the tracker to be analyzed
  * @param nTracker the number of tracks to be used to analyze the coverage (defaults to 1000)
+ * @param nThreads the number of threads used to find the hits (defaults to 1). The results do not depend on it
+ * @param usePhiSymmetry if true, the tracks are only shot in one phi wedge of the tracker symmetry and unfolded to the others (defaults to false)
+ * @param analyticCoverage if true, the module coverage plots are computed from the projected module outlines instead of the tracks (defaults to false)
  */
-void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
+void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/, int nThreads /*=1*/, bool usePhiSymmetry /*=false*/, bool analyticCoverage /*=false*/ ) {
   geometryTracksUsed = nTracks;
   savingGeometryV.clear();
   clearGeometryHistograms();
@@ -2701,7 +2829,7 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
 
 
   // Initialize random number generator, counters and histograms
-  myDice.SetSeed(MY_RANDOM_SEED);
+  CounterRandom dice(MY_RANDOM_SEED, CounterRandom::GEOMETRY);
   createResetCounters(tracker, moduleTypeCount);
   createResetCounters(tracker, sensorTypeCount);
   createResetCounters(tracker, moduleTypeCountStubs);
@@ -2768,6 +2896,19 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   int nTracksPerSide = int(pow(nTracks, 0.5));
   int nBlocks = int(nTracksPerSide/2.);
   nTracks = nTracksPerSide*nTracksPerSide;
+
+  // With the phi symmetry, a track shot in the first wedge stands for its order images in all the wedges:
+  // they hit the images of its modules, at the same eta. Its plots are filled with weight order, its phi map entries at each image
+  PhiSymmetry symmetry;
+  if (usePhiSymmetry) {
+    symmetry.build(tracker);
+    logINFO("Tracker phi symmetry order: " + any2str(symmetry.order()));
+  }
+  int order = symmetry.order();
+  double wedgePhi = 2*M_PI/order;
+  double weight = order;
+  int nTraced = (nTracks + order - 1)/order;
+  geometryTracksUsed = nTraced; // the tracks actually traced, each standing for order tracks with the phi symmetry
   mapPhiEta.SetBins(nBlocks, -1*M_PI, M_PI, nBlocks, -maxEta, maxEta);
   TH2I mapPhiEtaCount("mapPhiEtaCount ", "phi Eta hit count", nBlocks, -1*M_PI, M_PI, nBlocks, -maxEta, maxEta);
   totalEtaProfile.Reset();
@@ -2799,15 +2940,29 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
 
   std::map<std::string, int> modulePlotColors; // CUIDADO quick and dirty way of creating a map with all the module colors (a cleaner way would be to have the map already created somewhere else)
 
-  //XYZVector dir(0, 1, 0);
-  // Shoot nTracksPerSide^2 tracks
-  double angle = M_PI/2/(double)nTracksPerSide;
-  for (int i=0; i<nTracksPerSide; i++) {
-    for (int j=0; j<nTracksPerSide; j++) {
-      // Reset the hit counter
-      // Generate a straight track and collect the list of hit modules
-      aLine = shootDirection(randomBase, randomSpan);
-      std::vector<std::pair<Module*, HitType>> hitModules = trackHit( XYZVector(0, 0, ((myDice.Rndm()*2)-1)* zError), aLine.first, tracker.modules());
+  ModuleHitCounts moduleHitCounts;
+
+  // Shoot nTracksPerSide^2 tracks, by blocks: the tracks of a block are generated and their hits are searched
+  // on nThreads threads, then the plots are filled in the track order, so that the results do not depend on nThreads.
+  // With the analytic coverage, the tracks only fill the sensor and stub plots: the hit module plots come from the outlines
+  static const int tracksPerBlock = 4096;
+  std::vector<std::pair<XYZVector, double> > blockLines;
+  std::vector<std::vector<std::pair<Module*, HitType> > > blockHitModules;
+  for (int blockBegin = 0; blockBegin < nTraced; blockBegin += tracksPerBlock) {
+    int blockSize = MIN(tracksPerBlock, nTraced - blockBegin);
+    blockLines.resize(blockSize);
+    blockHitModules.resize(blockSize);
+    parallelFor(0, blockSize, nThreads, [&](int k) {
+      // Generate a straight track from its own random stream and collect the list of hit modules
+      CounterRandom::Stream trackDice = dice.stream(blockBegin + k);
+      blockLines[k] = shootDirection(trackDice, randomBase, randomSpan, wedgePhi);
+      XYZVector origin(0, 0, ((trackDice.Rndm()*2)-1)* zError);
+      blockHitModules[k] = trackHit(origin, blockLines[k].first, tracker);
+    });
+
+    for (int k = 0; k < blockSize; k++) {
+      aLine = blockLines[k];
+      const std::vector<std::pair<Module*, HitType>>& hitModules = blockHitModules[k];
       // Reset the per-type hit counter and fill it
       resetTypeCounter(moduleTypeCount);
       resetTypeCounter(sensorTypeCount);
@@ -2815,6 +2970,7 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
       int numStubs = 0;
       int numHits = 0;
       for (auto& mh : hitModules) {
+        if (!analyticCoverage) moduleHitCounts.add(mh.first);
         moduleTypeCount[mh.first->moduleType()]++;
         if (mh.second & HitType::INNER) {
           sensorTypeCount[mh.first->moduleType()]++;
@@ -2831,24 +2987,31 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
         modulePlotColors[mh.first->moduleType()] = mh.first->plotColor();
       }
       // Fill the module type hit plot
-      for (std::map <std::string, int>::iterator it = moduleTypeCount.begin(); it!=moduleTypeCount.end(); it++) {
-        etaProfileByType[(*it).first].Fill(fabs(aLine.second), (*it).second);
+      if (!analyticCoverage) {
+        for (std::map <std::string, int>::iterator it = moduleTypeCount.begin(); it!=moduleTypeCount.end(); it++) {
+          etaProfileByType[(*it).first].Fill(fabs(aLine.second), (*it).second, weight);
+        }
       }
 
       for (auto& mel : sensorTypeCount) {
-        etaProfileByTypeSensors[mel.first].Fill(fabs(aLine.second), mel.second);
+        etaProfileByTypeSensors[mel.first].Fill(fabs(aLine.second), mel.second, weight);
       }
 
       for (auto& mel : moduleTypeCountStubs) {
-        etaProfileByTypeStubs[mel.first].Fill(fabs(aLine.second), mel.second);
+        etaProfileByTypeStubs[mel.first].Fill(fabs(aLine.second), mel.second, weight);
       }
       // Fill other plots
-      mapPhiEta.Fill(aLine.first.Phi(), aLine.second, hitModules.size()); // phi, eta 2d plot
-      mapPhiEtaCount.Fill(aLine.first.Phi(), aLine.second);               // Number of shot tracks
-
-      totalEtaProfile.Fill(fabs(aLine.second), hitModules.size());                // Total number of hits
-      totalEtaProfileSensors.Fill(fabs(aLine.second), numHits);
-      totalEtaProfileStubs.Fill(fabs(aLine.second), numStubs); 
+      if (!analyticCoverage) {
+        for (int image = 0; image < order; image++) {
+          double phi = aLine.first.Phi() + image*wedgePhi;
+          if (phi > M_PI) phi -= 2*M_PI;
+          mapPhiEta.Fill(phi, aLine.second, hitModules.size()); // phi, eta 2d plot
+          mapPhiEtaCount.Fill(phi, aLine.second);               // Number of shot tracks
+        }
+        totalEtaProfile.Fill(fabs(aLine.second), hitModules.size(), weight);                // Total number of hits
+      }
+      totalEtaProfileSensors.Fill(fabs(aLine.second), numHits, weight);
+      totalEtaProfileStubs.Fill(fabs(aLine.second), numStubs, weight);
 
       for (auto layerName : layerNames.data) {
         int layerHit = 0;
@@ -2861,8 +3024,8 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
             if (layerHit && layerStub) break;
           }
         }
-        layerEtaCoverageProfile[layerName].Fill(aLine.second, layerHit);
-        layerEtaCoverageProfileStubs[layerName].Fill(aLine.second, layerStub);
+        if (!analyticCoverage) layerEtaCoverageProfile[layerName].Fill(aLine.second, layerHit, weight);
+        layerEtaCoverageProfileStubs[layerName].Fill(aLine.second, layerStub, weight);
       }
 
     }
@@ -2881,6 +3044,29 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
     }
   }
 
+  // The analytic coverage fills the plots of the hit modules; the sensor and stub plots come from the tracks
+  AnalyticCoverage coverage;
+  if (analyticCoverage) {
+    std::vector<std::string> typeNames;
+    std::map<std::string, int> typeIndex;
+    for (const auto& mel : moduleTypeCount) { typeIndex[mel.first] = typeNames.size(); typeNames.push_back(mel.first); }
+    std::vector<std::string> layerNameList(layerNames.data.begin(), layerNames.data.end());
+    std::map<std::string, int> layerIndex;
+    for (unsigned int i = 0; i < layerNameList.size(); i++) layerIndex[layerNameList[i]] = i;
+
+    std::vector<const DetectorModule*> modules;
+    std::vector<int> types, layers;
+    for (auto m : tracker.modules()) {
+      UniRef ur = m->uniRef();
+      modules.push_back(m);
+      types.push_back(typeIndex[m->moduleType()]);
+      layers.push_back(layerIndex[ur.cnt + " " + any2str(ur.layer)]);
+      modulePlotColors[m->moduleType()] = m->plotColor();
+    }
+    coverage.build(modules, types, typeNames.size(), layers, layerNameList.size(), zError);
+    fillAnalyticCoverage(coverage, randomBase, randomBase + randomSpan, typeNames, layerNameList, etaProfileByType, nThreads);
+  }
+
   savingGeometryV.push_back(mapPhiEta);
 
   // Eta profile compute
@@ -2950,8 +3136,28 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   // Record the fraction of hits per module
   hitDistribution.SetBins(nTracks, 0 , 1);
   savingGeometryV.push_back(hitDistribution);
-  for (auto m : tracker.modules()) {
-    hitDistribution.Fill(m->numHits()/double(nTracks));
+  if (analyticCoverage) {
+    std::vector<double> acceptance = coverage.acceptance(randomBase, randomBase + randomSpan);
+    for (double fraction : acceptance) hitDistribution.Fill(fraction);
+  } else if (usePhiSymmetry) {
+    // The images of the traced tracks hitting a module are the traced tracks hitting the modules of its orbit
+    std::vector<int> orbitHits(symmetry.numOrbits(), 0);
+    std::vector<int> orbitSize(symmetry.numOrbits(), 0);
+    for (auto m : tracker.modules()) {
+      int orbit = symmetry.orbit(m);
+      if (orbit < 0) continue;
+      orbitHits[orbit] += moduleHitCounts.count(m);
+      orbitSize[orbit]++;
+    }
+    for (auto m : tracker.modules()) {
+      int orbit = symmetry.orbit(m);
+      if (orbit < 0) hitDistribution.Fill(moduleHitCounts.count(m)/double(nTraced));
+      else hitDistribution.Fill(orbitHits[orbit]/double(nTraced*orbitSize[orbit]));
+    }
+  } else {
+    for (auto m : tracker.modules()) {
+      hitDistribution.Fill(moduleHitCounts.count(m)/double(nTracks));
+    }
   }
 
 
@@ -2977,6 +3183,59 @@ void Analyzer::analyzeGeometry(Tracker& tracker, int nTracks /*=1000*/ ) {
   return;
 }
 
+// private
+/**
+ * Fills the hit module plots of the geometry analysis from the analytic coverage, one scan per bin center
+ * @param coverage the analytic coverage of the tracker modules
+ * @param minEta the lowest eta of the geometry tracks
+ * @param maxEta the highest eta of the geometry tracks
+ * @param typeNames the module types, by type index of the coverage
+ * @param layerNames the layer names, by group index of the coverage
+ * @param etaProfileByType the plots of the number of hit modules per type
+ * @param nThreads the number of threads the scans are run on
+ */
+void Analyzer::fillAnalyticCoverage(const AnalyticCoverage& coverage, double minEta, double maxEta, const std::vector<std::string>& typeNames,
+                                    const std::vector<std::string>& layerNames, std::map<std::string, TProfile>& etaProfileByType, int nThreads) {
+  // The |eta| profiles: average of the scans at +eta and -eta
+  const TAxis* absEtaAxis = totalEtaProfile.GetXaxis();
+  int nAbsEtaBins = absEtaAxis->GetNbins();
+  std::vector<AnalyticCoverage::Scan> forward(nAbsEtaBins), backward(nAbsEtaBins);
+  parallelFor(0, nAbsEtaBins, nThreads, [&](int b) {
+    double eta = absEtaAxis->GetBinCenter(b+1);
+    forward[b] = coverage.scan(eta, 1);
+    backward[b] = coverage.scan(-eta, 1);
+  });
+  for (int b = 0; b < nAbsEtaBins; b++) {
+    double eta = absEtaAxis->GetBinCenter(b+1);
+    totalEtaProfile.Fill(eta, (forward[b].hits + backward[b].hits)/2.);
+    for (unsigned int t = 0; t < typeNames.size(); t++) {
+      etaProfileByType[typeNames[t]].Fill(eta, (forward[b].typeHits[t] + backward[b].typeHits[t])/2.);
+    }
+  }
+
+  // The layer coverage profiles, in signed eta: they keep the binning of the track mode, whose range is set by the
+  // filled values, so they are scanned at as many points as bins over the eta range of the tracks
+  int nEtaBins = layerNames.empty() ? 0 : layerEtaCoverageProfile[layerNames.front()].GetNbinsX();
+  std::vector<double> scanEtas(nEtaBins);
+  std::vector<AnalyticCoverage::Scan> scans(nEtaBins);
+  for (int b = 0; b < nEtaBins; b++) scanEtas[b] = minEta + (b + 0.5)*(maxEta - minEta)/nEtaBins;
+  parallelFor(0, nEtaBins, nThreads, [&](int b) { scans[b] = coverage.scan(scanEtas[b], 1); });
+  for (unsigned int l = 0; l < layerNames.size(); l++) {
+    TProfile& aProfile = layerEtaCoverageProfile[layerNames[l]];
+    for (int b = 0; b < nEtaBins; b++) aProfile.Fill(scanEtas[b], scans[b].groupCoverage[l]);
+  }
+
+  // The (phi, eta) map of the number of hit modules
+  int nPhiBins = mapPhiEta.GetNbinsX();
+  int nMapEtaBins = mapPhiEta.GetNbinsY();
+  const TAxis* mapEtaAxis = mapPhiEta.GetYaxis();
+  std::vector<AnalyticCoverage::Scan> rows(nMapEtaBins);
+  parallelFor(0, nMapEtaBins, nThreads, [&](int b) { rows[b] = coverage.scan(mapEtaAxis->GetBinCenter(b+1), nPhiBins); });
+  for (int ny = 0; ny < nMapEtaBins; ny++) {
+    for (int nx = 0; nx < nPhiBins; nx++) mapPhiEta.SetBinContent(nx+1, ny+1, rows[ny].phiHits[nx]);
+  }
+}
+
 // public
 // TODO!!!
 // Creates the geometry objects geomLite
@@ -3019,7 +3278,6 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
 
       for (auto m : tracker.modules()) {
           aType = m->moduleType();
-          m->resetHits();
           if (moduleTypeCount.find(aType)==moduleTypeCount.end()) {
             moduleTypeCount[aType]=typeCounter++;
           }
@@ -3032,22 +3290,24 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
     /**
      * Shoots directions with random (flat) phi, random (flat) pseudorapidity
      * gives also the direction's eta
+     * @param dice the random stream of the track
      * @param minEta minimum eta to shoot tracks
      * @param spanEta difference between minimum and maximum eta
+     * @param spanPhi the tracks are shot with phi in [0, spanPhi) (defaults to 2pi)
      * @return the pair of value: pointing XYZVector and eta of the track
      */
-    std::pair <XYZVector, double > Analyzer::shootDirection(double minEta, double spanEta) {
+    std::pair <XYZVector, double > Analyzer::shootDirection(CounterRandom::Stream& dice, double minEta, double spanEta, double spanPhi) const {
       std::pair <XYZVector, double> result;
 
       double eta;
       double phi;
       double theta;
 
-      // phi is random [0, 2pi)
-      phi = myDice.Rndm() * 2 * M_PI; // debug
+      // phi is random [0, spanPhi)
+      phi = dice.Rndm() * spanPhi; // debug
 
       // eta is random (-4, 4]
-      eta = myDice.Rndm() * spanEta + minEta;
+      eta = dice.Rndm() * spanEta + minEta;
       theta=2*atan(exp(-1*eta));
 
       // Direction
@@ -3061,23 +3321,37 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
      * Checks whether a track would hit a module
      * @param origin XYZVector of origin of the track
      * @param direction pointing XYZVector of the track
-     * @param moduleV vector of modules to be checked
+     * @param tracker the tracker whose modules are to be checked (only the candidates of its hit index, if it can serve the track)
      * @return the vector of hit modules
      */
-    std::vector<std::pair<Module*, HitType>> Analyzer::trackHit(const XYZVector& origin, const XYZVector& direction, Tracker::Modules& moduleV) {
+    std::vector<std::pair<Module*, HitType>> Analyzer::trackHit(const XYZVector& origin, const XYZVector& direction, Tracker& tracker) const {
       std::vector<std::pair<Module*, HitType>> result;
-      double distance;
       static const double BoundaryEtaSafetyMargin = 5. ; // track origin shift in units of zError to compute boundaries
 
+      // A module can be hit if it fits the phi (precise) contraints
+      // and the eta constaints (taken assuming origin within 5 sigma)
+      auto couldHit = [&](const Module* m) { return m->couldHit(direction, simParms().zErrorCollider()*BoundaryEtaSafetyMargin); };
+      auto addHit = [&](Module* m, const std::pair<XYZVector, HitType>& h) {
+        if (h.second != HitType::NONE) {
+          result.push_back(std::make_pair(m,h.second));
+        }
+      };
+
       //static std::ofstream ofs("hits.txt");
-      for (auto& m : moduleV) {
-        // A module can be hit if it fits the phi (precise) contraints
-        // and the eta constaints (taken assuming origin within 5 sigma)
-        if (m->couldHit(direction, simParms().zErrorCollider()*BoundaryEtaSafetyMargin)) {
-          auto h = m->checkTrackHits(origin, direction); 
-          if (h.second != HitType::NONE) {
-            result.push_back(std::make_pair(m,h.second));
-          }
+      const ModuleHitIndex::Candidates* candidates = tracker.hitIndex().candidates(origin, direction);
+      if (candidates) {
+        // the candidates which could be hit are checked in one batch against the packed sensor polygons
+        ModuleHitIndex::Candidates reachable;
+        for (int i : *candidates) if (couldHit(tracker.indexedModules()[i])) reachable.push_back(i);
+        std::vector<PackedSensorPolygons::SegmentHit> innerHits, outerHits;
+        tracker.hitIndex().sensorPolygons().checkHitSegments(origin, direction, reachable, innerHits, outerHits);
+        for (unsigned int k = 0; k < reachable.size(); k++) {
+          Module* m = tracker.indexedModules()[reachable[k]];
+          addHit(m, m->assignTrackHits(innerHits[k], outerHits[k]));
+        }
+      } else {
+        for (auto& m : tracker.modules()) {
+          if (couldHit(m)) addHit(m, m->checkTrackHits(origin, direction));
         }
       }
       return result;
@@ -3118,6 +3392,83 @@ void Analyzer::createGeometryLite(Tracker& tracker) {
       tracker.accept(bv);
     }
 
+    /**
+     * Measures the occupancy of the sensors with a Monte Carlo of the pile-up, to be compared with the parametrised
+     * occupancy of the modules: the channels hit per crossing, the cluster widths and the sparsified bandwidth they need.
+     * @param spectra The spectra of the charged particles of the minimum bias interactions
+     * @param crossings The number of bunch crossings simulated, each with simParms().numMinBiasEvents() interactions
+     * @param nThreads The number of threads the crossings are simulated on (the results do not depend on it)
+     */
+    void Analyzer::simulatePileUp(Tracker& tracker, const PileUpSpectra& spectra, long crossings, int nThreads) {
+      int nMB = simParms().numMinBiasEvents();
+      PileUpSimulator simulator;
+      simulator.simulate(tracker, spectra, nMB, crossings, MY_RANDOM_SEED, nThreads);
+      pileUpCrossings_ = crossings;
+
+      pileUpChanHitDistribution.Reset();
+      pileUpChanHitDistribution.SetNameTitle("PileUpHitChannels", "Number of hit channels (simulated pile-up);Hit Channels;Sensors");
+      pileUpChanHitDistribution.SetBins(200, 0., 400);
+      const std::vector<long>& hitChannels = simulator.hitChannelDistribution();
+      for (unsigned int n = 0; n < hitChannels.size(); n++) {
+        if (hitChannels[n] > 0) pileUpChanHitDistribution.Fill(n, hitChannels[n]);
+      }
+      if (crossings > 0) pileUpChanHitDistribution.Scale(1./crossings); // sensors per crossing, as the parametrised distribution
+
+      pileUpClusterWidthDistribution.Reset();
+      pileUpClusterWidthDistribution.SetNameTitle("PileUpClusterWidth", "Cluster width (simulated pile-up);Channels;Clusters");
+      pileUpClusterWidthDistribution.SetBins(PileUpSimulator::maxClusterWidth, 0.5, PileUpSimulator::maxClusterWidth + 0.5);
+      const std::vector<long>& clusterWidths = simulator.clusterWidthDistribution();
+      for (int w = 1; w <= PileUpSimulator::maxClusterWidth; w++) {
+        if (clusterWidths[w] > 0) pileUpClusterWidthDistribution.Fill(w, clusterWidths[w]);
+      }
+
+      pileUpBandwidthDistributionSparsified.Reset();
+      pileUpBandwidthDistributionSparsified.SetNameTitle("PileUpBandWidthDistSp", "Module Needed Bandwidth (sparsified, simulated pile-up);Bandwidth (bps);Sensors");
+      pileUpBandwidthDistributionSparsified.SetBins(100, 0., 6E+8);
+      pileUpBandwidthDistributionSparsified.SetLineColor(kRed);
+      pileUpOccupancyRatioDistribution.Reset();
+      pileUpOccupancyRatioDistribution.SetNameTitle("PileUpOccupancyRatio", "Simulated over parametrised hit occupancy;Ratio;Sensors");
+      pileUpOccupancyRatioDistribution.SetBins(100, 0., 5.);
+
+      // the occupancy and cluster width of the sensors, averaged by layer and ring
+      std::map<std::string, std::map<std::pair<int, int>, std::pair<double, int> > > occupancies, widths;
+      for (const PileUpSimulator::SensorOccupancy& s : simulator.sensors()) {
+        const DetectorModule& m = *s.module;
+        double meanHitChannels = crossings > 0 ? double(s.counts.hitChannels) / crossings : 0.;
+        double occupancy = meanHitChannels / s.channels;
+        // the sparsified bandwidth is only modelled for the strip modules, as in BandwidthVisitor
+        if (m.sensors().back().type() == SensorType::Strip) {
+          pileUpBandwidthDistributionSparsified.Fill((m.numSparsifiedHeaderBits()*s.chips + meanHitChannels*m.numSparsifiedPayloadBits())*100E3);
+        }
+        double parametrisedOccupancy = m.hitOccupancyPerEvent() * nMB;
+        if (parametrisedOccupancy > 0.) pileUpOccupancyRatioDistribution.Fill(occupancy / parametrisedOccupancy);
+
+        TableRef ref = m.tableRef();
+        std::pair<double, int>& occupancySum = occupancies[ref.table][std::make_pair(ref.row, ref.col)];
+        occupancySum.first += occupancy * 100;
+        occupancySum.second++;
+        if (s.counts.clusters > 0) {
+          std::pair<double, int>& widthSum = widths[ref.table][std::make_pair(ref.row, ref.col)];
+          widthSum.first += double(s.counts.clusterWidths) / s.counts.clusters;
+          widthSum.second++;
+        }
+      }
+      pileUpHitOccupancySummaries_.clear();
+      pileUpClusterWidthSummaries_.clear();
+      for (auto& table : occupancies) {
+        SummaryTable& summary = pileUpHitOccupancySummaries_[table.first];
+        summary.setHeader("Layer", "Ring");
+        summary.setPrecision(3);
+        for (auto& cell : table.second) summary.setCell(cell.first.first, cell.first.second, cell.second.first / cell.second.second);
+      }
+      for (auto& table : widths) {
+        SummaryTable& summary = pileUpClusterWidthSummaries_[table.first];
+        summary.setHeader("Layer", "Ring");
+        summary.setPrecision(3);
+        for (auto& cell : table.second) summary.setCell(cell.first.first, cell.first.second, cell.second.first / cell.second.second);
+      }
+    }
+
 
     std::vector<double> Analyzer::average(TGraph& myGraph, std::vector<double> cuts) {
       std::vector<double> averages;
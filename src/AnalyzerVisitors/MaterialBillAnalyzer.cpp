@@ -3,9 +3,9 @@
 #include "ModuleCap.h"
 #include <iostream>
 
-void MaterialBillAnalyzer::inspectInactiveElements(const std::vector<InactiveElement>& inactiveElements) {
+void MaterialBillAnalyzer::inspectInactiveElements(const InactiveSurfaces::ElementList& inactiveElements) {
   for (const auto& it : inactiveElements) {
-    const std::map<std::string, double>& localMasses = it.getLocalMasses();
+    const std::map<std::string, double>& localMasses = it.getLocalMassesByName();
     for (auto massIt : localMasses) {
       outputTable += any2str(it.getInnerRadius()) + ", ";
       outputTable += any2str(it.getInnerRadius()+it.getRWidth()) + ", ";
@@ -34,8 +34,8 @@ void MaterialBillAnalyzer::inspectModules(std::vector<std::vector<insur::ModuleC
       Visitor v;
       myModule->accept(v);
       MaterialMap& layerMaterial = layerMaterialMap_[v.id_];
-      const std::map<std::string, double>& localMasses = myModuleCap.getLocalMasses();
-      for (const auto &it : localMasses)  layerMaterial[it.first]+=it.second;
+      const MassVector& localMasses = myModuleCap.getLocalMasses();
+      for (const auto &it : localMasses)  layerMaterial[MaterialSymbols::name(it.first)]+=it.second;
     }
   }
 }
@@ -57,9 +57,9 @@ void MaterialBillAnalyzer::inspectTracker(MaterialBudget& mb) {
   }
 
   InactiveSurfaces& is = mb.getInactiveSurfaces();
-  std::vector<InactiveElement>& barrelServices = is.getBarrelServices();
-  std::vector<InactiveElement>& endcapServices = is.getEndcapServices();
-  std::vector<InactiveElement>& supports = is.getSupports();
+  InactiveSurfaces::ElementList& barrelServices = is.getBarrelServices();
+  InactiveSurfaces::ElementList& endcapServices = is.getEndcapServices();
+  InactiveSurfaces::ElementList& supports = is.getSupports();
   outputTable += "other elements\n";
   outputTable += "r_in, r_out, z_in, z_out, material, weight_grams\n";
   inspectInactiveElements(barrelServices);
@@ -121,6 +121,15 @@ namespace material {
     return stationType_;
   }
 
+  /**
+   * Adds the names of the materials converted by the station: the quantities of their conversions depend on their density.
+   */
+  void ConversionStation::getInputMaterials(std::set<std::string>& materials) const {
+    for (const Conversion* currConversion : conversions) {
+      materials.insert(currConversion->input->elements[0]->elementName());
+    }
+  }
+
   void ConversionStation::buildConversions() {
     //std::cout << "STATION" << std::endl;
 
@@ -88,17 +88,16 @@ void DetectorModule::setup() {
 
 
 
+/**
+ * The eta range of the module seen from the beam line within zError of the origin. It is computed on every call, with
+ * no cache, so that the hit checks of concurrent tracks only read the module, whatever their zError.
+ */
 std::pair<double, double> DetectorModule::minMaxEtaWithError(double zError) const {
-  if (cachedZError_ != zError) {
-    cachedZError_ = zError;
-    double eta1 = (XYZVector(0., maxR(), maxZ() + zError)).Eta();
-    double eta2 = (XYZVector(0., minR(), minZ() - zError)).Eta();
-    double eta3 = (XYZVector(0., minR(), maxZ() + zError)).Eta();
-    double eta4 = (XYZVector(0., maxR(), minZ() - zError)).Eta();
-    cachedMinMaxEtaWithError_ = std::minmax({eta1, eta2, eta3, eta4});
-    //cachedMinMaxEtaWithError_ = std::make_pair(MIN(eta1, eta2), MAX(eta1, eta2));
-  }
-  return cachedMinMaxEtaWithError_;
+  double eta1 = (XYZVector(0., maxR(), maxZ() + zError)).Eta();
+  double eta2 = (XYZVector(0., minR(), minZ() - zError)).Eta();
+  double eta3 = (XYZVector(0., minR(), maxZ() + zError)).Eta();
+  double eta4 = (XYZVector(0., maxR(), minZ() - zError)).Eta();
+  return std::minmax({eta1, eta2, eta3, eta4});
 }
 
 bool DetectorModule::couldHit(const XYZVector& direction, double zError) const {
@@ -199,16 +198,27 @@ double DetectorModule::effectiveDsDistance() const {
   else return dsDistance()*sin(center().Theta())/sin(center().Theta()+tiltAngle());
 }
 
-std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) {
+void DetectorModule::freeze() const {
+  basePoly().getCenter();
+  basePoly().getNormal();
+  for (const auto& s : sensors_) s.buildPolys();
+  minR(); maxR(); minZ(); maxZ();
+  minPhi(); maxPhi();
+  minSegments(); maxSegments();
+}
+
+std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& trackOrig, const XYZVector& trackDir) const {
+  if (numSensors() == 1) return assignTrackHits(innerSensor().checkHitSegment(trackOrig, trackDir), std::make_pair(XYZVector(), -1));
+  else return assignTrackHits(innerSensor().checkHitSegment(trackOrig, trackDir), outerSensor().checkHitSegment(trackOrig, trackDir));
+}
+
+std::pair<XYZVector, HitType> DetectorModule::assignTrackHits(const std::pair<XYZVector, int>& inSegm, const std::pair<XYZVector, int>& outSegm) const {
   HitType ht = HitType::NONE;
   XYZVector gc; // global coordinates of the hit
   if (numSensors() == 1) {
-    auto segm = innerSensor().checkHitSegment(trackOrig, trackDir);
     // <SMe>The following line used to return HitType::BOTH. Changing to INNER in order to avoid double hit counting</SMe>
-    if (segm.second > -1) { gc = segm.first; ht = HitType::INNER; } 
+    if (inSegm.second > -1) { gc = inSegm.first; ht = HitType::INNER; } 
   } else {
-    auto inSegm = innerSensor().checkHitSegment(trackOrig, trackDir);
-    auto outSegm = outerSensor().checkHitSegment(trackOrig, trackDir);
     if (inSegm.second > -1 && outSegm.second > -1) { 
       gc = inSegm.first; // in case of both sensors are hit, the inner sensor hit coordinate is returned
       ht = ((zCorrelation() == SAMESEGMENT && (inSegm.second / (maxSegments()/minSegments()) == outSegm.second)) || zCorrelation() == MULTISEGMENT) ? HitType::STUB : HitType::BOTH;
@@ -216,9 +226,8 @@ std::pair<XYZVector, HitType> DetectorModule::checkTrackHits(const XYZVector& tr
     else if (outSegm.second > -1) { gc = outSegm.first; ht = HitType::OUTER; }
   }
   //basePoly().isLineIntersecting(trackOrig, trackDir, gc); // this was just for debug
-  if (ht != HitType::NONE) numHits_++;
   return std::make_pair(gc, ht);
-};
+}
 
 //BarrelModule::BarrelModule(Decorated* decorated) : DetectorModule(decorated) {
 //setup();
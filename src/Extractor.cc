@@ -10,6 +10,7 @@
 
 #include <Extractor.h>
 #include <cstdlib>
+#include <algorithm>
 
 namespace insur {
   //public
@@ -1705,8 +1706,8 @@ namespace insur {
     pos.trans.dy = 0.0;
     // b_ser: one composite for every service volume on the z+ side
     // s, l and p: one entry per service volume
-    std::vector<InactiveElement>::iterator iter, guard;
-    std::vector<InactiveElement>& bs = is.getBarrelServices();
+    InactiveSurfaces::ElementList::iterator iter, guard;
+    InactiveSurfaces::ElementList& bs = is.getBarrelServices();
     guard = bs.end();
 #if 1
     int  previousInnerRadius = -1;
@@ -1792,8 +1793,8 @@ namespace insur {
     pos.trans.dy = 0.0;
     // e_ser: one composite for every service volume on the z+ side
     // s, l and p: one entry per service volume
-    std::vector<InactiveElement>::iterator iter, guard;
-    std::vector<InactiveElement>& es = is.getEndcapServices();
+    InactiveSurfaces::ElementList::iterator iter, guard;
+    InactiveSurfaces::ElementList& es = is.getEndcapServices();
     guard = es.end();
     for (iter = es.begin(); iter != guard; iter++) {
       std::ostringstream matname, shapename;
@@ -1871,8 +1872,8 @@ namespace insur {
     // l, s and p: one entry per support part
     std::set<MaterialProperties::Category> found;
     std::set<MaterialProperties::Category>::iterator fres;
-    std::vector<InactiveElement>::iterator iter, guard;
-    std::vector<InactiveElement>& sp = is.getSupports();
+    InactiveSurfaces::ElementList::iterator iter, guard;
+    InactiveSurfaces::ElementList& sp = is.getSupports();
     guard = sp.end();
     // support volume loop
     for (iter = sp.begin(); iter != guard; iter++) {
@@ -1990,16 +1991,18 @@ namespace insur {
     comp.density = density;
     comp.method = wt;
     double m = 0.0;
-   for (std::map<std::string, double>::const_iterator it = mp.getLocalMasses().begin(); it != mp.getLocalMasses().end(); ++it) {
-      if (!nosensors || (it->first.compare(xml_sensor_silicon) != 0)) {
+    int siliconId = MaterialSymbols::find(xml_sensor_silicon);
+    for (MassVector::const_iterator it = mp.getLocalMasses().begin(); it != mp.getLocalMasses().end(); ++it) {
+      if (!nosensors || (it->first != siliconId)) {
         //    std::pair<std::string, double> p;
         //    p.first = mp.getLocalTag(i);
         //    p.second = mp.getLocalMass(i);
-        comp.elements.push_back(*it);
+        comp.elements.push_back(std::make_pair(MaterialSymbols::name(it->first), it->second));
         //    m = m + mp.getLocalMass(i);
         m += it->second;
       }
     }
+    std::sort(comp.elements.begin(), comp.elements.end()); // in alphabetical order, as the names are unique
     for (unsigned int i = 0; i < comp.elements.size(); i++)
       comp.elements.at(i).second = comp.elements.at(i).second / m;
     return comp;
@@ -2135,9 +2138,7 @@ namespace insur {
   double Extractor::calculateSensorThickness(ModuleCap& mc, MaterialTable& mt) {
     double t = 0.0;
     double m = 0.0, d = 0.0;
-    for (std::map<std::string, double>::const_iterator it = mc.getLocalMasses().begin(); it != mc.getLocalMasses().end(); ++it) {
-      if (it->first.compare(xml_sensor_silicon) == 0) m += it->second;
-    }
+    m = mc.getLocalMass(MaterialSymbols::find(xml_sensor_silicon));
     try { d = mt.getMaterial(xml_sensor_silicon).density; }
     catch (std::exception& e) { return 0.0; }
     t = 1000 * m / (d * mc.getSurface());
@@ -2192,8 +2193,9 @@ namespace insur {
     double d = mc.getSurface() * mc.getModule().thickness();
     if (nosensors) {
       double m = 0.0;
-      for (std::map<std::string, double>::const_iterator it = mc.getLocalMasses().begin(); it != mc.getLocalMasses().end(); ++it) {
-        if (it->first.compare(xml_sensor_silicon) != 0) m += it->second;
+      int siliconId = MaterialSymbols::find(xml_sensor_silicon);
+      for (MassVector::const_iterator it = mc.getLocalMasses().begin(); it != mc.getLocalMasses().end(); ++it) {
+        if (it->first != siliconId) m += it->second;
       }
       d = 1000 * m / d;
     }
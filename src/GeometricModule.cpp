@@ -9,7 +9,7 @@ double ModuleHelpers::polygonAperture(const Polygon3d<4>& poly) {
 // Distance between origin and module if hits
 // Otherwise -1
 double GeometricModule::trackCross(const XYZVector& PL, // Base line point
-                                   const XYZVector& PU) // Line direction
+                                   const XYZVector& PU) const // Line direction
 {
   double distance;
 
@@ -26,7 +26,6 @@ double GeometricModule::trackCross(const XYZVector& PL, // Base line point
   }
 
   if (distance>=0) {
-    numHits_++;
     distance /= PU.r();
   } else {
     return -1;
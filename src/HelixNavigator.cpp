@@ -0,0 +1,121 @@
+#include <HelixNavigator.h>
+
+/**
+ * Bins the modules of a tracker in surfaces and phi sectors. The geometry must be final, as the modules are only read from
+ * then on, concurrently: their center and normal, which are computed on first use, are computed here.
+ */
+void HelixNavigator::setTracker(const Tracker& tracker) {
+  class ModuleCollector : public ConstGeometryVisitor {
+  public:
+    std::vector<const DetectorModule*> modules;
+    void visit(const BarrelModule& m) { modules.push_back(&m); }
+    void visit(const EndcapModule& m) { modules.push_back(&m); }
+  };
+  ModuleCollector collector;
+  tracker.accept(collector);
+  modules_ = collector.modules;
+  trackerMaxRho_ = tracker.maxR();
+
+  std::map<long, Surface> barrelSurfaces, endcapSurfaces; // by position in tenths of mm
+  for (unsigned int i = 0; i < modules_.size(); i++) {
+    const DetectorModule& m = *modules_[i];
+    m.normal();
+    if (m.subdet() == BARREL) addToSurface(barrelSurfaces, m.center().Rho(), m.planarMinZ(), m.planarMaxZ(), i);
+    else addToSurface(endcapSurfaces, m.center().Z(), m.planarMinR(), m.planarMaxR(), i);
+  }
+  barrelSurfaces_.clear();
+  endcapSurfaces_.clear();
+  for (auto& s : barrelSurfaces) barrelSurfaces_.push_back(std::move(s.second));
+  for (auto& s : endcapSurfaces) endcapSurfaces_.push_back(std::move(s.second));
+}
+
+/**
+ * Adds a module to the surface at its position, and to the phi sectors its corners span, with a margin for the
+ * distance between the surface and the plane of the module.
+ */
+void HelixNavigator::addToSurface(std::map<long, Surface>& surfaces, double position, double min, double max, int moduleIndex) {
+  static const double phiMargin = 0.02;
+  Surface& surface = surfaces[lround(position*10)];
+  if (surface.sectors.empty()) {
+    surface.position = position;
+    surface.min = min;
+    surface.max = max;
+    surface.sectors.resize(phiSectors);
+  }
+  surface.min = MIN(surface.min, min);
+  surface.max = MAX(surface.max, max);
+
+  const DetectorModule& m = *modules_[moduleIndex];
+  double centerPhi = m.center().Phi();
+  double minDeltaPhi = 0., maxDeltaPhi = 0.;
+  for (int v = 0; v < 4; v++) {
+    double deltaPhi = m.basePoly().getVertex(v).Phi() - centerPhi;
+    if (deltaPhi > M_PI) deltaPhi -= 2*M_PI;
+    else if (deltaPhi < -M_PI) deltaPhi += 2*M_PI;
+    minDeltaPhi = MIN(minDeltaPhi, deltaPhi);
+    maxDeltaPhi = MAX(maxDeltaPhi, deltaPhi);
+  }
+  int first = floor((centerPhi + minDeltaPhi - phiMargin + M_PI) / (2*M_PI) * phiSectors);
+  int last = floor((centerPhi + maxDeltaPhi + phiMargin + M_PI) / (2*M_PI) * phiSectors);
+  for (int sector = first; sector <= MIN(last, first + phiSectors - 1); sector++) {
+    surface.sectors[(sector + phiSectors) % phiSectors].push_back(moduleIndex);
+  }
+}
+
+int HelixNavigator::phiSector(double phi) {
+  int sector = floor((phi + M_PI) / (2*M_PI) * phiSectors);
+  return MAX(0, MIN(phiSectors - 1, sector));
+}
+
+/**
+ * Finds the modules crossed by a track, ordered along it.
+ * @param result Cleared, then filled with the crossings
+ */
+void HelixNavigator::crossings(const Helix& helix, std::vector<Crossing>& result) const {
+  result.clear();
+  double maxPath = M_PI*helix.R;
+  double escapePath = helix.pathToRadius(trackerMaxRho_);
+  if (escapePath >= 0.) maxPath = MIN(maxPath, escapePath + 1.);
+  crossSurfaces(helix, barrelSurfaces_, true, maxPath, result);
+  crossSurfaces(helix, endcapSurfaces_, false, maxPath, result);
+  std::sort(result.begin(), result.end(), [](const Crossing& a, const Crossing& b) { return a.s < b.s; });
+}
+
+void HelixNavigator::crossSurfaces(const Helix& helix, const std::vector<Surface>& surfaces, bool barrel, double maxPath, std::vector<Crossing>& result) const {
+  static const double margin = 10.; // mm, for the distance between the surface and the module planes
+  Crossing crossing;
+  for (const Surface& surface : surfaces) {
+    double s = barrel ? helix.pathToRadius(surface.position) : helix.pathToZ(surface.position);
+    if (s < 0. || s > maxPath) continue;
+    XYZVector point = helix.at(s);
+    double extent = barrel ? point.Z() : point.Rho();
+    if (extent < surface.min - margin || extent > surface.max + margin) continue;
+    for (int moduleIndex : surface.sectors[phiSector(point.Phi())]) {
+      if (crossModule(helix, moduleIndex, s, maxPath, crossing)) result.push_back(crossing);
+    }
+  }
+}
+
+/**
+ * Intersects a track with the plane of a module, with Newton steps on the path length from a point near it, and checks
+ * whether the intersection is inside the module.
+ */
+bool HelixNavigator::crossModule(const Helix& helix, int moduleIndex, double s, double maxPath, Crossing& crossing) const {
+  const DetectorModule& m = *modules_[moduleIndex];
+  const XYZVector& center = m.center();
+  const XYZVector& normal = m.normal();
+  for (int step = 0; step < 10; step++) {
+    double slope = normal.Dot(helix.direction(s));
+    if (fabs(slope) < 1e-9) return false; // the track runs along the module
+    double ds = -normal.Dot(helix.at(s) - center) / slope;
+    s += ds;
+    if (fabs(ds) < 1e-6) break;
+  }
+  if (s < 0. || s > maxPath) return false;
+  XYZVector global = helix.at(s);
+  if (fabs(normal.Dot(global - center)) > 1e-3 || !m.basePoly().isPointInside(global)) return false;
+  crossing.s = s;
+  crossing.module = moduleIndex;
+  crossing.global = global;
+  return true;
+}
@@ -1,4 +1,5 @@
 #include <HoughTrack.h>
+#include <sys/resource.h>
 
 
 HoughTrack::~HoughTrack() {
@@ -69,26 +70,27 @@ double HoughTrack::rectangularSmear(double mean, double sigma, int nsteps, int s
 }
 
 
-void HoughTrack::processHit(int evid, int hitid, double x, double y, double z, double pt, double ptError, double yResolution) { 
+void HoughTrack::processHit(const HitSample& hit, CounterRandom::Stream& dice, HistoType& histo) const {
   const double sigmaZ0 = 70;
-  const double sigmaZ = yResolution*sqrt(12)/2;
-  double sigmaInvPt = 3*ptError*1/fabs(pt);
-  //double invPt = die_.Gaus(1/pt, ptError); 
-  double invPt = die_.Uniform(1/pt - sigmaInvPt, 1/pt + sigmaInvPt);
-  int nSamplesPt = 2*sigmaInvPt/histo_.getWbins(H_K); 
-  z = die_.Uniform(z-sigmaZ, z+sigmaZ);
+  const double sigmaZ = hit.yres*sqrt(12)/2;
+  double x = hit.x, y = hit.y, pt = hit.pt;
+  double sigmaInvPt = 3*hit.ptError*1/fabs(pt);
+  //double invPt = dice.Gaus(1/pt, ptError); 
+  double invPt = 1/pt - sigmaInvPt + 2*sigmaInvPt*dice.Rndm();
+  int nSamplesPt = 2*sigmaInvPt/histo.getWbins(H_K); 
+  double z = hit.z - sigmaZ + 2*sigmaZ*dice.Rndm();
+  SmartBin sample(1, hit.entry, 1 << hit.hitid);
   for (int k = 0; k < nSamplesPt; k++) {
     double invPtSample = rectangularSmear(invPt, sigmaInvPt, nSamplesPt, k);
     double phi0 = calcPhi0(x, y, 1/invPtSample);
-    int nSamplesZ0 = 2*sigmaZ0/histo_.getWbins(H_Z0);
+    int nSamplesZ0 = 2*sigmaZ0/histo.getWbins(H_Z0);
     for (int l = 0; l < nSamplesZ0; l++) {
       double z0Sample = rectangularSmear(0, sigmaZ0, nSamplesZ0, l);
-      int nSamplesZ = 2*sigmaZ/histo_.getWbins(H_Z0);
+      int nSamplesZ = 2*sigmaZ/histo.getWbins(H_Z0);
       for (int m = 0; m < nSamplesZ; m++) {
         double zSample = rectangularSmear(z, sigmaZ, nSamplesZ, m);
         double theta = calcTheta(x, y, zSample, z0Sample, 1/invPtSample);
-        //histo_.fill(seq<4>(invPtSample)(phi0)(z0Sample)(theta));
-        histo_[invPtSample][phi0][z0Sample][theta] += SmartBin(1, evid, 1 << hitid);
+        histo.fill(seq<4>(invPtSample)(phi0)(z0Sample)(theta), sample);
       }
     }
   }
@@ -111,6 +113,14 @@ void HoughTrack::loadGeometryData(TFile* infile) {
 }
 
 
+// The peak resident memory of the process so far, in MB
+static long peakResidentMemory() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss/1024; // kB on Linux
+}
+
+
 void printTHisto(TH1* th, const char* drawopts = "", bool logx = false, bool logy = false) {
   TCanvas* canvas = new TCanvas("histo_canvas", "Histo Canvas", 1200, 1200 );
   canvas->cd();
@@ -126,13 +136,11 @@ void printTHisto(TH1* th, const char* drawopts = "", bool logx = false, bool log
 
 //#define GENERATE_HIT_MAP
 
-void HoughTrack::processTree(std::string filename, long int startev, long int howmany) {
+void HoughTrack::processTree(std::string filename, long int startev, long int howmany, int numThreads) {
 
   TracksP tracks;
   HitsP hits;
 
-  ptError pterror;
-
   TFile* infile = new TFile(filename.c_str(), "read");
   if (infile->IsZombie()) {
     std::cerr << "Failed opening file \"" << filename << "\" for reading. Processing aborted." << std::endl;
@@ -177,40 +185,64 @@ void HoughTrack::processTree(std::string filename, long int startev, long int ho
                                    Seq<2,double> (.6)(2.2));
   Histo<2, double> invPtEtaAverageHits(Seq<2,int>   (100) (100),
                                        Seq<2,double>(-.6)(-2.2),
-                                       Seq<2,double> (.6) (2.2));
+                                       Seq<2,double> (.6)(2.2));
 #endif
   int minHits = 100, maxHits = 0;
   float minAvgHits = 100, maxAvgHits = 0;
-  for (long int i = startev; i < howmany+startev && i < nevents; i++) {
-    tree->GetEntry(i);
-    /*if ((i-startev)%2 == 0)*/ std::cout << "Event " << i+1 << " of " << MIN(nevents,howmany+startev) << std::endl;
-    for (unsigned int j = 0; j < tracks.trackn->size(); j++) {
-      minHits = tracks.nhits->at(j) < minHits ? hits.cnt->size() /*tracks.nhits->at(j)*/ : minHits;
-      maxHits = tracks.nhits->at(j) > maxHits ? hits.cnt->size() /*tracks.nhits->at(j)*/ : maxHits;
+
+  numThreads = MAX(1, numThreads);
+  CounterRandom dice(0xcafebabe, CounterRandom::HOUGH_TRANSFORM);
+  std::vector<HistoType> shards(numThreads, histo_);
+  long endev = MIN(nevents, howmany+startev);
+  long entriesPerBatch = entriesPerThreadBatch*numThreads; // a multiple of the number of threads, so that entry i always goes to the thread i % numThreads
+  std::vector<std::vector<HitSample> > batch;
+  size_t peakShardMemory = 0;
+
+  for (long int batchBegin = startev; batchBegin < endev; batchBegin += entriesPerBatch) {
+    // the tree is read on this thread only
+    batch.assign(MIN(entriesPerBatch, endev - batchBegin), std::vector<HitSample>());
+    for (long int i = batchBegin; i < batchBegin + long(batch.size()); i++) {
+      tree->GetEntry(i);
+      /*if ((i-startev)%2 == 0)*/ std::cout << "Event " << i+1 << " of " << endev << std::endl;
+      for (unsigned int j = 0; j < tracks.trackn->size(); j++) {
+        minHits = tracks.nhits->at(j) < minHits ? hits.cnt->size() /*tracks.nhits->at(j)*/ : minHits;
+        maxHits = tracks.nhits->at(j) > maxHits ? hits.cnt->size() /*tracks.nhits->at(j)*/ : maxHits;
 #ifndef GENERATE_HIT_MAP
-      for (size_t k = 0; k < hits.cnt->size(); k++) {
-        ModuleData& mdata = mods_[hits.cnt->at(k)][hits.z->at(k)][hits.rho->at(k)][hits.phi->at(k)];
-        pterror.setPitch((mdata.pitchhi+mdata.pitchlo)/2);
-        pterror.setStripLength(mdata.striplen);
-        pterror.setZ(mdata.z);
-        pterror.setR(mdata.rho);
-        pterror.setDistance(mdata.stereo);
-        pterror.setHeight(mdata.height);
-        pterror.setInefficiencyType((ptError::InefficiencyType)mdata.inefftype);
-        pterror.setModuleType(mdata.type);
-        processHit(i, k, hits.glox->at(k), hits.gloy->at(k), hits.gloz->at(k), tracks.pt->at(j), hits.pterr->at(k), mdata.yres);
-        //if (tracks.nhits->at(j) > 10) 
-        //  std::cout << "  Mod z, rho, phi: " << mdata.z << "," << mdata.rho << "," << mdata.phi << " Hit invPt, pterr: " << 1/pt << "," << hits.pterr->at(k) << std::endl;
-      }
+        for (size_t k = 0; k < hits.cnt->size(); k++) {
+          ModuleData& mdata = mods_[hits.cnt->at(k)][hits.z->at(k)][hits.rho->at(k)][hits.phi->at(k)];
+          HitSample hit = { i, int(j), int(k), hits.glox->at(k), hits.gloy->at(k), hits.gloz->at(k), tracks.pt->at(j), hits.pterr->at(k), mdata.yres };
+          batch[i - batchBegin].push_back(hit);
+        }
 #else
-      double invpt = 1/tracks.pt->at(j), eta = tracks.eta->at(j);
-      invPtEtaTrackCount.fill(seq<2>(invpt)(eta));
-      double avg = invPtEtaAverageHits.get(seq<2>(invpt)(eta));
-      invPtEtaAverageHits.fill(seq<2>(invpt)(eta), (hits.cnt->size() - avg)/invPtEtaTrackCount.get(seq<2>(invpt)(eta)));
+        double invpt = 1/tracks.pt->at(j), eta = tracks.eta->at(j);
+        invPtEtaTrackCount.fill(seq<2>(invpt)(eta));
+        double avg = invPtEtaAverageHits.get(seq<2>(invpt)(eta));
+        invPtEtaAverageHits.fill(seq<2>(invpt)(eta), (hits.cnt->size() - avg)/invPtEtaTrackCount.get(seq<2>(invpt)(eta)));
 #endif
+      }
     }
+
+    parallelFor(0, numThreads, numThreads, [&](int t) {
+      for (size_t e = t; e < batch.size(); e += numThreads) {
+        for (const HitSample& hit : batch[e]) {
+          // the hits of an entry are sampled again for each of its tracks, each with its own stream
+          CounterRandom::Stream hitDice = dice.stream(uint64_t(hit.entry) << 32 | uint64_t(hit.track) << 16 | hit.hitid);
+          processHit(hit, hitDice, shards[t]);
+        }
+      }
+    });
+    for (const HistoType& shard : shards) peakShardMemory = MAX(peakShardMemory, shard.memoryUsage());
   }
-  cout << "Transform done. Histo size: " << histo_.size() << " entries. " << histo_.size()*(sizeof(BinKey<4, uint16_t>) + sizeof(SmartBin))/1048576 << " MB (no overhead)" << std::endl;
+
+  // each shard is freed once merged, which bounds the memory needed by the merge
+  for (HistoType& shard : shards) {
+    histo_.merge(shard, [](SmartBin& bin, const SmartBin& other) { bin.merge(other); });
+    shard.clear();
+  }
+
+  cout << "Transform done. Histo size: " << histo_.size() << " entries. " << histo_.memoryUsage()/1048576 << " MB in the hash table, "
+       << peakShardMemory/1048576 << " MB in the largest of the " << numThreads << " thread tables. Peak memory of the process: "
+       << peakResidentMemory() << " MB" << std::endl;
 
 #ifdef GENERATE_HIT_MAP
   std::ofstream hout("pt_eta_average_hits_3million.hst");
@@ -295,8 +327,12 @@ void HoughTrack::processTree(std::string filename, long int startev, long int ho
 
 int main(int argc, char* argv[]) {
 
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " <tracks file> <first event> <num events> [num threads]" << std::endl;
+    return EXIT_FAILURE;
+  }
   HoughTrack ht;
-  ht.processTree(argv[1], str2any<long int>(argv[2]), str2any<long int>(argv[3]));
+  ht.processTree(argv[1], str2any<long int>(argv[2]), str2any<long int>(argv[3]), argc > 4 ? str2any<int>(argv[4]) : 1);
   
   return 0;
 }
@@ -10,9 +10,10 @@
 namespace insur {
     /*-----public functions-----*/
     /**
-     * The constructor sets some defaults: no neighbours, intermediate element.
+     * The constructor sets some defaults: no neighbours, horizontal intermediate element.
      */
     InactiveElement::InactiveElement() {
+        is_vertical = false;
         is_final = false;
         feeder_type = no_in;
         feeder_index = -1;
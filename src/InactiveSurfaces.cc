@@ -4,14 +4,99 @@
  */
 
 #include <InactiveSurfaces.h>
+#include <algorithm>
+#include <utility>
 namespace insur {
+    /*===== construction and copies =====*/
+    InactiveSurfaces::InactiveSurfaces() : is_up(false), etaIndexValid_(false) {
+        bindLists();
+    }
+
+    /**
+     * The copy only takes the elements still on the lists, so it leaves out the slots freed by removals.
+     */
+    InactiveSurfaces::InactiveSurfaces(const InactiveSurfaces& other) : is_up(other.is_up), etaIndexValid_(false) {
+        bindLists();
+        const ElementList* otherLists[3] = { &other.barrelservices, &other.endcapservices, &other.supports };
+        for (int c = 0; c < 3; c++) {
+            ElementList& list = collection(c);
+            list.slots_.reserve(otherLists[c]->size());
+            for (const InactiveElement& element : *otherLists[c]) add(list, InactiveElement(element));
+        }
+    }
+
+    /**
+     * The elements stay where they are in the arena, so the references to them remain valid in the new owner.
+     */
+    InactiveSurfaces::InactiveSurfaces(InactiveSurfaces&& other) :
+        is_up(other.is_up),
+        arena(std::move(other.arena)),
+        freeSlots(std::move(other.freeSlots)),
+        barrelservices(std::move(other.barrelservices)),
+        endcapservices(std::move(other.endcapservices)),
+        supports(std::move(other.supports)),
+        etaIndexValid_(false) {
+        bindLists();
+        other.freeSlots.clear();
+        other.barrelservices.slots_.clear();
+        other.endcapservices.slots_.clear();
+        other.supports.slots_.clear();
+        other.bindLists();
+    }
+
+    InactiveSurfaces& InactiveSurfaces::operator=(InactiveSurfaces other) {
+        is_up = other.is_up;
+        arena.swap(other.arena);
+        freeSlots.swap(other.freeSlots);
+        barrelservices.slots_.swap(other.barrelservices.slots_);
+        endcapservices.slots_.swap(other.endcapservices.slots_);
+        supports.slots_.swap(other.supports.slots_);
+        etaIndexValid_ = false;
+        return *this;
+    }
+
+    void InactiveSurfaces::bindLists() {
+        barrelservices.arena_ = &arena;
+        endcapservices.arena_ = &arena;
+        supports.arena_ = &arena;
+    }
+
+    /**
+     * Move an element into a free slot of the arena, or a new one at its end, and append the slot to a list.
+     */
+    void InactiveSurfaces::add(ElementList& list, InactiveElement&& element) {
+        if (freeSlots.empty()) {
+            list.slots_.push_back(arena.size());
+            arena.push_back(std::move(element));
+        } else {
+            list.slots_.push_back(freeSlots.back());
+            arena[freeSlots.back()] = std::move(element);
+            freeSlots.pop_back();
+        }
+        etaIndexValid_ = false;
+    }
+
+    /**
+     * Take an element off a list. Its slot is reset, which releases its material tables, and kept for the next addition.
+     * @return An iterator to the element immediately after the removed one, or to <i>end()</i>
+     */
+    InactiveSurfaces::ElementList::iterator InactiveSurfaces::remove(ElementList& list, int index) {
+        etaIndexValid_ = false;
+        if ((index < 0) || ((unsigned int)index >= list.size())) return list.end();
+        int slot = list.slots_[index];
+        arena[slot] = InactiveElement();
+        freeSlots.push_back(slot);
+        return ElementList::iterator(&arena, list.slots_.erase(list.slots_.begin() + index));
+    }
+
     /*===== services =====*/
     /**
-     * Add a single inactive element to the list of barrel services by copying it.
+     * Add a single inactive element to the list of barrel services by moving it. Callers that keep using the element
+     * pass a copy.
      * @param service The element that is appended to the list of barrel service parts
      */
-    void InactiveSurfaces::addBarrelServicePart(InactiveElement service) {
-        barrelservices.push_back(service);
+    void InactiveSurfaces::addBarrelServicePart(InactiveElement&& service) {
+        add(barrelservices, std::move(service));
     }
     
     /**
@@ -30,25 +115,24 @@ namespace insur {
      * @param index The index of the barrel element that will be removed
      * @return An interator to the barrel element immediately after the removed one
      */
-    std::vector<InactiveElement>::iterator InactiveSurfaces::removeBarrelServicePart(int index) {
-        if ((index >= 0) && ((unsigned int)index < barrelservices.size())) return barrelservices.erase(barrelservices.begin() + index);
-        return barrelservices.end();
+    InactiveSurfaces::ElementList::iterator InactiveSurfaces::removeBarrelServicePart(int index) {
+        return remove(barrelservices, index);
     }
     
     /**
      * Access the full list of barrel service parts at once.
-     * @return A reference to the internal barrel service vector
+     * @return A reference to the internal barrel service list
      */
-    std::vector<InactiveElement>& InactiveSurfaces::getBarrelServices() {
+    InactiveSurfaces::ElementList& InactiveSurfaces::getBarrelServices() {
         return barrelservices;
     }
     
     /**
-     * Add a single inactive element to the list of endcap services by copying it.
+     * Add a single inactive element to the list of endcap services by moving it.
      * @param service The element that is appended to the list of endcap service parts
      */
-    void InactiveSurfaces::addEndcapServicePart(InactiveElement service) {
-        endcapservices.push_back(service);
+    void InactiveSurfaces::addEndcapServicePart(InactiveElement&& service) {
+        add(endcapservices, std::move(service));
     }
     
     /**
@@ -67,25 +151,24 @@ namespace insur {
      * @param index The index of the endcap element that will be removed
      * @return An interator to the endcap element immediately after the removed one
      */
-    std::vector<InactiveElement>::iterator InactiveSurfaces::removeEndcapServicePart(int index) {
-        if ((index >= 0) && ((unsigned int)index < endcapservices.size())) return endcapservices.erase(endcapservices.begin() + index);
-        return endcapservices.end();
+    InactiveSurfaces::ElementList::iterator InactiveSurfaces::removeEndcapServicePart(int index) {
+        return remove(endcapservices, index);
     }
     
     /**
      * Access the full list of endcap services at once.
-     * @return A reference to the internal endcap services vector
+     * @return A reference to the internal endcap services list
      */
-    std::vector<InactiveElement>& InactiveSurfaces::getEndcapServices() {
+    InactiveSurfaces::ElementList& InactiveSurfaces::getEndcapServices() {
         return endcapservices;
     }
     /*===== supports =====*/
     /**
-     * Add a single inactive element to the list of supports by copying it.
+     * Add a single inactive element to the list of supports by moving it.
      * @param support The element that is appended to the list of support parts
      */
-    void InactiveSurfaces::addSupportPart(InactiveElement support) {
-        supports.push_back(support);
+    void InactiveSurfaces::addSupportPart(InactiveElement&& support) {
+        add(supports, std::move(support));
     }
     
     /**
@@ -104,16 +187,15 @@ namespace insur {
      * @param index The index of the element that will be removed
      * @return An interator to the element immediately after the removed one
      */
-    std::vector<InactiveElement>::iterator InactiveSurfaces::removeSupportPart(int index) {
-        if ((index >= 0) && ((unsigned int)index < supports.size())) return supports.erase(supports.begin() + index);
-        return supports.end();
+    InactiveSurfaces::ElementList::iterator InactiveSurfaces::removeSupportPart(int index) {
+        return remove(supports, index);
     }
     
     /**
      * Access the full list of support parts at once.
-     * @return A reference to the internal supports vector
+     * @return A reference to the internal supports list
      */
-    std::vector<InactiveElement>& InactiveSurfaces::getSupports() { // may return empty vector
+    InactiveSurfaces::ElementList& InactiveSurfaces::getSupports() { // may return empty list
         return supports;
     }
     
@@ -160,4 +242,136 @@ namespace insur {
             }
         }
     }
+
+    /*===== eta queries =====*/
+    /**
+     * Find the elements crossed by a track from the origin, that is the elements reaching z > 0 whose eta range contains the
+     * track eta, as the per-element collision check of the material analysis does.
+     * @param eta The track eta
+     * @param cat The category of the elements to return; all categories if <i>no_cat</i>
+     * @param collections The lists to look in, as a combination of <i>Collection</i> flags
+     * @return The crossed elements, in list order
+     */
+    std::vector<InactiveElement*> InactiveSurfaces::elementsCrossedAt(double eta, MaterialProperties::Category cat, int collections) {
+        if (!etaIndexValid_ || indexedSizes_[0] != barrelservices.size() || indexedSizes_[1] != endcapservices.size()
+            || indexedSizes_[2] != supports.size()) buildEtaIndex();
+        std::vector<int> found;
+        etaIndex_.query(eta, found);
+        std::vector<std::pair<int, int> > positions;
+        positions.reserve(found.size());
+        for (int i : found) {
+            const EtaIndex::Entry& e = etaIndex_.entry(i);
+            if (!(collections & (1 << e.collection))) continue;
+            if ((cat != MaterialProperties::no_cat) && (cat != e.category)) continue;
+            positions.push_back(std::make_pair(e.collection, e.element));
+        }
+        std::sort(positions.begin(), positions.end());
+        std::vector<InactiveElement*> crossed;
+        crossed.reserve(positions.size());
+        for (const auto& p : positions) crossed.push_back(&collection(p.first)[p.second]);
+        return crossed;
+    }
+
+    InactiveSurfaces::ElementList& InactiveSurfaces::collection(int i) {
+        if (i == 0) return barrelservices;
+        if (i == 1) return endcapservices;
+        return supports;
+    }
+
+    /**
+     * Collect the eta ranges of the elements reaching z > 0 and build the interval tree over them. Empty or undefined ranges,
+     * which no track can fall into, are left out.
+     */
+    void InactiveSurfaces::buildEtaIndex() {
+        std::vector<EtaIndex::Entry> entries;
+        for (int c = 0; c < 3; c++) {
+            ElementList& elements = collection(c);
+            indexedSizes_[c] = elements.size();
+            for (unsigned int i = 0; i < elements.size(); i++) {
+                InactiveElement& element = elements[i];
+                if ((element.getZOffset() + element.getZLength()) <= 0) continue;
+                std::pair<double, double> range = element.getEtaMinMax();
+                if (!(range.first < range.second)) continue;
+                EtaIndex::Entry e;
+                e.etaMin = range.first;
+                e.etaMax = range.second;
+                e.collection = c;
+                e.element = i;
+                e.category = element.getCategory();
+                entries.push_back(e);
+            }
+        }
+        etaIndex_.build(entries);
+        etaIndexValid_ = true;
+    }
+
+    void InactiveSurfaces::EtaIndex::build(const std::vector<Entry>& entries) {
+        entries_ = entries;
+        nodes_.clear();
+        std::vector<int> ids(entries_.size());
+        for (unsigned int i = 0; i < ids.size(); i++) ids[i] = i;
+        root_ = buildNode(ids);
+    }
+
+    /**
+     * Build the subtree of a set of ranges: the center is the median of their end points, the ranges containing it stay in the
+     * node and the others go to the left or right subtree. The median end point belongs to a range of the node, so every level
+     * holds at least one range.
+     * @return The index of the node, -1 for an empty set
+     */
+    int InactiveSurfaces::EtaIndex::buildNode(std::vector<int>& ids) {
+        if (ids.empty()) return -1;
+        std::vector<double> ends;
+        ends.reserve(2 * ids.size());
+        for (int i : ids) {
+            ends.push_back(entries_[i].etaMin);
+            ends.push_back(entries_[i].etaMax);
+        }
+        std::nth_element(ends.begin(), ends.begin() + ends.size() / 2, ends.end());
+        double center = ends[ends.size() / 2];
+        std::vector<int> left, right, here;
+        for (int i : ids) {
+            if (entries_[i].etaMax < center) left.push_back(i);
+            else if (entries_[i].etaMin > center) right.push_back(i);
+            else here.push_back(i);
+        }
+        int n = nodes_.size();
+        nodes_.push_back(Node());
+        nodes_[n].center = center;
+        nodes_[n].byMin = here;
+        std::sort(nodes_[n].byMin.begin(), nodes_[n].byMin.end(), [&](int a, int b) { return entries_[a].etaMin < entries_[b].etaMin; });
+        nodes_[n].byMax = here;
+        std::sort(nodes_[n].byMax.begin(), nodes_[n].byMax.end(), [&](int a, int b) { return entries_[a].etaMax > entries_[b].etaMax; });
+        int l = buildNode(left);
+        int r = buildNode(right);
+        nodes_[n].left = l;
+        nodes_[n].right = r;
+        return n;
+    }
+
+    void InactiveSurfaces::EtaIndex::query(double eta, std::vector<int>& found) const {
+        int n = root_;
+        while (n >= 0) {
+            const Node& node = nodes_[n];
+            if (eta < node.center) {
+                // the ranges of the node end at or after the center: only their start matters
+                for (int i : node.byMin) {
+                    if (!(entries_[i].etaMin < eta)) break;
+                    found.push_back(i);
+                }
+                n = node.left;
+            } else if (eta > node.center) {
+                for (int i : node.byMax) {
+                    if (!(entries_[i].etaMax > eta)) break;
+                    found.push_back(i);
+                }
+                n = node.right;
+            } else {
+                for (int i : node.byMin) {
+                    if ((entries_[i].etaMin < eta) && (entries_[i].etaMax > eta)) found.push_back(i);
+                }
+                break;
+            }
+        }
+    }
 }
@@ -42,6 +42,23 @@ namespace insur {
 
     CapsVisitor v(capsbarrelmods, capsendmods);
     tr.accept(v);
+
+    buildCapIndex(capsbarrelmods, capsbarrelindex);
+    buildCapIndex(capsendmods, capsendindex);
+  }
+
+  /**
+   * Index the modules behind a collection of module caps for the track hit finding.
+   * The index serves the same track origins as the one of the tracker, or only the nominal IP if the latter was not built.
+   * @param caps The collection of module caps, layer by layer
+   * @param index The index to be built
+   */
+  void MaterialBudget::buildCapIndex(std::vector<std::vector<ModuleCap> >& caps, ModuleHitIndex& index) {
+    std::vector<const DetectorModule*> modules;
+    for (auto& layer : caps) {
+      for (auto& cap : layer) modules.push_back(&cap.getModule());
+    }
+    index.build(modules, tracker->hitIndex().zMargin());
   }
 
   /**
@@ -128,6 +128,14 @@ namespace material {
     }
   }
 
+  const MaterialObject::ElementsVector& MaterialObject::serviceElements() const {
+    return serviceElements_;
+  }
+
+  void MaterialObject::clearServiceElements() {
+    serviceElements_.clear();
+  }
+
   void MaterialObject::populateMaterialProperties(MaterialProperties& materialProperties) const {
     double quantity = 0;
     
@@ -165,6 +173,10 @@ namespace material {
     return (materials_ != nullptr);
   }
 
+  const MaterialObject::Materials* MaterialObject::materials() const {
+    return materials_;
+  }
+
 
   //void MaterialObject::chargeTrain(Materialway::Train& train) const {
   //  materials_->chargeTrain(train);
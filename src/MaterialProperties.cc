@@ -5,6 +5,8 @@
 
 #include <MaterialProperties.h>
 #include<MaterialTab.h>
+#include <algorithm>
+#include <cfloat>
 
 RILength& RILength::operator+=(const RILength &a) {
   interaction += a.interaction;
@@ -21,6 +23,109 @@ const RILength RILength::operator+(const RILength &other) const {
 
 
 namespace insur {
+    /*-----symbol table-----*/
+    std::deque<MaterialSymbols::Symbol>& MaterialSymbols::symbols() {
+        static std::deque<Symbol> symbols_;
+        return symbols_;
+    }
+
+    std::map<std::string, int>& MaterialSymbols::ids() {
+        static std::map<std::string, int> ids_;
+        return ids_;
+    }
+
+    std::mutex& MaterialSymbols::mutex() {
+        static std::mutex mutex_;
+        return mutex_;
+    }
+
+    int MaterialSymbols::intern(const std::string& name) {
+        std::map<std::string, int>::iterator it = ids().find(name);
+        if (it != ids().end()) return it->second;
+        int newId = symbols().size();
+        ids()[name] = newId;
+        symbols().push_back(Symbol{name, newId, newId});
+        // the sub and super names of a name without '_' are the name itself, so this does not recurse further
+        std::string sub = MaterialProperties::getSubName(name);
+        std::string super = MaterialProperties::getSuperName(name);
+        int subId = (sub == name) ? newId : intern(sub);
+        int superId = (super == name) ? newId : intern(super);
+        symbols()[newId].sub = subId;
+        symbols()[newId].super = superId;
+        return newId;
+    }
+
+    /**
+     * Get the id of a material or component name, adding it to the table if needed.
+     * @param name The name
+     * @return The id
+     */
+    int MaterialSymbols::id(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex());
+        return intern(name);
+    }
+
+    int MaterialSymbols::find(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::map<std::string, int>::const_iterator it = ids().find(name);
+        return it != ids().end() ? it->second : -1;
+    }
+
+    const std::string& MaterialSymbols::name(int id) {
+        std::lock_guard<std::mutex> lock(mutex());
+        return symbols().at(id).name;
+    }
+
+    int MaterialSymbols::subId(int id) {
+        std::lock_guard<std::mutex> lock(mutex());
+        return symbols().at(id).sub;
+    }
+
+    int MaterialSymbols::superId(int id) {
+        std::lock_guard<std::mutex> lock(mutex());
+        return symbols().at(id).super;
+    }
+
+    std::vector<int> MaterialSymbols::superIds() {
+        std::lock_guard<std::mutex> lock(mutex());
+        std::vector<int> result;
+        result.reserve(symbols().size());
+        for (const Symbol& symbol : symbols()) result.push_back(symbol.super);
+        return result;
+    }
+
+    /*-----resolved length table-----*/
+    /**
+     * The table starts with the super ids of all the names known so far, and no material resolved.
+     */
+    MaterialLengthTable::MaterialLengthTable() :
+        superIds_(MaterialSymbols::superIds()) {
+        lengths_.resize(superIds_.size());
+        resolved_.resize(superIds_.size(), false);
+    }
+
+    /**
+     * Look the materials of an element up in the material tab, if they are not in the table yet. Only the materials are
+     * looked up, as the ids of the component names are not in the material tab.
+     * @param element An element whose masses are populated
+     */
+    void MaterialLengthTable::add(const MaterialProperties& element) {
+        const material::MaterialTab& materialTab = material::MaterialTab::instance();
+        for (const auto& mass : element.getLocalMasses()) {
+            int id = mass.first;
+            if (id >= int(superIds_.size())) { // interned after the table was created
+                superIds_ = MaterialSymbols::superIds();
+                lengths_.resize(superIds_.size());
+                resolved_.resize(superIds_.size(), false);
+            }
+            if (resolved_[id]) continue;
+            const std::string& name = MaterialSymbols::name(id);
+            lengths_[id].radiation = materialTab.radiationLength(name);
+            lengths_[id].interaction = materialTab.interactionLength(name);
+            resolved_[id] = true;
+        }
+    }
+
     /*-----public functions-----*/
     /**
      * The constructor sets a few defaults. The flags for the initialisation status of the material vectors are
@@ -29,6 +134,7 @@ namespace insur {
      */
     MaterialProperties::MaterialProperties() {
         msl_set = false;
+        masses = std::make_shared<MassTable>();
         trck = true;
         cat = no_cat;
         total_mass = 0;
@@ -67,8 +173,10 @@ namespace insur {
      * @return The mass of the requested material
      */
     double MaterialProperties::getLocalMass(std::string tag) { // throws exception
-        if (!localmasses.count(tag)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + tag);
-        return localmasses.at(tag);
+        int id = MaterialSymbols::find(tag);
+        MassVector::const_iterator it = std::lower_bound(masses->localmasses.begin(), masses->localmasses.end(), std::make_pair(id, -DBL_MAX));
+        if (id < 0 || it == masses->localmasses.end() || it->first != id) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + tag);
+        return it->second;
     }
 
     /**
@@ -78,13 +186,34 @@ namespace insur {
      * @return The mass of the requested component
      */
     double MaterialProperties::getLocalMassComp(std::string comp) { // throws exception
-        if (!localmassesComp.count(comp)) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + comp);
-        return localmassesComp.at(comp);
+        int id = MaterialSymbols::find(comp);
+        MassVector::const_iterator it = std::lower_bound(masses->localmassesComp.begin(), masses->localmassesComp.end(), std::make_pair(id, -DBL_MAX));
+        if (id < 0 || it == masses->localmassesComp.end() || it->first != id) throw std::runtime_error("MaterialProperties::getLocalMass(std::string): " + err_local_mass + ": " + comp);
+        return it->second;
     }
+
+    /**
+     * Get the local mass of one of the materials, as identified by its id, that make up the element.
+     * @param materialId The id of the material
+     * @return The mass of the requested material, 0 if it does not appear on the list
+     */
+    double MaterialProperties::getLocalMass(int materialId) const { return findMass(masses->localmasses, materialId); }
+
+    /**
+     * Get the local mass of one of the components, as identified by the id of its name, that make up the element.
+     * @param componentId The id of the component
+     * @return The mass of the requested component, 0 if it does not appear on the list
+     */
+    double MaterialProperties::getLocalMassComp(int componentId) const { return findMass(masses->localmassesComp, componentId); }
     
-    
-    const std::map<std::string, double>& MaterialProperties::getLocalMasses() const { return localmasses; }
-    const std::map<std::string, double>& MaterialProperties::getLocalMassesComp() const { return localmassesComp; }
+    const MassVector& MaterialProperties::getLocalMasses() const { return masses->localmasses; }
+    const MassVector& MaterialProperties::getLocalMassesComp() const { return masses->localmassesComp; }
+
+    std::map<std::string, double> MaterialProperties::getLocalMassesByName() const {
+        std::map<std::string, double> result;
+        for (const auto& mass : masses->localmasses) result[MaterialSymbols::name(mass.first)] = mass.second;
+        return result;
+    }
 
     /**
      * Add the local mass for a material, as specified by its tag, to the internal list.
@@ -95,7 +224,7 @@ namespace insur {
      */
   void MaterialProperties::addLocalMass(std::string tag, double ms) {
         msl_set = true;
-        localmasses[tag] += ms;
+        addMass(editMasses().localmasses, MaterialSymbols::id(tag), ms);
     }
 
     /**
@@ -108,31 +237,44 @@ namespace insur {
      * @param ms The mass value
      */
   void MaterialProperties::addLocalMass(std::string tag, std::string comp, double ms, int minZ) {
+        addLocalMass(MaterialSymbols::id(tag), MaterialSymbols::id(comp), ms);
+    }
+
+    /**
+     * Add the local mass for a material of a component, both specified by their ids.
+     * @param materialId The id of the material
+     * @param componentId The id of the component
+     * @param ms The mass value
+     */
+    void MaterialProperties::addLocalMass(int materialId, int componentId, double ms) {
         msl_set = true;
-        localmasses[tag] += ms;
-        localmassesComp[getSubName(comp)] += ms;
-        localCompMats[comp][tag] += ms; 
+        MassTable& table = editMasses();
+        addMass(table.localmasses, materialId, ms);
+        addMass(table.localmassesComp, MaterialSymbols::subId(componentId), ms);
+        ComponentMaterial entry{componentId, materialId, 0.};
+        std::vector<ComponentMaterial>::iterator it = std::lower_bound(table.localCompMats.begin(), table.localCompMats.end(), entry,
+            [](const ComponentMaterial& a, const ComponentMaterial& b) { return a.component < b.component || (a.component == b.component && a.material < b.material); });
+        if (it == table.localCompMats.end() || it->component != componentId || it->material != materialId) it = table.localCompMats.insert(it, entry);
+        it->mass += ms;
     }
     
     /**
      * Get the number of registered local masses for the materials found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::localMassCount() { return localmasses.size(); }
+    unsigned int MaterialProperties::localMassCount() { return masses->localmasses.size(); }
     
     /**
      * Get the number of registered local masses for the components found in the inactive element.
      * @return The size of the internal mass vector
      */
-    unsigned int MaterialProperties::localMassCompCount() { return localmassesComp.size(); }
+    unsigned int MaterialProperties::localMassCompCount() { return masses->localmassesComp.size(); }
     
     /**
      * Reset the state of the internal mass vector to empty, discarding all entries.
      */
     void MaterialProperties::clearMassVectors() {
-        localmasses.clear();
-        localmassesComp.clear();
-        localCompMats.clear();
+        masses = std::make_shared<MassTable>();
     }
     
     /**
@@ -143,9 +285,19 @@ namespace insur {
       mp.clearMassVectors(); //TODO: why?!?!?!?!?!
         //for (unsigned int i = 0; i < localMassCount(); i++) mp.addLocalMass(localmasses.at(i));
         //for (unsigned int i = 0; i < localMassCompCount(); i++) mp.addLocalMassComp(localmassesComp.at(i));
-        for (std::map<std::string, std::map<std::string, double> >::iterator compit = localCompMats.begin(); compit != localCompMats.end(); ++compit)
-            for (std::map<std::string, double>::iterator matit = compit->second.begin(); matit != compit->second.end(); ++matit)
-                mp.addLocalMass(matit->first, compit->first, matit->second);
+        for (const ComponentMaterial& entry : masses->localCompMats)
+            mp.addLocalMass(entry.material, entry.component, entry.mass);
+    }
+
+    /**
+     * Make this instance use the mass vectors of another one, without copying them. They are copied as soon
+     * as either instance adds a mass, so this is meant for elements that would end up with the same masses anyway,
+     * e.g. the modules of the same type.
+     * @param mp The instance whose masses are used
+     */
+    void MaterialProperties::shareMassVectors(const MaterialProperties& mp) {
+        masses = mp.masses;
+        msl_set = mp.msl_set;
     }
     
     /**
@@ -167,7 +319,7 @@ namespace insur {
     double MaterialProperties::getRadiationLength() { return r_length; }
     
 
-    const std::map<std::string, RILength>& MaterialProperties::getComponentsRI() const { return componentsRI; } // CUIDADO: I know it parts with the old API but it's so much more practical this way
+    const ComponentsRIVector& MaterialProperties::getComponentsRI() const { return componentsRI; } // CUIDADO: I know it parts with the old API but it's so much more practical this way
 
     /**
      * Get the intraction length of the inactive element.
@@ -201,8 +353,8 @@ namespace insur {
     void MaterialProperties::calculateLocalMass(double offset) {
         if (msl_set) {
             local_mass = offset;
-            for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
-                local_mass += it->second;
+            for (const auto& mass : masses->localmasses) {
+                local_mass += mass.second;
             }
         }
     }
@@ -214,20 +366,7 @@ namespace insur {
      * @param offset A starting value for the calculation
      */
     void MaterialProperties::calculateRadiationLength(MaterialTable& materials, double offset) {
-        if (getSurface() > 0) {
-            r_length = offset;
-            if (msl_set) {
-                // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
-                    r_length += it->second / (materials.getMaterial(it->first).rlength * getSurface() / 100.0);
-                }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
-                    for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materials.getMaterial(mit->first).rlength * getSurface() / 100.0);
-                    }
-                }
-            }
-        }
+        calculateLengths([&materials](int id) { return materials.getMaterial(MaterialSymbols::name(id)).rlength; }, MaterialSymbols::superId, &RILength::radiation, r_length, offset);
     }
     
     /**
@@ -237,64 +376,40 @@ namespace insur {
      * @param offset A starting value for the calculation
      */
     void MaterialProperties::calculateInteractionLength(MaterialTable& materials, double offset) {
-        if (getSurface() > 0) {
-            i_length = offset;
-            if (msl_set) {
-                // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
-                    i_length += it->second / (materials.getMaterial(it->first).ilength * getSurface() / 100.0);
-                }
-                    
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
-                    for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materials.getMaterial(mit->first).ilength * getSurface() / 100.0);
-                    }
-                }
-            }
-        }
+        calculateLengths([&materials](int id) { return materials.getMaterial(MaterialSymbols::name(id)).ilength; }, MaterialSymbols::superId, &RILength::interaction, i_length, offset);
     }
 
   // Versions with new material tab definition
     void MaterialProperties::calculateRadiationLength(double offset) {
       const material::MaterialTab& materialTab = material::MaterialTab::instance();
- 
-        if (getSurface() > 0) {
-            r_length = offset;
-            if (msl_set) {
-                // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
-                    r_length += it->second / (materialTab.radiationLength(it->first) * getSurface() / 100.0);
-                }
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
-                    for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].radiation += mit->second / (materialTab.radiationLength(mit->first) * getSurface() / 100.0);
-                    }
-                }
-            }
-        }
+      calculateLengths([&materialTab](int id) { return materialTab.radiationLength(MaterialSymbols::name(id)); }, MaterialSymbols::superId, &RILength::radiation, r_length, offset);
     }
     
     void MaterialProperties::calculateInteractionLength(double offset) {
       const material::MaterialTab& materialTab =  material::MaterialTab::instance();
+      calculateLengths([&materialTab](int id) { return materialTab.interactionLength(MaterialSymbols::name(id)); }, MaterialSymbols::superId, &RILength::interaction, i_length, offset);
+    }
 
-        if (getSurface() > 0) {
-            i_length = offset;
-            if (msl_set) {
-                // local mass loop
-                for (std::map<std::string, double>::iterator it = localmasses.begin(); it != localmasses.end(); ++it) {
-                    i_length += it->second / (materialTab.interactionLength(it->first) * getSurface() / 100.0);
-                }
-                    
-                for (std::map<std::string, std::map<std::string, double> >::iterator cit = localCompMats.begin(); cit != localCompMats.end(); ++cit) {
-                    for (std::map<std::string, double>::iterator mit = cit->second.begin(); mit != cit->second.end(); ++mit) {
-                        componentsRI[getSuperName(cit->first)].interaction += mit->second / (materialTab.interactionLength(mit->first) * getSurface() / 100.0);
-                    }
-                }
-            }
-        }
+    /**
+     * Calculate the overall radiation length from a table resolved beforehand with the materials of this element.
+     * Unlike the other versions, this one can be called for several elements at the same time.
+     * @param lengths The resolved table
+     * @param offset A starting value for the calculation
+     */
+    void MaterialProperties::calculateRadiationLength(const MaterialLengthTable& lengths, double offset) {
+      calculateLengths([&lengths](int id) { return lengths.radiationLength(id); }, [&lengths](int id) { return lengths.superId(id); }, &RILength::radiation, r_length, offset);
+    }
+
+    /**
+     * Calculate the overall interaction length from a table resolved beforehand with the materials of this element.
+     * Unlike the other versions, this one can be called for several elements at the same time.
+     * @param lengths The resolved table
+     * @param offset A starting value for the calculation
+     */
+    void MaterialProperties::calculateInteractionLength(const MaterialLengthTable& lengths, double offset) {
+      calculateLengths([&lengths](int id) { return lengths.interactionLength(id); }, [&lengths](int id) { return lengths.superId(id); }, &RILength::interaction, i_length, offset);
     }
 
-    
     /**
      * Find out if the volume is relevant for tracking during analysis.
      * @return True if the material properties of this volume matter for the tracker analysis, false otherwise
@@ -312,10 +427,10 @@ namespace insur {
      */
     void MaterialProperties::print() {
         std::cout << "Material properties (current state)" << std::endl;
-        std::cout << "localmasses: vector with " << localmasses.size() << " elements." << std::endl;
+        std::cout << "localmasses: vector with " << masses->localmasses.size() << " elements." << std::endl;
         int i = 0;
-        for (std::map<std::string, double>::const_iterator it = localmasses.begin(); it != localmasses.end(); ++it)
-            std::cout << "Material " << i++ << " (material, mass): (" << it->first << ", " << it->second << ")" << std::endl;
+        for (const auto& mass : masses->localmasses)
+            std::cout << "Material " << i++ << " (material, mass): (" << MaterialSymbols::name(mass.first) << ", " << mass.second << ")" << std::endl;
         i = 0;
 
         std::cout << "total_mass = " << total_mass << std::endl;
@@ -328,7 +443,60 @@ namespace insur {
 
     /*-----protected-----*/
 
-    std::string MaterialProperties::getSuperName(std::string name) const {
+    MaterialProperties::MassTable& MaterialProperties::editMasses() {
+        if (masses.use_count() > 1) masses = std::make_shared<MassTable>(*masses);
+        return *masses;
+    }
+
+    void MaterialProperties::addMass(MassVector& massVector, int id, double ms) {
+        MassVector::iterator it = std::lower_bound(massVector.begin(), massVector.end(), std::make_pair(id, -DBL_MAX));
+        if (it == massVector.end() || it->first != id) it = massVector.insert(it, std::make_pair(id, 0.));
+        it->second += ms;
+    }
+
+    double MaterialProperties::findMass(const MassVector& massVector, int id) {
+        MassVector::const_iterator it = std::lower_bound(massVector.begin(), massVector.end(), std::make_pair(id, -DBL_MAX));
+        return (it != massVector.end() && it->first == id) ? it->second : 0.;
+    }
+
+    /**
+     * Sum the radiation or interaction lengths of the materials, overall and per component.
+     * The length of each material is looked up once, then reused for the components. The component sums of a previous
+     * calculation are replaced, so that the lengths can be calculated again after the masses or the materials changed.
+     * @param length The function giving the length of a material from its id
+     * @param superId The function giving the id of the super name of a component from its id
+     * @param result The member of <i>RILength</i> the component sums go to
+     * @param total The overall sum
+     * @param offset A starting value for the overall sum
+     */
+    template<class LengthFunction, class SuperIdFunction>
+    void MaterialProperties::calculateLengths(LengthFunction length, SuperIdFunction superId, double RILength::* result, double& total, double offset) {
+        double surface = getSurface();
+        if (surface > 0) {
+            total = offset;
+            for (auto& component : componentsRI) component.second.*result = 0.;
+            if (msl_set) {
+                // local mass loop
+                MassVector lengths;
+                lengths.reserve(masses->localmasses.size());
+                for (const auto& mass : masses->localmasses) {
+                    lengths.push_back(std::make_pair(mass.first, length(mass.first) * surface / 100.0));
+                    total += mass.second / lengths.back().second;
+                }
+                for (const ComponentMaterial& entry : masses->localCompMats) {
+                    MassVector::const_iterator it = std::lower_bound(lengths.begin(), lengths.end(), std::make_pair(entry.material, -DBL_MAX));
+                    double materialLength = (it != lengths.end() && it->first == entry.material) ? it->second : length(entry.material) * surface / 100.0;
+                    int componentSuperId = superId(entry.component);
+                    ComponentsRIVector::iterator cit = std::lower_bound(componentsRI.begin(), componentsRI.end(), std::make_pair(componentSuperId, RILength()),
+                        [](const std::pair<int, RILength>& a, const std::pair<int, RILength>& b) { return a.first < b.first; });
+                    if (cit == componentsRI.end() || cit->first != componentSuperId) cit = componentsRI.insert(cit, std::make_pair(componentSuperId, RILength()));
+                    cit->second.*result += entry.mass / materialLength;
+                }
+            }
+        }
+    }
+
+    std::string MaterialProperties::getSuperName(std::string name) {
         std::stringstream ss(name);
         std::pair<std::string, std::string> split;
         std::getline(ss, split.first, '_');
@@ -336,7 +504,7 @@ namespace insur {
         return !split.second.empty() ? split.second : split.first;
     }
 
-    std::string MaterialProperties::getSubName(std::string name) const {
+    std::string MaterialProperties::getSubName(std::string name) {
         std::stringstream ss(name);
         std::pair<std::string, std::string> split;
         std::getline(ss, split.first, '_');
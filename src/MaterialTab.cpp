@@ -21,8 +21,11 @@ namespace material {
   const std::string MaterialTab::msg_no_mat_file_entry2 = "' not found in Material tab file.";
 
   MaterialTab::MaterialTab() {
-    std::string mattabFile(mainConfigHandler::instance().getMattabDirectory() + "/" + insur::default_mattabfile);
-    std::ifstream mattabStream(mainConfigHandler::instance().getMattabDirectory() + "/" + insur::default_mattabfile);
+    read();
+  }
+
+  void MaterialTab::read() {
+    std::ifstream mattabStream(fileName());
     std::string line;
     std::string material;
     std::istringstream lineStream;
@@ -48,11 +51,49 @@ namespace material {
     }
   }
 
-  const MaterialTab& MaterialTab::instance() {
+  std::string MaterialTab::fileName() const {
+    return mainConfigHandler::instance().getMattabDirectory() + "/" + insur::default_mattabfile;
+  }
+
+  MaterialTab& MaterialTab::editableInstance() {
     static MaterialTab instance_;
     return instance_;
   }
 
+  const MaterialTab& MaterialTab::instance() {
+    return editableInstance();
+  }
+
+  /**
+   * Reads the material tab file again, e.g. after it was edited, and tells which materials changed.
+   * The materials added or removed count as changed in both sets.
+   * @param changedDensities Filled with the materials whose density changed: the masses they give in mm depend on it
+   * @param changedLengths Filled with the materials whose radiation or interaction length changed
+   */
+  void MaterialTab::reload(std::set<std::string>& changedDensities, std::set<std::string>& changedLengths) {
+    MaterialTab& materialTab = editableInstance();
+    MaterialTabType previous;
+    previous.swap(materialTab);
+    materialTab.read();
+
+    for (const auto& entry : materialTab) {
+      auto old = previous.find(entry.first);
+      if (old == previous.end()) {
+        changedDensities.insert(entry.first);
+        changedLengths.insert(entry.first);
+      } else {
+        if (std::get<0>(old->second) != std::get<0>(entry.second)) changedDensities.insert(entry.first);
+        if (std::get<1>(old->second) != std::get<1>(entry.second) || std::get<2>(old->second) != std::get<2>(entry.second)) changedLengths.insert(entry.first);
+      }
+    }
+    for (const auto& entry : previous) {
+      if (materialTab.count(entry.first) == 0) {
+        changedDensities.insert(entry.first);
+        changedLengths.insert(entry.first);
+      }
+    }
+  }
+
   double MaterialTab::density(std::string material) const {
     double val = 0;
     try {
@@ -0,0 +1,237 @@
+/**
+ * @file MaterialVoxelMap.cpp
+ * @brief This class bins the material of a material budget in (r, z) and integrates straight tracks through it
+ */
+
+#include "MaterialVoxelMap.h"
+#include "MaterialBudget.h"
+#include "InactiveElement.h"
+#include "ModuleCap.h"
+#include "global_funcs.h"
+#include "messageLogger.h"
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <cmath>
+
+namespace insur {
+  /**
+   * Builds the map from the inactive surfaces and the module caps of a material budget, whose radiation and
+   * interaction lengths must have been computed already.
+   * @param mb The material budget
+   * @param binSize The voxel size in r and z, in mm
+   */
+  void MaterialVoxelMap::build(MaterialBudget& mb, double binSize) {
+    InactiveSurfaces& is = mb.getInactiveSurfaces();
+    double maxR = 0., maxZ = 0.;
+    for (InactiveSurfaces::ElementList* elements : { &is.getBarrelServices(), &is.getEndcapServices(), &is.getSupports() }) {
+      for (const InactiveElement& e : *elements) {
+        maxR = MAX(maxR, e.getInnerRadius() + e.getRWidth());
+        maxZ = MAX(maxZ, e.getZOffset() + e.getZLength());
+      }
+    }
+    for (std::vector<std::vector<ModuleCap> >* caps : { &mb.getBarrelModuleCaps(), &mb.getEndcapModuleCaps() }) {
+      for (std::vector<ModuleCap>& layer : *caps) {
+        for (ModuleCap& cap : layer) {
+          maxR = MAX(maxR, cap.getModule().maxR());
+          maxZ = MAX(maxZ, cap.getModule().maxZ());
+        }
+      }
+    }
+    binR_ = binSize;
+    binZ_ = binSize;
+    binsR_ = MAX(1, int(ceil(maxR / binSize)));
+    binsZ_ = MAX(1, int(ceil(maxZ / binSize)));
+    densities_.assign(NumComponents * binsR_ * binsZ_, Material());
+
+    addModules(mb.getBarrelModuleCaps());
+    addModules(mb.getEndcapModuleCaps());
+    addElements(is.getBarrelServices(), Services);
+    addElements(is.getEndcapServices(), Services);
+    addElements(is.getSupports(), Supports);
+  }
+
+  /**
+   * Spreads a quantity uniformly over the volume an (r, z) box sweeps around the z axis. A box with no width in r or z
+   * goes to the bin containing it.
+   * @param quantity The radiation and interaction lengths of the whole volume, times mm^2: once divided by a volume, they become densities per mm
+   */
+  void MaterialVoxelMap::deposit(Component component, double minR, double maxR, double minZ, double maxZ, const Material& quantity) {
+    if (maxZ < 0.) return;
+    bool flatR = maxR <= minR, flatZ = maxZ <= minZ;
+    int firstR = MIN(binsR_ - 1, int(minR / binR_)), lastR = MIN(binsR_ - 1, int(maxR / binR_));
+    int firstZ = MAX(0, MIN(binsZ_ - 1, int(minZ / binZ_))), lastZ = MIN(binsZ_ - 1, int(maxZ / binZ_));
+    double boxR2 = maxR*maxR - minR*minR;
+    for (int iR = firstR; iR <= lastR; iR++) {
+      double low = iR * binR_, high = low + binR_;
+      double fractionR = flatR ? (iR == firstR) : (MIN(high, maxR)*MIN(high, maxR) - MAX(low, minR)*MAX(low, minR)) / boxR2;
+      if (fractionR <= 0.) continue;
+      double ringArea = M_PI * (high*high - low*low);
+      for (int iZ = firstZ; iZ <= lastZ; iZ++) {
+        double fractionZ = flatZ ? (iZ == firstZ) : (MIN((iZ+1) * binZ_, maxZ) - MAX(iZ * binZ_, minZ)) / (maxZ - minZ);
+        if (fractionZ <= 0.) continue;
+        double weight = fractionR * fractionZ / (ringArea * binZ_);
+        Material& d = densities_[index(component, iR, iZ)];
+        d.radiation += quantity.radiation * weight;
+        d.interaction += quantity.interaction * weight;
+      }
+    }
+  }
+
+  /**
+   * Adds the tracked inactive elements: their lengths are given for a crossing along their thickness, so the lengths
+   * times their surface are the quantity spread over their volume.
+   */
+  void MaterialVoxelMap::addElements(InactiveSurfaces::ElementList& elements, Component component) {
+    for (InactiveElement& e : elements) {
+      if (!e.track()) continue;
+      Material quantity;
+      quantity.radiation = e.getRadiationLength() * e.getSurface();
+      quantity.interaction = e.getInteractionLength() * e.getSurface();
+      deposit(component, e.getInnerRadius(), e.getInnerRadius() + e.getRWidth(), e.getZOffset(), e.getZOffset() + e.getZLength(), quantity);
+    }
+  }
+
+  /**
+   * Adds the module caps, averaged over phi over the box of their sensors.
+   */
+  void MaterialVoxelMap::addModules(std::vector<std::vector<ModuleCap> >& caps) {
+    for (std::vector<ModuleCap>& layer : caps) {
+      for (ModuleCap& cap : layer) {
+        const Module& m = cap.getModule();
+        Material quantity;
+        quantity.radiation = cap.getRadiationLength() * cap.getSurface();
+        quantity.interaction = cap.getInteractionLength() * cap.getSurface();
+        deposit(Active, m.minR(), m.maxR(), m.minZ(), m.maxZ(), quantity);
+      }
+    }
+  }
+
+  /**
+   * Integrates a straight track from the origin through the map, one voxel at a time.
+   * @param theta The polar angle of the track, in (0, pi/2]
+   * @param byComponent Filled with the NumComponents radiation and interaction lengths along the track
+   */
+  void MaterialVoxelMap::integrate(double theta, Material* byComponent) const {
+    for (int c = 0; c < NumComponents; c++) byComponent[c] = Material();
+    double dirR = sin(theta), dirZ = cos(theta);
+    const double never = std::numeric_limits<double>::max();
+    int iR = 0, iZ = 0;
+    double t = 0.;
+    while (iR < binsR_ && iZ < binsZ_) {
+      // path lengths at which the track leaves the current voxel in r and in z
+      double exitR = dirR > 0. ? (iR + 1) * binR_ / dirR : never;
+      double exitZ = dirZ > 0. ? (iZ + 1) * binZ_ / dirZ : never;
+      double next = MIN(exitR, exitZ);
+      double step = next - t;
+      for (int c = 0; c < NumComponents; c++) {
+        const Material& d = densities_[index(c, iR, iZ)];
+        byComponent[c].radiation += d.radiation * step;
+        byComponent[c].interaction += d.interaction * step;
+      }
+      t = next;
+      if (exitR < exitZ) iR++;
+      else iZ++;
+    }
+  }
+
+  /**
+   * @return The total radiation and interaction lengths along a straight track from the origin
+   */
+  Material MaterialVoxelMap::integrate(double theta) const {
+    Material byComponent[NumComponents];
+    integrate(theta, byComponent);
+    Material total;
+    for (int c = 0; c < NumComponents; c++) total += byComponent[c];
+    return total;
+  }
+
+  /**
+   * Writes the map as text: a header with the voxel size and counts, then one line per voxel with its r and z centre and the
+   * radiation and interaction length densities of each component.
+   * @return False if the file could not be written
+   */
+  bool MaterialVoxelMap::save(const std::string& fileName) const {
+    std::ofstream out(fileName.c_str());
+    if (!out) {
+      logERROR("Cannot write the material map to " + fileName);
+      return false;
+    }
+    out << "# binR binZ binsR binsZ" << std::endl;
+    out << binR_ << " " << binZ_ << " " << binsR_ << " " << binsZ_ << std::endl;
+    out << "# r z active_x0 active_l0 services_x0 services_l0 supports_x0 supports_l0 (per mm)" << std::endl;
+    out << std::setprecision(10);
+    for (int iR = 0; iR < binsR_; iR++) {
+      for (int iZ = 0; iZ < binsZ_; iZ++) {
+        out << (iR + 0.5) * binR_ << " " << (iZ + 0.5) * binZ_;
+        for (int c = 0; c < NumComponents; c++) {
+          const Material& d = densities_[index(c, iR, iZ)];
+          out << " " << d.radiation << " " << d.interaction;
+        }
+        out << std::endl;
+      }
+    }
+    return out.good();
+  }
+
+  /**
+   * Reads back a map written by save().
+   * @return False if the file could not be read or is truncated
+   */
+  bool MaterialVoxelMap::load(const std::string& fileName) {
+    std::ifstream in(fileName.c_str());
+    std::string comment;
+    if (!in || !std::getline(in, comment) || !(in >> binR_ >> binZ_ >> binsR_ >> binsZ_) || binsR_ < 1 || binsZ_ < 1) {
+      logERROR("Cannot read the material map from " + fileName);
+      binsR_ = binsZ_ = 0;
+      densities_.clear();
+      return false;
+    }
+    in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::getline(in, comment);
+    densities_.assign(NumComponents * binsR_ * binsZ_, Material());
+    double r, z;
+    for (int iR = 0; iR < binsR_; iR++) {
+      for (int iZ = 0; iZ < binsZ_; iZ++) {
+        in >> r >> z;
+        for (int c = 0; c < NumComponents; c++) {
+          Material& d = densities_[index(c, iR, iZ)];
+          in >> d.radiation >> d.interaction;
+        }
+      }
+    }
+    if (!in) {
+      logERROR("The material map in " + fileName + " is truncated");
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Writes the material along tracks evenly spaced in eta, as text: one line per track with its eta and the radiation and
+   * interaction lengths of each component.
+   * @param maxEta The eta of the last track
+   * @param etaSteps The number of tracks, from eta = 0 to maxEta
+   * @return False if the file could not be written
+   */
+  bool MaterialVoxelMap::saveEtaScan(const std::string& fileName, double maxEta, int etaSteps) const {
+    std::ofstream out(fileName.c_str());
+    if (!out) {
+      logERROR("Cannot write the material eta scan to " + fileName);
+      return false;
+    }
+    out << "# eta active_x0 active_l0 services_x0 services_l0 supports_x0 supports_l0" << std::endl;
+    out << std::setprecision(10);
+    double etaStep = etaSteps > 1 ? maxEta / (etaSteps - 1) : maxEta;
+    Material byComponent[NumComponents];
+    for (int i = 0; i < etaSteps; i++) {
+      double eta = i * etaStep;
+      integrate(2 * atan(exp(-eta)), byComponent);
+      out << eta;
+      for (int c = 0; c < NumComponents; c++) out << " " << byComponent[c].radiation << " " << byComponent[c].interaction;
+      out << std::endl;
+    }
+    return out.good();
+  }
+}
@@ -24,6 +24,10 @@
 #include "StopWatch.h"
 
 #include <ctime>
+#include <climits>
+#include <tuple>
+#include <thread>
+#include <algorithm>
 
 
 namespace material {
@@ -308,10 +312,222 @@ namespace material {
 
   //END Materialway::Station
   //=================================================================================
+  //START Materialway::ServiceFlow
+
+  Materialway::ServiceFlow::ServiceFlow() :
+    filtered_(MaterialObject::SERVICE) {}
+
+  void Materialway::ServiceFlow::ElementWeights::add(const MaterialObject::Element* element, double weight) {
+    std::map<const MaterialObject::Element*, int>::iterator it = index_.find(element);
+    if (it == index_.end()) {
+      index_[element] = weights_.size();
+      weights_.push_back(std::make_pair(element, weight));
+    } else {
+      weights_[it->second].second += weight;
+    }
+  }
+
+  /**
+   * Adds the services of a source to the flow entering a section
+   * @param entry the first section the services are routed to
+   * @param source the material object whose services are routed
+   * @param unitsToPass the units of the routed elements
+   */
+  void Materialway::ServiceFlow::add(Section* entry, const MaterialObject& source, const std::vector<std::string>& unitsToPass) {
+    filtered_.clearServiceElements();
+    source.deployMaterialTo(filtered_, unitsToPass, MaterialObject::ONLY_SERVICES);
+    if (inflows_.find(entry) == inflows_.end()) entries_.push_back(entry);
+    ElementWeights& weights = inflows_[entry];
+    for (const MaterialObject::Element* currElement : filtered_.serviceElements()) {
+      weights.add(currElement, 1.);
+    }
+  }
+
+  /**
+   * Deploys the accumulated services to the sections and stations, then empties the flow
+   */
+  void Materialway::ServiceFlow::route() {
+    //count the incoming links of every section reached by the flow (the maps are only looked up: the sections are
+    //taken in the order of the entries, not of their pointers, so that the routing is the same from run to run)
+    std::map<Section*, int> incoming;
+    std::set<Section*> visited;
+    for (Section* entry : entries_) {
+      Section* currSection = entry;
+      incoming.insert(std::make_pair(currSection, 0));
+      while (visited.insert(currSection).second) {
+        if (dynamic_cast<Station*>(currSection) != nullptr || !currSection->hasNextSection()) break;
+        currSection = currSection->nextSection();
+        incoming[currSection]++;
+      }
+    }
+
+    std::vector<Section*> ready;
+    for (Section* entry : entries_) {
+      if (incoming[entry] == 0) ready.push_back(entry);
+    }
+    while (!ready.empty()) {
+      Section* currSection = ready.back();
+      ready.pop_back();
+      const ElementWeights& weights = inflows_[currSection];
+
+      Station* station = dynamic_cast<Station*>(currSection);
+      if (station != nullptr) {
+        deliver(weights, station->conversionStation());
+      } else {
+        deliver(weights, currSection->materialObject());
+        if (currSection->hasNextSection()) {
+          Section* next = currSection->nextSection();
+          ElementWeights& nextWeights = inflows_[next];
+          for (auto& weight : weights.weights()) {
+            nextWeights.add(weight.first, weight.second);
+          }
+          if (--incoming[next] == 0) ready.push_back(next);
+        }
+      }
+    }
+    inflows_.clear();
+    entries_.clear();
+  }
+
+  /**
+   * Adds the elements to a material object, the ones coming from more than one source as a single scaled copy
+   */
+  void Materialway::ServiceFlow::deliver(const ElementWeights& weights, MaterialObject& destination) {
+    for (auto& weight : weights.weights()) {
+      if (weight.second == 1.) {
+        destination.addElement(weight.first);
+      } else {
+        destination.addElement(new MaterialObject::Element(*weight.first, weight.second));
+      }
+    }
+  }
+
+  //END Materialway::ServiceFlow
+  //=================================================================================
+  //START Materialway::ObstacleIndex
+  template<class Obstacle>
+  Materialway::ObstacleIndex<Obstacle>::ObstacleIndex(int margin) :
+    margin_(margin) {
+    clear();
+  }
+
+  template<class Obstacle>
+  void Materialway::ObstacleIndex<Obstacle>::add(Obstacle* obstacle) {
+    int order = obstacles_.size();
+    obstacles_.push_back(obstacle);
+    orders_[obstacle] = order;
+    extents_.push_back(Extent{obstacle->minZ(), obstacle->minR(), obstacle->maxZ(), obstacle->maxR()});
+    place(order, false);
+  }
+
+  template<class Obstacle>
+  void Materialway::ObstacleIndex<Obstacle>::update(Obstacle* obstacle) {
+    auto orderIter = orders_.find(obstacle);
+    if (orderIter == orders_.end()) return;
+    int order = orderIter->second;
+    place(order, true);
+    extents_[order] = Extent{obstacle->minZ(), obstacle->minR(), obstacle->maxZ(), obstacle->maxR()};
+    place(order, false);
+  }
+
+  template<class Obstacle>
+  void Materialway::ObstacleIndex<Obstacle>::clear() {
+    obstacles_.clear();
+    extents_.clear();
+    orders_.clear();
+    for (std::vector<Node>& tree : nodes_) {
+      tree.assign(1, Node());
+    }
+  }
+
+  template<class Obstacle>
+  int Materialway::ObstacleIndex<Obstacle>::size() const {
+    return obstacles_.size();
+  }
+
+  /**
+   * Stores or removes an obstacle in both trees, with the open span it blocks (as in isHit) turned into a closed one
+   * @param order the order of the obstacle
+   * @param remove true to remove it
+   */
+  template<class Obstacle>
+  void Materialway::ObstacleIndex<Obstacle>::place(int order, bool remove) {
+    const Extent& extent = extents_[order];
+    modify(0, 0, INT_MIN, INT_MAX, extent.minR - margin_ + 1, extent.maxR + margin_ - 1, Key(extent.minZ, -order), remove);
+    modify(1, 0, INT_MIN, INT_MAX, extent.minZ - margin_ + 1, extent.maxZ + margin_ - 1, Key(extent.minR, -order), remove);
+  }
+
+  template<class Obstacle>
+  void Materialway::ObstacleIndex<Obstacle>::modify(int tree, int node, long long low, long long high, int from, int to, const Key& key, bool remove) {
+    if (from <= low && high <= to) {
+      if (remove) {
+        nodes_[tree][node].keys.erase(key);
+      } else {
+        nodes_[tree][node].keys.insert(key);
+      }
+      return;
+    }
+    long long mid = low + (high - low) / 2;
+    for (int side = 0; side < 2; side++) {
+      long long childLow = (side == 0) ? low : mid + 1;
+      long long childHigh = (side == 0) ? mid : high;
+      if (to < childLow || from > childHigh) continue;
+      int child = nodes_[tree][node].children[side];
+      if (child < 0) {
+        if (remove) continue;
+        child = nodes_[tree].size();
+        nodes_[tree].push_back(Node());
+        nodes_[tree][node].children[side] = child; //the push_back may have moved the nodes
+      }
+      modify(tree, child, childLow, childHigh, from, to, key, remove);
+    }
+  }
+
+  /**
+   * Finds the nearest obstacle starting beyond the point along the direction, whose span across the direction contains the point
+   * @param hitCoord is a reference for the return value of the start of the obstacle (Z if horizontal, rho if vertical)
+   * @return the obstacle, nullptr if there is none
+   */
+  template<class Obstacle>
+  Obstacle* Materialway::ObstacleIndex<Obstacle>::firstHit(int z, int r, Direction direction, int& hitCoord) const {
+    int tree = (direction == HORIZONTAL) ? 0 : 1;
+    int across = (direction == HORIZONTAL) ? r : z;
+    int along = (direction == HORIZONTAL) ? z : r;
+    bool found = false;
+    Key best;
+
+    long long low = INT_MIN;
+    long long high = INT_MAX;
+    for (int node = 0; node >= 0; ) {
+      const std::set<Key>& keys = nodes_[tree][node].keys;
+      auto keyIter = keys.lower_bound(Key(std::max(along, 0) + 1, INT_MIN)); //as in isHit, only positive coordinates are hits
+      if (keyIter != keys.end() && (!found || *keyIter < best)) {
+        best = *keyIter;
+        found = true;
+      }
+      long long mid = low + (high - low) / 2;
+      if (across <= mid) {
+        node = nodes_[tree][node].children[0];
+        high = mid;
+      } else {
+        node = nodes_[tree][node].children[1];
+        low = mid + 1;
+      }
+    }
+
+    if (!found) return nullptr;
+    hitCoord = best.first;
+    return obstacles_[-best.second];
+  }
+
+  //END Materialway::ObstacleIndex
+  //=================================================================================
   //START Materialway::OuterUsher
   Materialway::OuterUsher::OuterUsher(SectionVector& sectionsList, BoundariesSet& boundariesList) :
     sectionsList_(sectionsList),
-    boundariesList_(boundariesList) {}
+    boundariesList_(boundariesList),
+    boundaryIndex_(0),
+    sectionIndex_(sectionWidth + safetySpace) {}
   Materialway::OuterUsher::~OuterUsher() {}
 
   void Materialway::OuterUsher::go(Boundary* boundary, const Tracker& tracker, Direction direction) {
@@ -348,24 +564,23 @@ namespace material {
     int hitCoord;
     int globalMaxZ = discretize(tracker.maxZ()) + globalMaxZPadding;
     int globalMaxR = discretize(tracker.maxR()) + globalMaxRPadding;
-    std::map<int, BoundariesSet::const_iterator> hitBoundariesCoords;
     bool foundCollision = false;
 
-    //test all the boundaries for an hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
-    //for (Boundary& currBoundary : boundariesList_) {
-    for(BoundariesSet::const_iterator it = boundariesList_.cbegin(); it != boundariesList_.cend(); ++it) {
-      hitCoord = (*it)->isHit(startZ, startR, direction);
-      if (hitCoord>0) {
-        hitBoundariesCoords[hitCoord] = it;
+    //the boundaries are all built before the sections, index them again only if they changed
+    if (boundaryIndex_.size() != int(boundariesList_.size())) {
+      boundaryIndex_.clear();
+      for (Boundary* currBoundary : boundariesList_) {
+        boundaryIndex_.add(currBoundary);
       }
     }
 
-    if (hitBoundariesCoords.size()) {
-      collision = hitBoundariesCoords.begin()->first;
+    Boundary* hitBoundary = boundaryIndex_.firstHit(startZ, startR, direction, hitCoord);
+    if (hitBoundary != nullptr) {
+      collision = hitCoord;
       if(direction == HORIZONTAL) {
-        border = (*hitBoundariesCoords.begin()->second)->maxR();
+        border = hitBoundary->maxR();
       } else {
-        border = (*hitBoundariesCoords.begin()->second)->maxZ();
+        border = hitBoundary->maxZ();
       }
       foundCollision = true;
     } else {
@@ -393,18 +608,18 @@ namespace material {
    */
   bool Materialway::OuterUsher::findSectionCollision(std::pair<int,Section*>& sectionCollision, int startZ, int startR, int end, Direction direction) {
     int hitCoord;
-    std::map<int, Section*> hitSectionsCoords;
 
-    //test all the sections for an hit (keep it on a map ordered for key = collision coords, so the first is the nearest collision)
-    for (Section* currSection : sectionsList_) {
-      hitCoord = currSection->isHit(startZ, startR, end, direction);
-      if (hitCoord>0) {
-        hitSectionsCoords[hitCoord] = currSection;
-      }
+    //index the sections appended since the last search
+    if (sectionIndex_.size() > int(sectionsList_.size())) {
+      sectionIndex_.clear();
+    }
+    while (sectionIndex_.size() < int(sectionsList_.size())) {
+      sectionIndex_.add(sectionsList_[sectionIndex_.size()]);
     }
 
-    if (hitSectionsCoords.size()) {
-      sectionCollision = std::make_pair(hitSectionsCoords.begin()->first, hitSectionsCoords.begin()->second);
+    Section* hitSection = sectionIndex_.firstHit(startZ, startR, direction, hitCoord);
+    if ((hitSection != nullptr) && (hitCoord <= end + safetySpace)) {
+      sectionCollision = std::make_pair(hitCoord, hitSection);
       return true;
     }
     return false;
@@ -556,6 +771,7 @@ namespace material {
         section->maxZ(collision - safetySpace);
         updateLastSectionPointer(section, retValue);
       }
+      sectionIndex_.update(section);
       return retValue;
   }
 
@@ -1051,7 +1267,8 @@ namespace material {
   Materialway::Materialway() :
     outerUsher(sectionsList_, boundariesList_),
     innerUsher(sectionsList_, stationListFirst_, stationListSecond_, barrelBoundaryAssociations_, endcapBoundaryAssociations_, moduleSectionAssociations_, layerRodSections_, diskRodSections_),
-    boundariesList_() {}
+    boundariesList_(),
+    threads_(1) {}
   Materialway::~Materialway() {}
 
   int Materialway::discretize(double input) {
@@ -1061,7 +1278,12 @@ namespace material {
     return double(input / gridFactor);
   }
 
-  bool Materialway::build(Tracker& tracker, InactiveSurfaces& inactiveSurface, WeightDistributionGrid& weightDistribution) {
+  /**
+   * Builds the sections and stations, routes the services and computes the material of the modules, services and supports.
+   * @param weightDistribution The grid filled with the grams of the sections and modules, or nullptr not to fill any
+   * @param threads The number of threads the material is computed on (the results do not depend on it)
+   */
+  bool Materialway::build(Tracker& tracker, InactiveSurfaces& inactiveSurface, WeightDistributionGrid* weightDistribution, int threads) {
     /*
     std::cout<<endl<<"tracker: > "<<tracker.maxZ()<<"; v "<<tracker.minR()<<"; ^ "<<tracker.maxR()<<endl;
     std::cout<<"endcap: < "<<tracker.endcaps()[0].minZ()<<"; > "<<tracker.endcaps()[0].maxZ()<<"; v "<<tracker.endcaps()[0].minR()<<"; ^ "<<tracker.endcaps()[0].maxR()<<endl;
@@ -1121,6 +1343,7 @@ namespace material {
 */
 
     bool retValue = false;
+    threads_ = threads;
 
     int startTime = time(0);
     startTaskClock("Building boundaries");
@@ -1139,6 +1362,7 @@ namespace material {
     startTaskClock("Populating MaterialProperties"); populateAllMaterialProperties(tracker, weightDistribution); stopTaskClock();
     startTaskClock("Building inactive surfaces"); buildInactiveSurface(tracker, inactiveSurface); stopTaskClock();
     startTaskClock("Computing material amounts"); calculateMaterialValues(inactiveSurface, tracker); stopTaskClock();
+    indexMaterialConsumers();
     return retValue;
   }
 
@@ -1246,6 +1470,7 @@ namespace material {
       ModuleSectionMap& moduleSectionAssociations_;  /**< Map that associate each module with the section that it feeds */
       LayerRodSectionsMap& layerRodSections_;      /**< maps for sections of the rods */
       DiskRodSectionsMap& diskRodSections_;
+      ServiceFlow& serviceFlow_;                   /**< collects the routed services, deployed at the end of the visit */
 
       const Layer* currLayer_;
       const Disk* currDisk_;
@@ -1262,11 +1487,13 @@ namespace material {
       const std::vector<std::string> unitsToPassRodMM = {"mm"};
       const std::vector<std::string> unitsToPassLayer = {"g", "g/m", "mm"};
       const std::vector<std::string> unitsToPassLayerServ = {"g/m", "mm"};
+      const std::vector<std::string> unitsToPassModule = {"g/m", "mm"};
     public:
-      ServiceVisitor(ModuleSectionMap& moduleSectionAssociations, LayerRodSectionsMap& layerRodSections, DiskRodSectionsMap& diskRodSections) :
+      ServiceVisitor(ModuleSectionMap& moduleSectionAssociations, LayerRodSectionsMap& layerRodSections, DiskRodSectionsMap& diskRodSections, ServiceFlow& serviceFlow) :
         moduleSectionAssociations_(moduleSectionAssociations),
         layerRodSections_(layerRodSections),
-        diskRodSections_(diskRodSections), printGuard(true), printCounter(0), firstRing(false), rodSectionsSize(0) {}
+        diskRodSections_(diskRodSections),
+        serviceFlow_(serviceFlow), printGuard(true), printCounter(0), firstRing(false), rodSectionsSize(0) {}
 
       void visit(const Layer& layer) {
         currLayer_ = &layer;
@@ -1280,7 +1507,7 @@ namespace material {
           for (Section* currSection : layerRodSections_.at(currLayer_).getSections()) {
             layer.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / totalLength);
           }
-          layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(layer.materialObject(), unitsToPassLayerServ);
+          serviceFlow_.add(layerRodSections_.at(currLayer_).getStation(), layer.materialObject(), unitsToPassLayerServ);
         }
       }
 
@@ -1292,17 +1519,17 @@ namespace material {
             rodSectionsSize += currSection->maxZ() - currSection->minZ();
           }
           firstRod = false;
-          layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(rod.materialObject(), unitsToPassRodMM);
+          serviceFlow_.add(layerRodSections_.at(currLayer_).getStation(), rod.materialObject(), unitsToPassRodMM);
         }
         for (Section* currSection : layerRodSections_.at(currLayer_).getSections()) {
           rod.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassRodGGM, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxZ()-currSection->minZ()) / rodSectionsSize);
         }
-        layerRodSections_.at(currLayer_).getStation()->getServicesAndPass(rod.materialObject(), unitsToPassRodGM);
+        serviceFlow_.add(layerRodSections_.at(currLayer_).getStation(), rod.materialObject(), unitsToPassRodGM);
       }
 
       void visit(const BarrelModule& module) {
         if(module.maxZ() > 0) {
-          moduleSectionAssociations_.at(&module)->getServicesAndPass(module.materialObject());
+          serviceFlow_.add(moduleSectionAssociations_.at(&module), module.materialObject(), unitsToPassModule);
 
           return;
 
@@ -1392,7 +1619,7 @@ namespace material {
           for (Section* currSection : diskRodSections_.at(currDisk_).getSections()) {
             disk.materialObject().deployMaterialTo(currSection->materialObject(), unitsToPassLayer, MaterialObject::SERVICES_AND_LOCALS, double(currSection->maxR()-currSection->minR()) / totalLength);
           }          
-          diskRodSections_.at(currDisk_).getStation()->getServicesAndPass(disk.materialObject(), unitsToPassLayerServ);
+          serviceFlow_.add(diskRodSections_.at(currDisk_).getStation(), disk.materialObject(), unitsToPassLayerServ);
         }
 
         /*
@@ -1446,7 +1673,7 @@ namespace material {
       void visit(const EndcapModule& module) {
         if (module.minZ() >= 0) {
           //route module services
-          moduleSectionAssociations_.at(&module)->getServicesAndPass(module.materialObject());
+          serviceFlow_.add(moduleSectionAssociations_.at(&module), module.materialObject(), unitsToPassModule);
 
           /*
           //route disk rod services
@@ -1460,8 +1687,10 @@ namespace material {
       }
     };
 
-    ServiceVisitor v(moduleSectionAssociations_, layerRodSections_, diskRodSections_);
+    ServiceFlow serviceFlow;
+    ServiceVisitor v(moduleSectionAssociations_, layerRodSections_, diskRodSections_, serviceFlow);
     tracker.accept(v);
+    serviceFlow.route();
   }
 
   /*
@@ -1502,6 +1731,7 @@ namespace material {
   void Materialway::firstStepConversions() {
     for (Station* station : stationListFirst_) {
       if ((station->nextSection() != nullptr) && (station->inactiveElement() != nullptr)) {
+        station->conversionStation().getInputMaterials(convertedMaterials_);
         //put local materials in the materialObject of the station
         //put routed services in the materialObject of the adiacent section of station
         station->conversionStation().routeConvertedElements(station->materialObject(), station->outgoingMaterialObject(), *station->inactiveElement());
@@ -1516,6 +1746,7 @@ namespace material {
   void Materialway::secondStepConversions() {
     for (Station* station : stationListSecond_) {
       if ((station->nextSection() != nullptr) && (station->inactiveElement() != nullptr)) {
+        station->conversionStation().getInputMaterials(convertedMaterials_);
         //put local materials in the materialObject of the station
         //put routed services in the materialObject of the adiacent section of station
         station->conversionStation().routeConvertedElements(station->materialObject(), station->outgoingMaterialObject(), *station->inactiveElement());
@@ -1578,7 +1809,10 @@ namespace material {
     sectionsList_.insert(sectionsList_.end(), negativeSections.begin(), negativeSections.end());
   }
 
-  void Materialway::populateAllMaterialProperties(Tracker& tracker, WeightDistributionGrid& weightDistribution) {
+  void Materialway::populateAllMaterialProperties(Tracker& tracker, WeightDistributionGrid* weightDistribution) {
+    weightBoxes_.clear();
+    materialConsumers_.clear();
+
     //sections
     for(Section* section : sectionsList_) {
       if(section->inactiveElement() != nullptr) {
@@ -1586,15 +1820,13 @@ namespace material {
 
         section->materialObject().populateMaterialProperties(*section->inactiveElement());
 
-        /*
         double sectionMinZ = undiscretize(section->minZ());
         double sectionMinR = undiscretize(section->minR());
         double sectionMaxZ = undiscretize(section->maxZ());
         double sectionMaxR = undiscretize(section->maxR());
         double sectionLength = undiscretize(section->maxZ() - section->minZ());
         double sectionArea = sectionLength * 2 * M_PI * sectionMinR;
-        weightDistribution.addTotalGrams(sectionMinZ, sectionMinR, sectionMaxZ, sectionMaxR, sectionLength, sectionArea, section->materialObject());
-        */
+        weightBoxes_.push_back(WeightBox{sectionMinZ, sectionMinR, sectionMaxZ, sectionMaxR, sectionLength, sectionArea, &section->materialObject()});
       } else {
         logUniqueERROR(inactiveElementError);
       }
@@ -1603,24 +1835,60 @@ namespace material {
     //modules
     class ModuleVisitor : public GeometryVisitor {
     private:
-      WeightDistributionGrid& weightDistribution_;
+      std::vector<WeightBox>& weightBoxes_;
+      std::vector<MaterialConsumer>& materialConsumers_;
+      //the masses only depend on the shared materials and on the size of the module: the modules alike share one mass table
+      typedef std::tuple<const MaterialObject::Materials*, double, double> MassKey;
+      std::map<MassKey, int> populatedCaps_;
     public:
-      ModuleVisitor(WeightDistributionGrid& weightDistribution) :
-        weightDistribution_(weightDistribution) {}
+      ModuleVisitor(std::vector<WeightBox>& weightBoxes, std::vector<MaterialConsumer>& materialConsumers) :
+        weightBoxes_(weightBoxes),
+        materialConsumers_(materialConsumers) {}
       virtual ~ModuleVisitor() {}
 
       void visit(DetectorModule& module) {
         //ModuleCap* moduleCap = module.getModuleCap();
         //MaterialProperties* materialProperties = ModuleCap;
         //module.materialObject().populateMaterialProperties(*materialProperties);
-        module.materialObject().populateMaterialProperties(*module.getModuleCap());
+        ModuleCap* moduleCap = module.getModuleCap();
+        const MaterialObject& materialObject = module.materialObject();
+        MaterialConsumer consumer{moduleCap, [&materialObject](MaterialProperties& properties) { materialObject.populateMaterialProperties(properties); }, -1};
+        if (materialObject.serviceElements().empty()) {
+          MassKey key(materialObject.materials(), moduleCap->getLength(), moduleCap->getSurface());
+          auto populatedCap = populatedCaps_.find(key);
+          if (populatedCap != populatedCaps_.end()) {
+            consumer.sharedFrom = populatedCap->second;
+            moduleCap->shareMassVectors(*materialConsumers_[consumer.sharedFrom].properties);
+          } else {
+            consumer.populate(*moduleCap);
+            populatedCaps_[key] = materialConsumers_.size();
+          }
+        } else {
+          consumer.populate(*moduleCap);
+        }
+        materialConsumers_.push_back(consumer);
 
-        //weightDistribution_.addTotalGrams(module.minZ(), module.minR(), module.maxZ(), module.maxR(), module.length(), module.area(), module.materialObject());
+        weightBoxes_.push_back(WeightBox{module.minZ(), module.minR(), module.maxZ(), module.maxR(), module.length(), module.area(), &materialObject});
       }
     };
 
-    ModuleVisitor visitor(weightDistribution);
+    ModuleVisitor visitor(weightBoxes_, materialConsumers_);
     tracker.accept(visitor);
+
+    if (weightDistribution != nullptr) fillWeightDistribution(*weightDistribution);
+  }
+
+  /**
+   * Fills the weight distribution with the grams of the sections and modules. The grams are computed first, as the material
+   * properties cache their values lazily, then the boxes are binned on the threads of the build.
+   */
+  void Materialway::fillWeightDistribution(WeightDistributionGrid& weightDistribution) const {
+    std::vector<WeightDistributionGrid::Box> boxes;
+    boxes.reserve(weightBoxes_.size());
+    for (const WeightBox& box : weightBoxes_) {
+      boxes.push_back(WeightDistributionGrid::Box{box.minZ, box.minR, box.maxZ, box.maxR, box.materialObject->totalGrams(box.length, box.surface)});
+    }
+    weightDistribution.fill(boxes, threads_);
   }
 
   /*
@@ -1654,30 +1922,45 @@ namespace material {
   */
 
   void Materialway::buildInactiveSurface(Tracker& tracker, InactiveSurfaces& inactiveSurface) {
+    //the copies in the inactive surfaces are the material consumers, to be indexed once they are all in place
+    typedef std::vector<std::pair<int, std::function<void(MaterialProperties&)> > > PendingConsumers;
+    PendingConsumers pendingSupports, pendingServices;
+
     class SupportVisitor : public GeometryVisitor {
     private:
       InactiveSurfaces& inactiveSurface_;
+      PendingConsumers& pendingSupports_;
+
+      void update(SupportStructure& supportStructure) {
+        int firstSupport = inactiveSurface_.getSupports().size();
+        supportStructure.updateInactiveSurfaces(inactiveSurface_);
+        for (int i = firstSupport; i < int(inactiveSurface_.getSupports().size()); i++) {
+          pendingSupports_.push_back(std::make_pair(i, [&supportStructure](MaterialProperties& properties) { supportStructure.populateMaterialProperties(properties); }));
+        }
+      }
     public:
-      SupportVisitor(InactiveSurfaces& inactiveSurface) : inactiveSurface_(inactiveSurface) {}
+      SupportVisitor(InactiveSurfaces& inactiveSurface, PendingConsumers& pendingSupports) :
+        inactiveSurface_(inactiveSurface),
+        pendingSupports_(pendingSupports) {}
     
       void visit (Tracker& tracker) {
         for (auto& supportStructure : tracker.supportStructures()) {
-          supportStructure.updateInactiveSurfaces(inactiveSurface_);
+          update(supportStructure);
         }
       }
       void visit (Barrel& barrel) {
         for (auto& supportStructure : barrel.supportStructures()) {
-          supportStructure.updateInactiveSurfaces(inactiveSurface_);
+          update(supportStructure);
         }
       }
       void visit (Endcap& endcap) {
         for (auto& supportStructure : endcap.supportStructures()) {
-          supportStructure.updateInactiveSurfaces(inactiveSurface_);
+          update(supportStructure);
         }
       }
     };
 
-    SupportVisitor supportVisitor(inactiveSurface);
+    SupportVisitor supportVisitor(inactiveSurface, pendingSupports);
     tracker.accept(supportVisitor);
     
     
@@ -1688,7 +1971,8 @@ namespace material {
           std::cout<<"ERRORE INT LEN"<<std::endl;
         }
         */
-	inactiveSurface.addBarrelServicePart(*section->inactiveElement());
+        const MaterialObject& materialObject = section->materialObject();
+        pendingServices.push_back(std::make_pair(int(inactiveSurface.getBarrelServices().size()), [&materialObject](MaterialProperties& properties) { materialObject.populateMaterialProperties(properties); }));
         if((section->inactiveElement()->localMassCount() == 0)) {
           logWARNING(std::string(Form("Empty inactive element at r=%f, dr=%f, z=%f, dz=%f",
 				      section->inactiveElement()->getInnerRadius(),
@@ -1696,51 +1980,136 @@ namespace material {
 				      section->inactiveElement()->getZOffset(),
 				      section->inactiveElement()->getZLength() )));
         }
+        //the section element is not used after this point: the inactive surfaces take over its content
+	inactiveSurface.addBarrelServicePart(std::move(*section->inactiveElement()));
       } else {
         logUniqueERROR(inactiveElementError);
       }
     }
     /*
-    std::vector<InactiveElement>& elements = inactiveSurface.getBarrelServices();
+    InactiveSurfaces::ElementList& elements = inactiveSurface.getBarrelServices();
     for (InactiveElement& currElem : elements) {
       if (currElem.getInteractionLength() < 0){
         std::cout<<"ERRORE INT LEN"<<std::endl;
       }
     }
     */
+
+    for (auto& pending : pendingSupports) {
+      materialConsumers_.push_back(MaterialConsumer{&inactiveSurface.getSupports()[pending.first], pending.second, -1});
+    }
+    for (auto& pending : pendingServices) {
+      materialConsumers_.push_back(MaterialConsumer{&inactiveSurface.getBarrelServices()[pending.first], pending.second, -1});
+    }
   }
 
   void Materialway::calculateMaterialValues(InactiveSurfaces& inactiveSurface, Tracker& tracker) {
+    std::vector<MaterialProperties*> elements;
+
     //supports
     for (InactiveElement& currElem : inactiveSurface.getSupports()) {
-      currElem.calculateTotalMass();
-      currElem.calculateRadiationLength();
-      currElem.calculateInteractionLength();
+      elements.push_back(&currElem);
     }
 
     //sections
     for (InactiveElement& currElem : inactiveSurface.getBarrelServices()) {
-      currElem.calculateTotalMass();
-      currElem.calculateRadiationLength();
-      currElem.calculateInteractionLength();
+      elements.push_back(&currElem);
     }
 
     //modules
     class ModuleVisitor : public GeometryVisitor {
+    private:
+      std::vector<MaterialProperties*>& elements_;
     public:
-      ModuleVisitor() {}
+      ModuleVisitor(std::vector<MaterialProperties*>& elements) : elements_(elements) {}
       virtual ~ModuleVisitor() {}
 
       void visit(DetectorModule& module) {
-        ModuleCap* moduleCap = module.getModuleCap();
-        moduleCap->calculateTotalMass();
-        moduleCap->calculateRadiationLength();
-        moduleCap->calculateInteractionLength();
+        elements_.push_back(module.getModuleCap());
       }
     };
 
-    ModuleVisitor visitor;
+    ModuleVisitor visitor(elements);
     tracker.accept(visitor);
+
+    calculateMaterialValues(elements);
+  }
+
+  /**
+   * Calculates the total mass, radiation and interaction lengths of a set of elements, which are independent of each other
+   * once their masses are populated: the material tab is resolved for all of them first, then they are split among the
+   * threads of the build.
+   */
+  void Materialway::calculateMaterialValues(const std::vector<MaterialProperties*>& elements) const {
+    insur::MaterialLengthTable lengths;
+    for (const MaterialProperties* element : elements) lengths.add(*element);
+    parallelFor(0, elements.size(), threads_, [&](int i) {
+      elements[i]->calculateTotalMass();
+      elements[i]->calculateRadiationLength(lengths);
+      elements[i]->calculateInteractionLength(lengths);
+    });
+  }
+
+  /**
+   * Indexes the material consumers by the materials they have a mass of, which do not change as long as the geometry is the same.
+   */
+  void Materialway::indexMaterialConsumers() {
+    materialConsumersIndex_.clear();
+    for (int i = 0; i < int(materialConsumers_.size()); i++) {
+      for (const auto& mass : materialConsumers_[i].properties->getLocalMasses()) {
+        materialConsumersIndex_[mass.first].push_back(i);
+      }
+    }
+  }
+
+  /**
+   * Updates the built materialway after some entries of the material tab changed: only the module caps, services and supports
+   * with a mass of a changed material are computed again. Their masses are populated again if a density changed, as the
+   * quantities given in mm depend on it, then their radiation and interaction lengths are calculated again.
+   * The quantities of the services converted by the stations depend on the density of the converted materials too:
+   * if one of those changed, the services must be routed again and nothing is updated.
+   * @param weightDistribution The weight distribution filled by the build, filled again if a density changed, or nullptr
+   * @param changedDensities The materials whose density changed
+   * @param changedLengths The materials whose radiation or interaction length changed
+   * @return True if the materialway was updated, false if it must be built again
+   */
+  bool Materialway::update(WeightDistributionGrid* weightDistribution, const std::set<std::string>& changedDensities, const std::set<std::string>& changedLengths) {
+    for (const std::string& material : changedDensities) {
+      if (convertedMaterials_.count(material)) {
+        logINFO("The density of the converted material " + material + " changed: the services must be routed again.");
+        return false;
+      }
+    }
+
+    auto addConsumers = [this](const std::set<std::string>& materials, std::set<int>& consumers) {
+      for (const std::string& material : materials) {
+        auto indexed = materialConsumersIndex_.find(insur::MaterialSymbols::find(material));
+        if (indexed != materialConsumersIndex_.end()) consumers.insert(indexed->second.begin(), indexed->second.end());
+      }
+    };
+    std::set<int> repopulated, recalculated;
+    addConsumers(changedDensities, repopulated);
+    recalculated = repopulated;
+    addConsumers(changedLengths, recalculated);
+
+    //in order, so that the shared masses are populated before they are shared again
+    for (int i : repopulated) {
+      MaterialConsumer& consumer = materialConsumers_[i];
+      if (consumer.sharedFrom >= 0) {
+        consumer.properties->shareMassVectors(*materialConsumers_[consumer.sharedFrom].properties);
+      } else {
+        consumer.properties->clearMassVectors();
+        consumer.populate(*consumer.properties);
+      }
+    }
+    std::vector<MaterialProperties*> recalculatedElements;
+    for (int i : recalculated) recalculatedElements.push_back(materialConsumers_[i].properties);
+    calculateMaterialValues(recalculatedElements);
+    if (!repopulated.empty() && weightDistribution != nullptr) fillWeightDistribution(*weightDistribution);
+
+    logINFO("Material update: " + std::to_string(repopulated.size()) + " of " + std::to_string(materialConsumers_.size())
+            + " elements populated again, " + std::to_string(recalculated.size()) + " recalculated.");
+    return true;
   }
 
   /*
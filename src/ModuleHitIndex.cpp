@@ -0,0 +1,115 @@
+#include "ModuleHitIndex.h"
+#include "DetectorModule.h"
+
+#include <limits>
+#include <algorithm>
+
+ModuleHitIndex::ModuleHitIndex(int etaBins, int phiBins, double etaMax) :
+  etaBins_(etaBins),
+  phiBins_(phiBins),
+  etaMax_(etaMax),
+  etaWidth_(2.*etaMax/etaBins),
+  phiWidth_(2.*M_PI/phiBins) {}
+
+void ModuleHitIndex::clear() {
+  bins_.clear();
+  sensorPolygons_.clear();
+  numModules_ = 0;
+  zMargin_ = 0.;
+  built_ = false;
+}
+
+int ModuleHitIndex::etaBin(double eta) const {
+  if (!(eta > -etaMax_)) return 0;  // also catches -inf
+  if (eta >= etaMax_) return etaBins_-1;
+  return MIN(int((eta + etaMax_)/etaWidth_), etaBins_-1);
+}
+
+int ModuleHitIndex::phiBin(double phi) const {
+  int b = int(floor((phi + M_PI)/phiWidth_)) % phiBins_;
+  return b < 0 ? b + phiBins_ : b;
+}
+
+/**
+ * Registers each module in all the bins it can be reached from. The (eta, phi) extent is computed from the hit polygons
+ * of the sensors (the same polygons used by Sensor::checkHitSegment), for track origins anywhere on the z axis within
+ * +/- zMargin, and widened by a small safety margin. Modules whose projection contains the z axis are put everywhere.
+ * @param modules The list of modules to index; candidates are returned as positions in this list
+ * @param zMargin The maximum |z| of the track origins the index has to serve
+ */
+void ModuleHitIndex::build(const std::vector<const DetectorModule*>& modules, double zMargin) {
+  clear();
+  zMargin_ = zMargin;
+  numModules_ = modules.size();
+  bins_.assign(etaBins_*phiBins_, Candidates());
+
+  const double inf = std::numeric_limits<double>::infinity();
+
+  for (int i = 0; i < numModules_; i++) {
+    const DetectorModule& m = *modules[i];
+    double minR = inf, maxR = 0., minZ = inf, maxZ = -inf;
+    double centerPhi = m.center().Phi();
+    double minDPhi = 0., maxDPhi = 0.;
+    for (const auto& s : m.sensors()) {
+      const Polygon3d<4>& poly = s.hitPoly();
+      minR = MIN(minR, CoordinateOperations::computeMinR(poly));
+      maxR = MAX(maxR, CoordinateOperations::computeMaxR(poly));
+      minZ = MIN(minZ, CoordinateOperations::computeMinZ(poly));
+      maxZ = MAX(maxZ, CoordinateOperations::computeMaxZ(poly));
+      for (const auto& v : poly) {
+        double dPhi = v.Phi() - centerPhi;
+        if (dPhi > M_PI) dPhi -= 2*M_PI;
+        else if (dPhi <= -M_PI) dPhi += 2*M_PI;
+        minDPhi = MIN(minDPhi, dPhi);
+        maxDPhi = MAX(maxDPhi, dPhi);
+      }
+    }
+
+    // The vertices not fitting in a half plane mean the module surrounds the z axis: no constraint can be derived
+    bool surroundsAxis = (maxDPhi - minDPhi) >= M_PI || minR - lengthSafetyMargin <= 0.;
+
+    // Eta range: extreme directions are found at the corners of the (r, z - z0) box
+    double minEta = -inf, maxEta = inf;
+    if (!surroundsAxis) {
+      double rLow = minR - lengthSafetyMargin, rHigh = maxR + lengthSafetyMargin;
+      double dzLow = minZ - zMargin_ - lengthSafetyMargin, dzHigh = maxZ + zMargin_ + lengthSafetyMargin;
+      double eta1 = asinh(dzLow/rLow), eta2 = asinh(dzLow/rHigh);
+      double eta3 = asinh(dzHigh/rLow), eta4 = asinh(dzHigh/rHigh);
+      minEta = std::min({eta1, eta2, eta3, eta4}) - etaSafetyMargin;
+      maxEta = std::max({eta1, eta2, eta3, eta4}) + etaSafetyMargin;
+    }
+
+    // Phi range: origins are on the z axis, so the hit point and the track share the same phi
+    int firstPhiBin = 0, numPhiBins = phiBins_;
+    if (!surroundsAxis) {
+      double minPhi = centerPhi + minDPhi - phiSafetyMargin;
+      double maxPhi = centerPhi + maxDPhi + phiSafetyMargin;
+      firstPhiBin = int(floor((minPhi + M_PI)/phiWidth_));
+      numPhiBins = MIN(int(floor((maxPhi + M_PI)/phiWidth_)) - firstPhiBin + 1, phiBins_);
+    }
+
+    for (int iEta = etaBin(minEta); iEta <= etaBin(maxEta); iEta++) {
+      for (int k = 0; k < numPhiBins; k++) {
+        int iPhi = (firstPhiBin + k) % phiBins_;
+        if (iPhi < 0) iPhi += phiBins_;
+        bin(iEta, iPhi).push_back(i);
+      }
+    }
+  }
+
+  sensorPolygons_.build(modules);
+  built_ = true;
+}
+
+/**
+ * Gives the list of modules a straight track could hit.
+ * @param origin The track origin
+ * @param direction The track direction
+ * @return The sorted positions of the candidate modules, or NULL if the index cannot serve the track
+ */
+const ModuleHitIndex::Candidates* ModuleHitIndex::candidates(const XYZVector& origin, const XYZVector& direction) const {
+  if (!built_) return NULL;
+  if (origin.Rho() > 1e-9 || fabs(origin.Z()) > zMargin_) return NULL;
+  if (direction.Rho() <= 0.) return NULL;
+  return &bin(etaBin(direction.Eta()), phiBin(direction.Phi()));
+}
@@ -0,0 +1,112 @@
+#include "PackedSensorPolygons.h"
+#include "DetectorModule.h"
+
+void PackedSensorPolygons::clear() {
+  for (auto v : { &nx_, &ny_, &nz_, &d_, &sx_, &sy_, &sz_, &stripLength_ }) v->clear();
+  for (int i = 0; i < NumVertices; i++) {
+    for (auto v : { &vx_[i], &vy_[i], &vz_[i], &ex_[i], &ey_[i], &ez_[i] }) v->clear();
+  }
+  innerSensor_.clear();
+  outerSensor_.clear();
+}
+
+int PackedSensorPolygons::addSensor(const Sensor& s) {
+  const Polygon3d<4>& poly = s.hitPoly();
+  const XYZVector& normal = poly.getNormal();
+  nx_.push_back(normal.X());
+  ny_.push_back(normal.Y());
+  nz_.push_back(normal.Z());
+  d_.push_back(poly.getCenter().Dot(normal));
+  for (int i = 0; i < NumVertices; i++) {
+    const XYZVector& v = poly.getVertex(i);
+    XYZVector edgeNormal = normal.Cross(poly.getVertex((i+1) % NumVertices) - v); // points inwards, as long as the edge
+    vx_[i].push_back(v.X());
+    vy_[i].push_back(v.Y());
+    vz_[i].push_back(v.Z());
+    ex_[i].push_back(edgeNormal.X());
+    ey_[i].push_back(edgeNormal.Y());
+    ez_[i].push_back(edgeNormal.Z());
+  }
+  XYZVector stripAxis = (poly.getVertex(1) - poly.getVertex(0)).Unit();
+  sx_.push_back(stripAxis.X());
+  sy_.push_back(stripAxis.Y());
+  sz_.push_back(stripAxis.Z());
+  stripLength_.push_back(s.stripLength());
+  return d_.size() - 1;
+}
+
+/**
+ * Packs the hit polygons of the sensors of the given modules. Only the inner and outer sensors are kept,
+ * as those are the only ones DetectorModule::checkTrackHits looks at.
+ * @param modules The list of modules; checkHitSegments takes positions in this list
+ */
+void PackedSensorPolygons::build(const std::vector<const DetectorModule*>& modules) {
+  clear();
+  for (const DetectorModule* m : modules) {
+    int inner = addSensor(m->innerSensor());
+    innerSensor_.push_back(inner);
+    if (m->numSensors() == 1) outerSensor_.push_back(-1);
+    else if (&m->outerSensor() == &m->innerSensor()) outerSensor_.push_back(inner);
+    else outerSensor_.push_back(addSensor(m->outerSensor()));
+  }
+}
+
+/**
+ * The batched kernel: intersects the track with the given sensors, one sensor per iteration and no branch
+ * but the final selects. The intersection point is computed as in Polygon3d::isLineIntersecting, the segment as in Sensor::checkHitSegment.
+ */
+void PackedSensorPolygons::intersect(double ox, double oy, double oz, double dx, double dy, double dz, const std::vector<int>& sensors,
+                                     std::vector<double>& px, std::vector<double>& py, std::vector<double>& pz, std::vector<int>& segments) const {
+  int n = sensors.size();
+  px.resize(n);
+  py.resize(n);
+  pz.resize(n);
+  segments.resize(n);
+  for (int k = 0; k < n; k++) {
+    int s = sensors[k];
+    double normOrig = nx_[s]*ox + ny_[s]*oy + nz_[s]*oz;
+    double normDir = nx_[s]*dx + ny_[s]*dy + nz_[s]*dz;
+    double t = (d_[s] - normOrig)/normDir;
+    double x = ox + t*dx, y = oy + t*dy, z = oz + t*dz;
+    double halfExcess = 0.;
+    for (int i = 0; i < NumVertices; i++) {
+      double signedArea = ex_[i][s]*(x - vx_[i][s]) + ey_[i][s]*(y - vy_[i][s]) + ez_[i][s]*(z - vz_[i][s]);
+      halfExcess += signedArea < 0. ? -signedArea : 0.;
+    }
+    double projL = (x - vx_[0][s])*sx_[s] + (y - vy_[0][s])*sy_[s] + (z - vz_[0][s])*sz_[s];
+    bool hit = normDir >= minNormDir && halfExcess < maxHalfExcessArea;
+    px[k] = x;
+    py[k] = y;
+    pz[k] = z;
+    segments[k] = hit ? int(projL / stripLength_[s]) : -1;
+  }
+}
+
+/**
+ * Intersects a straight track with the inner and outer sensors of a batch of modules.
+ * @param trackOrig The track origin
+ * @param trackDir The track direction
+ * @param modules The positions of the modules to check
+ * @param innerHits Filled with the inner sensor results, one per module, as Sensor::checkHitSegment would return them
+ * @param outerHits Filled with the outer sensor results; the segment is -1 for single sensor modules
+ */
+void PackedSensorPolygons::checkHitSegments(const XYZVector& trackOrig, const XYZVector& trackDir, const std::vector<int>& modules,
+                                            std::vector<SegmentHit>& innerHits, std::vector<SegmentHit>& outerHits) const {
+  std::vector<int> sensors;
+  sensors.reserve(2*modules.size());
+  for (int m : modules) sensors.push_back(innerSensor_[m]);
+  for (int m : modules) if (outerSensor_[m] >= 0) sensors.push_back(outerSensor_[m]);
+
+  std::vector<double> px, py, pz;
+  std::vector<int> segments;
+  intersect(trackOrig.X(), trackOrig.Y(), trackOrig.Z(), trackDir.X(), trackDir.Y(), trackDir.Z(), sensors, px, py, pz, segments);
+
+  int n = modules.size();
+  innerHits.resize(n);
+  outerHits.resize(n);
+  for (int k = 0, j = n; k < n; k++) {
+    innerHits[k] = std::make_pair(XYZVector(px[k], py[k], pz[k]), segments[k]);
+    if (outerSensor_[modules[k]] >= 0) { outerHits[k] = std::make_pair(XYZVector(px[j], py[j], pz[j]), segments[j]); j++; }
+    else outerHits[k] = std::make_pair(XYZVector(), -1);
+  }
+}
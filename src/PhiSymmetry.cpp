@@ -0,0 +1,86 @@
+#include "PhiSymmetry.h"
+#include "Tracker.h"
+
+/**
+ * Finds the module of a group lying where the given module would be, once rotated around the z axis.
+ * @param m The module to rotate
+ * @param angle The rotation angle
+ * @param group The modules to look into
+ * @return The image module (same type, same vertices), or NULL if there is none
+ */
+const DetectorModule* PhiSymmetry::findImage(const DetectorModule& m, double angle, const Group& group) {
+  RotationZ rotation(angle);
+  XYZVector center = rotation(m.center());
+  XYZVector vertices[4];
+  for (int i = 0; i < 4; i++) vertices[i] = rotation(m.basePoly().getVertex(i));
+
+  for (const DetectorModule* other : group) {
+    if ((other->center() - center).R() > tolerance || other->moduleType() != m.moduleType()) continue;
+    bool match = true;
+    for (int i = 0; i < 4 && match; i++) {
+      match = false;
+      for (const auto& v : other->basePoly()) {
+        if ((v - vertices[i]).R() <= tolerance) { match = true; break; }
+      }
+    }
+    if (match) return other;
+  }
+  return NULL;
+}
+
+bool PhiSymmetry::isSymmetric(const Group& group, int order) {
+  for (const DetectorModule* m : group) {
+    if (!findImage(*m, 2*M_PI/order, group)) return false;
+  }
+  return true;
+}
+
+/**
+ * Detects the symmetry order of the tracker and groups its modules into orbits.
+ * @param tracker The tracker, after it has been built
+ */
+void PhiSymmetry::build(const Tracker& tracker) {
+  // Modules are grouped by the layer or ring they belong to, each group with the number of rods or modules it is expected to repeat with
+  class GroupVisitor : public ConstGeometryVisitor {
+  public:
+    std::vector<std::pair<int, Group> > groups;
+    void visit(const Layer& l) { groups.push_back(std::make_pair(l.numRods(), Group())); }
+    void visit(const Ring& r) { groups.push_back(std::make_pair(r.nModules(), Group())); }
+    void visit(const DetectorModule& m) { if (!groups.empty()) groups.back().second.push_back(&m); }
+  } groupVisitor;
+  tracker.accept(groupVisitor);
+
+  int order = 0;
+  for (const auto& g : groupVisitor.groups) {
+    if (g.second.empty()) continue;
+    int groupOrder = 1;
+    for (int d = g.first; d > 1; d--) {
+      if (g.first % d == 0 && isSymmetric(g.second, d)) { groupOrder = d; break; }
+    }
+    // the tracker has the common rotations of all the groups
+    int a = order, b = groupOrder;
+    while (b != 0) { int r = a % b; a = b; b = r; }
+    order = a;
+  }
+  order_ = MAX(order, 1);
+
+  // Orbits: the successive images of each module under the rotation by 2*pi/order
+  orbits_.clear();
+  numOrbits_ = 0;
+  for (const auto& g : groupVisitor.groups) {
+    for (const DetectorModule* m : g.second) {
+      if (orbits_.count(m)) continue;
+      const DetectorModule* image = m;
+      for (int k = 0; k < order_ && image != NULL && !orbits_.count(image); k++) {
+        orbits_[image] = numOrbits_;
+        image = findImage(*image, 2*M_PI/order_, g.second);
+      }
+      numOrbits_++;
+    }
+  }
+}
+
+int PhiSymmetry::orbit(const DetectorModule* m) const {
+  auto it = orbits_.find(m);
+  return it != orbits_.end() ? it->second : -1;
+}
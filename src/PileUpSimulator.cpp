@@ -0,0 +1,278 @@
+/**
+ * @file PileUpSimulator.cpp
+ * @brief This class overlays minimum bias interactions on the tracker and counts the channels they hit
+ */
+
+#include "PileUpSimulator.h"
+#include "messageLogger.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace insur {
+
+  const int PileUpSimulator::maxClusterWidth;
+  const int PileUpSimulator::maxHitChannelsCounted;
+
+  namespace {
+    // the channels hit in a crossing are sorted as (sensor, chip, channel) keys
+    const int chipShift = 28, sensorShift = 40;
+    const uint64_t maxChannels = 1ULL << chipShift, maxChips = 1ULL << (sensorShift - chipShift), maxSensors = 1ULL << (64 - sensorShift);
+
+    int poisson(CounterRandom::Stream& dice, double mean) {
+      if (mean <= 0.) return 0;
+      if (mean > 100.) return MAX(0L, lround(dice.Gaus(mean, sqrt(mean))));
+      double limit = exp(-mean), product = dice.Rndm();
+      int n = 0;
+      while (product > limit) {
+        product *= dice.Rndm();
+        n++;
+      }
+      return n;
+    }
+  }
+
+  bool PileUpSpectra::Spectrum::add(double low, double high, double density) {
+    if (high <= low || density < 0.) return false;
+    low_.push_back(low);
+    high_.push_back(high);
+    cumulative_.push_back(total() + density*(high - low));
+    return true;
+  }
+
+  /**
+   * Draws a value from the spectrum: a bin with the probability of its integral, then a value uniformly in it.
+   */
+  double PileUpSpectra::Spectrum::draw(CounterRandom::Stream& dice) const {
+    double r = dice.Rndm() * total();
+    int bin = std::upper_bound(cumulative_.begin(), cumulative_.end(), r) - cumulative_.begin();
+    bin = MIN(bin, int(cumulative_.size()) - 1);
+    double binLow = bin > 0 ? cumulative_[bin-1] : 0.;
+    return low_[bin] + (high_[bin] - low_[bin]) * (r - binLow) / (cumulative_[bin] - binLow);
+  }
+
+  /**
+   * Reads the spectra from a text file.
+   * @return False if the file could not be read, has a malformed line or lacks one of the spectra
+   */
+  bool PileUpSpectra::load(const std::string& fileName) {
+    std::ifstream in(fileName.c_str());
+    if (!in) {
+      logERROR("Cannot read the pile-up spectra from " + fileName);
+      return false;
+    }
+    eta_ = Spectrum();
+    pt_ = Spectrum();
+    std::string line;
+    for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+      line = trim(line.substr(0, line.find('#')));
+      if (line.empty()) continue;
+      std::istringstream fields(line);
+      std::string key;
+      double low, high, density;
+      bool ok;
+      fields >> key;
+      if (key == "eta") ok = (fields >> low >> high >> density) && eta_.add(low, high, density);
+      else if (key == "pt") ok = (fields >> low >> high >> density) && low >= 0. && pt_.add(low, high, density);
+      else if (key == "z0sigma") ok = (fields >> z0Sigma_) && z0Sigma_ >= 0.;
+      else ok = false;
+      if (!ok) {
+        logERROR("Malformed line " + any2str(lineNumber) + " in the pile-up spectra file " + fileName + ": " + line);
+        return false;
+      }
+    }
+    if (eta_.empty() || eta_.total() <= 0. || pt_.empty() || pt_.total() <= 0.) {
+      logERROR("The pile-up spectra file " + fileName + " needs both an eta and a pt spectrum");
+      return false;
+    }
+    return true;
+  }
+
+  void PileUpSimulator::SensorCounts::merge(const SensorCounts& other) {
+    hitChannels += other.hitChannels;
+    hitChannelsSquared += other.hitChannelsSquared;
+    clusters += other.clusters;
+    clusterWidths += other.clusterWidths;
+    maxHitChannels = MAX(maxHitChannels, other.maxHitChannels);
+    maxChipHitChannels = MAX(maxChipHitChannels, other.maxChipHitChannels);
+  }
+
+  /**
+   * Simulates the pile-up of a number of bunch crossings, and counts the channels hit in every sensor of a tracker.
+   * @param interactionsPerCrossing The number of minimum bias interactions overlaid in each crossing
+   * @param seed The seed of the random streams of the interactions
+   * @param numThreads The number of threads the crossings are simulated on (the results do not depend on it)
+   */
+  void PileUpSimulator::simulate(const Tracker& tracker, const PileUpSpectra& spectra, int interactionsPerCrossing, long crossings, int seed, int numThreads) {
+    crossings_ = crossings;
+    navigator_.setTracker(tracker);
+    setupFrames();
+
+    std::vector<Shard> shards(MAX(1, numThreads));
+    for (Shard& shard : shards) {
+      shard.sensors.resize(frames_.size());
+      shard.hitChannels.assign(maxHitChannelsCounted + 1, 0);
+      shard.clusterWidths.assign(maxClusterWidth + 1, 0);
+      shard.touched = 0;
+    }
+    CounterRandom dice(seed, CounterRandom::PILE_UP);
+    // worker t simulates the crossings t, t+numThreads... in its own shard
+    parallelFor(0, shards.size(), shards.size(), [&](int t) {
+      std::vector<HelixNavigator::Crossing> trackCrossings;
+      for (long crossing = t; crossing < crossings; crossing += shards.size()) {
+        simulateCrossing(spectra, dice, interactionsPerCrossing, crossing, trackCrossings, shards[t]);
+      }
+    });
+
+    hitChannelDistribution_.assign(maxHitChannelsCounted + 1, 0);
+    clusterWidthDistribution_.assign(maxClusterWidth + 1, 0);
+    long touched = 0;
+    for (const Shard& shard : shards) {
+      for (unsigned int i = 0; i < frames_.size(); i++) sensors_[i].counts.merge(shard.sensors[i]);
+      for (int n = 0; n <= maxHitChannelsCounted; n++) hitChannelDistribution_[n] += shard.hitChannels[n];
+      for (int w = 0; w <= maxClusterWidth; w++) clusterWidthDistribution_[w] += shard.clusterWidths[w];
+      touched += shard.touched;
+    }
+    hitChannelDistribution_[0] += crossings * frames_.size() - touched;
+  }
+
+  /**
+   * Resolves the frame and the channel layout of every sensor up front, so that the threads do not go through the
+   * sensor properties and their caches.
+   */
+  void PileUpSimulator::setupFrames() {
+    const std::vector<const DetectorModule*>& modules = navigator_.modules();
+    frames_.clear();
+    sensors_.clear();
+    moduleFrames_.assign(modules.size(), std::vector<int>());
+    for (unsigned int i = 0; i < modules.size(); i++) {
+      const DetectorModule& m = *modules[i];
+      const Polygon3d<4>& poly = m.basePoly();
+      int sensorIndex = 0;
+      for (const Sensor& s : m.sensors()) {
+        SensorFrame f;
+        f.module = i;
+        f.normalOffset = s.normalOffset();
+        f.thickness = s.sensorThickness();
+        f.center = poly.getCenter();
+        f.normal = poly.getNormal();
+        // vertices 0 and 3 are the wide end of the module, 1 and 2 the narrow one
+        f.along = ((poly.getVertex(1) + poly.getVertex(2)) - (poly.getVertex(0) + poly.getVertex(3))).Unit();
+        f.across = (poly.getVertex(3) - poly.getVertex(0)).Unit();
+        f.length = m.length();
+        f.maxWidth = m.maxWidth();
+        f.minWidth = m.minWidth();
+        f.strips = s.numStripsAcrossEstimate();
+        f.segments = s.numSegmentsEstimate();
+        f.chipsAcross = s.numROCX.state() ? MAX(1, s.numROCX()) : 1;
+        f.chipsAlong = s.numROCY.state() ? MAX(1, s.numROCY()) : 1;
+        f.stripsPerChip = MAX(1, f.strips / f.chipsAcross);
+        f.segmentsPerChip = MAX(1, f.segments / f.chipsAlong);
+        if (f.strips < 1 || f.segments < 1 || uint64_t(f.strips) * f.segments >= maxChannels
+            || uint64_t(f.chipsAcross) * f.chipsAlong >= maxChips || frames_.size() + 1 >= maxSensors) {
+          logERROR("Sensor " + any2str(sensorIndex) + " of a module at r=" + any2str(m.center().Rho()) + ", z=" + any2str(m.center().Z())
+                   + " has a channel layout the pile-up simulation cannot count: it is skipped");
+        } else {
+          moduleFrames_[i].push_back(frames_.size());
+          frames_.push_back(f);
+          sensors_.push_back((SensorOccupancy){ &m, sensorIndex, f.strips * f.segments, f.chipsAcross * f.chipsAlong, SensorCounts() });
+        }
+        sensorIndex++;
+      }
+    }
+  }
+
+  void PileUpSimulator::simulateCrossing(const PileUpSpectra& spectra, const CounterRandom& dice, int interactionsPerCrossing, long crossing,
+                                         std::vector<HelixNavigator::Crossing>& trackCrossings, Shard& shard) const {
+    for (int k = 0; k < interactionsPerCrossing; k++) {
+      CounterRandom::Stream interactionDice = dice.stream(uint64_t(crossing) * interactionsPerCrossing + k);
+      double z0 = interactionDice.Gaus(0., spectra.z0Sigma());
+      int particles = poisson(interactionDice, spectra.multiplicity());
+      for (int p = 0; p < particles; p++) {
+        double eta = spectra.drawEta(interactionDice);
+        double pt = spectra.drawPt(interactionDice);
+        double phi0 = -M_PI + 2*M_PI*interactionDice.Rndm();
+        double charge = interactionDice.Rndm() < 0.5 ? -1. : 1.;
+        if (pt <= 0.) continue;
+        Helix helix(charge*pt, eta, phi0, z0);
+        navigator_.crossings(helix, trackCrossings);
+        for (const HelixNavigator::Crossing& c : trackCrossings) {
+          XYZVector direction = helix.direction(c.s);
+          for (int frameIndex : moduleFrames_[c.module]) addCluster(frames_[frameIndex], frameIndex, c.global, direction, shard);
+        }
+      }
+    }
+    countCrossing(shard);
+  }
+
+  /**
+   * Adds the channels a track crossing a sensor goes through: those between the points where it enters and leaves the sensor
+   * thickness, up to maxClusterWidth in each direction.
+   * @param position The crossing point on the mid-plane of the module
+   * @param direction The direction of the track there, of any length
+   */
+  void PileUpSimulator::addCluster(const SensorFrame& frame, int frameIndex, const XYZVector& position, const XYZVector& direction, Shard& shard) const {
+    double normalSlope = direction.Dot(frame.normal);
+    if (fabs(normalSlope) < 1e-9) return;
+    XYZVector local = position + direction * (frame.normalOffset / normalSlope) - frame.center;
+    double along = local.Dot(frame.along) + frame.length/2.; // from the wide end
+    if (along < 0. || along >= frame.length) return;
+    double width = frame.maxWidth + (frame.minWidth - frame.maxWidth) * along / frame.length;
+    double across = local.Dot(frame.across) + width/2.; // from the edge of vertex 0
+    if (across < 0. || across >= width) return;
+
+    // half the extent of the path through the sensor thickness, in each direction
+    double halfPath = frame.thickness / 2. / fabs(normalSlope);
+    double spreadAcross = fabs(direction.Dot(frame.across)) * halfPath;
+    double spreadAlong = fabs(direction.Dot(frame.along)) * halfPath;
+    int firstStrip = MAX(0, int(floor((across - spreadAcross) / width * frame.strips)));
+    int lastStrip = MIN(MIN(frame.strips - 1, firstStrip + maxClusterWidth - 1), int(floor((across + spreadAcross) / width * frame.strips)));
+    int firstSegment = MAX(0, int(floor((along - spreadAlong) / frame.length * frame.segments)));
+    int lastSegment = MIN(MIN(frame.segments - 1, firstSegment + maxClusterWidth - 1), int(floor((along + spreadAlong) / frame.length * frame.segments)));
+
+    int clusterWidth = lastStrip - firstStrip + 1;
+    SensorCounts& counts = shard.sensors[frameIndex];
+    counts.clusters++;
+    counts.clusterWidths += clusterWidth;
+    shard.clusterWidths[clusterWidth]++;
+    for (int segment = firstSegment; segment <= lastSegment; segment++) {
+      for (int strip = firstStrip; strip <= lastStrip; strip++) {
+        uint64_t chip = MIN(frame.chipsAcross - 1, strip / frame.stripsPerChip) * frame.chipsAlong + MIN(frame.chipsAlong - 1, segment / frame.segmentsPerChip);
+        uint64_t channel = uint64_t(segment) * frame.strips + strip;
+        shard.keys.push_back(uint64_t(frameIndex) << sensorShift | chip << chipShift | channel);
+      }
+    }
+  }
+
+  /**
+   * Counts the channels hit in the crossing just simulated, once each, by sensor and by chip.
+   */
+  void PileUpSimulator::countCrossing(Shard& shard) const {
+    std::vector<uint64_t>& keys = shard.keys;
+    std::sort(keys.begin(), keys.end());
+    size_t i = 0;
+    while (i < keys.size()) {
+      uint64_t sensor = keys[i] >> sensorShift;
+      uint64_t chip = keys[i] >> chipShift;
+      int hitChannels = 0, chipHitChannels = 0, maxChipHitChannels = 0;
+      for (; i < keys.size() && keys[i] >> sensorShift == sensor; i++) {
+        if (i > 0 && keys[i] == keys[i-1]) continue;
+        if (keys[i] >> chipShift != chip) {
+          chip = keys[i] >> chipShift;
+          chipHitChannels = 0;
+        }
+        hitChannels++;
+        maxChipHitChannels = MAX(maxChipHitChannels, ++chipHitChannels);
+      }
+      SensorCounts& counts = shard.sensors[sensor];
+      counts.hitChannels += hitChannels;
+      counts.hitChannelsSquared += long(hitChannels) * hitChannels;
+      counts.maxHitChannels = MAX(counts.maxHitChannels, hitChannels);
+      counts.maxChipHitChannels = MAX(counts.maxChipHitChannels, maxChipHitChannels);
+      shard.hitChannels[MIN(hitChannels, maxHitChannelsCounted)]++;
+      shard.touched++;
+    }
+    keys.clear();
+  }
+}
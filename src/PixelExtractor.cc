@@ -1,6 +1,7 @@
 #include<PixelExtractor.h>
 #include <ModuleCap.h>
 #include<iomanip>
+#include <algorithm>
 
 #include <boost/version.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -445,7 +446,7 @@ namespace insur {
   void PixelExtractor::createPixelBarrelServices(InactiveSurfaces& inatcvser) {
     //Inactive elements part
     //InactiveSurfaces& inatvser = pix.getInactiveSurfaces();
-    std::vector<InactiveElement>& bser = inatcvser.getBarrelServices();
+    InactiveSurfaces::ElementList& bser = inatcvser.getBarrelServices();
     ShapeInfo bser_shape;
     bser_shape.type = tb;
     bser_shape.dx = 0.0;
@@ -974,7 +975,7 @@ namespace insur {
   void PixelExtractor::createPixelEndcapServices(InactiveSurfaces& inatcvser) {
     //Inactive elements part
     //InactiveSurfaces& inatvser = pix.getInactiveSurfaces();
-    std::vector<InactiveElement>& bser = inatcvser.getEndcapServices();
+    InactiveSurfaces::ElementList& bser = inatcvser.getEndcapServices();
     ShapeInfo bser_shape;
     bser_shape.type = tb;
     bser_shape.dx = 0.0;
@@ -1059,16 +1060,18 @@ namespace insur {
     comp.density = density;
     comp.method = wt;
     double m = 0.0;
-    for (std::map<std::string, double>::const_iterator it = mp.getLocalMasses().begin(); it != mp.getLocalMasses().end(); ++it) {
-      if (!nosensors || (it->first.compare(xml_sensor_silicon) != 0)) {
+    int siliconId = MaterialSymbols::find(xml_sensor_silicon);
+    for (MassVector::const_iterator it = mp.getLocalMasses().begin(); it != mp.getLocalMasses().end(); ++it) {
+      if (!nosensors || (it->first != siliconId)) {
         //    std::pair<std::string, double> p;
         //    p.first = mp.getLocalTag(i);
         //    p.second = mp.getLocalMass(i);
-        comp.elements.push_back(*it);
+        comp.elements.push_back(std::make_pair(MaterialSymbols::name(it->first), it->second));
         //    m = m + mp.getLocalMass(i);
         m += it->second;
       }
     }
+    std::sort(comp.elements.begin(), comp.elements.end()); // in alphabetical order, as the names are unique
     for (unsigned int i = 0; i < comp.elements.size(); i++)
       comp.elements.at(i).second = comp.elements.at(i).second / m;
     //////
@@ -1111,8 +1114,9 @@ namespace insur {
    double d = mc.getSurface() * mc.getModule().thickness();
     if (nosensors) {
       double m = 0.0;
-      for (std::map<std::string, double>::const_iterator it = mc.getLocalMasses().begin(); it != mc.getLocalMasses().end(); ++it) {
-        if (it->first.compare(xml_sensor_silicon) != 0) m += it->second;
+      int siliconId = MaterialSymbols::find(xml_sensor_silicon);
+      for (MassVector::const_iterator it = mc.getLocalMasses().begin(); it != mc.getLocalMasses().end(); ++it) {
+        if (it->first != siliconId) m += it->second;
       }
       d = 1000 * m / d;
     }
@@ -1,8 +1,11 @@
 #include "PtErrorAdapter.h"
+#include <tuple>
 
 const double PtErrorAdapter::minimumPt = 0.3;
 const double PtErrorAdapter::maximumPt = 30;
 
+const double PtErrorAdapter::curvatureStep = 1e-3;
+
 const double PtErrorAdapter::ptMinFit = 0.22;
 const double PtErrorAdapter::ptMaxFit = 10.;
 // log(pt/z) distribution parameters for 12000 events at 14 TeV
@@ -25,6 +28,12 @@ void PtErrorAdapter::setPterrorParameters() {
 }
 
 
+/**
+ * The probability of a track to be accepted by the trigger of the module, looked up in the table of the trigger probabilities.
+ * @param trackPt The transverse momentum of the track
+ * @param stereoDistance The distance between the sensors, instead of the one of the module if not 0
+ * @param triggerWindow The width of the trigger window in strips, instead of the one of the module if not 0
+ */
 double PtErrorAdapter::getTriggerProbability(const double& trackPt, const double& stereoDistance /*= 0*/, const int& triggerWindow /* = 0 */ ) {
   setPterrorParameters();
   if (stereoDistance!=0) {
@@ -37,15 +46,91 @@ double PtErrorAdapter::getTriggerProbability(const double& trackPt, const double
   if (triggerWindow!=0) thisTriggerWindow = triggerWindow;
   else thisTriggerWindow = mod_.triggerWindow();
   double pt_cut = stripsToP(thisTriggerWindow/2.);
+  double result = triggerProbabilityTable().probability(myPtError, pt_cut, trackPt) * mod_.geometricEfficiency();
+  // std::cerr << "trigger prob @ " << trackPt << " GeV/c is " << result <<std::endl; // debug
+  return result;
+}
+
+double PtErrorAdapter::computeTriggerProbability(ptError& pterr, double ptCut, double trackPt) {
   // Error on curvatre is the relative error of trackPt times the
   // curvature (cur = 1/pt)
-  double cur_error = myPtError.computeError(trackPt) / trackPt; 
+  double cur_error = pterr.computeError(trackPt) / trackPt; 
+  return pterr.probabilityInside(1/ptCut, 1/trackPt, cur_error);
+}
+
+PtErrorAdapter::TriggerProbabilityTable& PtErrorAdapter::triggerProbabilityTable() {
+  static TriggerProbabilityTable table;
+  return table;
+}
+
+bool PtErrorAdapter::TriggerProbabilityTable::Key::operator<(const Key& other) const {
+  return std::tie(r, z, pitch, stripLength, height, distance, effectiveDistance, tilt, ptCut, moduleType, zCorrelation) <
+         std::tie(other.r, other.z, other.pitch, other.stripLength, other.height, other.distance, other.effectiveDistance, other.tilt, other.ptCut, other.moduleType, other.zCorrelation);
+}
+
+/**
+ * @return The points of the curves used by the calling thread so far, a copy of the ones of the shared table
+ */
+PtErrorAdapter::TriggerProbabilityTable::Curves& PtErrorAdapter::TriggerProbabilityTable::localCurves() {
+  static thread_local Curves curves;
+  return curves;
+}
+
+/**
+ * The trigger probability at a point of a curve, taken from the table of the thread, else from the shared table,
+ * else computed.
+ * @param localCurve The curve of the key in the table of the thread
+ * @param step The curvature of the point, in multiples of curvatureStep
+ */
+double PtErrorAdapter::TriggerProbabilityTable::point(const Key& key, Curve& localCurve, long step, ptError& pterr, double ptCut) {
+  Curve::const_iterator it = localCurve.find(step);
+  if (it != localCurve.end()) return it->second;
   double result;
-  result = myPtError.probabilityInside(1/pt_cut, 1/trackPt, cur_error) * mod_.geometricEfficiency();
-  // std::cerr << "trigger prob @ " << trackPt << " GeV/c is " << result <<std::endl; // debug
+  bool found;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Curve& curve = curves_[key];
+    it = curve.find(step);
+    found = it != curve.end();
+    if (found) result = it->second;
+  }
+  if (!found) {
+    result = computeTriggerProbability(pterr, ptCut, 1/(step*curvatureStep)); // infinite (not finite) at the first point
+    std::lock_guard<std::mutex> lock(mutex_);
+    curves_[key][step] = result;
+  }
+  localCurve[step] = result;
   return result;
 }
 
+/**
+ * The trigger probability of a track, interpolated between the points of the curve of the module around its curvature.
+ * It is computed directly where the curve is not defined on both sides, that is for the tracks too stiff or too soft
+ * to get a resolution.
+ * @param pterr The ptError set up for the module
+ * @param ptCut The pt of the tracks at the edge of the trigger window
+ * @param trackPt The transverse momentum of the track
+ * @return The probability, without the geometric efficiency of the module
+ */
+double PtErrorAdapter::TriggerProbabilityTable::probability(ptError& pterr, double ptCut, double trackPt) {
+  double curvature = fabs(1/trackPt)/curvatureStep;
+  if (!std::isfinite(curvature)) return computeTriggerProbability(pterr, ptCut, trackPt);
+
+  Key key = { pterr.getR(), pterr.getZ(), pterr.getPitch(), pterr.getStripLength(), pterr.getHeight(), pterr.getDistance(),
+              pterr.getEffectiveDistance(), pterr.getTilt(), ptCut, pterr.getModuleType(), pterr.getZCorrelation() };
+  Curve& localCurve = localCurves()[key];
+  long step = floor(curvature);
+  double low = point(key, localCurve, step, pterr, ptCut);
+  double high = point(key, localCurve, step + 1, pterr, ptCut);
+  if (!std::isfinite(low) || !std::isfinite(high)) return computeTriggerProbability(pterr, ptCut, trackPt);
+  return low + (curvature - step)*(high - low);
+}
+
+double PtErrorAdapter::computeError(double trackPt) {
+  setPterrorParameters();
+  return myPtError.computeError(trackPt);
+}
+
 // TODO: this is VERY ugly!!! :( sorry: hurry !
 
 double PtErrorAdapter::getTriggerFrequencyTruePerEventAbove(const double& myCut) {
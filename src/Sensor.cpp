@@ -27,6 +27,14 @@ void Sensor::clearPolys() {
   envPoly_ = 0;
 }
 
+// Builds the polygons (and their center and normal) upfront, instead of on first use
+void Sensor::buildPolys() const {
+  for (const Polygon3d<4>* p : { &hitPoly(), &envelopePoly() }) {
+    p->getCenter();
+    p->getNormal();
+  }
+}
+
 const Polygon3d<4>& Sensor::hitPoly() const {
   if (hitPoly_ == 0) hitPoly_ = buildOwnPoly(normalOffset());
   return *hitPoly_;
@@ -7,6 +7,10 @@
 #include "SvnRevision.h"
 #include "Squid.h"
 #include "StopWatch.h"
+#include "MaterialTab.h"
+#include "TrackShooter.h"
+#include <chrono>
+#include <thread>
 
 namespace insur {
   // public
@@ -17,7 +21,8 @@ namespace insur {
       mainConfiguration(mainConfigHandler::instance()),
       t2c(mainConfiguration),
       weightDistributionTracker(0.1),
-      weightDistributionPixel(0.1) {
+      weightDistributionPixel(0.1),
+      weightsFilled(false) {
     tr = NULL;
     is = NULL;
     mb = NULL;
@@ -166,6 +171,10 @@ namespace insur {
       a.simParms(simParms_);
       pixelAnalyzer.simParms(simParms_);
 
+      // Index the modules for the track hit finding (track origins within 5 sigma of the luminous region are served)
+      if (tr) tr->buildHitIndex(5. * simParms_->zErrorCollider());
+      if (px) px->buildHitIndex(5. * simParms_->zErrorCollider());
+
       childRange = getChildRange(pt, "Support");
       std::for_each(childRange.first, childRange.second, [&](const ptree::value_type& kv) {
         Support* s = new Support();
@@ -254,16 +263,29 @@ namespace insur {
     }
   }
 
-  bool Squid::buildMaterials(bool verbose) {
+  /**
+   * Builds the materialway of the tracker, and of the pixel if it exists, which computes the material of the modules,
+   * services and supports.
+   * @param verbose Unused
+   * @param threads The number of threads the material is computed on (the results do not depend on it)
+   * @param weightBinSize The bin size of the weight distributions, in mm, or 0 not to fill them
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::buildMaterials(bool verbose, int threads, double weightBinSize) {
     startTaskClock("Building materials");
 
     if (tr) {
+        weightsFilled = weightBinSize > 0;
+        if (weightsFilled) {
+          weightDistributionTracker = WeightDistributionGrid(weightBinSize);
+          weightDistributionPixel = WeightDistributionGrid(weightBinSize);
+        }
         if (!is) is = new InactiveSurfaces();
-        materialwayTracker.build(*tr, *is, weightDistributionTracker);
+        materialwayTracker.build(*tr, *is, weightsFilled ? &weightDistributionTracker : nullptr, threads);
 
           if (px) {
 	    if (!pi) pi = new InactiveSurfaces();
-	    materialwayPixel.build(*px, *pi, weightDistributionPixel);
+	    materialwayPixel.build(*px, *pi, weightsFilled ? &weightDistributionPixel : nullptr, threads);
           }
 
       } else {
@@ -319,6 +341,62 @@ namespace insur {
     }
   }
 
+  /**
+   * Read the material tab again and update the materials built by <i>buildMaterials()</i>, then the material budget.
+   * Only the module caps, services and supports with a mass of a changed material are computed again.
+   * @param verbose A flag that turns the final status summary of the material budget on or off
+   * @return True if the materials were updated, false if they must be built again from scratch
+   */
+  bool Squid::updateMaterials(bool verbose) {
+    if (!tr || !is) {
+      logERROR(err_no_matbudget);
+      return false;
+    }
+    startTaskClock("Updating materials");
+    std::set<std::string> changedDensities, changedLengths;
+    material::MaterialTab::reload(changedDensities, changedLengths);
+    bool updated = materialwayTracker.update(weightsFilled ? &weightDistributionTracker : nullptr, changedDensities, changedLengths);
+    if (updated && px && pi) updated = materialwayPixel.update(weightsFilled ? &weightDistributionPixel : nullptr, changedDensities, changedLengths);
+    stopTaskClock();
+    if (!updated) {
+      logERROR("The material changes cannot be applied incrementally: the materials must be built again.");
+      return false;
+    }
+    return createMaterialBudget(verbose);
+  }
+
+  /**
+   * Wait for changes of the material tab, and write the material map again after each of them, until the program is
+   * interrupted or an update fails.
+   * @param mapFileName The file of the material map, as for <i>exportMaterialMap()</i>
+   * @param etaSteps The number of tracks of the eta scan
+   * @return False if an update failed
+   */
+  bool Squid::watchMaterials(const std::string& mapFileName, int etaSteps) {
+    std::string mattabFile = material::MaterialTab::instance().fileName();
+    std::time_t lastWrite = 0;
+    try {
+      lastWrite = boost::filesystem::last_write_time(mattabFile);
+    } catch (boost::filesystem::filesystem_error& e) {
+      logERROR(e.what());
+      return false;
+    }
+    std::cout << "Watching " << mattabFile << " for changes, interrupt to stop." << std::endl;
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      std::time_t write;
+      try {
+        write = boost::filesystem::last_write_time(mattabFile);
+      } catch (boost::filesystem::filesystem_error& e) {
+        continue; // being saved
+      }
+      if (write == lastWrite) continue;
+      lastWrite = write;
+      if (!updateMaterials() || !exportMaterialMap(mapFileName, etaSteps)) return false;
+      std::cout << "Material map " << mapFileName << " updated." << std::endl;
+    }
+  }
+
   /**
    * Build a full system consisting of tracker object, collection of inactive surfaces and material budget from the
    * given configuration files. All three objects replace the previously registered ones, if they existed. They remain
@@ -454,13 +532,17 @@ namespace insur {
 
   /**
    * Analyze the previously created geometry and without no output  through rootweb.
+   * @param tracks The number of tracks to be shot
+   * @param threads The number of threads used to shoot them (the results do not depend on it)
+   * @param phiSymmetry If true, the tracks are only shot in one phi wedge of the tracker symmetry and unfolded to the others
+   * @param analyticCoverage If true, the module coverage is computed from the projected module outlines instead of the tracks
    * @return True if there were no errors during processing, false otherwise
    */
-  bool Squid::pureAnalyzeGeometry(int tracks) {
+  bool Squid::pureAnalyzeGeometry(int tracks, int threads, bool phiSymmetry, bool analyticCoverage) {
     if (tr) {
       startTaskClock("Analyzing geometry");
-      a.analyzeGeometry(*tr, tracks);
-      if (px) pixelAnalyzer.analyzeGeometry(*px, tracks);
+      a.analyzeGeometry(*tr, tracks, threads, phiSymmetry, analyticCoverage);
+      if (px) pixelAnalyzer.analyzeGeometry(*px, tracks, threads, phiSymmetry, analyticCoverage);
       stopTaskClock();
       return true; // TODO: this return value is not really meaningful
     } else {
@@ -469,7 +551,14 @@ namespace insur {
     }
   }
 
-  bool Squid::analyzeTriggerEfficiency(int tracks, bool detailed) {
+  /**
+   * Analyze the trigger efficiency of the previously created geometry.
+   * @param tracks The number of tracks fanned out in eta
+   * @param detailed If true, the distance tuning plots are created as well
+   * @param threads The number of threads the tracks are traced on (the results do not depend on it)
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::analyzeTriggerEfficiency(int tracks, bool detailed, int threads) {
     // Call this before analyzetrigger if you want to have the map of suggested spacings
     if (detailed) {
       startTaskClock("Creating distance tuning plots");
@@ -480,7 +569,8 @@ namespace insur {
     a.analyzeTriggerEfficiency(*tr,
                                mainConfiguration.getTriggerMomenta(),
                                mainConfiguration.getThresholdProbabilities(),
-                               tracks);
+                               tracks,
+                               threads);
     stopTaskClock();
     return true;
   }
@@ -537,6 +627,45 @@ namespace insur {
     }
   }
 
+  /**
+   * Bins the previously created material budget into an (r, z) voxel map and writes it, together with a fine eta scan
+   * of the material integrated through it.
+   * @param fileName The file of the map; the eta scan goes to the same name with the suffix .eta
+   * @param etaSteps The number of tracks of the eta scan
+   * @param binSize The voxel size, in mm
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::exportMaterialMap(const std::string& fileName, int etaSteps, double binSize) {
+    if (mb) {
+      startTaskClock("Building the material voxel map");
+      MaterialVoxelMap map;
+      map.build(*mb, binSize);
+      bool written = map.save(fileName) && map.saveEtaScan(fileName + ".eta", a.getEtaMaxMaterial(), etaSteps);
+      stopTaskClock();
+      return written;
+    } else {
+      logERROR(err_no_matbudget);
+      return false;
+    }
+  }
+
+  /**
+   * Writes the weight distributions filled by <i>buildMaterials()</i>, with the grams of the sections and modules binned in (z, r).
+   * @param fileName The file of the tracker weights; the pixel ones go to the same name with the suffix .pixel
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::exportWeightMap(const std::string& fileName) {
+    if (weightsFilled) {
+      startTaskClock("Writing the weight map");
+      bool written = weightDistributionTracker.save(fileName) && (!px || weightDistributionPixel.save(fileName + ".pixel"));
+      stopTaskClock();
+      return written;
+    } else {
+      logERROR("The weight distributions were not filled: the materials must be built with a weight bin size.");
+      return false;
+    }
+  }
+
   /**
    * Produces the output of the analysis of the geomerty analysis
    * @return True if there were no errors during processing, false otherwise
@@ -570,6 +699,31 @@ namespace insur {
     }
   }
 
+  /**
+   * Measures the occupancy with a Monte Carlo of the pile-up, and reports it.
+   * @param spectraFile The spectra of the minimum bias interactions, or empty for the default one of the configuration directory
+   * @param crossings The number of bunch crossings to simulate
+   * @param threads The number of threads the crossings are simulated on (the results do not depend on it)
+   * @return True if there were no errors during processing, false otherwise
+   */
+  bool Squid::reportPileUpSite(const std::string& spectraFile, long crossings, int threads) {
+    if (tr) {
+      PileUpSpectra spectra;
+      std::string fileName = spectraFile.empty() ? mainConfiguration.getStandardDirectory() + "/" + default_configdir + "/" + default_pileupspectrafile : spectraFile;
+      if (!spectra.load(fileName)) return false;
+      startTaskClock("Simulating the pile-up occupancy");
+      a.simulatePileUp(*tr, spectra, crossings, threads);
+      stopTaskClock();
+      startTaskClock("Creating pile-up occupancy report");
+      v.pileUpSummary(a, *simParms_, site);
+      stopTaskClock();
+      return true;
+    } else {
+      logERROR(err_no_tracker);
+      return false;
+    }
+  }
+
   bool Squid::reportTriggerProcessorsSite() {
     if (tr) {
       startTaskClock("Computing multiple trigger tower connections");
@@ -709,22 +863,21 @@ namespace insur {
     return mySettingsFile_;
   }
 
-  void Squid::simulateTracks(const po::variables_map& varmap, int seed) { // CUIDADO not ported to coderev -- yet?
-    startTaskClock("Shooting particles");
-/*    TrackShooter ts;
-    //std::ofstream ofs((outputfile + "." + any2str(getpid())).c_str());
-    //ofs.rdbuf()->pubsetbuf(&(std::vector<char>(32768)[0]), 32768);
-    //std::nounitbuf(ofs);
-    ts.setOutput(std::cout);
-    ts.setTrackerBoundaries(tr->getMaxR(), tr->getMaxBarrelZ(-1), tr->getMaxBarrelZ(+1));
-    for (std::vector<Layer*>::const_iterator lit = tr->getLayers().begin(); lit != tr->getLayers().end(); ++lit) {
-      ModuleVector* mods = (*lit)->getModuleVector();
-      for (ModuleVector::const_iterator mit = mods->begin(); mit != mods->end(); ++mit) {
-        ts.addModule(*mit);
-      }
+  /**
+   * Simulates the hits of helix tracks in the tracker modules, and writes them to a ROOT file.
+   * @param varmap The track simulation options
+   * @param seed The seed of the random streams of the tracks
+   * @param threads The number of threads the events are simulated on (the results do not depend on it)
+   */
+  void Squid::simulateTracks(const po::variables_map& varmap, int seed, int threads) {
+    if (!tr) {
+      logERROR(err_no_tracker);
+      return;
     }
-
-    ts.shootTracks(varmap, seed);*/
+    startTaskClock("Shooting particles");
+    TrackShooter ts;
+    ts.setTracker(*tr);
+    ts.shootTracks(varmap, seed, threads);
     stopTaskClock();
   }
 
@@ -209,9 +209,12 @@ namespace material {
     cleanup();
   }
 
+  /**
+   * Moves the elements of the structure into the inactive surfaces, which own them from then on.
+   */
   void SupportStructure::updateInactiveSurfaces(InactiveSurfaces& inactiveSurfaces) {
     for(InactiveElement* inactiveElement : inactiveElements) {
-      inactiveSurfaces.addSupportPart(*inactiveElement);
+      inactiveSurfaces.addSupportPart(std::move(*inactiveElement));
     }
   }
 
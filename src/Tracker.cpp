@@ -73,6 +73,14 @@ void Tracker::build() {
 
   accept(cntNameVisitor);
 
+  // The geometry is final: everything the hit checks read is computed now, so that the modules are only read from then on
+  for (const Module* m : modules()) m->freeze();
+
   cleanup();
   builtok(true);
 }
+
+void Tracker::buildHitIndex(double zMargin) {
+  indexedModules_.assign(modules().begin(), modules().end());
+  hitIndex_.build(std::vector<const DetectorModule*>(indexedModules_.begin(), indexedModules_.end()), zMargin);
+}
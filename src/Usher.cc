@@ -130,7 +130,7 @@ namespace insur {
                     ring.setNeighbourIndex(2 * tracker.totalDiscs() - blueprint.getNeighbourIndex() - 1);
                 }
                 // append the new volume to the list of barrel services
-                is.addBarrelServicePart(ring);
+                is.addBarrelServicePart(std::move(ring));
             }
             // horizontal services => simple neighbourhood
             else {
@@ -148,7 +148,7 @@ namespace insur {
                 // feeder index of short layer must be adjusted by 1
                 if (short_layer) tube.setFeederIndex(tube.getFeederIndex() - 1);
                 // append the new volume to the list of barrel services
-                is.addBarrelServicePart(tube);
+                is.addBarrelServicePart(std::move(tube));
             }
         }
         stopTaskClock();
@@ -162,7 +162,7 @@ namespace insur {
             if (blueprint.isVertical()) {
                 InactiveRing ring = mirrorRing(blueprint);
                 if (blueprint.getFeederIndex() != -1) ring.setFeederIndex(2 * tracker.totalDiscs() - blueprint.getFeederIndex() - 1);
-                is.addEndcapServicePart(ring);
+                is.addEndcapServicePart(std::move(ring));
             }
             // horizontal services => standard and only case for now
             else {
@@ -178,7 +178,7 @@ namespace insur {
                     tube.setNeighbourIndex(is.getEndcapServices().size() - i + blueprint.getNeighbourIndex());
                 }
                 // append the new volume to the list of endcap services
-                is.addEndcapServicePart(tube);
+                is.addEndcapServicePart(std::move(tube));
             }
         }
         stopTaskClock();
@@ -193,12 +193,12 @@ namespace insur {
                 if (blueprint.isVertical()) {
                     InactiveRing ring = mirrorRing(blueprint);
                     // append the new volume to the list of supports
-                    is.addSupportPart(ring);
+                    is.addSupportPart(std::move(ring));
                 }
                 else {
                     InactiveTube tube = mirrorTube(blueprint);
                     // append the new volume to the list of supports
-                    is.addSupportPart(tube);
+                    is.addSupportPart(std::move(tube));
                 }
             }
         }
@@ -809,7 +809,7 @@ namespace insur {
         ir.setInnerRadius(radius);
         ir.setRWidth(width);
         ir.setFinal(final);
-        is.addBarrelServicePart(ir);
+        is.addBarrelServicePart(std::move(ir));
         return is;
     }
     
@@ -830,7 +830,7 @@ namespace insur {
         it.setInnerRadius(radius);
         it.setRWidth(width);
         it.setFinal(final);
-        is.addBarrelServicePart(it);
+        is.addBarrelServicePart(std::move(it));
         return is;
     }
     
@@ -851,7 +851,7 @@ namespace insur {
         it.setInnerRadius(radius);
         it.setRWidth(width);
         it.setFinal(final);
-        is.addEndcapServicePart(it);
+        is.addEndcapServicePart(std::move(it));
         return is;
     }
     
@@ -871,7 +871,7 @@ namespace insur {
         ir.setZOffset(offset);
         ir.setInnerRadius(radius);
         ir.setRWidth(width);
-        is.addSupportPart(ir);
+        is.addSupportPart(std::move(ir));
         return is;
     }
     
@@ -891,7 +891,7 @@ namespace insur {
         it.setZOffset(offset);
         it.setInnerRadius(radius);
         it.setRWidth(width);
-        is.addSupportPart(it);
+        is.addSupportPart(std::move(it));
         return is;
     }
     
@@ -1139,17 +1139,14 @@ namespace insur {
     // Inactive surfaces
     double inactiveSurfacesTotalMass;
     if (inactive) {
-      std::vector<InactiveElement>& inactiveBarrelServices = inactive->getBarrelServices();
-      std::vector<InactiveElement>& inactiveEndcapServices = inactive->getEndcapServices();
-      std::vector<InactiveElement>& inactiveSupports = inactive->getSupports();
-      std::vector<InactiveElement> allInactives;
-      allInactives.reserve( inactiveBarrelServices.size() + inactiveEndcapServices.size() + inactiveSupports.size() );
-      allInactives.insert(allInactives.end(), inactiveBarrelServices.begin(), inactiveBarrelServices.end() );
-      allInactives.insert(allInactives.end(), inactiveEndcapServices.begin(), inactiveEndcapServices.end() );
-      allInactives.insert(allInactives.end(), inactiveSupports.begin(), inactiveSupports.end() );
+      InactiveSurfaces::ElementList& inactiveBarrelServices = inactive->getBarrelServices();
+      InactiveSurfaces::ElementList& inactiveEndcapServices = inactive->getEndcapServices();
+      InactiveSurfaces::ElementList& inactiveSupports = inactive->getSupports();
       inactiveSurfacesTotalMass = 0;
-      for (const auto elem : allInactives ) {
-        if (elem.getTotalMass()>0) inactiveSurfacesTotalMass += elem.getTotalMass();
+      for (InactiveSurfaces::ElementList* inactives : { &inactiveBarrelServices, &inactiveEndcapServices, &inactiveSupports }) {
+        for (const auto& elem : *inactives ) {
+          if (elem.getTotalMass()>0) inactiveSurfacesTotalMass += elem.getTotalMass();
+        }
       }
     }
 
@@ -2547,6 +2544,65 @@ namespace insur {
   }
 
 
+  bool Vizard::pileUpSummary(Analyzer& analyzer, SimParms& simparms, RootWSite& site) {
+    RootWPage* myPage = new RootWPage("Pile-up");
+    myPage->setAddress("pileup.html");
+    site.addPage(myPage);
+    RootWContent* myContent = new RootWContent("Simulated pile-up distributions");
+    myPage->addContent(myContent);
+
+    RootWText* myDescription = new RootWText();
+    myContent->addItem(myDescription);
+    ostringstream aStringStream;
+    aStringStream << analyzer.getPileUpCrossings() << " bunch crossings of " << simparms.numMinBiasEvents() << " minimum bias events simulated.<br/>";
+    myDescription->addText(aStringStream.str());
+    myDescription->addText("Every sensor is counted separately. The hit channels of a cluster are those the track crosses through the sensor thickness.<br/>");
+    myDescription->addText("Sparsified (binary) bits/event: header bits/chip + payload bits/hit, 100 kHz trigger<br/>");
+
+    TCanvas* chanHitCanvas = new TCanvas("PileUpHitC", "Pile-up hit countC", vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    chanHitCanvas->SetLogy(1);
+    chanHitCanvas->cd();
+    analyzer.getPileUpChanHitDistribution().Draw();
+    RootWImage* myImage = new RootWImage(chanHitCanvas, vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    myImage->setComment("Distribution of the number of hit channels per bunch crossing, averaged over the crossings");
+    myContent->addItem(myImage);
+
+    TCanvas* clusterWidthCanvas = new TCanvas("PileUpClusterWidthC", "Pile-up cluster widthC", vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    clusterWidthCanvas->SetLogy(1);
+    clusterWidthCanvas->cd();
+    analyzer.getPileUpClusterWidthDistribution().Draw();
+    myImage = new RootWImage(clusterWidthCanvas, vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    myImage->setComment("Distribution of the cluster width across the strips");
+    myContent->addItem(myImage);
+
+    TCanvas* bandwidthCanvas = new TCanvas("PileUpBandwidthC", "Pile-up bandwidthC", vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    bandwidthCanvas->SetLogy(1);
+    bandwidthCanvas->cd();
+    analyzer.getPileUpBandwidthDistributionSparsified().Draw();
+    myImage = new RootWImage(bandwidthCanvas, vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    myImage->setComment("Sensor bandwidth distribution in the sparsified model, from the mean simulated hit channels (strip modules)");
+    myContent->addItem(myImage);
+
+    TCanvas* ratioCanvas = new TCanvas("PileUpOccupancyRatioC", "Pile-up occupancy ratioC", vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    ratioCanvas->cd();
+    analyzer.getPileUpOccupancyRatioDistribution().Draw();
+    myImage = new RootWImage(ratioCanvas, vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    myImage->setComment("Ratio of the simulated hit occupancy to the parametrised one, by sensor");
+    myContent->addItem(myImage);
+
+    std::map<std::string, SummaryTable>& occupancySummaries = analyzer.getPileUpHitOccupancySummaries();
+    std::map<std::string, SummaryTable>& clusterWidthSummaries = analyzer.getPileUpClusterWidthSummaries();
+    for (std::map<std::string, SummaryTable>::iterator it = occupancySummaries.begin(); it != occupancySummaries.end(); ++it) {
+      myPage->addContent(std::string("Simulated hit occupancy % (") + it->first + ")", false).addTable().setContent(it->second.getContent());
+    }
+    for (std::map<std::string, SummaryTable>::iterator it = clusterWidthSummaries.begin(); it != clusterWidthSummaries.end(); ++it) {
+      myPage->addContent(std::string("Simulated cluster width (") + it->first + ")", false).addTable().setContent(it->second.getContent());
+    }
+
+    return true;
+  }
+
+
   bool Vizard::triggerProcessorsSummary(Analyzer& analyzer, Tracker& tracker, RootWSite& site) {
     RootWPage* myPage = new RootWPage("Trigger CPUs");
     myPage->setAddress("trigger_cpus.html");
@@ -5283,11 +5339,11 @@ namespace insur {
     auto& supports = materialBudget.getInactiveSurfaces().getSupports();
 
     // We put all services inside the same container
-    std::vector<InactiveElement> allServices;
+    std::vector<InactiveElement*> allServices;
     allServices.reserve( barrelServices.size() + endcapServices.size() + supports.size() ); // preallocate memory
-    allServices.insert( allServices.end(), barrelServices.begin(), barrelServices.end() );
-    allServices.insert( allServices.end(), endcapServices.begin(), endcapServices.end() );
-    allServices.insert( allServices.end(), supports.begin(), supports.end() );
+    for (auto& service : barrelServices) allServices.push_back(&service);
+    for (auto& service : endcapServices) allServices.push_back(&service);
+    for (auto& service : supports) allServices.push_back(&service);
 
     // Counting services with an ad-hoc index
     int serviceId = 0;
@@ -5308,7 +5364,8 @@ namespace insur {
 
     myStringStream << "serviceID/I,elementID/I,z1/D,z2/D,r1/D,r2/D,Element/C,mass/D,mass_per_length/D,rl/D,il/D,local/I" << std::endl;
 
-    for (auto& iter : allServices) {
+    for (InactiveElement* service : allServices) {
+      InactiveElement& iter = *service;
       z1 = iter.getZOffset();
       z2 = iter.getZOffset()+iter.getZLength();
       r1 = iter.getInnerRadius();
@@ -5325,7 +5382,7 @@ namespace insur {
 
       bool isEmpty = true;
 
-      const std::map<std::string, double>& localMasses = iter.getLocalMasses();
+      const std::map<std::string, double>& localMasses = iter.getLocalMassesByName();
 
       int elementId=0;
       for (auto& massIt : localMasses) {
@@ -5369,6 +5426,33 @@ namespace insur {
     servicesImage.setComment("Display of the rz positions of the service volumes. Ignoring services with no material.");
     servicesImage.setName("InactiveSurfacesPosition");
 
+    // Number of elements crossed by the tracks from the origin, as found by the eta index of the inactive surfaces
+    InactiveSurfaces& inactiveSurfaces = materialBudget.getInactiveSurfaces();
+    TH1D* servicesCrossed = new TH1D("servicesCrossed", ";#eta;Crossed elements", 200, 0, geom_max_eta_coverage);
+    TH1D* supportsCrossed = new TH1D("supportsCrossed", ";#eta;Crossed elements", 200, 0, geom_max_eta_coverage);
+    for (int iBin = 1; iBin <= servicesCrossed->GetNbinsX(); iBin++) {
+      double eta = servicesCrossed->GetBinCenter(iBin);
+      servicesCrossed->SetBinContent(iBin, inactiveSurfaces.elementsCrossedAt(eta, MaterialProperties::no_cat,
+                                                                            InactiveSurfaces::BarrelServices | InactiveSurfaces::EndcapServices).size());
+      supportsCrossed->SetBinContent(iBin, inactiveSurfaces.elementsCrossedAt(eta, MaterialProperties::no_cat, InactiveSurfaces::Supports).size());
+    }
+    TCanvas* crossedCanvas = new TCanvas("crossedCanvas", "crossedCanvas");
+    crossedCanvas->cd();
+    servicesCrossed->SetStats(0);
+    servicesCrossed->SetLineColor(kBlue);
+    supportsCrossed->SetLineColor(kRed);
+    servicesCrossed->SetMaximum(MAX(servicesCrossed->GetMaximum(), supportsCrossed->GetMaximum()) * 1.1);
+    servicesCrossed->Draw();
+    supportsCrossed->Draw("same");
+    TLegend* crossedLegend = new TLegend(0.75, 0.8, .95, .95);
+    crossedLegend->AddEntry(servicesCrossed, "Services", "l");
+    crossedLegend->AddEntry(supportsCrossed, "Supports", "l");
+    crossedLegend->Draw();
+
+    RootWImage& crossedImage = myContent.addImage(crossedCanvas, vis_min_canvas_sizeX, vis_min_canvas_sizeY);
+    crossedImage.setComment("Number of service and support volumes crossed by a track from the origin, versus eta.");
+    crossedImage.setName("InactiveSurfacesCrossed");
+
     RootWTextFile* myTextFile = new RootWTextFile(Form("inactiveSurfacesMaterials_%s.csv", myTrackerName.c_str()), "file containing all the materials");
     myTextFile->addText(myStringStream.str());
     myContent.addItem(myTextFile);
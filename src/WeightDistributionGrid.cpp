@@ -1,42 +1,202 @@
 #include "WeightDistributionGrid.h"
 #include "MaterialObject.h"
+#include "global_funcs.h"
+#include "messageLogger.h"
 #include <algorithm>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
 
 namespace material {
 
+  const long WeightDistributionGrid::maxDenseBins;
+  const uint64_t WeightDistributionGrid::emptyKey;
+
   WeightDistributionGrid::WeightDistributionGrid(double binDimension) :
-    binDimension_(binDimension) {}
+    binDimension_(binDimension),
+    firstBinZ_(0),
+    firstBinR_(0),
+    binsZ_(0),
+    binsR_(0),
+    sparseSize_(0) {}
+
+  /**
+   * Sets the region stored in the dense array, and moves the bins already filled to the new storage.
+   * If the region has more than maxDenseBins bins, all the bins go to the hash table.
+   */
+  void WeightDistributionGrid::setEnvelope(double minZ, double minR, double maxZ, double maxR) {
+    WeightDistributionGrid previous(*this);
+    clear();
+    binsZ_ = binsR_ = 0;
+    dense_.clear();
+    int firstBinZ = floor(minZ / binDimension_);
+    int firstBinR = floor(minR / binDimension_);
+    long binsZ = long(floor(maxZ / binDimension_)) - firstBinZ + 1;
+    long binsR = long(floor(maxR / binDimension_)) - firstBinR + 1;
+    if (binsZ > 0 && binsR > 0 && binsZ * binsR <= maxDenseBins) {
+      firstBinZ_ = firstBinZ;
+      firstBinR_ = firstBinR;
+      binsZ_ = binsZ;
+      binsR_ = binsR;
+      dense_.assign(binsZ * binsR, 0.);
+    }
+    merge(previous);
+  }
 
   void WeightDistributionGrid::addTotalGrams(double minZ, double minR, double maxZ, double maxR, double length, double surface, const MaterialObject& materialObject) {
-    int binIndexZStart = floor(minZ / binDimension_);
-    int binIndexZ = binIndexZStart;
-    int binIndexR = floor(minR / binDimension_);
-    double binMinZ, binMinR, binMaxZ, binMaxR, zMul, rMul;
+    addGrams(minZ, minR, maxZ, maxR, materialObject.totalGrams(length, surface));
+  }
 
-    do {
-      binMinR = floor(binIndexR * binDimension_);
-      binMaxR = binMinR + binDimension_;
+  /**
+   * Spreads grams over the bins of a (z, r) box, in proportion to the area of the box in each bin.
+   * A box with no width in z or r goes to the bins containing that edge.
+   */
+  void WeightDistributionGrid::addGrams(double minZ, double minR, double maxZ, double maxR, double grams) {
+    addGrams(minZ, minR, maxZ, maxR, grams, INT_MIN, INT_MAX);
+  }
 
-      do {
-        binMinZ = floor(binIndexZ * binDimension_);
-        binMaxZ = binMinZ + binDimension_;
+  /**
+   * Spreads grams over the bins of a (z, r) box as addGrams() does, but only fills the z bins from fromBinZ to toBinZ.
+   */
+  void WeightDistributionGrid::addGrams(double minZ, double minR, double maxZ, double maxR, double grams, int fromBinZ, int toBinZ) {
+    int firstBinZ = floor(minZ / binDimension_), lastBinZ = floor(maxZ / binDimension_);
+    int firstBinR = floor(minR / binDimension_), lastBinR = floor(maxR / binDimension_);
+    int beginBinZ = std::max(firstBinZ, fromBinZ), endBinZ = std::min(lastBinZ, toBinZ);
+    if (beginBinZ > endBinZ) return;
+    bool flatZ = maxZ <= minZ, flatR = maxR <= minR;
+    for (int binIndexR = firstBinR; binIndexR <= lastBinR; binIndexR++) {
+      double rMul = flatR ? (binIndexR == firstBinR) :
+        (std::min((binIndexR + 1) * binDimension_, maxR) - std::max(binIndexR * binDimension_, minR)) / (maxR - minR);
+      if (rMul <= 0) continue;
+      for (int binIndexZ = beginBinZ; binIndexZ <= endBinZ; binIndexZ++) {
+        double zMul = flatZ ? (binIndexZ == firstBinZ) :
+          (std::min((binIndexZ + 1) * binDimension_, maxZ) - std::max(binIndexZ * binDimension_, minZ)) / (maxZ - minZ);
+        if (zMul <= 0) continue;
+        add(binIndexZ, binIndexR, grams * zMul * rMul);
+      }
+    }
+  }
 
-        zMul = std::max(binMinZ, minZ) - std::min(binMaxZ, maxZ);
-        rMul = std::max(binMinR, minR) - std::min(binMaxR, maxR);
+  void WeightDistributionGrid::add(int binIndexZ, int binIndexR, double grams) {
+    int iZ = binIndexZ - firstBinZ_, iR = binIndexR - firstBinR_;
+    if (iZ >= 0 && iZ < binsZ_ && iR >= 0 && iR < binsR_) dense_[long(iZ) * binsR_ + iR] += grams;
+    else addSparse(key(binIndexZ, binIndexR), grams);
+  }
 
-        operator[](std::make_pair(binIndexZ, binIndexR)) += 
-          (materialObject.totalGrams(length, surface) * zMul * rMul) / ((maxZ - minZ) * (maxR - minR));
+  void WeightDistributionGrid::addSparse(uint64_t k, double grams) {
+    if (2 * (sparseSize_ + 1) > long(keys_.size())) growSparse();
+    size_t mask = keys_.size() - 1;
+    size_t i = (k * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+    while (keys_[i] != emptyKey && keys_[i] != k) i = (i + 1) & mask;
+    if (keys_[i] == emptyKey) {
+      keys_[i] = k;
+      sparseSize_++;
+    }
+    values_[i] += grams;
+  }
 
-        binIndexZ ++;
-      } while (binMaxZ < maxZ);
-      
-      binIndexR ++;
-      binIndexZ = binIndexZStart;
-    } while (binMinR < maxR);
+  void WeightDistributionGrid::growSparse() {
+    std::vector<uint64_t> keys;
+    std::vector<double> values;
+    keys.swap(keys_);
+    values.swap(values_);
+    keys_.assign(std::max<size_t>(64, 2 * keys.size()), emptyKey);
+    values_.assign(keys_.size(), 0.);
+    sparseSize_ = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i] != emptyKey) addSparse(keys[i], values[i]);
+    }
+  }
+
+  /**
+   * Replaces the content of the grid with the grams of a set of boxes, with the envelope set to contain them all.
+   * The z bins are split in one slab per thread, and each thread adds the part of every box inside its slab, in the order
+   * of the boxes: every bin is summed up by a single thread, so the result does not depend on the number of threads.
+   * The slabs are filled straight into the dense array, or, if the envelope is too large for it, each into a hash table
+   * of its own, merged afterwards.
+   */
+  void WeightDistributionGrid::fill(const std::vector<Box>& boxes, int threads) {
+    clear();
+    if (boxes.empty()) return;
+    double minZ = boxes.front().minZ, minR = boxes.front().minR;
+    double maxZ = boxes.front().maxZ, maxR = boxes.front().maxR;
+    for (const Box& box : boxes) {
+      minZ = std::min(minZ, box.minZ);
+      minR = std::min(minR, box.minR);
+      maxZ = std::max(maxZ, box.maxZ);
+      maxR = std::max(maxR, box.maxR);
+    }
+    setEnvelope(minZ, minR, maxZ, maxR);
+    int firstBinZ = floor(minZ / binDimension_);
+    long binsZ = long(floor(maxZ / binDimension_)) - firstBinZ + 1;
+    int slabs = std::max(1L, std::min<long>(threads, binsZ));
+    bool dense = binsZ_ > 0;
+    std::vector<WeightDistributionGrid> sparseSlabs(dense ? 0 : slabs, WeightDistributionGrid(binDimension_));
+    parallelFor(0, slabs, slabs, [&](int slab) {
+      int fromBinZ = firstBinZ + binsZ * slab / slabs;
+      int toBinZ = firstBinZ + binsZ * (slab + 1) / slabs - 1;
+      WeightDistributionGrid& target = dense ? *this : sparseSlabs[slab];
+      for (const Box& box : boxes) target.addGrams(box.minZ, box.minR, box.maxZ, box.maxR, box.grams, fromBinZ, toBinZ);
+    });
+    for (const WeightDistributionGrid& slab : sparseSlabs) merge(slab);
+  }
+
+  /**
+   * Adds the grams of another grid with the same binning.
+   */
+  void WeightDistributionGrid::merge(const WeightDistributionGrid& other) {
+    other.forEachBin([this](int binIndexZ, int binIndexR, double grams) { add(binIndexZ, binIndexR, grams); });
+  }
+
+  void WeightDistributionGrid::clear() {
+    std::fill(dense_.begin(), dense_.end(), 0.);
+    keys_.clear();
+    values_.clear();
+    sparseSize_ = 0;
   }
 
   double WeightDistributionGrid::binDimension() const {
     return binDimension_;
   }
-}
 
+  double WeightDistributionGrid::grams(int binIndexZ, int binIndexR) const {
+    int iZ = binIndexZ - firstBinZ_, iR = binIndexR - firstBinR_;
+    if (iZ >= 0 && iZ < binsZ_ && iR >= 0 && iR < binsR_) return dense_[long(iZ) * binsR_ + iR];
+    if (keys_.empty()) return 0.;
+    uint64_t k = key(binIndexZ, binIndexR);
+    size_t mask = keys_.size() - 1;
+    size_t i = (k * 0x9E3779B97F4A7C15ULL >> 17) & mask;
+    while (keys_[i] != emptyKey) {
+      if (keys_[i] == k) return values_[i];
+      i = (i + 1) & mask;
+    }
+    return 0.;
+  }
+
+  bool WeightDistributionGrid::empty() const {
+    bool result = true;
+    forEachBin([&result](int, int, double) { result = false; });
+    return result;
+  }
+
+  /**
+   * Writes the filled bins as text, one per line with the centre of the bin in z and r and its grams.
+   * @return False if the file could not be written
+   */
+  bool WeightDistributionGrid::save(const std::string& fileName) const {
+    std::ofstream out(fileName.c_str());
+    if (!out) {
+      logERROR("Cannot write the weight map to " + fileName);
+      return false;
+    }
+    out << "# binDimension" << std::endl;
+    out << binDimension_ << std::endl;
+    out << "# z r grams" << std::endl;
+    out << std::setprecision(10);
+    forEachBin([this, &out](int binIndexZ, int binIndexR, double grams) {
+      out << (binIndexZ + 0.5) * binDimension_ << " " << (binIndexR + 0.5) * binDimension_ << " " << grams << std::endl;
+    });
+    return out.good();
+  }
+}
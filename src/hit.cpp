@@ -14,6 +14,11 @@ using namespace ROOT::Math;
 using namespace std;
 
 // bool Track::debugRemoval = false; // debug
+Track::ErrorBackend Track::errorBackend_ = Track::GlobalFit;
+double Track::validationTolerance_ = 1e-6;
+Track::ValidationSummary Track::validation_ = Track::ValidationSummary();
+std::mutex Track::validationMutex_;
+
 //#ifdef HIT_DEBUG_RZ
 //bool Track::debugRZCovarianceMatrix = false;  // debug
 //bool Track::debugRZCorrelationMatrix = false;  // debug
@@ -264,14 +269,9 @@ Track::Track(const Track& t) {
   phi_ = t.phi_;
   cotgTheta_ = t.cotgTheta_;
   eta_ = t.eta_;
-  correlations_.ResizeTo(t.correlations_);
-  correlations_ = t.correlations_;
-  covariances_.ResizeTo(t.covariances_);
   covariances_ = t.covariances_;
-  correlationsRZ_.ResizeTo(t.correlationsRZ_);
-  correlationsRZ_ = t.correlationsRZ_;
-  covariancesRZ_.ResizeTo(t.covariancesRZ_);
   covariancesRZ_ = t.covariancesRZ_;
+  filterStates_ = t.filterStates_;
   deltarho_ = t.deltarho_;
   deltaphi_ = t.deltaphi_;
   deltad_ = t.deltad_;
@@ -298,14 +298,9 @@ Track& Track::operator= (const Track &t) {
   phi_ = t.phi_;
   cotgTheta_ = t.cotgTheta_;
   eta_ = t.eta_;
-  correlations_.ResizeTo(t.correlations_);
-  correlations_ = t.correlations_;
-  covariances_.ResizeTo(t.covariances_);
   covariances_ = t.covariances_;
-  correlationsRZ_.ResizeTo(t.correlationsRZ_);
-  correlationsRZ_ = t.correlationsRZ_;
-  covariancesRZ_.ResizeTo(t.covariancesRZ_);
   covariancesRZ_ = t.covariancesRZ_;
+  filterStates_ = t.filterStates_;
   deltarho_ = t.deltarho_;
   deltaphi_ = t.deltaphi_;
   deltad_ = t.deltad_;
@@ -499,17 +494,17 @@ void Track::sort() {
 }
 
 /**
- * Compute the correlation matrices of the track hits for a series of different energies.
- * @param momenta A reference of the list of energies that the correlation matrices should be calculated for
+ * Compute the correlation matrix of the active hits of the track, in the r-phi plane.
+ * The inactive hits only contribute their multiple scattering: they get no row nor column.
+ * @param correlations The matrix to fill, sized to the number of active hits
  */
-void Track::computeCorrelationMatrix() {
+void Track::computeCorrelationMatrix(HitMatrix& correlations) {
 
-  // matrix size
+  // number of hits
   int n = hitV_.size();
-  correlations_.ResizeTo(n,n);
 
   // pre-compute the squares of the scattering angles
-  std::vector<double> thetasq;
+  HitVector thetasq(n);
   // pre-fetch the error on ctg(theta)
   // will be zero, if not known
   double deltaCtgT = deltaCtgTheta_;
@@ -525,75 +520,41 @@ void Track::computeCorrelationMatrix() {
       th = (13.6 * 13.6) / (1000 * 1000 * transverseMomentum_ * transverseMomentum_) * th * (1 + 0.038 * log(th)) * (1 + 0.038 * log(th));
     else
       th = 0;
-    thetasq.push_back(th);
-  }
-  // correlations: c is column, r is row
-  for (int c = 0; c < n; c++) {
-    // dummy value for correlations involving inactive surfaces
-    if (hitV_.at(c)->getObjectKind() == Hit::Inactive) {
-      for (int r = 0; r <= c; r++) correlations_(r, c) = 0.0;
-    }
-    // one of the correlation factors refers to an active surface
-    else {
-      for (int r = 0; r <= c; r++) {
-        // dummy value for correlation involving an inactive surface
-        if (hitV_.at(r)->getObjectKind() == Hit::Inactive) correlations_(r, c) = 0.0;
-        // correlations between two active surfaces
-        else {
-          double sum = 0.0;
-          for (int i = 0; i < r; i++)
-            sum = sum + (hitV_.at(c)->getRadius() - hitV_.at(i)->getRadius()) * (hitV_.at(r)->getRadius() - hitV_.at(i)->getRadius()) * thetasq.at(i);
-          if (r == c) {
-            double prec = hitV_.at(r)->getResolutionRphi(pt2radius(transverseMomentum_, insur::magnetic_field)); // if Bmod = getResoX natural 
-            sum = sum + prec * prec;
-          }
-          correlations_(r, c) = sum;
-          if (r != c) correlations_(c, r) = sum;
-        }
-      }
-    }
+    thetasq(i, 0) = th;
   }
-    
-  // remove zero rows and columns
-  int ia = -1;
-  bool look_for_active = false;
-  for (int i = 0; i < n; i++) {
-    if ((hitV_.at(i)->getObjectKind() == Hit::Inactive) && (!look_for_active)) {
-      ia = i;
-      look_for_active = true;
-    }
-    else if ((hitV_.at(i)->getObjectKind() == Hit::Active) && (look_for_active)) {
-      for (int j = 0; j < n; j++) {
-        correlations_(ia, j) = correlations_(i, j);
-        correlations_(j, ia) = correlations_(j, i);
+  // correlations: c is column, r is row, ac and ar their indices among the active hits
+  for (int c = 0, ac = 0; c < n; c++) {
+    if (hitV_.at(c)->getObjectKind() != Hit::Active) continue;
+    for (int r = 0, ar = 0; r <= c; r++) {
+      if (hitV_.at(r)->getObjectKind() != Hit::Active) continue;
+      double sum = 0.0;
+      for (int i = 0; i < r; i++)
+        sum = sum + (hitV_.at(c)->getRadius() - hitV_.at(i)->getRadius()) * (hitV_.at(r)->getRadius() - hitV_.at(i)->getRadius()) * thetasq(i, 0);
+      if (r == c) {
+        double prec = hitV_.at(r)->getResolutionRphi(pt2radius(transverseMomentum_, insur::magnetic_field)); // if Bmod = getResoX natural 
+        sum = sum + prec * prec;
       }
-      correlations_(ia, ia) = correlations_(i, i);
-      ia++;
+      correlations(ar, ac) = sum;
+      correlations(ac, ar) = sum;
+      ar++;
     }
-  }
-  // resize matrix if necessary
-  if (ia != -1) correlations_.ResizeTo(ia, ia);
-  
-  // check if matrix is sane and worth keeping
-  if (!((correlations_.GetNoElements() > 0) && (correlations_.Determinant() != 0.0))) {
-    logERROR(Form("A singular matrix was found (this is unexpected: all analyzed tracks should have >= 3 hits). nElements=%d, determinant = %f", correlations_.GetNoElements(), correlations_.Determinant()));
+    ac++;
   }
 }
 
 /**
- * Compute the covariance matrices of the track hits from a series of previously calculated correlation matrices.
- * @param A reference to the map of correlation matrices per energy  that serves as the value source for the computation
+ * Compute the covariance matrix of the track parameters in the r-phi plane, D^T * C^-1 * D, from the correlation matrix
+ * with a Cholesky solve.
+ * @param correlations The correlation matrix of the active hits, overwritten by its Cholesky decomposition
+ * @return False if the correlation matrix is singular
  */
-void Track::computeCovarianceMatrix() {
+bool Track::computeCovarianceMatrix(HitMatrix& correlations) {
   unsigned int offset = 0;
   unsigned int nhits = hitV_.size();
-  int n = correlations_.GetNrows();
-  TMatrixT<double> C(correlations_); // Local copy to be inverted
-  TMatrixT<double> diffsT(3, n);
-  TMatrixT<double> diffs(n, 3);
-  covariances_.ResizeTo(3, 3);
+  int n = correlations.rows();
+  SmallMatrix<MaxHits, 3> diffs(n, 3);
 
-  // set up partial derivative matrices diffs and diffsT
+  // set up partial derivative matrix diffs
   for (unsigned int i = 0; i < nhits; i++) {
     if (hitV_.at(i)->getObjectKind()  == Hit::Active) {
       diffs(i - offset, 0) = 0.5 * hitV_.at(i)->getRadius() * hitV_.at(i)->getRadius();
@@ -602,8 +563,7 @@ void Track::computeCovarianceMatrix() {
     }
     else offset++;
   }
-  diffsT.Transpose(diffs);
-  covariances_ = diffsT * C.Invert() * diffs;
+  return n > 0 && SmallMatrixOps::weightedProduct(correlations, diffs, covariances_);
 }
 
 void Track::computeLocalResolution() {
@@ -617,15 +577,15 @@ void Track::computeLocalResolution() {
 }
 
 /**
- * Compute the correlation matrices of the track hits for a series of different energies.
- * @param momenta A reference of the list of energies that the correlation matrices should be calculated for
+ * Compute the correlation matrix of the active hits of the track, in the r-z plane.
+ * The inactive hits only contribute their multiple scattering: they get no row nor column.
+ * @param correlations The matrix to fill, sized to the number of active hits
  */
-void Track::computeCorrelationMatrixRZ() {
+void Track::computeCorrelationMatrixRZ(HitMatrix& correlations) {
 
-  // matrix size
+  // number of hits
   int n = hitV_.size();
   double ctgTheta = 1/tan(theta_);
-  correlationsRZ_.ResizeTo(n,n);
 
   // set up correlation matrix
   double curvatureR = pt2radius(transverseMomentum_, insur::magnetic_field);
@@ -633,7 +593,7 @@ void Track::computeCorrelationMatrixRZ() {
   // already divided by sin^2 (that is : we should use p instead of p_T here
   // but the result for theta^2 differ by a factor 1/sin^2, which is exactly the
   // needed factor to project the scattering angle on an horizontal surface
-  std::vector<double> thetaOverSin_sq;
+  HitVector thetaOverSin_sq(n);
   for (int i = 0; i < n - 1; i++) {
     double th = hitV_.at(i)->getCorrectedMaterial().radiation;
     if (th>0)
@@ -641,83 +601,47 @@ void Track::computeCorrelationMatrixRZ() {
       th = (13.6 * 13.6) / (1000 * 1000 * transverseMomentum_ * transverseMomentum_ ) * th * (1 + 0.038 * log(th)) * (1 + 0.038 * log(th));
     else
       th = 0;
-    thetaOverSin_sq.push_back(th);
+    thetaOverSin_sq(i, 0) = th;
   }
-  // correlations: c is column, r is row
-  for (int c = 0; c < n; c++) {
-      // dummy value for correlations involving inactive surfaces
-    if (hitV_.at(c)->getObjectKind() == Hit::Inactive) {
-      for (int r = 0; r <= c; r++) correlationsRZ_(r, c) = 0.0;
-    }
-    // one of the correlation factors refers to an active surface
-    else {
-      for (int r = 0; r <= c; r++) {
-        // dummy value for correlation involving an inactive surface
-        if (hitV_.at(r)->getObjectKind() == Hit::Inactive) correlationsRZ_(r, c) = 0.0;
-        // correlations between two active surfaces
-        else {
-          double sum = 0.0;
-          for (int i = 0; i < r; i++)
-            sum += thetaOverSin_sq.at(i)
-              * (hitV_.at(c)->getDistance() - hitV_.at(i)->getDistance())
-              * (hitV_.at(r)->getDistance() - hitV_.at(i)->getDistance());
-          if (r == c) {
-            double prec = hitV_.at(r)->getResolutionZ(curvatureR);
-            sum = sum + prec * prec;
-          }
-          correlationsRZ_(r, c) = sum;
-          if (r != c) correlationsRZ_(c, r) = sum;
+  // correlations: c is column, r is row, ac and ar their indices among the active hits
+  for (int c = 0, ac = 0; c < n; c++) {
+    if (hitV_.at(c)->getObjectKind() != Hit::Active) continue;
+    for (int r = 0, ar = 0; r <= c; r++) {
+      if (hitV_.at(r)->getObjectKind() != Hit::Active) continue;
+      double sum = 0.0;
+      for (int i = 0; i < r; i++)
+        sum += thetaOverSin_sq(i, 0)
+          * (hitV_.at(c)->getDistance() - hitV_.at(i)->getDistance())
+          * (hitV_.at(r)->getDistance() - hitV_.at(i)->getDistance());
+      if (r == c) {
+        double prec = hitV_.at(r)->getResolutionZ(curvatureR);
+        sum = sum + prec * prec;
+      }
 #undef CORRELATIONS_OFF_DEBUG
 #ifdef CORRELATIONS_OFF_DEBUG
-          if (r!=c) {
-            correlationsRZ_(c, r)=0;
-            correlationsRZ_(r, c)=0;
-          }
+      if (r!=c) sum = 0;
 #endif
-        }
-      }
-    }
-  }
-  // remove zero rows and columns
-  int ia = -1;
-  bool look_for_active = false;
-  for (int i = 0; i < n; i++) {
-    if ((hitV_.at(i)->getObjectKind() == Hit::Inactive) && (!look_for_active)) {
-      ia = i;
-      look_for_active = true;
-    }
-    else if ((hitV_.at(i)->getObjectKind() == Hit::Active) && (look_for_active)) {
-      for (int j = 0; j < n; j++) {
-        correlationsRZ_(ia, j) = correlationsRZ_(i, j);
-        correlationsRZ_(j, ia) = correlationsRZ_(j, i);
-      }
-      correlationsRZ_(ia, ia) = correlationsRZ_(i, i);
-      ia++;
+      correlations(ar, ac) = sum;
+      correlations(ac, ar) = sum;
+      ar++;
     }
-  }
-  // resize matrix if necessary
-  if (ia != -1) correlationsRZ_.ResizeTo(ia, ia);
-  
-  // check if matrix is sane and worth keeping
-  if (!((correlationsRZ_.GetNoElements() > 0) && (correlationsRZ_.Determinant() != 0.0))) {
-    std::cerr << "WARNING: this should be handled properly" << std::endl;
+    ac++;
   }
 }
 
 /**
- * Compute the covariance matrices of the track hits from a series of previously calculated correlation matrices.
- * @param A reference to the map of correlation matrices per energy  that serves as the value source for the computation
+ * Compute the covariance matrix of the track parameters in the r-z plane, D^T * C^-1 * D, from the correlation matrix
+ * with a Cholesky solve.
+ * @param correlations The correlation matrix of the active hits, overwritten by its Cholesky decomposition
+ * @return False if the correlation matrix is singular
  */
-void Track::computeCovarianceMatrixRZ() {
+bool Track::computeCovarianceMatrixRZ(HitMatrix& correlations) {
   unsigned int offset = 0;
   unsigned int nhits = hitV_.size();
-  int n = correlationsRZ_.GetNrows();
-  TMatrixT<double> C(correlationsRZ_); // Local copy to be inverted
-  TMatrixT<double> diffsT(2, n);
-  TMatrixT<double> diffs(n, 2);
-  covariancesRZ_.ResizeTo(2,2);
+  int n = correlations.rows();
+  SmallMatrix<MaxHits, 2> diffs(n, 2);
   
-  // set up partial derivative matrices diffs and diffsT
+  // set up partial derivative matrix diffs
   for (unsigned int i = 0; i < nhits; i++) {
     if (hitV_.at(i)->getObjectKind()  == Hit::Active) {
       // partial derivatives for x = p[0] * y + p[1]
@@ -726,21 +650,36 @@ void Track::computeCovarianceMatrixRZ() {
     }
     else offset++;
     }
-  diffsT.Transpose(diffs);
-  // Invert the C matrix
-  // TODO: check if this matrix can be inverted
-  C.Invert();
-  // compute covariancesRZ_ from diffsT, the correlation matrix and diffs
-  covariancesRZ_ = diffsT * C * diffs;
+  return n > 0 && SmallMatrixOps::weightedProduct(correlations, diffs, covariancesRZ_);
 }
 
 
 /**
  * Calculate the errors of the track curvature radius, the propagation direction at the point of closest approach and the
- * distance of closest approach to the origin, all of them for each momentum of the test particle.
- * @param momentaList A reference of the list of energies that the errors should be calculated for
+ * distance of closest approach to the origin, with the selected backend (see setErrorBackend).
  */
 void Track::computeErrors() {
+  switch (errorBackend_) {
+  case KalmanFilter:
+    computeLocalResolution();
+    computeErrorsKalman();
+    covariances_ = SmallMatrix<3, 3>(); // no stale global fit ones
+    covariancesRZ_ = SmallMatrix<2, 2>();
+    break;
+  case Validation:
+    computeErrorsGlobalFit();
+    validateErrors();
+    break;
+  default:
+    computeErrorsGlobalFit();
+  }
+}
+
+/**
+ * The global fit: the errors come from the full correlation matrix of the active hits.
+ * The matrices live on the stack as long as the track has at most MaxHits active hits.
+ */
+void Track::computeErrorsGlobalFit() {
   deltarho_ = 0 ;
   deltaphi_ = 0 ;
   deltad_ = 0 ;
@@ -752,35 +691,71 @@ void Track::computeErrors() {
   // Compute spatial resolution for all active hits
   computeLocalResolution();
 
+  HitMatrix correlations(nActiveHits(true, true), nActiveHits(true, true));
+
   // Compute the relevant matrices (RZ plane)
-  computeCorrelationMatrixRZ();
-  computeCovarianceMatrixRZ();
-  TMatrixT<double> dataRz(covariancesRZ_); // Local copy to be inverted
-  double err;
-  dataRz = dataRz.Invert();
+  computeCorrelationMatrixRZ(correlations);
+  computeErrorsRZ(correlations);
+  
+  // rPhi plane
+  computeCorrelationMatrix(correlations);
+  computeErrorsRphi(correlations);
+}
 
-  if (dataRz(0, 0) >= 0) err = sqrt(dataRz(0, 0));
+/**
+ * Compute the errors on ctg(theta) and z0 from the r-z correlation matrix of the active hits
+ * @param correlations The correlation matrix, overwritten by its Cholesky decomposition
+ */
+void Track::computeErrorsRZ(HitMatrix& correlations) {
+  double dataRz[2] = { -1, -1 }; // the diagonal of the inverse of covariancesRZ_
+  if (!computeCovarianceMatrixRZ(correlations)) {
+    std::cerr << "WARNING: this should be handled properly" << std::endl;
+  } else SmallMatrixOps::inverseDiagonal(covariancesRZ_, dataRz);
+  setErrorsRZ(dataRz);
+}
+
+/**
+ * Compute the errors on rho, phi, d and p from the r-phi correlation matrix of the active hits
+ * (the error on ctg(theta) must be known already)
+ * @param correlations The correlation matrix, overwritten by its Cholesky decomposition
+ */
+void Track::computeErrorsRphi(HitMatrix& correlations) {
+  // calculate delta rho, delta phi and delta d from the diagonal of the inverse of covariances_
+  double data[3] = { -1, -1, -1 };
+  if (!computeCovarianceMatrix(correlations)) {
+    logERROR(Form("A singular matrix was found (this is unexpected: all analyzed tracks should have >= 3 hits). nElements=%d", correlations.rows()*correlations.cols()));
+  } else SmallMatrixOps::inverseDiagonal(covariances_, data);
+  setErrorsRphi(data);
+}
+
+/**
+ * Sets the errors on ctg(theta) and z0
+ * @param dataRz The variances of ctg(theta) and z0, -1 if unknown
+ */
+void Track::setErrorsRZ(const double* dataRz) {
+  double err;
+  if (dataRz[0] >= 0) err = sqrt(dataRz[0]);
   else err = -1;
   deltaCtgTheta_ = err;
 
-  if (dataRz(1, 1) >= 0) err = sqrt(dataRz(1, 1));
+  if (dataRz[1] >= 0) err = sqrt(dataRz[1]);
   else err = -1;
   deltaZ0_ = err;
-  
-  // rPhi plane
-  computeCorrelationMatrix();
-  computeCovarianceMatrix();
+}
 
-  // calculate delta rho, delta phi and delta d maps from covariances_ matrix
-  TMatrixT<double> data(covariances_);
-  data = data.Invert();
-  if (data(0, 0) >= 0) err = sqrt(data(0, 0));
+/**
+ * Sets the errors on rho, phi, d and p (the error on ctg(theta) must be set already)
+ * @param data The variances of rho, phi and d, -1 if unknown
+ */
+void Track::setErrorsRphi(const double* data) {
+  double err;
+  if (data[0] >= 0) err = sqrt(data[0]);
   else err = -1;
   deltarho_ = err;
-  if (data(1, 1) >= 0) err = sqrt(data(1, 1));
+  if (data[1] >= 0) err = sqrt(data[1]);
   else err = -1;
   deltaphi_ = err;
-  if (data(2, 2)) err = sqrt(data(2, 2));
+  if (data[2] >= 0) err = sqrt(data[2]);
   else err = -1;
   deltad_ = err;
 
@@ -795,15 +770,258 @@ void Track::computeErrors() {
   deltaP_ = ptErr + sin(theta_) * cos(theta_) * deltaCtgTheta_;
 }
 
+/**
+ * Moves an information matrix inwards: with x_out = F * x_in, I_in = F^T * I_out * F.
+ */
+template<int N>
+static void transportInwards(SmallMatrix<N, N>& info, const SmallMatrix<N, N>& f) {
+  SmallMatrix<N, N> product(N, N);
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      double s = 0.;
+      for (int k = 0; k < N; k++) s += info(i, k) * f(k, j);
+      product(i, j) = s;
+    }
+  }
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) {
+      double s = 0.;
+      for (int k = 0; k < N; k++) s += f(k, i) * product(k, j);
+      info(i, j) = s;
+    }
+  }
+}
+
+/**
+ * Adds a random deflection to a slope of the state, in information form (Woodbury identity, valid for singular matrices too).
+ */
+template<int N>
+static void addSlopeNoise(SmallMatrix<N, N>& info, int slope, double variance) {
+  double column[N];
+  for (int i = 0; i < N; i++) column[i] = info(i, slope);
+  double denominator = 1. / variance + info(slope, slope);
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j < N; j++) info(i, j) -= column[i] * column[j] / denominator;
+  }
+}
+
+/**
+ * The Kalman filter: the track state is carried hit by hit from the outermost hit to the beam line, as an information matrix
+ * (the outer end of the track is unconstrained). Each active hit adds its measurement, each hit adds its scattering as a random
+ * change of the slopes, seen by the hits outside it only. At the beam line the state is the one of the global fit, with the same
+ * covariance: the cost is linear in the number of hits. The intermediate covariances are kept in filterStates_.
+ * The r-z scattering is carried along the radius: the lever arms along the track are the radial ones divided by sin(theta).
+ * The local resolutions must have been computed.
+ */
+void Track::computeErrorsKalman() {
+  deltarho_ = 0 ;
+  deltaphi_ = 0 ;
+  deltad_ = 0 ;
+  deltaCtgTheta_ = 0 ;
+  deltaZ0_ = 0 ;
+  deltaP_ = 0 ;
+  filterStates_.clear();
+
+  int n = hitV_.size();
+  double sinTheta = sin(theta_);
+  double curvatureR = pt2radius(transverseMomentum_, insur::magnetic_field);
+  SmallMatrix<3, 3> infoRphi;   // state (rho, drphi/dr, rphi)
+  SmallMatrix<2, 2> infoRZ;     // state (dz/dr, z)
+  auto transport = [&](double length) {
+    SmallMatrix<3, 3> fRphi;
+    fRphi(0, 0) = 1;
+    fRphi(1, 0) = length; fRphi(1, 1) = 1;
+    fRphi(2, 0) = length * length / 2; fRphi(2, 1) = length; fRphi(2, 2) = 1;
+    transportInwards(infoRphi, fRphi);
+    SmallMatrix<2, 2> fRZ;
+    fRZ(0, 0) = 1;
+    fRZ(1, 0) = length; fRZ(1, 1) = 1;
+    transportInwards(infoRZ, fRZ);
+  };
+
+  double previousRadius = n > 0 ? hitV_.back()->getRadius() : 0.;
+  for (int k = n - 1; k >= 0; k--) {
+    Hit* hit = hitV_.at(k);
+    transport(previousRadius - hit->getRadius());
+    previousRadius = hit->getRadius();
+
+    if (hit->getObjectKind() == Hit::Active) {
+      double precRphi = hit->getResolutionRphi(curvatureR);
+      double precZ = hit->getResolutionZ(curvatureR);
+      infoRphi(2, 2) += 1. / (precRphi * precRphi);
+      infoRZ(1, 1) += 1. / (precZ * precZ);
+      FilterState state;
+      state.hit = k;
+      state.radius = hit->getRadius();
+      state.validRphi = SmallMatrixOps::inverse(infoRphi, state.covarianceRphi);
+      state.validRZ = SmallMatrixOps::inverse(infoRZ, state.covarianceRZ);
+      filterStates_.push_back(state);
+    }
+
+    // the scattering on the outermost hit deflects nothing
+    double th = hit->getCorrectedMaterial().radiation;
+    if (k < n - 1 && th > 0) {
+      th = (13.6 * 13.6) / (1000 * 1000 * transverseMomentum_ * transverseMomentum_) * th * (1 + 0.038 * log(th)) * (1 + 0.038 * log(th));
+      addSlopeNoise(infoRphi, 1, th);
+      addSlopeNoise(infoRZ, 0, th / (sinTheta * sinTheta));
+    }
+  }
+  transport(previousRadius);
+
+  double dataRz[2] = { -1, -1 };
+  if (!SmallMatrixOps::inverseDiagonal(infoRZ, dataRz)) {
+    logERROR(Form("A singular r-z information matrix was found (this is unexpected: all analyzed tracks should have >= 2 hits). nActiveHits=%d", nActiveHits(true, true)));
+  }
+  setErrorsRZ(dataRz);
+  double data[3] = { -1, -1, -1 };
+  if (!SmallMatrixOps::inverseDiagonal(infoRphi, data)) {
+    logERROR(Form("A singular matrix was found (this is unexpected: all analyzed tracks should have >= 3 hits). nActiveHits=%d", nActiveHits(true, true)));
+  }
+  setErrorsRphi(data);
+}
+
+/**
+ * Runs the Kalman filter after the global fit and records the errors the two backends disagree on, beyond the validation
+ * tolerance, for reportValidation. The errors of the global fit are kept.
+ */
+void Track::validateErrors() {
+  double globalFit[] = { deltarho_, deltaphi_, deltad_, deltaCtgTheta_, deltaZ0_, deltaP_ };
+  computeErrorsKalman();
+  double kalmanFilter[] = { deltarho_, deltaphi_, deltad_, deltaCtgTheta_, deltaZ0_, deltaP_ };
+  {
+    std::lock_guard<std::mutex> lock(validationMutex_);
+    validation_.tracks++;
+    for (int i = 0; i < 6; i++) {
+      double difference = fabs(kalmanFilter[i] - globalFit[i]);
+      if (difference > validationTolerance_ * fabs(globalFit[i])) {
+        double relative = globalFit[i] != 0 ? difference / fabs(globalFit[i]) : difference;
+        if (validation_.disagreements[i]++ == 0 || relative > validation_.worstDifference[i]) {
+          validation_.worstDifference[i] = relative;
+          validation_.worstEta[i] = eta_;
+          validation_.worstPt[i] = transverseMomentum_;
+        }
+      }
+    }
+  }
+  deltarho_ = globalFit[0];
+  deltaphi_ = globalFit[1];
+  deltad_ = globalFit[2];
+  deltaCtgTheta_ = globalFit[3];
+  deltaZ0_ = globalFit[4];
+  deltaP_ = globalFit[5];
+}
+
+/**
+ * Sets up the momentum independent part of the correlation matrices of a track.
+ * @param track The track, with its hits sorted; the tracks given to computeErrors must be copies of it
+ */
+MomentumSweep::MomentumSweep(const Track& track) : numHits_(track.hitV_.size()), prefixPruning_(true) {
+  std::vector<double> radius, distance, scattering;
+  for (int i = 0; i < numHits_; i++) {
+    Hit* hit = track.hitV_.at(i);
+    radius.push_back(hit->getRadius());
+    distance.push_back(hit->getDistance());
+    double th = hit->getCorrectedMaterial().radiation;
+    // the squared scattering angle at pT = 1 GeV/c: it scales as 1/pT^2
+    if (th>0) th = (13.6 * 13.6) / (1000 * 1000) * th * (1 + 0.038 * log(th)) * (1 + 0.038 * log(th));
+    else th = 0;
+    scattering.push_back(th);
+    if (hit->getObjectKind() == Hit::Active) active_.push_back(i);
+    if (i > 0 && radius[i] < radius[i-1]) prefixPruning_ = false;
+  }
+
+  // scattering_(a, b) = sum over the hits i before hit a of (r_b - r_i) * (r_a - r_i) * theta_i^2, a and b active and a <= b
+  int n = active_.size();
+  scatteringRphi_.assign(n*n, 0.);
+  scatteringRZ_.assign(n*n, 0.);
+  for (int b = 0; b < n; b++) {
+    int c = active_[b];
+    for (int a = 0; a <= b; a++) {
+      int r = active_[a];
+      double sumRphi = 0.0, sumRZ = 0.0;
+      for (int i = 0; i < r; i++) {
+        sumRphi += (radius[c] - radius[i]) * (radius[r] - radius[i]) * scattering[i];
+        sumRZ += (distance[c] - distance[i]) * (distance[r] - distance[i]) * scattering[i];
+      }
+      scatteringRphi_[a*n + b] = scatteringRphi_[b*n + a] = sumRphi;
+      scatteringRZ_[a*n + b] = scatteringRZ_[b*n + a] = sumRZ;
+    }
+  }
+}
+
+/**
+ * Reports the disagreements between the resolution backends found since the last report, one line per track parameter,
+ * and starts over.
+ */
+void Track::reportValidation() {
+  static const char* names[] = { "rho", "phi", "d", "ctgTheta", "z0", "p" };
+  std::lock_guard<std::mutex> lock(validationMutex_);
+  if (validation_.tracks == 0) return;
+  bool agree = true;
+  for (int i = 0; i < 6; i++) {
+    if (validation_.disagreements[i] == 0) continue;
+    agree = false;
+    logWARNING(Form("Resolution backends disagree on delta %s for %ld of %ld tracks, by up to %g relative (at eta = %f, pT = %f)",
+                    names[i], validation_.disagreements[i], validation_.tracks, validation_.worstDifference[i], validation_.worstEta[i], validation_.worstPt[i]));
+  }
+  if (agree) logINFO(Form("Resolution backends agree on all the %ld tracks validated", validation_.tracks));
+  validation_ = ValidationSummary();
+}
+
+/**
+ * Computes the errors of a pruned copy of the track: as Track::computeErrors would, but only adding the hit resolutions
+ * to the precomputed scattering terms. As the hits are sorted by distance, Track::pruneHits keeps the first hits of the track,
+ * whose correlations are the leading block of the full matrices.
+ * @param prunedTrack The copy of the track, with its transverse momentum set and its hits pruned
+ * @param withMaterial False if the material of the copy was removed
+ */
+void MomentumSweep::computeErrors(Track& prunedTrack, bool withMaterial) const {
+  int numKept = prunedTrack.hitV_.size();
+  if (!prefixPruning_ || numKept > numHits_ || Track::errorBackend() == Track::KalmanFilter) {
+    prunedTrack.computeErrors();
+    return;
+  }
+  prunedTrack.deltarho_ = 0;
+  prunedTrack.deltaphi_ = 0;
+  prunedTrack.deltad_ = 0;
+  prunedTrack.deltaCtgTheta_ = 0;
+  prunedTrack.deltaZ0_ = 0;
+  prunedTrack.deltaP_ = 0;
+  prunedTrack.computeLocalResolution();
+
+  int n = active_.size();
+  int nKept = std::lower_bound(active_.begin(), active_.end(), numKept) - active_.begin();
+  double pT = prunedTrack.getTransverseMomentum();
+  double scale = withMaterial ? 1. / (pT * pT) : 0.;
+  double curvatureR = pt2radius(pT, insur::magnetic_field);
+  Track::HitMatrix correlations(nKept, nKept);
+
+  for (int b = 0; b < nKept; b++) {
+    for (int a = 0; a < nKept; a++) correlations(a, b) = scatteringRZ_[a*n + b] * scale;
+    double prec = prunedTrack.hitV_.at(active_[b])->getResolutionZ(curvatureR);
+    correlations(b, b) += prec * prec;
+  }
+  prunedTrack.computeErrorsRZ(correlations);
+
+  for (int b = 0; b < nKept; b++) {
+    for (int a = 0; a < nKept; a++) correlations(a, b) = scatteringRphi_[a*n + b] * scale;
+    double prec = prunedTrack.hitV_.at(active_[b])->getResolutionRphi(curvatureR);
+    correlations(b, b) += prec * prec;
+  }
+  prunedTrack.computeErrorsRphi(correlations);
+  if (Track::errorBackend() == Track::Validation) prunedTrack.validateErrors();
+}
+
 /**
  * Print the values in the correlation and covariance matrices and the drho, dphi and dd vectors per momentum.
  */
 void Track::printErrors() {
     std::cout << "Overview of track errors:" << std::endl;
-    std::cout << "Hit correlation matrix: " << std::endl;
-    correlations_.Print();
     std::cout << "Covariance matrix: " << std::endl;
-    covariances_.Print();
+    for (int r = 0; r < covariances_.rows(); r++) {
+      for (int c = 0; c < covariances_.cols(); c++) std::cout << "\t" << covariances_(r, c);
+      std::cout << std::endl;
+    }
     std::cout << "Rho errors by momentum: " << deltarho_ << std::endl;
     std::cout << "Phi errors by momentum: " << deltaphi_ << std::endl;
     std::cout << "D errors by momentum: " << deltad_ << std::endl;
@@ -849,6 +1067,23 @@ void Track::addEfficiency(double efficiency, bool pixel /* = false */ ) {
   }
 }
 
+/**
+ * Changes some active hits into inactive
+ * according to the efficiency, drawing from the random stream of the track
+ * @param efficiency the modules active fraction
+ * @param alsoPixel true if the efficiency removal applies to the pixel hits also
+ * @param dice the random stream of the track
+ */
+void Track::addEfficiency(double efficiency, bool pixel, CounterRandom::Stream& dice) {
+  for (std::vector<Hit*>::iterator it = hitV_.begin(); it!=hitV_.end(); ++it) {
+    if ((*it)->getObjectKind() == Hit::Active && (*it)->isPixel() == pixel) {
+      if (dice.Rndm() > efficiency) { // This hit is LOST
+        (*it)->setObjectKind(Hit::Inactive);
+      }
+    }
+  }
+}
+
 /**
  * Makes all non-trigger hits inactive
  */
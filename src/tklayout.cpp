@@ -12,11 +12,16 @@ int main(int argc, char* argv[]) {
   usage += argv[0];
   usage += " <geometry file> [options]";
   int geomtracks, mattracks;
+  int materialMapSteps;
+  int threads;
+  double weightMapBin;
+  long pileUpCrossings;
+  std::string resolutionBackend;
   //std::vector<int> tracksim;
   int verbosity;
   int randseed; 
 
-  std::string basename, optfile, xmldir, htmldir;
+  std::string basename, optfile, xmldir, htmldir, materialMapFile, weightMapFile, pileUpSpectra;
   
   po::options_description shown("Analysis options");
   shown.add_options()
@@ -24,12 +29,23 @@ int main(int argc, char* argv[]) {
     ("opt-file", po::value<std::string>(&optfile)->implicit_value(""), "Specify an option file to parse program options from, in addition to the command line")
     ("geometry-tracks,n", po::value<int>(&geomtracks)->default_value(100), "N. of tracks for geometry calculations.")
     ("material-tracks,N", po::value<int>(&mattracks)->default_value(100), "N. of tracks for material calculations.")
+    ("threads,j", po::value<int>(&threads)->default_value(1), "N. of threads for geometry calculations,\nmaterials, trigger efficiency, pile-up\nand track simulation. The results do not\ndepend on it.")
+    ("phi-symmetry", "Shoot the geometry tracks in one phi wedge\nof the tracker symmetry only, and unfold\nthe coverage to the full phi range.")
+    ("analytic-coverage", "Compute the module coverage plots from the\nmodule outlines projected in (eta, phi)\ninstead of the geometry tracks.")
     ("power,p", "Report irradiated power analysis.")
     ("bandwidth,b", "Report base bandwidth analysis.")
     ("bandwidth-cpu,B", "Report multi-cpu bandwidth analysis.\n\t(implies 'b')")
+    ("pileup", po::value<std::string>(&pileUpSpectra)->implicit_value(""), "Report the occupancy, cluster width and\nbandwidth measured with a simulation of\nthe minimum bias pile-up.\nOptional arg specifies the file of the\neta and pt spectra of the interactions.\nIf not supplied, config/minbias_spectra.txt\nwill be used.")
+    ("pileup-crossings", po::value<long>(&pileUpCrossings)->default_value(1000), "N. of bunch crossings of the pile-up\nsimulation.")
     ("material,m", "Report materials and weights analyses.")
+    ("material-map", po::value<std::string>(&materialMapFile), "Write the material budget binned in (r, z)\nto the given file, and the material of a\nfine eta scan integrated through it to the\nsame file name with the suffix .eta")
+    ("material-map-steps", po::value<int>(&materialMapSteps)->default_value(100000), "N. of tracks of the material map eta scan.")
+    ("weight-map", po::value<std::string>(&weightMapFile), "Write the grams of the modules, services\nand supports binned in (z, r) to the given\nfile (the pixel ones to the same file name\nwith the suffix .pixel)")
+    ("weight-map-bin", po::value<double>(&weightMapBin)->default_value(1.), "Bin size of the weight map, in mm.")
+    ("material-watch", "Keep running once done, and write the\nmaterial map again each time the material\ntab changes, recomputing only the elements\nmade of the changed materials.\n(requires 'material-map')")
     ("resolution,r", "Report resolution analysis.")
     ("debug-resolution,R", "Report extended resolution analysis : debug plots for modules parametrized spatial resolution.")
+    ("resolution-backend", po::value<std::string>(&resolutionBackend)->default_value("global"), "Track resolution estimator: 'global' (fit\nwith the full hit correlation matrix),\n'kalman' (hit by hit information filter)\nor 'validate' (both, reporting any\ndisagreement).")
     ("trigger,t", "Report base trigger analysis.")
     ("trigger-ext,T", "Report extended trigger analysis.\n\t(implies 't')")
     ("debug-services,d", "Service additional debug info")
@@ -91,6 +107,12 @@ int main(int argc, char* argv[]) {
 
     if (geomtracks < 1) throw po::invalid_option_value("geometry-tracks");
     if (mattracks < 1) throw po::invalid_option_value("material-tracks");
+    if (threads < 1) throw po::invalid_option_value("threads");
+    if (pileUpCrossings < 1) throw po::invalid_option_value("pileup-crossings");
+    if (materialMapSteps < 1) throw po::invalid_option_value("material-map-steps");
+    if (weightMapBin <= 0) throw po::invalid_option_value("weight-map-bin");
+    if (vm.count("material-watch") && !vm.count("material-map")) throw po::error("Option 'material-watch' requires 'material-map'");
+    if (resolutionBackend != "global" && resolutionBackend != "kalman" && resolutionBackend != "validate") throw po::invalid_option_value("resolution-backend");
     if (!vm.count("base-name") && !vm.count("help") && !vm.count("version")) throw po::error("Missing geometry file"); 
 
   } catch(po::error e) {
@@ -109,6 +131,9 @@ int main(int argc, char* argv[]) {
     return 0;
   }
 
+  if (resolutionBackend == "kalman") Track::setErrorBackend(Track::KalmanFilter);
+  else if (resolutionBackend == "validate") Track::setErrorBackend(Track::Validation);
+
   insur::Squid squid;
   squid.setCommandLine(argc, argv);
   bool verboseMaterial = false;
@@ -132,28 +157,31 @@ int main(int argc, char* argv[]) {
   if (!vm.count("tracksim")) {
     // The tracker should pick the types here but in case it does not,
     // we can still write something
-    if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
+    if (!squid.pureAnalyzeGeometry(geomtracks, threads, vm.count("phi-symmetry"), vm.count("analytic-coverage"))) return EXIT_FAILURE;
 
 
     if ((vm.count("all") || vm.count("bandwidth") || vm.count("bandwidth-cpu")) && !squid.reportBandwidthSite()) return EXIT_FAILURE;
     if ((vm.count("all") || vm.count("bandwidth-cpu")) && (!squid.reportTriggerProcessorsSite()) ) return EXIT_FAILURE;
+    if (vm.count("pileup") && !squid.reportPileUpSite(pileUpSpectra, pileUpCrossings, threads)) return EXIT_FAILURE;
     if ((vm.count("all") || vm.count("power")) && (!squid.reportPowerSite()) ) return EXIT_FAILURE;
 
     // If we need to have the material model, then we build it
-    if ( vm.count("all") || vm.count("material") || vm.count("resolution") || vm.count("debug-resolution") || vm.count("graph") || vm.count("xml") ) {
-      if (squid.buildMaterials(verboseMaterial) && squid.createMaterialBudget(verboseMaterial)) {
+    if ( vm.count("all") || vm.count("material") || vm.count("resolution") || vm.count("debug-resolution") || vm.count("graph") || vm.count("xml") || vm.count("material-map") || vm.count("weight-map") ) {
+      if (squid.buildMaterials(verboseMaterial, threads, vm.count("weight-map") ? weightMapBin : 0.) && squid.createMaterialBudget(verboseMaterial)) {
         if ( vm.count("all") || vm.count("material") || vm.count("resolution") || vm.count("debug-resolution")) {
           if (!squid.pureAnalyzeMaterialBudget(mattracks, (vm.count("all") || vm.count("resolution") ||  vm.count("debug-resolution")), vm.count("debug-resolution"))) return EXIT_FAILURE;
           if ((vm.count("all") || vm.count("material"))  && !squid.reportMaterialBudgetSite(vm.count("debug-services"))) return EXIT_FAILURE;
           if ((vm.count("all") || vm.count("resolution") || vm.count("debug-resolution"))  && !squid.reportResolutionSite()) return EXIT_FAILURE;	  
         }
+        if (vm.count("material-map") && !squid.exportMaterialMap(materialMapFile, materialMapSteps)) return EXIT_FAILURE;
+        if (vm.count("weight-map") && !squid.exportWeightMap(weightMapFile)) return EXIT_FAILURE;
         if (vm.count("graph") && !squid.reportNeighbourGraphSite()) return EXIT_FAILURE;
         if (vm.count("xml") && !squid.translateFullSystemToXML(xmldir)) return (EXIT_FAILURE);
       }
     }
 
     if ((vm.count("all") || vm.count("trigger") || vm.count("trigger-ext")) &&
-        ( !squid.analyzeTriggerEfficiency(mattracks, vm.count("trigger-ext")) || !squid.reportTriggerPerformanceSite(vm.count("trigger-ext"))) ) return EXIT_FAILURE;
+        ( !squid.analyzeTriggerEfficiency(mattracks, vm.count("trigger-ext"), threads) || !squid.reportTriggerPerformanceSite(vm.count("trigger-ext"))) ) return EXIT_FAILURE;
    
     if (vm.count("pixelxml")) {
         squid.pixelExtraction(xmldir);
@@ -164,6 +192,7 @@ int main(int argc, char* argv[]) {
     if (!squid.reportGeometrySite(vm.count("debug-resolution"))) return EXIT_FAILURE;
     if (!squid.additionalInfoSite()) return EXIT_FAILURE;
     if (!squid.makeSite()) return EXIT_FAILURE;
+    if (vm.count("material-watch") && !squid.watchMaterials(materialMapFile, materialMapSteps)) return EXIT_FAILURE;
 
   } else {
     //if (tracksim.size() < 1 || tracksim.size > 2) {
@@ -172,13 +201,13 @@ int main(int argc, char* argv[]) {
     //  std::cerr << "                                    --tracksim \"key1 = value1; key2 = value2 ...\"" << std::endl;
     //  return EXIT_FAILURE;
    // }
-    if (!squid.pureAnalyzeGeometry(geomtracks)) return EXIT_FAILURE;
+    if (!squid.pureAnalyzeGeometry(geomtracks, threads, vm.count("phi-symmetry"), vm.count("analytic-coverage"))) return EXIT_FAILURE;
   
 //    if (tracksim.size() == 2) {
 //      vmtracks.insert(std::make_pair("num-events", po::variable_value(boost::any(tracksim[0]), false)));
 //      vmtracks.insert(std::make_pair("num-tracks", po::variable_value(boost::any(tracksim[1]), false)));
 //    }
-    squid.simulateTracks(vm, randseed);
+    squid.simulateTracks(vm, randseed, threads);
 
     //if (tracksim.size() == 2) { squid.simulateTracks(str2any<long int>(tracksim[0]), str2any<long int>(tracksim[1]), randseed, "", ""); }
     //else if (tracksim.size() == 1 && tracksim[0].at(0)=="\"") { squid.simulateTracks(0, 0, randseed, "", trim(tracksim[0], " \"")); }